@@ -81,31 +81,19 @@ static void help(void) {
 }
 
 void print_entry_table_locate_name_by_ordinal(const struct exe_ne_header_name_entry_table * const nonresnames,const struct exe_ne_header_name_entry_table *resnames,const unsigned int ordinal) {
+    const struct exe_ne_header_name_entry *ent;
     char tmp[255+1];
-    unsigned int i;
-
-    if (resnames->table != NULL) {
-        for (i=0;i < resnames->length;i++) {
-            struct exe_ne_header_name_entry *ent = resnames->table + i;
 
-            if (ne_name_entry_get_ordinal(resnames,ent) == ordinal) {
-                ne_name_entry_get_name(tmp,sizeof(tmp),resnames,ent);
-                printf(" RESIDENT NAME '%s' ",tmp);
-                return;
-            }
-        }
+    if ((ent=ne_name_entry_find_by_ordinal(resnames,ordinal)) != NULL) {
+        ne_name_entry_get_name(tmp,sizeof(tmp),resnames,ent);
+        printf(" RESIDENT NAME '%s' ",tmp);
+        return;
     }
 
-    if (nonresnames->table != NULL) {
-        for (i=0;i < nonresnames->length;i++) {
-            struct exe_ne_header_name_entry *ent = nonresnames->table + i;
-
-            if (ne_name_entry_get_ordinal(nonresnames,ent) == ordinal) {
-                ne_name_entry_get_name(tmp,sizeof(tmp),nonresnames,ent);
-                printf(" NONRESIDENT NAME '%s' ",tmp);
-                return;
-            }
-        }
+    if ((ent=ne_name_entry_find_by_ordinal(nonresnames,ordinal)) != NULL) {
+        ne_name_entry_get_name(tmp,sizeof(tmp),nonresnames,ent);
+        printf(" NONRESIDENT NAME '%s' ",tmp);
+        return;
     }
 }
 
@@ -0,0 +1,403 @@
+
+#include <assert.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <fcntl.h>
+
+#include <hw/dos/exehdr.h>
+
+/* re-use a little code from the NE parser. */
+#include <hw/dos/exenehdr.h>
+#include <hw/dos/exenepar.h>
+#include <hw/dos/exelehdr.h>
+#include <hw/dos/exelepar.h>
+
+void le_image_init(struct le_image * const img) {
+    memset(img,0,sizeof(*img));
+}
+
+void le_image_free(struct le_image * const img) {
+    unsigned int i;
+
+    if (img->object) {
+        for (i=0;i < img->objects;i++) {
+            if (img->object[i].data) free(img->object[i].data);
+        }
+        free(img->object);
+    }
+
+    le_image_init(img);
+}
+
+/* read len bytes at file offset ofs. *pos tracks the file pointer so that pages
+ * stored back to back in the file do not need an lseek between them. */
+static size_t le_image_read_at(const int fd,unsigned long * const pos,const unsigned long ofs,unsigned char *buf,size_t len) {
+    size_t got = 0;
+
+    if (*pos != ofs) {
+        if ((unsigned long)lseek(fd,(off_t)ofs,SEEK_SET) != ofs) {
+            *pos = ~0UL;
+            return 0;
+        }
+        *pos = ofs;
+    }
+
+    while (len > 0) {
+        unsigned int want = (len > (size_t)0x8000u) ? 0x8000u : (unsigned int)len;
+        int rd = read(fd,buf,want);
+        if (rd <= 0) break;
+
+        *pos += (unsigned long)rd;
+        got += (size_t)rd;
+        buf += rd;
+        len -= (size_t)rd;
+    }
+
+    return got;
+}
+
+/* expand LX EXEPACK 1 (iterated) page data:
+ *
+ * uint16_t         number of iterations
+ * uint16_t         data length
+ * uint8_t[len]     data, repeated (iterations) times */
+static int le_image_expand_iterated(unsigned char *dst,const size_t dstlen,const unsigned char *src,const size_t srclen) {
+    const unsigned char *sfence = src + srclen;
+    size_t d = 0;
+
+    while ((src+4) <= sfence) {
+        uint16_t count = *((uint16_t*)(src+0));
+        uint16_t len = *((uint16_t*)(src+2));
+        src += 4;
+
+        if (count == 0) break;
+        if ((src+len) > sfence) return -1;
+
+        while (count-- != 0) {
+            if ((d+len) > dstlen) return -1;
+            memcpy(dst+d,src,len);
+            d += len;
+        }
+
+        src += len;
+    }
+
+    return 0;
+}
+
+static void le_image_patch(struct le_image * const img,const struct le_image_object * const o,const uint32_t pageobjoff,const int16_t srcoff,const unsigned char src,const uint32_t trgoff,const uint32_t trglinoff) {
+    uint32_t soffset;
+    unsigned int width;
+
+    /* NTS: srcoff is signed, a fixup that spans pages is listed again in the next page with a negative offset */
+    if (srcoff < 0 && (uint32_t)(-((int32_t)srcoff)) > pageobjoff) {
+        img->fixups_skipped++;
+        return;
+    }
+    soffset = (uint32_t)((int32_t)pageobjoff + (int32_t)srcoff);
+
+    switch (src&0xF) {
+        case 0x0: width = 1; break;     /* byte */
+        case 0x3: width = 2; break;     /* 16:16 pointer, offset part only */
+        case 0x5: width = 2; break;     /* 16-bit offset */
+        case 0x6: width = 4; break;     /* 16:32 pointer, offset part only */
+        case 0x7: width = 4; break;     /* 32-bit offset */
+        case 0x8: width = 4; break;     /* 32-bit self-relative */
+        default:                        /* 16-bit selector: nothing to resolve it to */
+            img->fixups_skipped++;
+            return;
+    }
+
+    if ((soffset+(uint32_t)width) > o->size || soffset > o->size) {
+        img->fixups_skipped++;
+        return;
+    }
+
+    switch (src&0xF) {
+        case 0x0:
+            o->data[soffset] = (unsigned char)trgoff;
+            break;
+        case 0x3:
+        case 0x5:
+            *((uint16_t*)(o->data+soffset)) = (uint16_t)trgoff;
+            break;
+        case 0x6:
+        case 0x7:
+            *((uint32_t*)(o->data+soffset)) = trglinoff;
+            break;
+        case 0x8:
+            *((uint32_t*)(o->data+soffset)) = trglinoff - (o->linear + soffset + 4UL);
+            break;
+    }
+
+    img->fixups_applied++;
+}
+
+/* apply every internal fixup listed for one page of an object */
+static void le_image_fixup_page(struct le_image * const img,const struct le_image_object * const o,const uint32_t pageobjoff,struct le_header_fixup_record_table * const frtable,const struct le_header_parseinfo * const p) {
+    unsigned int srcoff_count,srcoff_i;
+    unsigned char flags,src;
+    unsigned char *raw;
+    int16_t srcoff = 0;
+    unsigned int ti;
+
+    for (ti=0;ti < (unsigned int)frtable->length;ti++) {
+        uint32_t trglinoff;
+        uint16_t tobject;
+        uint32_t trgoff;
+
+        raw = le_header_fixup_record_table_get_raw_entry(frtable,ti);
+        if (raw == NULL) continue;
+
+        // the parser ensures the record is long enough
+        src = *raw++;
+        flags = *raw++;
+
+        if ((src & 0xC0) || (flags&3) != 0) { // only internal references are parsed
+            img->fixups_skipped++;
+            continue;
+        }
+
+        if (src & 0x20) {
+            srcoff_count = *raw++; //number of source offsets. object follows, then array of srcoff
+        }
+        else {
+            srcoff_count = 1;
+            srcoff = *((int16_t*)raw); raw += 2;
+        }
+
+        if (flags&0x40) {
+            tobject = *((uint16_t*)raw); raw += 2;
+        }
+        else {
+            tobject = *raw++;
+        }
+
+        if ((src&0xF) != 0x2) { /* not 16-bit selector fixup */
+            if (flags&0x10) { // 32-bit target offset
+                trgoff = *((uint32_t*)raw); raw += 4;
+            }
+            else { // 16-bit target offset
+                trgoff = *((uint16_t*)raw); raw += 2;
+            }
+        }
+        else {
+            trgoff = 0;
+        }
+
+        if (tobject != 0 && tobject <= p->le_header.object_table_entries)
+            trglinoff = p->le_object_table_loaded_linear[tobject - 1] + trgoff;
+        else
+            trglinoff = 0;
+
+        if (src & 0x20) {
+            for (srcoff_i=0;srcoff_i < srcoff_count;srcoff_i++) {
+                srcoff = *((int16_t*)raw); raw += 2;
+                le_image_patch(img,o,pageobjoff,srcoff,src,trgoff,trglinoff);
+            }
+        }
+        else {
+            le_image_patch(img,o,pageobjoff,srcoff,src,trgoff,trglinoff);
+        }
+    }
+}
+
+/* Load every object of the LE/LX image into memory, as it would be laid out when loaded at linear
+ * address "base", then apply all internal fixups in one pass over the parsed fixup record tables.
+ *
+ * The caller must have read the object table, the object page map, and (for fixups) the fixup
+ * record tables into the parser, the same as exeledmp does. Pages are read in object/page order,
+ * and pages that follow each other in the file are read with one read() call.
+ *
+ * LX page types (iterated, zero filled, invalid) are honored. LE page map entries are always
+ * treated as physical pages. Space past the end of the page data (uninitialized data) is zero.
+ *
+ * If img->no_fixups is set, fixups are not applied and the pages are left as stored in the file.
+ *
+ * Returns 0 on success, -1 on error. */
+int le_image_load(struct le_image * const img,const int fd,struct le_header_parseinfo * const p,const uint32_t base) {
+    const int is_lx = (p->le_header.signature == EXE_LX_SIGNATURE);
+    const uint32_t psz = p->le_header.memory_page_size;
+    unsigned char *tmp = NULL;
+    const unsigned char no_fixups = img->no_fixups;
+    unsigned long pos = ~0UL;
+    unsigned int i;
+
+    le_image_free(img);
+    img->no_fixups = no_fixups;
+
+    if (p->le_object_table == NULL || p->le_header.object_table_entries == 0 || psz == 0)
+        return -1;
+#if TARGET_MSDOS == 16
+    if (psz > 0x8000UL)
+        return -1;
+#endif
+
+    if (p->le_object_table_loaded_linear == NULL || p->load_base != base) {
+        p->load_base = base;
+        le_header_object_table_loaded_linear_generate(p);
+        if (p->le_object_table_loaded_linear == NULL)
+            return -1;
+    }
+
+    img->object = (struct le_image_object*)calloc(p->le_header.object_table_entries,sizeof(*(img->object)));
+    if (img->object == NULL)
+        return -1;
+    img->objects = p->le_header.object_table_entries;
+
+    for (i=0;i < img->objects;i++) {
+        const struct exe_le_header_object_table_entry *objent = p->le_object_table + i;
+        struct le_image_object *o = img->object + i;
+        uint32_t pg,sz;
+
+        o->linear = p->le_object_table_loaded_linear[i];
+
+        sz = (uint32_t)objent->page_map_entries * psz;
+        if (sz < objent->virtual_segment_size)
+            sz = ((objent->virtual_segment_size + psz - 1UL) / psz) * psz;
+        if (sz == 0)
+            continue;
+#if TARGET_MSDOS == 16
+        if (sz > 0xFFF0UL)
+            continue; /* too large for a 16-bit build, leave it unloaded */
+#endif
+
+        o->data = (unsigned char*)calloc((size_t)sz,1);
+        if (o->data == NULL) {
+            le_image_free(img);
+            return -1;
+        }
+        o->size = sz;
+
+        if (p->le_object_page_map_table == NULL || objent->page_map_index == 0)
+            continue;
+
+        pg = 0;
+        while (pg < objent->page_map_entries) {
+            const uint32_t page = (uint32_t)objent->page_map_index + pg; /* 1-based */
+            const struct exe_le_header_parseinfo_object_page_table_entry *ent;
+            unsigned char *dst;
+            uint32_t len;
+
+            if (page > p->le_header.number_of_memory_pages || ((pg+1UL)*psz) > sz)
+                break;
+
+            ent = p->le_object_page_map_table + page - 1;
+            dst = o->data + (size_t)(pg * psz);
+            len = ent->data_size;
+            if (len > psz) len = psz;
+
+            switch (is_lx ? ent->flags : LX_PAGE_FLAGS_LEGAL_PHYSICAL) {
+                case LX_PAGE_FLAGS_LEGAL_PHYSICAL: {
+                    uint32_t run = 1,total = len,last = len;
+
+                    /* extend the read over following pages that are stored right after this one */
+                    while (last == psz && (pg+run) < objent->page_map_entries && (page+run) <= p->le_header.number_of_memory_pages &&
+                        ((pg+run+1UL)*psz) <= sz) {
+                        const struct exe_le_header_parseinfo_object_page_table_entry *n = ent + run;
+
+                        if (is_lx && n->flags != LX_PAGE_FLAGS_LEGAL_PHYSICAL) break;
+                        if (n->page_data_offset != (ent->page_data_offset + total)) break;
+#if TARGET_MSDOS == 16
+                        if ((total + psz) > 0x8000UL) break;
+#endif
+
+                        last = n->data_size;
+                        if (last > psz) last = psz;
+                        total += last;
+                        run++;
+                    }
+
+                    if (total != 0)
+                        le_image_read_at(fd,&pos,ent->page_data_offset,dst,(size_t)total);
+
+                    pg += run;
+                    } break;
+                case LX_PAGE_FLAGS_ITERATED:
+                    if (tmp == NULL) {
+                        tmp = (unsigned char*)malloc((size_t)psz);
+                        if (tmp == NULL) {
+                            le_image_free(img);
+                            return -1;
+                        }
+                    }
+
+                    if (len != 0) {
+                        size_t got = le_image_read_at(fd,&pos,ent->page_data_offset,tmp,(size_t)len);
+
+                        if (le_image_expand_iterated(dst,(size_t)psz,tmp,got) < 0)
+                            img->pages_unsupported++;
+                    }
+
+                    pg++;
+                    break;
+                case LX_PAGE_FLAGS_INVALID:
+                case LX_PAGE_FLAGS_ZERO_FILLED:
+                    pg++; /* already zero */
+                    break;
+                default:
+                    img->pages_unsupported++;
+                    pg++;
+                    break;
+            }
+        }
+    }
+
+    if (tmp) free(tmp);
+
+    /* now apply fixups, in one pass over the pages of each object */
+    if (!img->no_fixups && p->le_fixup_records.table != NULL && p->le_fixup_records.length != 0) {
+        for (i=0;i < img->objects;i++) {
+            const struct exe_le_header_object_table_entry *objent = p->le_object_table + i;
+            const struct le_image_object *o = img->object + i;
+            uint32_t pg;
+
+            if (o->data == NULL || objent->page_map_index == 0)
+                continue;
+
+            for (pg=0;pg < objent->page_map_entries;pg++) {
+                const uint32_t page = (uint32_t)objent->page_map_index + pg; /* 1-based */
+
+                if (page > p->le_fixup_records.length)
+                    break;
+
+                le_image_fixup_page(img,o,pg * psz,p->le_fixup_records.table + page - 1,p);
+            }
+        }
+    }
+
+    return 0;
+}
+
+/* pointer to len bytes at object:offset of the loaded image, or NULL if not loaded */
+unsigned char *le_image_object_ptr(const struct le_image * const img,const uint16_t object,const uint32_t offset,const uint32_t len) {
+    const struct le_image_object *o;
+
+    if (object == 0 || object > img->objects)
+        return NULL;
+
+    o = img->object + object - 1;
+    if (o->data == NULL || offset > o->size || len > (o->size - offset))
+        return NULL;
+
+    return o->data + (size_t)offset;
+}
+
+/* pointer to len bytes at a linear address of the loaded image, or NULL if not loaded */
+unsigned char *le_image_linear_ptr(const struct le_image * const img,const uint32_t linear,const uint32_t len) {
+    unsigned int i;
+
+    for (i=0;i < img->objects;i++) {
+        const struct le_image_object *o = img->object + i;
+
+        if (o->data != NULL && linear >= o->linear && (linear - o->linear) < o->size)
+            return le_image_object_ptr(img,(uint16_t)(i + 1u),linear - o->linear,len);
+    }
+
+    return NULL;
+}
+
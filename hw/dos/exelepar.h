@@ -43,6 +43,31 @@ struct le_header_parseinfo {
     uint32_t                                                load_base;
 };
 
+/* LX object page table flags (page type). LE page map entries do not carry them in this parser. */
+#define LX_PAGE_FLAGS_LEGAL_PHYSICAL                0x0000
+#define LX_PAGE_FLAGS_ITERATED                      0x0001  /* EXEPACK 1 iterated data */
+#define LX_PAGE_FLAGS_INVALID                       0x0002
+#define LX_PAGE_FLAGS_ZERO_FILLED                   0x0003
+#define LX_PAGE_FLAGS_RANGE                         0x0004
+#define LX_PAGE_FLAGS_COMPRESSED                    0x0005  /* EXEPACK 2 */
+
+/* one object of an LE/LX image, loaded into memory */
+struct le_image_object {
+    unsigned char*                                          data;           /* NULL if not loaded */
+    uint32_t                                                size;           /* bytes allocated, at least virtual size, whole pages */
+    uint32_t                                                linear;         /* loaded linear address */
+};
+
+/* in-memory copy of an LE/LX image with internal fixups applied */
+struct le_image {
+    struct le_image_object*                                 object;         /* [object_table_entries] entries */
+    unsigned int                                            objects;
+    unsigned long                                           fixups_applied;
+    unsigned long                                           fixups_skipped; /* selector fixups, out of range, etc. */
+    unsigned long                                           pages_unsupported; /* page types we cannot decode (zero filled) */
+    unsigned char                                           no_fixups;      /* set before le_image_load() to leave the pages as stored in the file */
+};
+
 struct le_vmap_trackio {
     uint32_t                file_ofs;       // file offset of page
     uint32_t                page_number;    // page number we are on
@@ -116,3 +141,9 @@ uint32_t *le_header_object_table_loaded_linear_alloc(struct le_header_parseinfo
 
 uint32_t le_header_parseinfo_guess_le_header_size(struct le_header_parseinfo * const p);
 
+void le_image_init(struct le_image * const img);
+void le_image_free(struct le_image * const img);
+int le_image_load(struct le_image * const img,const int fd,struct le_header_parseinfo * const p,const uint32_t base);
+unsigned char *le_image_object_ptr(const struct le_image * const img,const uint16_t object,const uint32_t offset,const uint32_t len);
+unsigned char *le_image_linear_ptr(const struct le_image * const img,const uint32_t linear,const uint32_t len);
+
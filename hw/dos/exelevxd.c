@@ -28,29 +28,18 @@ int le_parser_is_windows_vxd(struct le_header_parseinfo * const p,uint16_t * con
         unsigned int i;
 
         tmp[0] = 0;
-        if (tmp[0] == 0 && p->le_resident_names.table != NULL) {
-            for (i=0;i < p->le_resident_names.length;i++) {
-                struct exe_ne_header_name_entry *ent = p->le_resident_names.table + i;
+        {
+            const struct exe_ne_header_name_entry *ne;
 
-                if (ne_name_entry_get_ordinal(&p->le_resident_names,ent) == 1) {
-                    ne_name_entry_get_name(tmp,sizeof(tmp),&p->le_resident_names,ent);
-                    break;
-                }
-            }
-        }
-
-        if (tmp[0] == 0 && p->le_nonresident_names.table != NULL) {
-            for (i=0;i < p->le_nonresident_names.length;i++) {
-                struct exe_ne_header_name_entry *ent = p->le_nonresident_names.table + i;
-
-                if (ne_name_entry_get_ordinal(&p->le_nonresident_names,ent) == 1) {
-                    ne_name_entry_get_name(tmp,sizeof(tmp),&p->le_nonresident_names,ent);
-                    break;
-                }
-            }
+            if ((ne=ne_name_entry_find_by_ordinal(&p->le_resident_names,1)) != NULL)
+                ne_name_entry_get_name(tmp,sizeof(tmp),&p->le_resident_names,ne);
+            else if ((ne=ne_name_entry_find_by_ordinal(&p->le_nonresident_names,1)) != NULL)
+                ne_name_entry_get_name(tmp,sizeof(tmp),&p->le_nonresident_names,ne);
         }
 
-        /* HACK: Microsoft DINPUT.VXD put the DDB export in entry #1 but nonresident name ordinal == 0 */
+        /* HACK: Microsoft DINPUT.VXD put the DDB export in entry #1 but nonresident name ordinal == 0.
+         *       There can be more than one ordinal 0 name (the module description is one), and the index
+         *       only returns the first, so look through them all for the one ending in _DDB. */
         if (tmp[0] == 0 && p->le_nonresident_names.table != NULL) {
             for (i=0;i < p->le_nonresident_names.length;i++) {
                 struct exe_ne_header_name_entry *ent = p->le_nonresident_names.table + i;
@@ -16,7 +16,18 @@ void exe_ne_header_name_entry_table_init(struct exe_ne_header_name_entry_table *
     memset(t,0,sizeof(*t));
 }
 
+void exe_ne_header_name_entry_table_free_index(struct exe_ne_header_name_entry_table * const t) {
+    if (t->hash_ordinal) free(t->hash_ordinal);
+    t->hash_ordinal = NULL;
+    if (t->hash_name) free(t->hash_name);
+    t->hash_name = NULL;
+    if (t->hash) free(t->hash);
+    t->hash = NULL;
+    t->hash_buckets = 0;
+}
+
 void exe_ne_header_name_entry_table_free_table(struct exe_ne_header_name_entry_table * const t) {
+    exe_ne_header_name_entry_table_free_index(t);
     if (t->table) free(t->table);
     t->table = NULL;
     t->length = 0;
@@ -132,6 +143,120 @@ int exe_ne_header_name_entry_table_parse_raw(struct exe_ne_header_name_entry_tab
     }
 
     t->length = entries;
+
+    /* the index is optional, lookups fall back to a linear scan without it */
+    exe_ne_header_name_entry_table_build_index(t);
     return 0;
 }
 
+static uint32_t ne_name_entry_hash_name(const unsigned char *name,const size_t len) {
+    uint32_t h = 0x811C9DC5UL; /* FNV-1a */
+    size_t i;
+
+    for (i=0;i < len;i++) {
+        h ^= name[i];
+        h *= 0x01000193UL;
+    }
+
+    return h;
+}
+
+/* build the ordinal and name hash index from table[]. must be called before table[] is sorted,
+ * so that where names or ordinals collide, lookups return the first one in raw table order
+ * the same as a linear scan would. */
+int exe_ne_header_name_entry_table_build_index(struct exe_ne_header_name_entry_table * const t) {
+    unsigned int i,b;
+
+    exe_ne_header_name_entry_table_free_index(t);
+    if (t->table == NULL || t->length == 0)
+        return 0;
+    if (t->length > 0xFFFFu) /* too many entries for uint16_t links */
+        return -1;
+#if TARGET_MSDOS == 16
+    if (t->length > (0xFFF0u / sizeof(*(t->hash))))
+        return -1;
+#endif
+
+    b = 16;
+    while (b < t->length) b <<= 1u;
+
+    t->hash = (struct exe_ne_header_name_entry_hash*)malloc(t->length * sizeof(*(t->hash)));
+    t->hash_ordinal = (uint16_t*)calloc(b,sizeof(uint16_t));
+    t->hash_name = (uint16_t*)calloc(b,sizeof(uint16_t));
+    if (t->hash == NULL || t->hash_ordinal == NULL || t->hash_name == NULL) {
+        exe_ne_header_name_entry_table_free_index(t);
+        return -1;
+    }
+    t->hash_buckets = b;
+
+    /* insert in reverse so the first entry in table order ends up at the head of each chain */
+    for (i=t->length;i > 0;) {
+        struct exe_ne_header_name_entry_hash *h = t->hash + (--i);
+        unsigned int ob,nb;
+
+        h->ent = t->table[i];
+        h->ordinal = ne_name_entry_get_ordinal(t,&h->ent);
+
+        ob = h->ordinal & (b - 1u);
+        nb = (unsigned int)ne_name_entry_hash_name(ne_name_entry_get_name_base(t,&h->ent),h->ent.length) & (b - 1u);
+
+        h->next_ordinal = t->hash_ordinal[ob];
+        t->hash_ordinal[ob] = (uint16_t)(i + 1u);
+        h->next_name = t->hash_name[nb];
+        t->hash_name[nb] = (uint16_t)(i + 1u);
+    }
+
+    return 0;
+}
+
+const struct exe_ne_header_name_entry *ne_name_entry_find_by_ordinal(const struct exe_ne_header_name_entry_table * const t,const uint16_t ordinal) {
+    unsigned int i;
+
+    if (t->hash == NULL || t->hash_buckets == 0) {
+        /* no index (out of memory?), fall back to linear scan */
+        for (i=0;t->table != NULL && i < t->length;i++) {
+            if (ne_name_entry_get_ordinal(t,t->table + i) == ordinal)
+                return t->table + i;
+        }
+
+        return NULL;
+    }
+
+    i = t->hash_ordinal[ordinal & (t->hash_buckets - 1u)];
+    while (i != 0) {
+        const struct exe_ne_header_name_entry_hash *h = t->hash + i - 1u;
+        if (h->ordinal == ordinal) return &h->ent;
+        i = h->next_ordinal;
+    }
+
+    return NULL;
+}
+
+/* NTS: name does not need to be NUL terminated. Comparison is exact (case sensitive) */
+const struct exe_ne_header_name_entry *ne_name_entry_find_by_name(const struct exe_ne_header_name_entry_table * const t,const char * const name,const size_t name_length) {
+    unsigned int i;
+
+    if (name_length > 255)
+        return NULL;
+
+    if (t->hash == NULL || t->hash_buckets == 0) {
+        /* no index (out of memory?), fall back to linear scan */
+        for (i=0;t->table != NULL && i < t->length;i++) {
+            if (t->table[i].length == name_length && memcmp(ne_name_entry_get_name_base(t,t->table + i),name,name_length) == 0)
+                return t->table + i;
+        }
+
+        return NULL;
+    }
+
+    i = t->hash_name[(unsigned int)ne_name_entry_hash_name((const unsigned char*)name,name_length) & (t->hash_buckets - 1u)];
+    while (i != 0) {
+        const struct exe_ne_header_name_entry_hash *h = t->hash + i - 1u;
+        if (h->ent.length == name_length && memcmp(ne_name_entry_get_name_base(t,&h->ent),name,name_length) == 0)
+            return &h->ent;
+        i = h->next_name;
+    }
+
+    return NULL;
+}
+
@@ -11,6 +11,26 @@ struct exe_ne_header_resource_table_t {
     uint16_t                                        resnames_length;
 };
 
+/* one resource from the resource table, by file location. see exe_ne_header_resource_extent_list_build() */
+struct exe_ne_header_resource_extent {
+    uint32_t                                        file_offset;    /* rnOffset << rscAlignShift */
+    uint32_t                                        length;         /* rnLength << rscAlignShift */
+    uint16_t                                        rtTypeID;
+    uint16_t                                        rnID;
+    uint16_t                                        typeinfo_index;
+    uint16_t                                        nameinfo_index;
+};
+
+struct exe_ne_header_resource_extent_list {
+    struct exe_ne_header_resource_extent*           table;          /* sorted by file offset */
+    unsigned int                                    length;
+};
+
+/* gaps up to this size between resources are read through rather than seeked over */
+#define EXE_NE_HEADER_RESOURCE_EXTENT_MAX_GAP       4096UL
+
+typedef int (*exe_ne_header_resource_extent_cb)(const struct exe_ne_header_resource_extent *e,const unsigned char *data,const size_t length,void *user);
+
 struct exe_ne_header_imported_name_table {
     uint16_t*                                       table;
     unsigned int                                    length;
@@ -39,6 +59,11 @@ struct exe_ne_header_name_entry_table {
     unsigned char*                                  raw;
     size_t                                          raw_length;
     unsigned char                                   raw_ownership;
+    /* ordinal->name and name->ordinal hash index, built by parse_raw (relies on raw) */
+    struct exe_ne_header_name_entry_hash*           hash;           /* one per table entry, in raw order */
+    uint16_t*                                       hash_ordinal;   /* bucket heads, index + 1 into hash[], 0 = empty */
+    uint16_t*                                       hash_name;      /* bucket heads, index + 1 into hash[], 0 = empty */
+    unsigned int                                    hash_buckets;   /* power of 2 */
 };
 
 #pragma pack(push,1)
@@ -48,6 +73,17 @@ struct exe_ne_header_name_entry {
 };
 #pragma pack(pop)
 
+/* NTS: The index keeps its own copy of each name entry so that sorting table[] does not invalidate it.
+ *      Links are uint16_t, so the index is only built for tables of 0xFFFF entries or less. The NE name
+ *      tables can't get that big, but the LE nonresident name table has a 32-bit length. Larger tables
+ *      are left without an index and lookups fall back to a linear scan. */
+struct exe_ne_header_name_entry_hash {
+    struct exe_ne_header_name_entry                 ent;
+    uint16_t                                        ordinal;
+    uint16_t                                        next_ordinal;   /* index + 1 into hash[], 0 = end of chain */
+    uint16_t                                        next_name;      /* index + 1 into hash[], 0 = end of chain */
+};
+
 #pragma pack(push,1)
 struct exe_ne_header_entry_table_entry {
     uint8_t         segment_id;         // 0x00 = empty  0xFF = movable  0xFE = constant   anything else = segment index
@@ -117,6 +153,11 @@ uint16_t exe_ne_header_resource_table_get_resname(const struct exe_ne_header_res
 void exe_ne_header_resource_table_parse(struct exe_ne_header_resource_table_t * const t);
 unsigned char *exe_ne_header_resource_table_alloc_raw(struct exe_ne_header_resource_table_t * const t,const size_t length);
 
+void exe_ne_header_resource_extent_list_init(struct exe_ne_header_resource_extent_list * const l);
+void exe_ne_header_resource_extent_list_free(struct exe_ne_header_resource_extent_list * const l);
+int exe_ne_header_resource_extent_list_build(struct exe_ne_header_resource_extent_list * const l,const struct exe_ne_header_resource_table_t * const t);
+int exe_ne_header_resource_extent_list_read(const struct exe_ne_header_resource_extent_list * const l,const int fd,size_t batch_size,exe_ne_header_resource_extent_cb cb,void *user);
+
 void ne_imported_name_table_entry_get_name(char *dst,size_t dstmax,const struct exe_ne_header_imported_name_table * const t,const uint16_t offset);
 void ne_imported_name_table_entry_get_module_ref_name(char *dst,size_t dstmax,const struct exe_ne_header_imported_name_table * const t,const uint16_t index);
 void exe_ne_header_imported_name_table_init(struct exe_ne_header_imported_name_table * const t);
@@ -150,6 +191,10 @@ uint16_t ne_name_entry_get_ordinal(const struct exe_ne_header_name_entry_table *
 unsigned char *ne_name_entry_get_name_base(const struct exe_ne_header_name_entry_table * const t,const struct exe_ne_header_name_entry * const ent);
 void ne_name_entry_get_name(char *dst,size_t dstmax,const struct exe_ne_header_name_entry_table * const t,const struct exe_ne_header_name_entry * const ent);
 int exe_ne_header_name_entry_table_parse_raw(struct exe_ne_header_name_entry_table * const t);
+void exe_ne_header_name_entry_table_free_index(struct exe_ne_header_name_entry_table * const t);
+int exe_ne_header_name_entry_table_build_index(struct exe_ne_header_name_entry_table * const t);
+const struct exe_ne_header_name_entry *ne_name_entry_find_by_ordinal(const struct exe_ne_header_name_entry_table * const t,const uint16_t ordinal);
+const struct exe_ne_header_name_entry *ne_name_entry_find_by_name(const struct exe_ne_header_name_entry_table * const t,const char * const name,const size_t name_length);
 
 int ne_name_entry_sort_by_name(const void *a,const void *b);
 int ne_name_entry_sort_by_ordinal(const void *a,const void *b);
@@ -7,6 +7,11 @@
 #include <errno.h>
 #include <stdio.h>
 #include <fcntl.h>
+#if defined(LINUX)
+#include <sys/stat.h>
+#else
+#include <direct.h>
+#endif
 
 #include <hw/dos/exehdr.h>
 #include <hw/dos/exenehdr.h>
@@ -21,6 +26,8 @@ static int                      src_fd = -1;
 
 static unsigned char            opt_pric = 0;
 
+static char*                    opt_extract_dir = NULL;
+
 static struct exe_dos_header    exehdr;
 static struct exe_dos_layout    exelayout;
 
@@ -28,6 +35,506 @@ static void help(void) {
     fprintf(stderr,"EXENERDM -i <exe file>\n");
     fprintf(stderr,"  -pric      Pre-pend a directory structure to ICON and CURSOR resources.\n");
     fprintf(stderr,"             .ico and .cur files are expected to contain this directory.\n");
+    fprintf(stderr,"  --extract-all <dir>  Write every resource to <dir> (implies -pric), reading\n");
+    fprintf(stderr,"             the file sequentially in large batches. <dir> is created if needed.\n");
+}
+
+/* choose file extension by resource type, or .BIN otherwise.
+ * Note that some resources, like RT_ICON and RT_CURSOR, are
+ * not stored using the familiar .ico and .cur extensions because
+ * the file format is expected to carry a "directory" structure
+ * that allows Windows to select one of multiple icons for the
+ * display, unless the user has explicitly instructed us to
+ * prepend a fake directory to the raw data to make it valid. */
+static const char *resource_file_ext(const uint16_t rtTypeID,const unsigned char pric) {
+    switch (rtTypeID) {
+        case exe_ne_header_RT_CURSOR:           return pric?".cur":".rcu";
+        case exe_ne_header_RT_BITMAP:           return ".bmp";
+        case exe_ne_header_RT_ICON:             return pric?".ico":".ric";
+        case exe_ne_header_RT_MENU:             return ".men";
+        case exe_ne_header_RT_DIALOG:           return ".dlg";
+        case exe_ne_header_RT_STRING:           return ".str";
+        case exe_ne_header_RT_FONTDIR:          return ".fdr";
+        case exe_ne_header_RT_FONT:             return ".fon";
+        case exe_ne_header_RT_ACCELERATOR:      return ".acc";
+        case exe_ne_header_RT_RCDATA:           return ".rcd";
+        case exe_ne_header_RT_MESSAGETABLE:     return ".msg";
+        case exe_ne_header_RT_GROUP_CURSOR:     return ".gcr";
+        case exe_ne_header_RT_GROUP_ICON:       return ".gic";
+        case exe_ne_header_RT_NAME_TABLE:       return ".ntb";
+        case exe_ne_header_RT_VERSION:          return ".ver";
+        default:                                break;
+    };
+
+    return ".bin";
+}
+
+static void resource_file_name(char *dst,const char *dir,const uint16_t rtTypeID,const uint16_t rnID,const unsigned char pric) {
+    if (dir != NULL)
+        sprintf(dst,"%s%c%04X%04X%s",dir,
+#if defined(TARGET_MSDOS) || defined(TARGET_WINDOWS)
+            '\\',
+#else
+            '/',
+#endif
+            (unsigned int)rtTypeID,(unsigned int)rnID,resource_file_ext(rtTypeID,pric));
+    else
+        sprintf(dst,"%04X%04X%s",(unsigned int)rtTypeID,(unsigned int)rnID,resource_file_ext(rtTypeID,pric));
+}
+
+/* copy resource data as-is from the current position in the source file */
+static int copy_resource_raw(const int fd,unsigned long fcpy) {
+    char tmp[4096];
+
+    while (fcpy > 0UL) {
+        int docpy = (fcpy > sizeof(tmp) ? sizeof(tmp) : fcpy);
+        int rd = read(src_fd,tmp,docpy);
+
+        if (rd > 0) {
+            write(fd,tmp,rd);
+            fcpy -= rd;
+        }
+
+        if (rd < docpy) {
+            fprintf(stderr,"Early EOF on resource\n");
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* load resource data from the current position in the source file.
+ * returns NULL if it is too large to hold in memory. */
+static unsigned char *load_resource(const unsigned long fcpy,size_t *len) {
+    unsigned char *buf;
+    size_t got = 0;
+
+#if TARGET_MSDOS == 16
+    if (fcpy > 0xFFF0UL)
+        return NULL;
+#endif
+
+    buf = malloc(fcpy ? (size_t)fcpy : 1);
+    if (buf == NULL)
+        return NULL;
+
+    while (got < (size_t)fcpy) {
+        int rd = read(src_fd,buf+got,(unsigned int)((size_t)fcpy - got));
+        if (rd <= 0) break;
+        got += (size_t)rd;
+    }
+
+    if (got < (size_t)fcpy)
+        fprintf(stderr,"Early EOF on resource\n");
+
+    *len = got;
+    return buf;
+}
+
+/* copy scanlines from a Windows 1.x/2.x top-down, WORD aligned bitmap to a
+ * Windows 3.x bottom-up, DWORD aligned bitmap. rows past the end of the data are zero. */
+static unsigned char *flip_scanlines(unsigned char *dst,const size_t dst_stride,const unsigned char *src,const size_t src_stride,const unsigned int height,const unsigned char *src_fence) {
+    unsigned int y;
+
+    for (y=0;y < height;y++) {
+        const unsigned char *s = src + ((size_t)(height - 1u - y) * src_stride);
+        size_t cpy = (src_stride < dst_stride) ? src_stride : dst_stride;
+
+        memset(dst,0,dst_stride);
+        if (s >= src_fence) cpy = 0;
+        else if ((size_t)(src_fence - s) < cpy) cpy = (size_t)(src_fence - s);
+        if (cpy != 0) memcpy(dst,s,cpy);
+        dst += dst_stride;
+    }
+
+    return dst;
+}
+
+/* convert a Windows 1.x/2.x RT_ICON or RT_CURSOR (they share the same layout) to a Windows 3.x
+ * .ico or .cur file. returns 1 if converted and written, 0 if the format is not understood. */
+static int write_resource_old_icon_or_cursor(const int fd,unsigned char *data,const size_t len,const unsigned char is_cursor) {
+    /* then it is necessary to convert, not just copy, because
+     * the alignment rules are different:
+     *
+     * Windows 1.x/2.x BITMAP:          Requires WORD alignment, DIBs are top-down
+     * Windows 3.x BITMAPINFOHEADER:    Requires DWORD alignment, DIBs are bottom-up */
+    struct exe_ne_header_RTICONBITMAP *bmphdr2x = (struct exe_ne_header_RTICONBITMAP *)data;
+    struct exe_ne_header_BITMAPINFOHEADER bmphdr3x;
+    struct exe_ne_header_RGBQUAD rgb[2];
+    unsigned int align3xmono;
+    unsigned int align3x;
+    unsigned int height;
+    unsigned char *out,*w;
+    size_t ird,mrd,outlen;
+
+    if (len < sizeof(*bmphdr2x))
+        return 0;
+
+    /* Windows 1.x/2.x icons for whatever reason have bits/pixel == 0 and planes == 0,
+     * which apparently means monochromatic anyway */
+    if (bmphdr2x->bmPlanes == 0)
+        bmphdr2x->bmPlanes = 1;
+    if (bmphdr2x->bmBitsPixel == 0)
+        bmphdr2x->bmBitsPixel = 1;
+
+    if (!(bmphdr2x->bmPlanes == 1 && bmphdr2x->bmBitsPixel == 1))
+        return 0;
+
+    printf("* Converting BITMAP to BITMAPINFOHEADER\n");
+
+    height = (unsigned int)abs(bmphdr2x->bmHeight);
+    align3x = (((bmphdr2x->bmBitsPixel * bmphdr2x->bmWidth) + 31) & (~31)) >> 3; // BITMAPINFOHEADER alignment
+    align3xmono = ((bmphdr2x->bmWidth + 31) & (~31)) >> 3; // BITMAPINFOHEADER alignment
+    ird = bmphdr2x->bmWidthBytes;
+    mrd = ((bmphdr2x->bmWidth + 15) & (~15)) >> 3; /* WORD align requirement */
+
+    /* NTS: ICONDIR/CURSORDIR and ICONDIRENTRY/CURSORDIRENTRY are the same size */
+    outlen = sizeof(struct exe_ne_header_resource_ICONDIR) + sizeof(struct exe_ne_header_resource_ICONDIRENTRY) +
+        sizeof(bmphdr3x) + sizeof(rgb) + ((size_t)align3x * height) + ((size_t)align3xmono * height);
+    out = w = malloc(outlen);
+    if (out == NULL)
+        return 0;
+
+    if (is_cursor) {
+        struct exe_ne_header_resource_CURSORDIR *pre = (struct exe_ne_header_resource_CURSORDIR*)w;
+        struct exe_ne_header_resource_CURSORDIRENTRY *dent = (struct exe_ne_header_resource_CURSORDIRENTRY*)(w + sizeof(*pre));
+
+        pre->cdReserved = 0;
+        pre->cdType = 1;
+        pre->cdCount = 1;
+
+        dent->bWidth = bmphdr2x->bmWidth;
+        dent->bHeight = bmphdr2x->bmHeight;
+        dent->bColorCount = 0;
+        dent->bReserved = 0;
+        dent->wXHotspot = 0;
+        dent->wYHotspot = 0;
+        dent->dwBytesInRes = sizeof(bmphdr3x) + (4UL << (unsigned long)bmphdr2x->bmBitsPixel) +
+            (align3x * height) + (align3xmono * height); // icon + mask
+        dent->dwImageOffset = sizeof(*pre) + sizeof(*dent);
+        w += sizeof(*pre) + sizeof(*dent);
+    }
+    else {
+        struct exe_ne_header_resource_ICONDIR *pre = (struct exe_ne_header_resource_ICONDIR*)w;
+        struct exe_ne_header_resource_ICONDIRENTRY *dent = (struct exe_ne_header_resource_ICONDIRENTRY*)(w + sizeof(*pre));
+
+        pre->idReserved = 0;
+        pre->idType = 1;
+        pre->idCount = 1;
+
+        dent->bWidth = bmphdr2x->bmWidth;
+        dent->bHeight = bmphdr2x->bmHeight;
+        dent->bColorCount = 1 << bmphdr2x->bmBitsPixel;
+        dent->bReserved = 0;
+        dent->wPlanes = bmphdr2x->bmPlanes;
+        dent->wBitCount = bmphdr2x->bmBitsPixel;
+        dent->dwBytesInRes = sizeof(bmphdr3x) + (4UL << (unsigned long)bmphdr2x->bmBitsPixel) +
+            (align3x * height) + (align3xmono * height); // icon + mask
+        dent->dwImageOffset = sizeof(*pre) + sizeof(*dent);
+        w += sizeof(*pre) + sizeof(*dent);
+    }
+
+    /* BITMAPINFOHEADER */
+    bmphdr3x.biSize = sizeof(bmphdr3x);
+    bmphdr3x.biWidth = bmphdr2x->bmWidth;
+    bmphdr3x.biHeight = bmphdr2x->bmHeight * 2; // icon + mask
+    bmphdr3x.biPlanes = bmphdr2x->bmPlanes;
+    bmphdr3x.biBitCount = bmphdr2x->bmBitsPixel;
+    bmphdr3x.biCompression = 0;
+    bmphdr3x.biSizeImage = (align3x * height) + (align3xmono * height); // icon + mask
+    bmphdr3x.biXPelsPerMeter = 0;
+    bmphdr3x.biYPelsPerMeter = 0;
+    bmphdr3x.biClrUsed = 0;
+    bmphdr3x.biClrImportant = 0;
+    memcpy(w,&bmphdr3x,sizeof(bmphdr3x));
+    w += sizeof(bmphdr3x);
+
+    /* color palette (monochrome) */
+    rgb[0].rgbRed = 0x00; rgb[0].rgbGreen = 0x00; rgb[0].rgbBlue = 0x00; rgb[0].rgbReserved = 0x00;
+    rgb[1].rgbRed = 0xFF; rgb[1].rgbGreen = 0xFF; rgb[1].rgbBlue = 0xFF; rgb[1].rgbReserved = 0x00;
+    memcpy(w,rgb,sizeof(rgb));
+    w += sizeof(rgb);
+
+    /* NTS: Where Windows 3.x stores the image first, followed by the mask,
+     *      Windows 1.x/2.x store the mask first, then the image. Like bitmaps
+     *      in Windows 1.x/2.x the DIB is top-down, we convert here to bottom-up. */
+    {
+        const unsigned char *msk = data + sizeof(*bmphdr2x);
+        const unsigned char *img = msk + (mrd * height);
+
+        w = flip_scanlines(w,align3x,img,ird,height,data + len);
+        w = flip_scanlines(w,align3xmono,msk,mrd,height,data + len);
+    }
+
+    assert(w == (out + outlen));
+    write(fd,out,outlen);
+    free(out);
+    return 1;
+}
+
+/* write resource data held in memory, prepending a directory or BITMAPFILEHEADER to RT_ICON, RT_CURSOR
+ * and RT_BITMAP resources and converting Windows 1.x/2.x formats to make them valid files.
+ * data may be modified. */
+static int write_resource_pric(const int fd,const uint16_t rtTypeID,unsigned char *data,size_t len) {
+    if (rtTypeID == exe_ne_header_RT_BITMAP) {
+        if (exe_ne_header_is_WINOLDBITMAP(data,len)) {
+            /* then it is necessary to convert, not just copy, because
+             * the alignment rules are different:
+             *
+             * Windows 1.x/2.x BITMAP:          Requires WORD alignment, DIBs are top-down
+             * Windows 3.x BITMAPINFOHEADER:    Requires DWORD alignment, DIBs are bottom-up */
+            const struct exe_ne_header_RTBITMAP *bmphdr2x =
+                (const struct exe_ne_header_RTBITMAP *)data;
+
+            if (len >= sizeof(*bmphdr2x) && bmphdr2x->bmPlanes == 1 && (bmphdr2x->bmBitsPixel == 1 || bmphdr2x->bmBitsPixel == 4)) {
+                struct exe_ne_header_BITMAPINFOHEADER bmphdr3x;
+                unsigned int pal_colors = 1 << bmphdr2x->bmBitsPixel;
+                unsigned int align3x = (((bmphdr2x->bmBitsPixel * bmphdr2x->bmWidth) + 31) & (~31)) >> 3; // BITMAPINFOHEADER alignment
+                unsigned int height = (unsigned int)abs(bmphdr2x->bmHeight);
+                struct exe_ne_header_RGBQUAD rgb[2];
+                unsigned long bboff = 14;
+                unsigned char *out,*w;
+                size_t outlen;
+
+                printf("* Converting BITMAP to BITMAPINFOHEADER\n");
+
+                outlen = 14 + sizeof(bmphdr3x) + ((size_t)align3x * height);
+                if (bmphdr2x->bmBitsPixel == 1) outlen += sizeof(rgb);
+                out = w = malloc(outlen);
+                if (out == NULL)
+                    return -1;
+
+                /* generate BMP FILE header */
+                bboff += sizeof(bmphdr3x);
+                bboff += pal_colors * 4;
+
+                memcpy(w+0,"BM",2);
+                *((uint32_t*)(w+2)) = (align3x * height) + bboff;
+                *((uint16_t*)(w+6)) = 0;
+                *((uint16_t*)(w+8)) = 0;
+                *((uint32_t*)(w+10)) = bboff;
+                w += 14;
+
+                /* BITMAPINFOHEADER */
+                bmphdr3x.biSize = sizeof(bmphdr3x);
+                bmphdr3x.biWidth = bmphdr2x->bmWidth;
+                bmphdr3x.biHeight = bmphdr2x->bmHeight;
+                bmphdr3x.biPlanes = bmphdr2x->bmPlanes;
+                bmphdr3x.biBitCount = bmphdr2x->bmBitsPixel;
+                bmphdr3x.biCompression = 0;
+                bmphdr3x.biSizeImage = align3x * height;
+                bmphdr3x.biXPelsPerMeter = 0;
+                bmphdr3x.biYPelsPerMeter = 0;
+                bmphdr3x.biClrUsed = 0;
+                bmphdr3x.biClrImportant = 0;
+                memcpy(w,&bmphdr3x,sizeof(bmphdr3x));
+                w += sizeof(bmphdr3x);
+
+                /* color palette */
+                if (bmphdr2x->bmBitsPixel == 1) {
+                    rgb[0].rgbRed = 0x00; rgb[0].rgbGreen = 0x00; rgb[0].rgbBlue = 0x00; rgb[0].rgbReserved = 0x00;
+                    rgb[1].rgbRed = 0xFF; rgb[1].rgbGreen = 0xFF; rgb[1].rgbBlue = 0xFF; rgb[1].rgbReserved = 0x00;
+                    memcpy(w,rgb,sizeof(rgb));
+                    w += sizeof(rgb);
+                }
+                else {
+                    /* I'll add 4bpp generation when I see it in the wild */
+                    printf("! Cannot guess palette\n");
+                }
+
+                /* copy scanlines, bitmap bits immediately follow bmphdr2x.
+                 * we have to flip the bitmap upside-down as we convert */
+                w = flip_scanlines(w,align3x,data + sizeof(*bmphdr2x),bmphdr2x->bmWidthBytes,height,data + len);
+
+                assert(w == (out + outlen));
+                write(fd,out,outlen);
+                free(out);
+                return 0;
+            }
+            else {
+                printf("! Cannot convert BITMAP to BITMAPINFOHEADER, unknown format\n");
+            }
+        }
+        else if (len >= sizeof(struct exe_ne_header_BITMAPINFOHEADER)) {
+            /* need to add a BITMAPFILEHEADER to make it valid */
+            const struct exe_ne_header_BITMAPINFOHEADER *bmphdr =
+                (const struct exe_ne_header_BITMAPINFOHEADER *)data;
+            unsigned int pal_colors =
+                exe_ne_header_BITMAPINFOHEADER_get_palette_count(bmphdr);
+            unsigned long bboff = 14;
+            unsigned char hd[14];
+
+            bboff += bmphdr->biSize;
+            bboff += pal_colors * 4;
+
+            memcpy(hd+0,"BM",2);
+            *((uint32_t*)(hd+2)) = len + 14;
+            *((uint16_t*)(hd+6)) = 0;
+            *((uint16_t*)(hd+8)) = 0;
+            *((uint32_t*)(hd+10)) = bboff;
+            write(fd,hd,sizeof(hd));
+        }
+    }
+    else if (rtTypeID == exe_ne_header_RT_ICON) {
+        if (exe_ne_header_is_WINOLDICON(data,len)) {
+            if (write_resource_old_icon_or_cursor(fd,data,len,0/*icon*/))
+                return 0;
+
+            printf("! Cannot convert BITMAP to BITMAPINFOHEADER, unknown format\n");
+        }
+        else if (len >= sizeof(struct exe_ne_header_BITMAPINFOHEADER)) {
+            struct exe_ne_header_resource_ICONDIR pre;
+            struct exe_ne_header_resource_ICONDIRENTRY dent;
+            struct exe_ne_header_BITMAPINFOHEADER *bmp =
+                (struct exe_ne_header_BITMAPINFOHEADER*)data;
+
+            pre.idReserved = 0;
+            pre.idType = 1;
+            pre.idCount = 1;
+            write(fd,&pre,sizeof(pre));
+
+            dent.bWidth = bmp->biWidth;
+            dent.bHeight = bmp->biHeight >> 1;      /* remember icons carry image + mask and dwHeight is double the actual height */
+            dent.bColorCount = 1 << bmp->biBitCount;
+            dent.bReserved = 0;
+            dent.wPlanes = bmp->biPlanes;
+            dent.wBitCount = bmp->biBitCount;
+            dent.dwBytesInRes = len;
+            dent.dwImageOffset = sizeof(pre) + sizeof(dent);
+            write(fd,&dent,sizeof(dent));
+        }
+    }
+    else if (rtTypeID == exe_ne_header_RT_CURSOR) {
+        /* raw resource data for a cursor when in an NE executable:
+         *
+         * WORD                 hotspot_x
+         * WORD                 hotspot_y
+         * BITMAPINFOHEADER     cursor bitmapinfo
+         * RGBQUAD              cursor palette
+         * BYTE[]               cursor bitmap
+         *
+         */
+        if (exe_ne_header_is_WINOLDCURSOR(data,len)) {
+            if (write_resource_old_icon_or_cursor(fd,data,len,1/*cursor*/))
+                return 0;
+
+            printf("! Cannot convert BITMAP to BITMAPINFOHEADER, unknown format\n");
+        }
+        else if (len >= (4 + sizeof(struct exe_ne_header_BITMAPINFOHEADER))) {
+            struct exe_ne_header_resource_CURSORDIR pre;
+            struct exe_ne_header_resource_CURSORDIRENTRY dent;
+            struct exe_ne_header_BITMAPINFOHEADER *bmp =
+                (struct exe_ne_header_BITMAPINFOHEADER*)(data + 4);
+
+            pre.cdReserved = 0;
+            pre.cdType = 2;
+            pre.cdCount = 1;
+            write(fd,&pre,sizeof(pre));
+
+            dent.bWidth = bmp->biWidth;
+            dent.bHeight = bmp->biHeight >> 1;      /* remember cursors carry image + mask and dwHeight is double the actual height */
+            dent.bColorCount = 1 << bmp->biBitCount;
+            dent.bReserved = 0;
+            dent.wXHotspot = *((uint16_t*)(data + 0));
+            dent.wYHotspot = *((uint16_t*)(data + 2));
+            dent.dwBytesInRes = len - 4;
+            dent.dwImageOffset = sizeof(pre) + sizeof(dent);
+            write(fd,&dent,sizeof(dent));
+
+            data += 4;
+            len -= 4;
+        }
+    }
+
+    if (len != 0)
+        write(fd,data,len);
+
+    return 0;
+}
+
+struct extract_all_state {
+    const char*         dir;
+    unsigned long       files;
+    unsigned long       bytes;
+    unsigned long       failed;
+};
+
+static int extract_all_cb(const struct exe_ne_header_resource_extent *e,const unsigned char *data,const size_t length,void *user) {
+    struct extract_all_state *st = (struct extract_all_state*)user;
+    unsigned char *cpy = NULL;
+    size_t len = length;
+    char tmp[1024];
+    int fd;
+
+    if (strlen(st->dir) > (sizeof(tmp) - 32))
+        return -1;
+
+    resource_file_name(tmp,st->dir,e->rtTypeID,e->rnID,1/*pric*/);
+    printf("    0x%08lx+0x%08lx -> %s\n",(unsigned long)e->file_offset,(unsigned long)e->length,tmp);
+
+    if (data != NULL) {
+        if (length < e->length)
+            fprintf(stderr,"Early EOF on resource\n");
+    }
+    else {
+        /* too large to batch, read it on its own */
+        if ((unsigned long)lseek(src_fd,e->file_offset,SEEK_SET) != (unsigned long)e->file_offset) {
+            printf("                ! Cannot seek to offset\n");
+            st->failed++;
+            return 0;
+        }
+        len = e->length;
+    }
+
+    /* conversion modifies the header, and the batch buffer may be shared with the next resource */
+    if (e->rtTypeID == exe_ne_header_RT_BITMAP || e->rtTypeID == exe_ne_header_RT_ICON || e->rtTypeID == exe_ne_header_RT_CURSOR) {
+        if (data != NULL) {
+            if ((cpy=malloc(length ? length : 1)) != NULL)
+                memcpy(cpy,data,length);
+        }
+        else {
+            cpy = load_resource(e->length,&len);
+        }
+
+        if (cpy == NULL) {
+            printf("                ! Not enough memory to convert, skipped\n");
+            st->failed++;
+            return 0;
+        }
+    }
+
+    fd = open(tmp,O_CREAT|O_TRUNC|O_WRONLY|O_BINARY,0644);
+    if (fd < 0) {
+        fprintf(stderr,"Unable to write %s, %s\n",tmp,strerror(errno));
+        if (cpy) free(cpy);
+        return -1;
+    }
+
+    if (cpy != NULL) {
+        int r = write_resource_pric(fd,e->rtTypeID,cpy,len);
+
+        free(cpy);
+        if (r < 0) {
+            printf("                ! Not enough memory to convert, skipped\n");
+            close(fd);
+            unlink(tmp);
+            st->failed++;
+            return 0;
+        }
+    }
+    else if (data != NULL) {
+        if (length != 0)
+            write(fd,data,length);
+    }
+    else {
+        copy_resource_raw(fd,e->length);
+    }
+
+    st->bytes += len;
+    st->files++;
+    close(fd);
+    return 0;
 }
 
 int main(int argc,char **argv) {
@@ -59,6 +566,11 @@ int main(int argc,char **argv) {
             else if (!strcmp(a,"pric")) {
                 opt_pric = 1;
             }
+            else if (!strcmp(a,"extract-all")) {
+                opt_extract_dir = argv[i++];
+                if (opt_extract_dir == NULL) return 1;
+                opt_pric = 1;
+            }
             else {
                 fprintf(stderr,"Unknown switch %s\n",a);
                 return 1;
@@ -442,15 +954,54 @@ int main(int argc,char **argv) {
     printf("    Resource table, 1 << %u = %lu byte alignment:\n",
         exe_ne_header_resource_table_get_shift(&ne_resources),
         1UL << (unsigned long)exe_ne_header_resource_table_get_shift(&ne_resources));
+    if (opt_extract_dir != NULL) {
+        struct exe_ne_header_resource_extent_list extents;
+        struct extract_all_state st;
+
+        memset(&st,0,sizeof(st));
+        st.dir = opt_extract_dir;
+
+        exe_ne_header_resource_extent_list_init(&extents);
+        if (exe_ne_header_resource_extent_list_build(&extents,&ne_resources)) {
+            fprintf(stderr,"Failed to build resource list\n");
+            return 1;
+        }
+
+#if defined(LINUX)
+        if (mkdir(opt_extract_dir,0755) && errno != EEXIST) {
+#else
+        if (mkdir(opt_extract_dir) && errno != EEXIST) {
+#endif
+            fprintf(stderr,"Cannot create %s, %s\n",opt_extract_dir,strerror(errno));
+            exe_ne_header_resource_extent_list_free(&extents);
+            return 1;
+        }
+
+        printf("    Extracting %u resources to %s\n",extents.length,opt_extract_dir);
+#if TARGET_MSDOS == 16
+        i = exe_ne_header_resource_extent_list_read(&extents,src_fd,0x8000u,extract_all_cb,&st);
+#else
+        i = exe_ne_header_resource_extent_list_read(&extents,src_fd,0x100000u,extract_all_cb,&st);
+#endif
+        printf("    Extracted %lu resources, %lu bytes\n",st.files,st.bytes);
+        if (st.failed != 0) {
+            fprintf(stderr,"%lu resources could not be extracted\n",st.failed);
+            if (i == 0) i = 1;
+        }
+
+        exe_ne_header_resource_extent_list_free(&extents);
+        exe_ne_header_resource_table_free(&ne_resources);
+        close(src_fd);
+        return (i != 0) ? 1 : 0;
+    }
+
     printf("        %u TYPEINFO entries\n",ne_resources.typeinfo_length);
     {
         const struct exe_ne_header_resource_table_nameinfo *ninfo;
         const struct exe_ne_header_resource_table_typeinfo *tinfo;
         const char *rtTypeIDintstr;
-        const char *file_ext;
         unsigned long foff;
         unsigned long fcpy;
-        unsigned long fcnt;
         char tmp[255+1];
         unsigned int ti;
         unsigned int ni;
@@ -465,32 +1016,6 @@ int main(int argc,char **argv) {
                 continue;
             }
 
-            /* choose file extension by resource type, or .BIN otherwise.
-             * Note that some resources, like RT_ICON and RT_CURSOR, are
-             * not stored using the familiar .ico and .cur extensions because
-             * the file format is expected to carry a "directory" structure
-             * that allows Windows to select one of multiple icons for the
-             * display, unless the user has explicitly instructed us to
-             * prepend a fake directory to the raw data to make it valid. */
-            switch (tinfo->rtTypeID) {
-                case exe_ne_header_RT_CURSOR:           file_ext = opt_pric?".cur":".rcu"; break;
-                case exe_ne_header_RT_BITMAP:           file_ext = ".bmp"; break;
-                case exe_ne_header_RT_ICON:             file_ext = opt_pric?".ico":".ric"; break;
-                case exe_ne_header_RT_MENU:             file_ext = ".men"; break;
-                case exe_ne_header_RT_DIALOG:           file_ext = ".dlg"; break;
-                case exe_ne_header_RT_STRING:           file_ext = ".str"; break;
-                case exe_ne_header_RT_FONTDIR:          file_ext = ".fdr"; break;
-                case exe_ne_header_RT_FONT:             file_ext = ".fon"; break;
-                case exe_ne_header_RT_ACCELERATOR:      file_ext = ".acc"; break;
-                case exe_ne_header_RT_RCDATA:           file_ext = ".rcd"; break;
-                case exe_ne_header_RT_MESSAGETABLE:     file_ext = ".msg"; break;
-                case exe_ne_header_RT_GROUP_CURSOR:     file_ext = ".gcr"; break;
-                case exe_ne_header_RT_GROUP_ICON:       file_ext = ".gic"; break;
-                case exe_ne_header_RT_NAME_TABLE:       file_ext = ".ntb"; break;
-                case exe_ne_header_RT_VERSION:          file_ext = ".ver"; break;
-                default:                                file_ext = ".bin"; break;
-            };
-
             /* NTS: if bit 15 of rtTypeID is set (rtTypeID & 0x8000), rtTypeID is an integer identifier.
              *      otherwise, rtTypeID is an offset to the length + string combo containing the
              *      identifier as a string. offset is relative to the resource table.
@@ -558,10 +1083,7 @@ int main(int argc,char **argv) {
                 }
 
                 /* then choose file to write */
-                sprintf(tmp,"%04X%04X%s",
-                    (unsigned int)tinfo->rtTypeID,
-                    (unsigned int)ninfo->rnID,
-                    file_ext);
+                resource_file_name(tmp,NULL,tinfo->rtTypeID,ninfo->rnID,opt_pric);
 
                 printf("                Writing to: %s\n",tmp);
 
@@ -578,426 +1100,22 @@ int main(int argc,char **argv) {
                     return 1;
                 }
 
-                fcnt = 0;
-                while (fcpy > 0UL) {
-                    int docpy = (fcpy > sizeof(tmp) ? sizeof(tmp) : fcpy);
-                    int rd = read(src_fd,tmp,docpy);
-
-                    if (rd > 0) {
-                        /* WAIT: If this is an RT_ICON or RT_CURSOR, prepend a header to make it a valid file */
-                        if (opt_pric && fcnt == 0) {
-                            if (tinfo->rtTypeID == exe_ne_header_RT_BITMAP) {
-                                if (exe_ne_header_is_WINOLDBITMAP((const unsigned char*)tmp,docpy)) {
-                                    /* then it is necessary to convert, not just copy, because
-                                     * the alignment rules are different:
-                                     *
-                                     * Windows 1.x/2.x BITMAP:          Requires WORD alignment, DIBs are top-down
-                                     * Windows 3.x BITMAPINFOHEADER:    Requires DWORD alignment, DIBs are bottom-up */
-                                    struct exe_ne_header_BITMAPINFOHEADER bmphdr3x;
-                                    const struct exe_ne_header_RTBITMAP *bmphdr2x =
-                                        (const struct exe_ne_header_RTBITMAP *)tmp;
-                                    unsigned int pal_colors = 1 << bmphdr2x->bmBitsPixel;
-                                    unsigned int align3x = (((bmphdr2x->bmBitsPixel * bmphdr2x->bmWidth) + 31) & (~31)) >> 3; // BITMAPINFOHEADER alignment
-                                    struct exe_ne_header_RGBQUAD rgb;
-                                    unsigned long bboff = 14;
-                                    unsigned char hd[14];
-
-                                    if (bmphdr2x->bmPlanes == 1 && (bmphdr2x->bmBitsPixel == 1 || bmphdr2x->bmBitsPixel == 4)) {
-                                        printf("* Converting BITMAP to BITMAPINFOHEADER\n");
-
-                                        /* reseek file pointer, bitmap bits immediately follow bmphdr2x */
-                                        lseek(src_fd,foff+sizeof(*bmphdr2x),SEEK_SET);
-
-                                        /* generate BMP FILE header */
-                                        bboff += sizeof(bmphdr3x);
-                                        bboff += pal_colors * 4;
-
-                                        memcpy(hd+0,"BM",2);
-                                        *((uint32_t*)(hd+2)) = (align3x * abs(bmphdr2x->bmHeight)) + bboff;
-                                        *((uint16_t*)(hd+6)) = 0;
-                                        *((uint16_t*)(hd+8)) = 0;
-                                        *((uint32_t*)(hd+10)) = bboff;
-                                        write(fd,hd,sizeof(hd));
-
-                                        /* BITMAPINFOHEADER */
-                                        bmphdr3x.biSize = sizeof(bmphdr3x);
-                                        bmphdr3x.biWidth = bmphdr2x->bmWidth;
-                                        bmphdr3x.biHeight = bmphdr2x->bmHeight;
-                                        bmphdr3x.biPlanes = bmphdr2x->bmPlanes;
-                                        bmphdr3x.biBitCount = bmphdr2x->bmBitsPixel;
-                                        bmphdr3x.biCompression = 0;
-                                        bmphdr3x.biSizeImage = align3x * abs(bmphdr2x->bmHeight);
-                                        bmphdr3x.biXPelsPerMeter = 0;
-                                        bmphdr3x.biYPelsPerMeter = 0;
-                                        bmphdr3x.biClrUsed = 0;
-                                        bmphdr3x.biClrImportant = 0;
-                                        write(fd,&bmphdr3x,sizeof(bmphdr3x));
-
-                                        /* color palette */
-                                        if (bmphdr2x->bmBitsPixel == 1) {
-                                            {
-                                                rgb.rgbRed = 0x00; rgb.rgbGreen = 0x00; rgb.rgbBlue = 0x00; rgb.rgbReserved = 0x00;
-                                                write(fd,&rgb,sizeof(rgb));
-                                            }
-                                            {
-                                                rgb.rgbRed = 0xFF; rgb.rgbGreen = 0xFF; rgb.rgbBlue = 0xFF; rgb.rgbReserved = 0x00;
-                                                write(fd,&rgb,sizeof(rgb));
-                                            }
-                                        }
-                                        else {
-                                            /* I'll add 4bpp generation when I see it in the wild */
-                                            printf("! Cannot guess palette\n");
-                                        }
-
-                                        /* copy scanlines */
-                                        {
-                                            size_t rd = bmphdr2x->bmWidthBytes;
-                                            size_t wd = align3x;
-                                            size_t bufl = (rd > wd) ? rd : wd;
-                                            unsigned char *buf = malloc(bufl);
-                                            unsigned int y;
-
-                                            if (buf) {
-                                                memset(buf,0,bufl);
-                                                for (y=0;y < (unsigned int)abs(bmphdr2x->bmHeight);y++) {
-                                                    /* we have to flip the bitmap upside-down as we convert */
-                                                    lseek(src_fd,foff+sizeof(*bmphdr2x)+((abs(bmphdr2x->bmHeight) - 1 - y) * rd),SEEK_SET);
-                                                    read(src_fd,buf,rd);
-                                                    write(fd,buf,wd);
-                                                }
-                                                free(buf);
-                                            }
-                                        }
-
-                                        /* DONE */
-                                        break;
-                                    }
-                                    else {
-                                        printf("! Cannot convert BITMAP to BITMAPINFOHEADER, unknown format\n");
-                                    }
-                                }
-                                else {
-                                    /* need to add a BITMAPFILEHEADER to make it valid */
-                                    const struct exe_ne_header_BITMAPINFOHEADER *bmphdr =
-                                        (const struct exe_ne_header_BITMAPINFOHEADER *)tmp;
-                                    unsigned int pal_colors =
-                                        exe_ne_header_BITMAPINFOHEADER_get_palette_count(bmphdr);
-                                    unsigned long bboff = 14;
-                                    unsigned char hd[14];
-
-                                    bboff += bmphdr->biSize;
-                                    bboff += pal_colors * 4;
-
-                                    memcpy(hd+0,"BM",2);
-                                    *((uint32_t*)(hd+2)) = fcpy + 14;
-                                    *((uint16_t*)(hd+6)) = 0;
-                                    *((uint16_t*)(hd+8)) = 0;
-                                    *((uint32_t*)(hd+10)) = bboff;
-                                    write(fd,hd,sizeof(hd));
-                                }
-                            }
-                            else if (tinfo->rtTypeID == exe_ne_header_RT_ICON) {
-                                if (exe_ne_header_is_WINOLDICON((const unsigned char*)tmp,docpy)) {
-                                    /* then it is necessary to convert, not just copy, because
-                                     * the alignment rules are different:
-                                     *
-                                     * Windows 1.x/2.x BITMAP:          Requires WORD alignment, DIBs are top-down
-                                     * Windows 3.x BITMAPINFOHEADER:    Requires DWORD alignment, DIBs are bottom-up */
-                                    struct exe_ne_header_resource_ICONDIR pre;
-                                    struct exe_ne_header_resource_ICONDIRENTRY dent;
-                                    struct exe_ne_header_BITMAPINFOHEADER bmphdr3x;
-                                    struct exe_ne_header_RTICONBITMAP *bmphdr2x =
-                                        (struct exe_ne_header_RTICONBITMAP *)tmp;
-                                    struct exe_ne_header_RGBQUAD rgb;
-                                    unsigned int align3xmono;
-                                    unsigned int align3x;
-
-                                    /* Windows 1.x/2.x icons for whatever reason have bits/pixel == 0 and planes == 0,
-                                     * which apparently means monochromatic anyway */
-                                    if (bmphdr2x->bmPlanes == 0)
-                                        bmphdr2x->bmPlanes = 1;
-                                    if (bmphdr2x->bmBitsPixel == 0)
-                                        bmphdr2x->bmBitsPixel = 1;
-
-                                    align3x = (((bmphdr2x->bmBitsPixel * bmphdr2x->bmWidth) + 31) & (~31)) >> 3; // BITMAPINFOHEADER alignment
-                                    align3xmono = ((bmphdr2x->bmWidth + 31) & (~31)) >> 3; // BITMAPINFOHEADER alignment
-                                    if (bmphdr2x->bmPlanes == 1 && bmphdr2x->bmBitsPixel == 1) {
-                                        printf("* Converting BITMAP to BITMAPINFOHEADER\n");
-
-                                        /* reseek file pointer, bitmap bits immediately follow bmphdr2x */
-                                        lseek(src_fd,foff+sizeof(*bmphdr2x),SEEK_SET);
-
-                                        pre.idReserved = 0;
-                                        pre.idType = 1;
-                                        pre.idCount = 1;
-                                        write(fd,&pre,sizeof(pre));
-
-                                        dent.bWidth = bmphdr2x->bmWidth;
-                                        dent.bHeight = bmphdr2x->bmHeight;
-                                        dent.bColorCount = 1 << bmphdr2x->bmBitsPixel;
-                                        dent.bReserved = 0;
-                                        dent.wPlanes = bmphdr2x->bmPlanes;
-                                        dent.wBitCount = bmphdr2x->bmBitsPixel;
-                                        dent.dwBytesInRes = sizeof(bmphdr3x) + (4UL << (unsigned long)bmphdr2x->bmBitsPixel) +
-                                            (align3x * abs(bmphdr2x->bmHeight)) + (align3xmono * abs(bmphdr2x->bmHeight)); // icon + mask
-                                        dent.dwImageOffset = sizeof(pre) + sizeof(dent);
-                                        write(fd,&dent,sizeof(dent));
-
-                                        /* BITMAPINFOHEADER */
-                                        bmphdr3x.biSize = sizeof(bmphdr3x);
-                                        bmphdr3x.biWidth = bmphdr2x->bmWidth;
-                                        bmphdr3x.biHeight = bmphdr2x->bmHeight * 2; // icon + mask
-                                        bmphdr3x.biPlanes = bmphdr2x->bmPlanes;
-                                        bmphdr3x.biBitCount = bmphdr2x->bmBitsPixel;
-                                        bmphdr3x.biCompression = 0;
-                                        bmphdr3x.biSizeImage = (align3x * abs(bmphdr2x->bmHeight)) +
-                                            (align3xmono * abs(bmphdr2x->bmHeight)); // icon + mask
-                                        bmphdr3x.biXPelsPerMeter = 0;
-                                        bmphdr3x.biYPelsPerMeter = 0;
-                                        bmphdr3x.biClrUsed = 0;
-                                        bmphdr3x.biClrImportant = 0;
-                                        write(fd,&bmphdr3x,sizeof(bmphdr3x));
-
-                                        /* color palette */
-                                        if (bmphdr2x->bmBitsPixel == 1) {
-                                            {
-                                                rgb.rgbRed = 0x00; rgb.rgbGreen = 0x00; rgb.rgbBlue = 0x00; rgb.rgbReserved = 0x00;
-                                                write(fd,&rgb,sizeof(rgb));
-                                            }
-                                            {
-                                                rgb.rgbRed = 0xFF; rgb.rgbGreen = 0xFF; rgb.rgbBlue = 0xFF; rgb.rgbReserved = 0x00;
-                                                write(fd,&rgb,sizeof(rgb));
-                                            }
-                                        }
-                                        else {
-                                            /* I'll add 4bpp generation when I see it in the wild */
-                                            printf("! Cannot guess palette\n");
-                                        }
-
-                                        /* NTS: Where Windows 3.x stores the image first, followed by the mask,
-                                         *      Windows 1.x/2.x store the mask first, then the image. Like bitmaps
-                                         *      in Windows 1.x/2.x the DIB is top-down, we convert here to bottom-up. */
-                                        {
-                                            size_t ird = bmphdr2x->bmWidthBytes;
-                                            size_t mrd = ((bmphdr2x->bmWidth + 15) & (~15)) >> 3; /* WORD align requirement */
-                                            size_t iwd = align3x;
-                                            size_t mwd = align3xmono;
-                                            size_t ibufl = (ird > iwd) ? ird : iwd;
-                                            size_t mbufl = (mrd > mwd) ? mrd : mwd;
-                                            unsigned char *img = malloc(ibufl * bmphdr2x->bmHeight);
-                                            unsigned char *msk = malloc(mbufl * bmphdr2x->bmHeight);
-                                            unsigned int y;
-
-                                            /* load */
-                                            for (y=0;y < (unsigned int)abs(bmphdr2x->bmHeight);y++)
-                                                read(src_fd,msk + ((abs(bmphdr2x->bmHeight) - 1 - y) * mbufl),mrd);
-                                            for (y=0;y < (unsigned int)abs(bmphdr2x->bmHeight);y++)
-                                                read(src_fd,img + ((abs(bmphdr2x->bmHeight) - 1 - y) * ibufl),ird);
-
-                                            /* write */
-                                            for (y=0;y < (unsigned int)abs(bmphdr2x->bmHeight);y++)
-                                                write(fd,img + (y * ibufl),iwd);
-                                            for (y=0;y < (unsigned int)abs(bmphdr2x->bmHeight);y++)
-                                                write(fd,msk + (y * mbufl),mwd);
-
-                                            free(img);
-                                            free(msk);
-                                        }
-
-                                        /* DONE */
-                                        break;
-                                    }
-                                    else {
-                                        printf("! Cannot convert BITMAP to BITMAPINFOHEADER, unknown format\n");
-                                    }
-                                }
-                                else {
-                                    struct exe_ne_header_resource_ICONDIR pre;
-                                    struct exe_ne_header_resource_ICONDIRENTRY dent;
-                                    struct exe_ne_header_BITMAPINFOHEADER *bmp =
-                                        (struct exe_ne_header_BITMAPINFOHEADER*)tmp;
-
-                                    pre.idReserved = 0;
-                                    pre.idType = 1;
-                                    pre.idCount = 1;
-                                    write(fd,&pre,sizeof(pre));
-
-                                    dent.bWidth = bmp->biWidth;
-                                    dent.bHeight = bmp->biHeight >> 1;      /* remember icons carry image + mask and dwHeight is double the actual height */
-                                    dent.bColorCount = 1 << bmp->biBitCount;
-                                    dent.bReserved = 0;
-                                    dent.wPlanes = bmp->biPlanes;
-                                    dent.wBitCount = bmp->biBitCount;
-                                    dent.dwBytesInRes = fcpy;
-                                    dent.dwImageOffset = sizeof(pre) + sizeof(dent);
-                                    write(fd,&dent,sizeof(dent));
-                                }
-                            }
-                            else if (tinfo->rtTypeID == exe_ne_header_RT_CURSOR) {
-                                /* raw resource data for a cursor when in an NE executable:
-                                 *
-                                 * WORD                 hotspot_x
-                                 * WORD                 hotspot_y
-                                 * BITMAPINFOHEADER     cursor bitmapinfo
-                                 * RGBQUAD              cursor palette
-                                 * BYTE[]               cursor bitmap
-                                 *
-                                 */
-                                if (exe_ne_header_is_WINOLDCURSOR((const unsigned char*)tmp,docpy)) {
-                                    /* then it is necessary to convert, not just copy, because
-                                     * the alignment rules are different:
-                                     *
-                                     * Windows 1.x/2.x BITMAP:          Requires WORD alignment, DIBs are top-down
-                                     * Windows 3.x BITMAPINFOHEADER:    Requires DWORD alignment, DIBs are bottom-up */
-                                    struct exe_ne_header_resource_CURSORDIR pre;
-                                    struct exe_ne_header_resource_CURSORDIRENTRY dent;
-                                    struct exe_ne_header_BITMAPINFOHEADER bmphdr3x;
-                                    struct exe_ne_header_RTCURSORBITMAP *bmphdr2x =
-                                        (struct exe_ne_header_RTCURSORBITMAP *)tmp;
-                                    struct exe_ne_header_RGBQUAD rgb;
-                                    unsigned int align3xmono;
-                                    unsigned int align3x;
-
-                                    /* Windows 1.x/2.x icons for whatever reason have bits/pixel == 0 and planes == 0,
-                                     * which apparently means monochromatic anyway */
-                                    if (bmphdr2x->bmPlanes == 0)
-                                        bmphdr2x->bmPlanes = 1;
-                                    if (bmphdr2x->bmBitsPixel == 0)
-                                        bmphdr2x->bmBitsPixel = 1;
-
-                                    align3x = (((bmphdr2x->bmBitsPixel * bmphdr2x->bmWidth) + 31) & (~31)) >> 3; // BITMAPINFOHEADER alignment
-                                    align3xmono = ((bmphdr2x->bmWidth + 31) & (~31)) >> 3; // BITMAPINFOHEADER alignment
-                                    if (bmphdr2x->bmPlanes == 1 && bmphdr2x->bmBitsPixel == 1) {
-                                        printf("* Converting BITMAP to BITMAPINFOHEADER\n");
-
-                                        /* reseek file pointer, bitmap bits immediately follow bmphdr2x */
-                                        lseek(src_fd,foff+sizeof(*bmphdr2x),SEEK_SET);
-
-                                        pre.cdReserved = 0;
-                                        pre.cdType = 1;
-                                        pre.cdCount = 1;
-                                        write(fd,&pre,sizeof(pre));
-
-                                        dent.bWidth = bmphdr2x->bmWidth;
-                                        dent.bHeight = bmphdr2x->bmHeight;
-                                        dent.bColorCount = 1 << bmphdr2x->bmBitsPixel;
-                                        dent.bReserved = 0;
-                                        dent.wXHotspot = 0;
-                                        dent.wYHotspot = 0;
-                                        dent.bColorCount = 0;
-                                        dent.dwBytesInRes = sizeof(bmphdr3x) + (4UL << (unsigned long)bmphdr2x->bmBitsPixel) +
-                                            (align3x * abs(bmphdr2x->bmHeight)) + (align3xmono * abs(bmphdr2x->bmHeight)); // icon + mask
-                                        dent.dwImageOffset = sizeof(pre) + sizeof(dent);
-                                        write(fd,&dent,sizeof(dent));
-
-                                        /* BITMAPINFOHEADER */
-                                        bmphdr3x.biSize = sizeof(bmphdr3x);
-                                        bmphdr3x.biWidth = bmphdr2x->bmWidth;
-                                        bmphdr3x.biHeight = bmphdr2x->bmHeight * 2; // icon + mask
-                                        bmphdr3x.biPlanes = bmphdr2x->bmPlanes;
-                                        bmphdr3x.biBitCount = bmphdr2x->bmBitsPixel;
-                                        bmphdr3x.biCompression = 0;
-                                        bmphdr3x.biSizeImage = (align3x * abs(bmphdr2x->bmHeight)) +
-                                            (align3xmono * abs(bmphdr2x->bmHeight)); // icon + mask
-                                        bmphdr3x.biXPelsPerMeter = 0;
-                                        bmphdr3x.biYPelsPerMeter = 0;
-                                        bmphdr3x.biClrUsed = 0;
-                                        bmphdr3x.biClrImportant = 0;
-                                        write(fd,&bmphdr3x,sizeof(bmphdr3x));
-
-                                        /* color palette */
-                                        if (bmphdr2x->bmBitsPixel == 1) {
-                                            {
-                                                rgb.rgbRed = 0x00; rgb.rgbGreen = 0x00; rgb.rgbBlue = 0x00; rgb.rgbReserved = 0x00;
-                                                write(fd,&rgb,sizeof(rgb));
-                                            }
-                                            {
-                                                rgb.rgbRed = 0xFF; rgb.rgbGreen = 0xFF; rgb.rgbBlue = 0xFF; rgb.rgbReserved = 0x00;
-                                                write(fd,&rgb,sizeof(rgb));
-                                            }
-                                        }
-                                        else {
-                                            /* I'll add 4bpp generation when I see it in the wild */
-                                            printf("! Cannot guess palette\n");
-                                        }
-
-                                        /* NTS: Where Windows 3.x stores the image first, followed by the mask,
-                                         *      Windows 1.x/2.x store the mask first, then the image. Like bitmaps
-                                         *      in Windows 1.x/2.x the DIB is top-down, we convert here to bottom-up. */
-                                        {
-                                            size_t ird = bmphdr2x->bmWidthBytes;
-                                            size_t mrd = ((bmphdr2x->bmWidth + 15) & (~15)) >> 3; /* WORD align requirement */
-                                            size_t iwd = align3x;
-                                            size_t mwd = align3xmono;
-                                            size_t ibufl = (ird > iwd) ? ird : iwd;
-                                            size_t mbufl = (mrd > mwd) ? mrd : mwd;
-                                            unsigned char *img = malloc(ibufl * bmphdr2x->bmHeight);
-                                            unsigned char *msk = malloc(mbufl * bmphdr2x->bmHeight);
-                                            unsigned int y;
-
-                                            /* load */
-                                            for (y=0;y < (unsigned int)abs(bmphdr2x->bmHeight);y++)
-                                                read(src_fd,msk + ((abs(bmphdr2x->bmHeight) - 1 - y) * mbufl),mrd);
-                                            for (y=0;y < (unsigned int)abs(bmphdr2x->bmHeight);y++)
-                                                read(src_fd,img + ((abs(bmphdr2x->bmHeight) - 1 - y) * ibufl),ird);
-
-                                            /* write */
-                                            for (y=0;y < (unsigned int)abs(bmphdr2x->bmHeight);y++)
-                                                write(fd,img + (y * ibufl),iwd);
-                                            for (y=0;y < (unsigned int)abs(bmphdr2x->bmHeight);y++)
-                                                write(fd,msk + (y * mbufl),mwd);
-
-                                            free(img);
-                                            free(msk);
-                                        }
-
-                                        /* DONE */
-                                        break;
-                                    }
-                                    else {
-                                        printf("! Cannot convert BITMAP to BITMAPINFOHEADER, unknown format\n");
-                                    }
-                                }
-                                else {
-                                    struct exe_ne_header_resource_CURSORDIR pre;
-                                    struct exe_ne_header_resource_CURSORDIRENTRY dent;
-                                    struct exe_ne_header_BITMAPINFOHEADER *bmp =
-                                        (struct exe_ne_header_BITMAPINFOHEADER*)(tmp + 4);
-
-                                    pre.cdReserved = 0;
-                                    pre.cdType = 2;
-                                    pre.cdCount = 1;
-                                    write(fd,&pre,sizeof(pre));
-
-                                    dent.bWidth = bmp->biWidth;
-                                    dent.bHeight = bmp->biHeight >> 1;      /* remember cursors carry image + mask and dwHeight is double the actual height */
-                                    dent.bColorCount = 1 << bmp->biBitCount;
-                                    dent.bReserved = 0;
-                                    dent.wXHotspot = *((uint16_t*)(tmp + 0));
-                                    dent.wYHotspot = *((uint16_t*)(tmp + 2));
-                                    dent.dwBytesInRes = fcpy - 4;
-                                    dent.dwImageOffset = sizeof(pre) + sizeof(dent);
-                                    write(fd,&dent,sizeof(dent));
-
-                                    if (rd >= 4) {
-                                        rd -= 4;
-                                        fcpy -= 4;
-                                        docpy -= 4;
-                                        memmove(tmp,tmp+4,rd);
-                                    }
-                                }
-                            }
-                        }
-
-                        write(fd,tmp,rd);
-                        fcpy -= rd;
-                        fcnt += rd;
-                    }
+                /* WAIT: If this is an RT_BITMAP, RT_ICON or RT_CURSOR, prepend a header to make it a valid file */
+                if (opt_pric && (tinfo->rtTypeID == exe_ne_header_RT_BITMAP ||
+                    tinfo->rtTypeID == exe_ne_header_RT_ICON || tinfo->rtTypeID == exe_ne_header_RT_CURSOR)) {
+                    unsigned char *buf;
+                    size_t len = 0;
 
-                    if (rd < docpy) {
-                        fprintf(stderr,"Early EOF on resource\n");
-                        break;
+                    if ((buf=load_resource(fcpy,&len)) != NULL) {
+                        write_resource_pric(fd,tinfo->rtTypeID,buf,len);
+                        free(buf);
                     }
+                    else {
+                        copy_resource_raw(fd,fcpy);
+                    }
+                }
+                else {
+                    copy_resource_raw(fd,fcpy);
                 }
 
                 close(fd);
@@ -0,0 +1,202 @@
+
+#include <assert.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <fcntl.h>
+
+#include <hw/dos/exehdr.h>
+#include <hw/dos/exenehdr.h>
+#include <hw/dos/exenepar.h>
+
+void exe_ne_header_resource_extent_list_init(struct exe_ne_header_resource_extent_list * const l) {
+    memset(l,0,sizeof(*l));
+}
+
+void exe_ne_header_resource_extent_list_free(struct exe_ne_header_resource_extent_list * const l) {
+    if (l->table) free(l->table);
+    l->table = NULL;
+    l->length = 0;
+}
+
+static int exe_ne_header_resource_extent_qsort_cb(const void *a,const void *b) {
+    const struct exe_ne_header_resource_extent *ea = (const struct exe_ne_header_resource_extent*)a;
+    const struct exe_ne_header_resource_extent *eb = (const struct exe_ne_header_resource_extent*)b;
+
+    if (ea->file_offset < eb->file_offset)
+        return -1;
+    else if (ea->file_offset > eb->file_offset)
+        return 1;
+
+    /* keep resource table order for resources at the same offset */
+    if (ea->typeinfo_index < eb->typeinfo_index)
+        return -1;
+    else if (ea->typeinfo_index > eb->typeinfo_index)
+        return 1;
+
+    if (ea->nameinfo_index < eb->nameinfo_index)
+        return -1;
+    else if (ea->nameinfo_index > eb->nameinfo_index)
+        return 1;
+
+    return 0;
+}
+
+/* collect every resource in the resource table into a list sorted by file offset */
+int exe_ne_header_resource_extent_list_build(struct exe_ne_header_resource_extent_list * const l,const struct exe_ne_header_resource_table_t * const t) {
+    const struct exe_ne_header_resource_table_nameinfo *ninfo;
+    const struct exe_ne_header_resource_table_typeinfo *tinfo;
+    const unsigned int shift = exe_ne_header_resource_table_get_shift(t);
+    unsigned long count = 0;
+    unsigned int ti,ni;
+
+    exe_ne_header_resource_extent_list_free(l);
+
+    for (ti=0;ti < t->typeinfo_length;ti++) {
+        tinfo = exe_ne_header_resource_table_get_typeinfo_entry(t,ti);
+        if (tinfo == NULL) continue;
+        count += tinfo->rtResourceCount;
+    }
+
+    if (count == 0)
+        return 0;
+    if (count > (unsigned long)(((size_t)(~0UL)) / sizeof(*(l->table))))
+        return -1;
+
+    l->table = (struct exe_ne_header_resource_extent*)malloc((size_t)count * sizeof(*(l->table)));
+    if (l->table == NULL)
+        return -1;
+
+    for (ti=0;ti < t->typeinfo_length;ti++) {
+        tinfo = exe_ne_header_resource_table_get_typeinfo_entry(t,ti);
+        if (tinfo == NULL) continue;
+
+        for (ni=0;ni < tinfo->rtResourceCount && l->length < count;ni++) {
+            struct exe_ne_header_resource_extent *e;
+
+            ninfo = exe_ne_header_resource_table_get_typeinfo_nameinfo_entry(tinfo,ni);
+            if (ninfo == NULL) continue;
+
+            e = l->table + (l->length++);
+            e->file_offset = (uint32_t)ninfo->rnOffset << (uint32_t)shift;
+            e->length = (uint32_t)ninfo->rnLength << (uint32_t)shift;
+            e->rtTypeID = tinfo->rtTypeID;
+            e->rnID = ninfo->rnID;
+            e->typeinfo_index = (uint16_t)ti;
+            e->nameinfo_index = (uint16_t)ni;
+        }
+    }
+
+    if (l->length > 1)
+        qsort(l->table,l->length,sizeof(*(l->table)),exe_ne_header_resource_extent_qsort_cb);
+
+    return 0;
+}
+
+/* Read every resource in the (sorted) extent list, in file order, coalescing resources that are
+ * adjacent or separated by no more than EXE_NE_HEADER_RESOURCE_EXTENT_MAX_GAP bytes into one
+ * read of up to batch_size bytes. The callback is called once per resource with a pointer into
+ * the batch buffer, which is only valid during the callback. If a resource is too large to hold
+ * in memory, the callback is given data == NULL so the caller can handle it another way.
+ * If the file ends early, the callback is given the bytes that were available.
+ *
+ * Returns 0 on success, -1 on error, or the callback's return value if it returned nonzero. */
+int exe_ne_header_resource_extent_list_read(const struct exe_ne_header_resource_extent_list * const l,const int fd,size_t batch_size,exe_ne_header_resource_extent_cb cb,void *user) {
+    unsigned char *buf = NULL;
+    unsigned long pos = ~0UL;
+    size_t buf_alloc = 0;
+    unsigned int i = 0,j;
+    int ret = 0;
+
+    if (l->table == NULL || l->length == 0)
+        return 0;
+    if (batch_size < 4096)
+        batch_size = 4096;
+
+    while (i < l->length) {
+        const unsigned long start = l->table[i].file_offset;
+        unsigned long end = start + l->table[i].length;
+        unsigned long avail = 0;
+        size_t want;
+
+        /* extend the batch over following resources while they are close and the batch fits */
+        for (j=i+1;j < l->length;j++) {
+            const struct exe_ne_header_resource_extent *e = l->table + j;
+            unsigned long eend = (unsigned long)e->file_offset + e->length;
+
+            if (e->file_offset > (end + EXE_NE_HEADER_RESOURCE_EXTENT_MAX_GAP))
+                break;
+            if (eend < end)
+                eend = end;
+            if ((eend - start) > (unsigned long)batch_size)
+                break;
+
+            end = eend;
+        }
+
+#if TARGET_MSDOS == 16
+        if ((end - start) > 0xFFF0UL) {
+            /* too large for a 16-bit build to hold in memory */
+            for (;i < j && ret == 0;i++) ret = cb(l->table + i,NULL,0,user);
+            if (ret != 0) break;
+            pos = ~0UL; /* the callback may have moved the file pointer */
+            continue;
+        }
+#endif
+
+        want = (size_t)(end - start);
+        if (want > buf_alloc) {
+            unsigned char *nb = (unsigned char*)realloc(buf,want);
+
+            if (nb == NULL) {
+                /* cannot hold it in memory, let the caller stream it */
+                for (;i < j && ret == 0;i++) ret = cb(l->table + i,NULL,0,user);
+                if (ret != 0) break;
+                pos = ~0UL; /* the callback may have moved the file pointer */
+                continue;
+            }
+
+            buf = nb;
+            buf_alloc = want;
+        }
+
+        /* only seek if the previous batch did not leave us here */
+        if (pos != start) {
+            if ((unsigned long)lseek(fd,(off_t)start,SEEK_SET) != start) {
+                ret = -1;
+                break;
+            }
+            pos = start;
+        }
+
+        while (avail < (unsigned long)want) {
+            int rd = read(fd,buf + (size_t)avail,(unsigned int)(want - (size_t)avail));
+            if (rd <= 0) break;
+            avail += (unsigned long)rd;
+        }
+        pos = start + avail;
+
+        for (;i < j;i++) {
+            const struct exe_ne_header_resource_extent *e = l->table + i;
+            const unsigned long o = e->file_offset - start;
+            unsigned long len = e->length;
+
+            if (o >= avail)
+                len = 0;
+            else if ((o + len) > avail)
+                len = avail - o;
+
+            ret = cb(e,buf + (size_t)o,(size_t)len,user);
+            if (ret != 0) break;
+        }
+
+        if (ret != 0) break;
+    }
+
+    if (buf) free(buf);
+    return ret;
+}
+
@@ -0,0 +1,423 @@
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "dasmdb.h"
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+static uint64_t dasm_db_align(uint64_t x) {
+    return (x + 7u) & ~((uint64_t)7u);
+}
+
+int dasm_db_hash_fd(int fd,uint64_t *hash,uint64_t *size) {
+    const size_t bufsz = 64u * 1024u;
+    uint64_t h = 0xCBF29CE484222325ULL;
+    unsigned char *buf;
+    uint64_t total = 0;
+    uint64_t w;
+    size_t i;
+    int rd;
+
+    if (lseek(fd,0,SEEK_SET) != 0)
+        return -1;
+
+    buf = malloc(bufsz);
+    if (buf == NULL)
+        return -1;
+
+    /* 64 bits at a time. only a short read at the end of the file leaves a partial word */
+    while ((rd=read(fd,buf,bufsz)) > 0) {
+        for (i=0;(i+8u) <= (size_t)rd;i += 8u) {
+            memcpy(&w,buf+i,8);
+            h = (h ^ w) * 0x100000001B3ULL;
+            h ^= h >> 29u;
+        }
+        for (;i < (size_t)rd;i++) {
+            h = (h ^ buf[i]) * 0x100000001B3ULL;
+            h ^= h >> 29u;
+        }
+
+        total += (uint64_t)rd;
+    }
+
+    free(buf);
+    if (rd < 0)
+        return -1;
+
+    *hash = h ^ total;
+    *size = total;
+    return 0;
+}
+
+void dasm_db_close(struct dasm_db *db) {
+    if (db->base != NULL)
+        munmap(db->base,db->size);
+
+    memset(db,0,sizeof(*db));
+}
+
+/* is [ofs, ofs+count*sz) within the file? */
+static int dasm_db_in_file(const struct dasm_db *db,uint64_t ofs,uint64_t count,uint64_t sz) {
+    if (ofs > (uint64_t)db->size || (ofs & 7u) != 0)
+        return 0;
+    if (count != 0 && sz != 0 && count > (((uint64_t)db->size - ofs) / sz))
+        return 0;
+
+    return 1;
+}
+
+/* do the edges, blocks and relocations of a region make sense for it? restore and the listing trust them */
+static int dasm_db_region_ok(const struct dasm_db *db,const struct dasm_db_region *r) {
+    const struct dasm_db_edge *se = (const struct dasm_db_edge*)((const char*)db->base + r->edge);
+    const struct dasm_db_block *sb = (const struct dasm_db_block*)((const char*)db->base + r->block);
+    const struct dasm_reloc *sr = (const struct dasm_reloc*)((const char*)db->base + r->reloc);
+    uint32_t i;
+
+    for (i=0;i < r->edge_count;i++) {
+        if (se[i].from >= r->length || se[i].kind > DASM_EDGE_JUMP)
+            return 0;
+    }
+
+    for (i=0;i < r->block_count;i++) {
+        if (sb[i].start >= sb[i].end || sb[i].end > r->length || sb[i].flow > DASM_FLOW_STOP)
+            return 0;
+        if (sb[i].edge_first > r->edge_count || sb[i].edge_count > (r->edge_count - sb[i].edge_first))
+            return 0;
+    }
+
+    /* saved in sorted order, lookups depend on it */
+    for (i=1;i < r->reloc_count;i++) {
+        if (sr[i].addr < sr[i-1u].addr)
+            return 0;
+    }
+
+    return 1;
+}
+
+int dasm_db_open(struct dasm_db *db,const char *path,const struct dasm_db_key *key) {
+    const struct dasm_db_header *hdr;
+    struct stat st;
+    unsigned int i;
+    void *p;
+    int fd;
+
+    memset(db,0,sizeof(*db));
+
+    fd = open(path,O_RDONLY|O_BINARY);
+    if (fd < 0)
+        return -1;
+
+    if (fstat(fd,&st) || st.st_size < (off_t)sizeof(*hdr)) {
+        close(fd);
+        return -1;
+    }
+
+    p = mmap(NULL,(size_t)st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+    close(fd);
+    if (p == MAP_FAILED)
+        return -1;
+
+    db->base = p;
+    db->size = (size_t)st.st_size;
+    db->hdr = hdr = (const struct dasm_db_header*)p;
+
+    if (memcmp(hdr->magic,DASM_DB_MAGIC,8) || hdr->version != DASM_DB_VERSION ||
+        hdr->tool != key->tool || hdr->file_hash != key->hash || hdr->file_size != key->size)
+        goto fail;
+
+    if (!dasm_db_in_file(db,hdr->region_table,hdr->region_count,sizeof(struct dasm_db_region)) ||
+        !dasm_db_in_file(db,hdr->label_table,hdr->label_count,sizeof(struct dasm_db_label)) ||
+        !dasm_db_in_file(db,hdr->string_table,hdr->string_size,1))
+        goto fail;
+
+    db->region = (const struct dasm_db_region*)((const char*)p + hdr->region_table);
+    db->label = (const struct dasm_db_label*)((const char*)p + hdr->label_table);
+    db->strings = (const char*)p + hdr->string_table;
+
+    /* names must be NUL terminated within the string table */
+    if (hdr->string_size != 0 && db->strings[hdr->string_size-1u] != 0)
+        goto fail;
+
+    for (i=0;i < hdr->label_count;i++) {
+        if (db->label[i].name != DASM_DB_NO_NAME && (uint64_t)db->label[i].name >= hdr->string_size)
+            goto fail;
+    }
+
+    for (i=0;i < hdr->region_count;i++) {
+        const struct dasm_db_region *r = db->region + i;
+
+        if (r->length == 0)
+            continue;
+
+        if (!dasm_db_in_file(db,r->map,r->length,1) ||
+            !dasm_db_in_file(db,r->edge,r->edge_count,sizeof(struct dasm_db_edge)) ||
+            !dasm_db_in_file(db,r->block,r->block_count,sizeof(struct dasm_db_block)) ||
+            !dasm_db_in_file(db,r->reloc,r->reloc_count,sizeof(struct dasm_reloc)) ||
+            !dasm_db_region_ok(db,r))
+            goto fail;
+    }
+
+    return 0;
+fail:
+    dasm_db_close(db);
+    return -1;
+}
+
+const char *dasm_db_label_name(const struct dasm_db *db,const struct dasm_db_label *l) {
+    return (l->name != DASM_DB_NO_NAME) ? (db->strings + l->name) : NULL;
+}
+
+int dasm_db_restore(const struct dasm_db *db,unsigned int region,struct dasm_engine *e) {
+    const struct dasm_db_region *r;
+    const struct dasm_db_block *sb;
+    const struct dasm_db_edge *se;
+    size_t i;
+
+    if (db->base == NULL || region >= db->hdr->region_count)
+        return 0;
+
+    r = db->region + region;
+    if (r->length == 0)
+        return 0;
+    if (r->length != e->length || e->map == NULL)
+        return -1;
+
+    if (r->edge_count > e->edge_alloc) {
+        struct dasm_edge *np = realloc(e->edge,(size_t)r->edge_count * sizeof(*np));
+
+        if (np == NULL) return -1;
+        e->edge = np;
+        e->edge_alloc = r->edge_count;
+    }
+    if (r->block_count > e->block_alloc) {
+        struct dasm_block *np = realloc(e->block,(size_t)r->block_count * sizeof(*np));
+
+        if (np == NULL) return -1;
+        e->block = np;
+        e->block_alloc = r->block_count;
+    }
+
+    memcpy(e->map,(const char*)db->base + r->map,r->length);
+
+    se = (const struct dasm_db_edge*)((const char*)db->base + r->edge);
+    for (i=0;i < r->edge_count;i++) {
+        e->edge[i].from = se[i].from;
+        e->edge[i].to = se[i].to;
+        e->edge[i].kind = (uint8_t)se[i].kind;
+    }
+    e->edge_count = r->edge_count;
+
+    sb = (const struct dasm_db_block*)((const char*)db->base + r->block);
+    for (i=0;i < r->block_count;i++) {
+        e->block[i].start = sb[i].start;
+        e->block[i].end = sb[i].end;
+        e->block[i].edge_first = sb[i].edge_first;
+        e->block[i].edge_count = sb[i].edge_count;
+        e->block[i].flow = (uint8_t)sb[i].flow;
+    }
+    e->block_count = r->block_count;
+
+    e->walked = r->insn_count;
+    return 1;
+}
+
+int dasm_db_restore_relocs(const struct dasm_db *db,unsigned int region,struct dasm_reloc_map *m) {
+    const struct dasm_db_region *r;
+    const struct dasm_reloc *sr;
+    size_t i;
+
+    if (db->base == NULL || region >= db->hdr->region_count)
+        return 0;
+
+    r = db->region + region;
+    if (r->length == 0)
+        return 0;
+
+    /* saved in sorted order */
+    sr = (const struct dasm_reloc*)((const char*)db->base + r->reloc);
+    for (i=0;i < r->reloc_count;i++) {
+        if (dasm_reloc_map_add(m,sr[i].addr,sr[i].table,sr[i].index))
+            return -1;
+    }
+
+    m->cursor = 0;
+    m->last = 0;
+    return 1;
+}
+
+static int dasm_db_pad(FILE *fp,uint64_t *pos) {
+    static const unsigned char zero[8] = {0};
+    const uint64_t n = dasm_db_align(*pos) - *pos;
+
+    if (n != 0 && fwrite(zero,(size_t)n,1,fp) != 1)
+        return -1;
+
+    *pos += n;
+    return 0;
+}
+
+static int dasm_db_write(FILE *fp,uint64_t *pos,const void *p,size_t len) {
+    if (len != 0 && fwrite(p,len,1,fp) != 1)
+        return -1;
+
+    *pos += len;
+    return dasm_db_pad(fp,pos);
+}
+
+int dasm_db_save(const char *path,const struct dasm_db_key *key,
+    const struct dasm_db_region_in *region,unsigned int region_count,
+    const struct dasm_db_label_in *label,size_t label_count) {
+    struct dasm_db_region *rt = NULL;
+    struct dasm_db_label *lt = NULL;
+    struct dasm_db_header hdr;
+    char *tmp = NULL;
+    FILE *fp = NULL;
+    uint64_t pos,o;
+    unsigned int i;
+    size_t j;
+
+    if (label_count > (size_t)0xFFFFFFFEUL)
+        return -1;
+
+    rt = calloc(region_count != 0 ? region_count : 1,sizeof(*rt));
+    lt = calloc(label_count != 0 ? label_count : 1,sizeof(*lt));
+    tmp = malloc(strlen(path) + 5);
+    if (rt == NULL || lt == NULL || tmp == NULL)
+        goto fail;
+
+    sprintf(tmp,"%s.tmp",path);
+
+    /* lay the file out */
+    memset(&hdr,0,sizeof(hdr));
+    memcpy(hdr.magic,DASM_DB_MAGIC,8);
+    hdr.version = DASM_DB_VERSION;
+    hdr.tool = key->tool;
+    hdr.file_hash = key->hash;
+    hdr.file_size = key->size;
+    hdr.region_count = region_count;
+    hdr.label_count = (uint32_t)label_count;
+    hdr.region_table = dasm_db_align(sizeof(hdr));
+    hdr.label_table = dasm_db_align(hdr.region_table + ((uint64_t)region_count * sizeof(*rt)));
+    hdr.string_table = dasm_db_align(hdr.label_table + ((uint64_t)label_count * sizeof(*lt)));
+
+    o = 0;
+    for (j=0;j < label_count;j++) {
+        lt[j].seg = label[j].seg;
+        lt[j].ofs = label[j].ofs;
+        if (label[j].name != NULL) {
+            lt[j].name = (uint32_t)o;
+            o += strlen(label[j].name) + 1u;
+            if (o > (uint64_t)0xFFFFFFFEUL) goto fail;
+        }
+        else {
+            lt[j].name = DASM_DB_NO_NAME;
+        }
+    }
+    hdr.string_size = o;
+
+    o = dasm_db_align(hdr.string_table + hdr.string_size);
+    for (i=0;i < region_count;i++) {
+        const struct dasm_engine *e = region[i].eng;
+        struct dasm_db_region *r = rt + i;
+
+        if (e == NULL || e->map == NULL || e->length == 0)
+            continue;
+
+        r->length = e->length;
+        r->insn_count = (uint32_t)e->walked;
+        r->edge_count = (uint32_t)e->edge_count;
+        r->block_count = (uint32_t)e->block_count;
+        r->reloc_count = (region[i].reloc != NULL) ? (uint32_t)region[i].reloc->count : 0u;
+        r->map = o;     o = dasm_db_align(o + r->length);
+        r->edge = o;    o = dasm_db_align(o + ((uint64_t)r->edge_count * sizeof(struct dasm_db_edge)));
+        r->block = o;   o = dasm_db_align(o + ((uint64_t)r->block_count * sizeof(struct dasm_db_block)));
+        r->reloc = o;   o = dasm_db_align(o + ((uint64_t)r->reloc_count * sizeof(struct dasm_reloc)));
+    }
+
+    fp = fopen(tmp,"wb");
+    if (fp == NULL)
+        goto fail;
+
+    pos = 0;
+    if (dasm_db_write(fp,&pos,&hdr,sizeof(hdr)) ||
+        dasm_db_write(fp,&pos,rt,(size_t)region_count * sizeof(*rt)) ||
+        dasm_db_write(fp,&pos,lt,label_count * sizeof(*lt)))
+        goto fail;
+
+    for (j=0;j < label_count;j++) {
+        if (label[j].name != NULL && fwrite(label[j].name,strlen(label[j].name) + 1u,1,fp) != 1)
+            goto fail;
+    }
+    pos += hdr.string_size;
+    if (dasm_db_pad(fp,&pos))
+        goto fail;
+
+    for (i=0;i < region_count;i++) {
+        const struct dasm_engine *e = region[i].eng;
+        const struct dasm_db_region *r = rt + i;
+        struct dasm_db_block b;
+        struct dasm_db_edge d;
+
+        if (r->length == 0)
+            continue;
+
+        if (dasm_db_write(fp,&pos,e->map,r->length))
+            goto fail;
+
+        for (j=0;j < r->edge_count;j++) {
+            d.from = e->edge[j].from;
+            d.to = e->edge[j].to;
+            d.kind = e->edge[j].kind;
+            if (fwrite(&d,sizeof(d),1,fp) != 1) goto fail;
+        }
+        pos += (uint64_t)r->edge_count * sizeof(d);
+        if (dasm_db_pad(fp,&pos)) goto fail;
+
+        for (j=0;j < r->block_count;j++) {
+            b.start = e->block[j].start;
+            b.end = e->block[j].end;
+            b.edge_first = e->block[j].edge_first;
+            b.edge_count = e->block[j].edge_count;
+            b.flow = e->block[j].flow;
+            if (fwrite(&b,sizeof(b),1,fp) != 1) goto fail;
+        }
+        pos += (uint64_t)r->block_count * sizeof(b);
+        if (dasm_db_pad(fp,&pos)) goto fail;
+
+        if (r->reloc_count != 0 &&
+            dasm_db_write(fp,&pos,region[i].reloc->ent,(size_t)r->reloc_count * sizeof(struct dasm_reloc)))
+            goto fail;
+    }
+
+    if (fclose(fp)) {
+        fp = NULL;
+        goto fail;
+    }
+    fp = NULL;
+
+    if (rename(tmp,path))
+        goto fail;
+
+    free(tmp);
+    free(lt);
+    free(rt);
+    return 0;
+fail:
+    if (fp != NULL) {
+        fclose(fp);
+        remove(tmp);
+    }
+    if (tmp != NULL) free(tmp);
+    if (lt != NULL) free(lt);
+    if (rt != NULL) free(rt);
+    return -1;
+}
+
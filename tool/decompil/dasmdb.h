@@ -0,0 +1,129 @@
+
+#ifndef __DOSLIB_TOOL_DECOMPIL_DASMDB_H
+#define __DOSLIB_TOOL_DECOMPIL_DASMDB_H
+
+#include "dasmeng.h"
+
+/* Analysis database.
+ *
+ * What the first pass found for each region (the engine's per byte map, branch/call edges and basic
+ * blocks), the relocation map of each region and the labels made by the first pass are saved to a file,
+ * keyed by a hash of the file being disassembled. A later run on the same file maps the database into
+ * memory and restores the engines from it instead of walking the code again, so only the listing is
+ * made. Labels added since (-lf) that point at code not walked before are still walked.
+ *
+ * The file is a cache for the machine it was made on: numbers are in host byte order, and every
+ * table is 8-byte aligned so it can be used in place once mapped.
+ *
+ *   dasm_db_header
+ *   dasm_db_region[region_count]
+ *   dasm_db_label[label_count]
+ *   strings (label names, NUL terminated)
+ *   per region: map (length bytes), dasm_db_edge[], dasm_db_block[], dasm_reloc[] */
+
+#define DASM_DB_MAGIC                   "DASMDB\x1A\x01"
+#define DASM_DB_VERSION                 1u
+
+#define DASM_DB_NO_NAME                 0xFFFFFFFFUL
+
+/* what the database is for. tool is a four character code of the program writing it */
+struct dasm_db_key {
+    uint64_t                            hash;           /* of the whole file being disassembled */
+    uint64_t                            size;
+    uint32_t                            tool;
+};
+
+#define DASM_DB_TOOL(a,b,c,d)           ((uint32_t)(a) | ((uint32_t)(b) << 8u) | ((uint32_t)(c) << 16u) | ((uint32_t)(d) << 24u))
+
+struct dasm_db_header {
+    char                                magic[8];       /* DASM_DB_MAGIC */
+    uint32_t                            version;
+    uint32_t                            tool;
+    uint64_t                            file_hash;
+    uint64_t                            file_size;
+    uint32_t                            region_count;
+    uint32_t                            label_count;
+    uint64_t                            region_table;   /* file offsets */
+    uint64_t                            label_table;
+    uint64_t                            string_table;
+    uint64_t                            string_size;
+};
+
+struct dasm_db_region {
+    uint32_t                            length;         /* 0 if the region was not analysed */
+    uint32_t                            insn_count;     /* instructions walked */
+    uint32_t                            edge_count;
+    uint32_t                            block_count;
+    uint32_t                            reloc_count;
+    uint32_t                            _pad;
+    uint64_t                            map;            /* file offsets */
+    uint64_t                            edge;
+    uint64_t                            block;
+    uint64_t                            reloc;
+};
+
+struct dasm_db_edge {
+    uint32_t                            from;
+    uint32_t                            to;
+    uint32_t                            kind;
+};
+
+struct dasm_db_block {
+    uint32_t                            start;
+    uint32_t                            end;
+    uint32_t                            edge_first;
+    uint32_t                            edge_count;
+    uint32_t                            flow;
+};
+
+struct dasm_db_label {
+    uint32_t                            seg;
+    uint32_t                            ofs;
+    uint32_t                            name;           /* offset into the string table, or DASM_DB_NO_NAME */
+};
+
+/* an open (mapped) database */
+struct dasm_db {
+    void*                               base;
+    size_t                              size;
+    const struct dasm_db_header*        hdr;
+    const struct dasm_db_region*        region;
+    const struct dasm_db_label*         label;
+    const char*                         strings;
+};
+
+/* what to save */
+struct dasm_db_region_in {
+    const struct dasm_engine*           eng;            /* NULL if the region was not analysed */
+    const struct dasm_reloc_map*        reloc;          /* NULL if none */
+};
+
+struct dasm_db_label_in {
+    uint32_t                            seg;
+    uint32_t                            ofs;
+    const char*                         name;
+};
+
+/* hash the whole file, from the start. the file position is left at the end */
+int dasm_db_hash_fd(int fd,uint64_t *hash,uint64_t *size);
+
+/* returns 0 if the database exists, is intact and matches the key, -1 otherwise.
+ * intact means every table is within the file and every block and edge is within its region */
+int dasm_db_open(struct dasm_db *db,const char *path,const struct dasm_db_key *key);
+void dasm_db_close(struct dasm_db *db);
+
+const char *dasm_db_label_name(const struct dasm_db *db,const struct dasm_db_label *l);
+
+/* put the map, edges and blocks of a region back into an engine that was set up for it.
+ * returns 1 if restored, 0 if the database has nothing for the region, -1 if the region is not the
+ * same size as the engine or out of memory. on error the engine is left as it was */
+int dasm_db_restore(const struct dasm_db *db,unsigned int region,struct dasm_engine *e);
+int dasm_db_restore_relocs(const struct dasm_db *db,unsigned int region,struct dasm_reloc_map *m);
+
+/* write the database, through a temporary file renamed over path when complete */
+int dasm_db_save(const char *path,const struct dasm_db_key *key,
+    const struct dasm_db_region_in *region,unsigned int region_count,
+    const struct dasm_db_label_in *label,size_t label_count);
+
+#endif /* __DOSLIB_TOOL_DECOMPIL_DASMDB_H */
+
@@ -0,0 +1,779 @@
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "dasmeng.h"
+
+/* padding after the window, so the decoder and the copy into dasm_insn.bytes never run off the end */
+#define DASM_WINDOW_PADDING             64u
+
+void dasm_engine_init(struct dasm_engine *e) {
+    memset(e,0,sizeof(*e));
+    e->offset_mask = 0xFFFFFFFFUL;
+}
+
+void dasm_engine_free(struct dasm_engine *e) {
+    size_t i;
+
+    if (e->insn_chunk) {
+        for (i=0;i < e->insn_chunk_alloc;i++) {
+            if (e->insn_chunk[i]) free(e->insn_chunk[i]);
+        }
+        free(e->insn_chunk);
+        e->insn_chunk = NULL;
+    }
+    e->insn_chunk_alloc = 0;
+    e->insn_count = 0;
+
+    if (e->window) free(e->window);
+    e->window = NULL;
+    e->window_offset = 0;
+    e->window_length = 0;
+
+    if (e->index) free(e->index);
+    e->index = NULL;
+    if (e->map) free(e->map);
+    e->map = NULL;
+    if (e->work) free(e->work);
+    e->work = NULL;
+    e->work_count = e->work_alloc = 0;
+    if (e->edge) free(e->edge);
+    e->edge = NULL;
+    e->edge_count = e->edge_alloc = 0;
+    if (e->block) free(e->block);
+    e->block = NULL;
+    e->block_count = e->block_alloc = 0;
+}
+
+/* allocate the cache and maps for the region. length, read, and the other caller fields must be set. */
+int dasm_engine_setup(struct dasm_engine *e) {
+    const size_t n = (e->length != 0) ? (size_t)e->length : (size_t)1;
+
+    if (e->read == NULL && e->image == NULL)
+        return -1;
+
+    e->window = malloc(DASM_WINDOW_SIZE + DASM_WINDOW_PADDING);
+    e->index = calloc(n,sizeof(uint32_t));
+    e->map = calloc(n,1);
+    if (e->window == NULL || e->index == NULL || e->map == NULL) {
+        dasm_engine_free(e);
+        return -1;
+    }
+
+    e->window_offset = 0;
+    e->window_length = 0;
+    memset(e->window,0,DASM_WINDOW_SIZE + DASM_WINDOW_PADDING);
+    memset(&e->st,0,sizeof(e->st));
+    return 0;
+}
+
+/* in memory regions are used in place, except for the last few bytes which are copied to the window.
+ * that way there is always zero padding past the end of the region for the decoder to run into. */
+static const unsigned char *dasm_engine_fetch_image(struct dasm_engine *e,uint32_t offset,unsigned int *avail) {
+    *avail = (unsigned int)(e->length - offset);
+    if (*avail >= DASM_WINDOW_PADDING)
+        return e->image + offset;
+
+    if (e->window_length == 0 || (e->window_offset + e->window_length) != e->length) {
+        const uint32_t t = (e->length > DASM_WINDOW_PADDING) ? (e->length - DASM_WINDOW_PADDING) : 0;
+
+        e->window_offset = t;
+        e->window_length = e->length - t;
+        memcpy(e->window,e->image + t,e->window_length);
+        memset(e->window + e->window_length,0,(DASM_WINDOW_SIZE + DASM_WINDOW_PADDING) - (size_t)e->window_length);
+    }
+
+    return e->window + (offset - e->window_offset);
+}
+
+/* return a pointer to the region data at offset, with *avail set to how many bytes are valid from there.
+ * the window is refilled when less than an instruction's worth of bytes remain in it. */
+const unsigned char *dasm_engine_fetch(struct dasm_engine *e,uint32_t offset,unsigned int *avail) {
+    uint32_t wend = e->window_offset + e->window_length;
+
+    if (offset >= e->length)
+        return NULL;
+
+    if (e->image != NULL)
+        return dasm_engine_fetch_image(e,offset,avail);
+
+    if (offset < e->window_offset || offset >= wend ||
+        ((offset + DASM_INSN_MAX_BYTES) > wend && wend < e->length)) {
+        uint32_t want = e->length - offset;
+        int rd;
+
+        if (want > DASM_WINDOW_SIZE)
+            want = DASM_WINDOW_SIZE;
+
+        rd = e->read(e->user,offset,e->window,(unsigned int)want);
+        if (rd < 0) rd = 0;
+        if ((uint32_t)rd > want) rd = (int)want;
+
+        e->window_offset = offset;
+        e->window_length = (uint32_t)rd;
+        memset(e->window + rd,0,(DASM_WINDOW_SIZE + DASM_WINDOW_PADDING) - (size_t)rd);
+        wend = offset + (uint32_t)rd;
+
+        if (rd == 0)
+            return NULL;
+    }
+
+    *avail = (unsigned int)(wend - offset);
+    return e->window + (offset - e->window_offset);
+}
+
+static struct dasm_insn *dasm_engine_insn(struct dasm_engine *e,uint32_t n) {
+    return e->insn_chunk[n >> DASM_INSN_CHUNK_SHIFT] + (n & (DASM_INSN_CHUNK - 1u));
+}
+
+static struct dasm_insn *dasm_engine_new_insn(struct dasm_engine *e) {
+    const size_t c = e->insn_count >> DASM_INSN_CHUNK_SHIFT;
+
+    if (e->insn_count >= (size_t)0xFFFFFFFEUL)
+        return NULL;
+
+    if (c >= e->insn_chunk_alloc) {
+        const size_t na = e->insn_chunk_alloc + 64;
+        struct dasm_insn **np = realloc(e->insn_chunk,na * sizeof(*np));
+
+        if (np == NULL) return NULL;
+        memset(np + e->insn_chunk_alloc,0,(na - e->insn_chunk_alloc) * sizeof(*np));
+        e->insn_chunk = np;
+        e->insn_chunk_alloc = na;
+    }
+
+    if (e->insn_chunk[c] == NULL) {
+        e->insn_chunk[c] = malloc(DASM_INSN_CHUNK * sizeof(struct dasm_insn));
+        if (e->insn_chunk[c] == NULL) return NULL;
+    }
+
+    return dasm_engine_insn(e,(uint32_t)(e->insn_count++));
+}
+
+static void dasm_insn_classify(struct dasm_insn *ins) {
+    const struct minx86dec_instruction *i = &ins->i;
+
+    ins->flow = DASM_FLOW_NEXT;
+    ins->flags = 0;
+    ins->target_ip = 0;
+
+    if ((i->opcode == MXOP_JMP || i->opcode == MXOP_CALL || i->opcode == MXOP_JCXZ ||
+        (i->opcode >= MXOP_JO && i->opcode <= MXOP_JG)) && i->argc == 1 &&
+        i->argv[0].regtype == MX86_RT_IMM) {
+        ins->flags |= DASM_INSN_HAS_TARGET;
+        ins->target_ip = i->argv[0].value;
+
+        if (i->opcode == MXOP_JMP)
+            ins->flow = DASM_FLOW_JUMP;
+        else if (i->opcode == MXOP_CALL)
+            ins->flow = DASM_FLOW_CALL;
+        else
+            ins->flow = DASM_FLOW_BRANCH;
+    }
+    else if (i->opcode == MXOP_JMP || i->opcode == MXOP_JMP_FAR ||
+        i->opcode == MXOP_RET || i->opcode == MXOP_RETF) {
+        ins->flow = DASM_FLOW_STOP;
+    }
+}
+
+/* return the instruction at offset, decoded at the given instruction pointer.
+ * an offset is decoded once, later calls return the cached copy. If the same bytes are asked for
+ * at a different instruction pointer (the same code reached through another segment) the
+ * instruction is decoded again into a scratch copy that is only valid until the next call.
+ * Cached instructions stay valid until dasm_engine_free(). */
+const struct dasm_insn *dasm_engine_decode(struct dasm_engine *e,uint32_t offset,uint32_t ip) {
+    const unsigned char *p;
+    struct dasm_insn *ins;
+    unsigned int avail;
+    unsigned int extra;
+    uint32_t idx;
+
+    if (offset >= e->length || e->index == NULL)
+        return NULL;
+
+    idx = e->index[offset];
+    if (idx != 0) {
+        ins = dasm_engine_insn(e,idx - 1u);
+        if (ins->ip == ip) {
+            e->cache_hits++;
+            return ins;
+        }
+    }
+
+    p = dasm_engine_fetch(e,offset,&avail);
+    if (p == NULL)
+        return NULL;
+
+    if (idx == 0) {
+        ins = dasm_engine_new_insn(e);
+        if (ins != NULL)
+            e->index[offset] = (uint32_t)e->insn_count;
+        else
+            ins = &e->scratch;
+    }
+    else {
+        ins = &e->scratch;
+    }
+
+    e->st.data32 = e->st.addr32 = e->data32;
+    e->st.fence = (uint8_t*)p + avail;
+    if (e->image != NULL && avail >= DASM_WINDOW_PADDING)
+        e->st.prefetch_fence = (uint8_t*)p + avail - 16; /* in place, see dasm_engine_fetch_image() */
+    else
+        e->st.prefetch_fence = e->window + DASM_WINDOW_SIZE + DASM_WINDOW_PADDING - 16;
+    e->st.read_ip = (uint8_t*)p;
+    e->st.ip_value = ip;
+    minx86dec_init_instruction(&ins->i);
+    minx86dec_decodeall(&e->st,&ins->i);
+    e->decoded++;
+
+    assert(ins->i.end >= p);
+    ins->dlen = (uint8_t)((ins->i.end > p) ? (size_t)(ins->i.end - p) : (size_t)1);
+    if (ins->dlen > DASM_INSN_MAX_BYTES) ins->dlen = DASM_INSN_MAX_BYTES;
+    memcpy(ins->bytes,p,DASM_INSN_MAX_BYTES);
+    ins->i.start = ins->bytes;
+    ins->i.end = ins->bytes + ins->dlen;
+    ins->offset = offset;
+    ins->ip = ip;
+    ins->len = ins->dlen;
+    dasm_insn_classify(ins);
+
+    if (e->extra != NULL) {
+        extra = e->extra(e->user,ins);
+        if ((ins->dlen + extra) > DASM_INSN_MAX_BYTES)
+            extra = DASM_INSN_MAX_BYTES - ins->dlen;
+        ins->len = (uint8_t)(ins->dlen + extra);
+    }
+
+    return ins;
+}
+
+uint32_t dasm_insn_target_offset(const struct dasm_engine *e,const struct dasm_insn *ins) {
+    return (ins->offset + (ins->target_ip - ins->ip)) & e->offset_mask;
+}
+
+static int dasm_engine_add_edge(struct dasm_engine *e,uint32_t from,uint32_t to,uint8_t kind) {
+    struct dasm_edge *d;
+
+    if (e->edge_count >= e->edge_alloc) {
+        const size_t na = (e->edge_alloc != 0) ? (e->edge_alloc * 2) : 1024;
+        struct dasm_edge *np = realloc(e->edge,na * sizeof(*np));
+
+        if (np == NULL) return -1;
+        e->edge = np;
+        e->edge_alloc = na;
+    }
+
+    d = e->edge + (e->edge_count++);
+    d->from = from;
+    d->to = to;
+    d->kind = kind;
+    return 0;
+}
+
+/* add an entry point to the worklist. returns 1 if queued, 0 if already walked or queued
+ * (or outside the region), -1 if out of memory. */
+int dasm_engine_queue(struct dasm_engine *e,uint32_t offset,uint32_t ip) {
+    struct dasm_entry *w;
+
+    if (offset >= e->length || e->map == NULL)
+        return 0;
+
+    e->map[offset] |= DASM_MAP_LEADER;
+    if (e->map[offset] & DASM_MAP_SEEN)
+        return 0;
+
+    if (e->work_count >= e->work_alloc) {
+        const size_t na = (e->work_alloc != 0) ? (e->work_alloc * 2) : 256;
+        struct dasm_entry *np = realloc(e->work,na * sizeof(*np));
+
+        if (np == NULL) return -1;
+        e->work = np;
+        e->work_alloc = na;
+    }
+
+    e->map[offset] |= DASM_MAP_SEEN;
+    w = e->work + (e->work_count++);
+    w->offset = offset;
+    w->ip = ip;
+    return 1;
+}
+
+/* walk code from every queued entry point until the worklist is empty. Each path follows
+ * instructions until one does not continue, it reaches the end of the region, or it reaches code
+ * that was already walked. Branch and call targets within the region are queued as they are found. */
+int dasm_engine_run(struct dasm_engine *e,dasm_engine_walk_cb cb,void *user) {
+    const struct dasm_insn *ins;
+    struct dasm_entry ent;
+    unsigned int count;
+    uint32_t target;
+
+    while (e->work_count != 0) {
+        ent = e->work[--e->work_count];
+        count = 0;
+
+        do {
+            ins = dasm_engine_decode(e,ent.offset,ent.ip);
+            if (ins == NULL) break;
+
+            if (!(e->map[ent.offset] & DASM_MAP_INSN))
+                e->walked++;
+
+            e->map[ent.offset] |= DASM_MAP_SEEN | DASM_MAP_INSN;
+
+            if (cb != NULL && cb(e,ins,user) != 0)
+                break;
+
+            if (ins->flags & DASM_INSN_HAS_TARGET) {
+                target = dasm_insn_target_offset(e,ins);
+
+                if (dasm_engine_add_edge(e,ent.offset,target,
+                    ins->flow == DASM_FLOW_CALL ? DASM_EDGE_CALL :
+                    (ins->flow == DASM_FLOW_JUMP ? DASM_EDGE_JUMP : DASM_EDGE_BRANCH)) < 0)
+                    return -1;
+                if (dasm_engine_queue(e,target,ins->target_ip) < 0)
+                    return -1;
+            }
+
+            if (ins->flow == DASM_FLOW_JUMP || ins->flow == DASM_FLOW_STOP)
+                break;
+
+            ent.ip += ins->len;
+            ent.offset += ins->len;
+            if (ent.offset >= e->length)
+                break;
+
+            /* the instruction after a conditional branch starts a new basic block */
+            if (ins->flow == DASM_FLOW_BRANCH)
+                e->map[ent.offset] |= DASM_MAP_LEADER;
+
+            if (e->map[ent.offset] & DASM_MAP_SEEN)
+                break;
+            if (e->max_run != 0 && ++count >= e->max_run)
+                break;
+        } while (1);
+    }
+
+    return 0;
+}
+
+int dasm_engine_decode_walked(struct dasm_engine *e,uint32_t ip_base) {
+    uint32_t o;
+
+    if (e->map == NULL)
+        return 0;
+
+    for (o=0;o < e->length;o++) {
+        if ((e->map[o] & DASM_MAP_INSN) && e->index[o] == 0) {
+            if (dasm_engine_decode(e,o,ip_base + o) == NULL)
+                return -1;
+        }
+    }
+
+    return 0;
+}
+
+const struct dasm_insn *dasm_engine_walked_at(struct dasm_engine *e,uint32_t offset,uint32_t ip_base,uint32_t *back) {
+    const struct dasm_insn *ins;
+    uint32_t o;
+
+    if (e->map == NULL || offset >= e->length)
+        return NULL;
+
+    for (;*back < DASM_INSN_MAX_BYTES && *back <= offset;(*back)++) {
+        o = offset - *back;
+        if (!(e->map[o] & DASM_MAP_INSN))
+            continue;
+
+        if ((ins=dasm_engine_decode(e,o,ip_base + o)) == NULL)
+            return NULL;
+        if (*back < ins->len) {
+            (*back)++;
+            return ins;
+        }
+    }
+
+    return NULL;
+}
+
+static int dasm_edge_qsort_cb(const void *a,const void *b) {
+    const struct dasm_edge *ea = (const struct dasm_edge*)a;
+    const struct dasm_edge *eb = (const struct dasm_edge*)b;
+
+    if (ea->from < eb->from)
+        return -1;
+    else if (ea->from > eb->from)
+        return 1;
+
+    if (ea->to < eb->to)
+        return -1;
+    else if (ea->to > eb->to)
+        return 1;
+
+    return 0;
+}
+
+/* split the walked instructions into basic blocks. A block ends at a branch, jump or return, or
+ * where the next instruction begins another block. Edges are sorted by source offset so that each
+ * block's outgoing edges are a contiguous range of edge[]. Call once, after dasm_engine_run(). */
+int dasm_engine_build_blocks(struct dasm_engine *e) {
+    const struct dasm_insn *ins;
+    struct dasm_block *b;
+    uint32_t o,start,ei;
+
+    e->block_count = 0;
+    if (e->map == NULL)
+        return 0;
+
+    if (e->edge_count > 1)
+        qsort(e->edge,e->edge_count,sizeof(*(e->edge)),dasm_edge_qsort_cb);
+
+    o = 0;
+    ei = 0;
+    while (o < e->length) {
+        if (!(e->map[o] & DASM_MAP_INSN) || e->index[o] == 0) {
+            o++;
+            continue;
+        }
+
+        start = o;
+        do {
+            ins = dasm_engine_insn(e,e->index[o] - 1u);
+            o += ins->len;
+
+            if (ins->flow == DASM_FLOW_BRANCH || ins->flow == DASM_FLOW_JUMP || ins->flow == DASM_FLOW_STOP)
+                break;
+            if (o >= e->length || e->index[o] == 0)
+                break;
+            if ((e->map[o] & (DASM_MAP_INSN|DASM_MAP_LEADER)) != DASM_MAP_INSN)
+                break;
+        } while (1);
+
+        if (e->block_count >= e->block_alloc) {
+            const size_t na = (e->block_alloc != 0) ? (e->block_alloc * 2) : 1024;
+            struct dasm_block *np = realloc(e->block,na * sizeof(*np));
+
+            if (np == NULL) return -1;
+            e->block = np;
+            e->block_alloc = na;
+        }
+
+        b = e->block + (e->block_count++);
+        b->start = start;
+        b->end = o;
+        b->flow = ins->flow;
+
+        while (ei < e->edge_count && e->edge[ei].from < start)
+            ei++;
+        b->edge_first = ei;
+        while (ei < e->edge_count && e->edge[ei].from < o)
+            ei++;
+        b->edge_count = ei - b->edge_first;
+    }
+
+    return 0;
+}
+
+void dasm_label_index_init(struct dasm_label_index *x) {
+    memset(x,0,sizeof(*x));
+}
+
+void dasm_label_index_free(struct dasm_label_index *x) {
+    if (x->slot) free(x->slot);
+    x->slot = NULL;
+    x->slot_mask = 0;
+    x->used = 0;
+    x->indexed = 0;
+}
+
+void dasm_label_index_clear(struct dasm_label_index *x) {
+    if (x->slot) memset(x->slot,0,sizeof(*(x->slot)) * ((size_t)x->slot_mask + 1u));
+    x->used = 0;
+    x->indexed = 0;
+}
+
+static inline uint32_t dasm_label_hash(uint32_t seg,uint32_t ofs) {
+    uint32_t h = (ofs * 0x9E3779B1UL) ^ (seg * 0x85EBCA77UL);
+
+    return h ^ (h >> 15u);
+}
+
+static int dasm_label_index_grow(struct dasm_label_index *x) {
+    const uint32_t ncount = (x->slot != NULL) ? ((x->slot_mask + 1u) * 2u) : 1024u;
+    struct dasm_label_slot *ns;
+    uint32_t i,h;
+
+    if (ncount == 0u)
+        return -1;
+
+    ns = calloc(ncount,sizeof(*ns));
+    if (ns == NULL)
+        return -1;
+
+    if (x->slot != NULL) {
+        for (i=0;i <= x->slot_mask;i++) {
+            const struct dasm_label_slot *s = x->slot + i;
+
+            if (s->n == 0) continue;
+            h = dasm_label_hash(s->seg,s->ofs) & (ncount - 1u);
+            while (ns[h].n != 0) h = (h + 1u) & (ncount - 1u);
+            ns[h] = *s;
+        }
+
+        free(x->slot);
+    }
+
+    x->slot = ns;
+    x->slot_mask = ncount - 1u;
+    return 0;
+}
+
+int dasm_label_index_add(struct dasm_label_index *x,uint32_t seg,uint32_t ofs,uint32_t n) {
+    struct dasm_label_slot *s;
+    uint32_t h;
+
+    /* keep the table at most half full */
+    if (x->slot == NULL || (x->used + 1u) > ((x->slot_mask + 1u) / 2u)) {
+        if (dasm_label_index_grow(x))
+            return -1;
+    }
+
+    h = dasm_label_hash(seg,ofs) & x->slot_mask;
+    while ((s=x->slot+h)->n != 0) {
+        /* first label with this key wins, like the linear search it replaces */
+        if (s->seg == seg && s->ofs == ofs)
+            return 0;
+
+        h = (h + 1u) & x->slot_mask;
+    }
+
+    s->seg = seg;
+    s->ofs = ofs;
+    s->n = n + 1u;
+    x->used++;
+    return 0;
+}
+
+uint32_t dasm_label_index_find(const struct dasm_label_index *x,uint32_t seg,uint32_t ofs) {
+    const struct dasm_label_slot *s;
+    uint32_t h;
+
+    if (x->slot == NULL)
+        return DASM_LABEL_NONE;
+
+    h = dasm_label_hash(seg,ofs) & x->slot_mask;
+    while ((s=x->slot+h)->n != 0) {
+        if (s->seg == seg && s->ofs == ofs)
+            return s->n - 1u;
+
+        h = (h + 1u) & x->slot_mask;
+    }
+
+    return DASM_LABEL_NONE;
+}
+
+void dasm_reloc_map_init(struct dasm_reloc_map *m) {
+    memset(m,0,sizeof(*m));
+}
+
+void dasm_reloc_map_free(struct dasm_reloc_map *m) {
+    if (m->ent) free(m->ent);
+    memset(m,0,sizeof(*m));
+}
+
+int dasm_reloc_map_add(struct dasm_reloc_map *m,uint32_t addr,uint32_t table,uint32_t index) {
+    struct dasm_reloc *r;
+
+    if (m->count >= m->alloc) {
+        const size_t na = (m->alloc != 0) ? (m->alloc * 2u) : 256u;
+        struct dasm_reloc *np = realloc(m->ent,na * sizeof(*np));
+
+        if (np == NULL)
+            return -1;
+
+        m->ent = np;
+        m->alloc = na;
+    }
+
+    r = m->ent + (m->count++);
+    r->addr = addr;
+    r->table = table;
+    r->index = index;
+    return 0;
+}
+
+static int dasm_reloc_qsortcb(const void *a,const void *b) {
+    const struct dasm_reloc *ra = (const struct dasm_reloc*)a;
+    const struct dasm_reloc *rb = (const struct dasm_reloc*)b;
+
+    if (ra->addr != rb->addr)
+        return (ra->addr < rb->addr) ? -1 : 1;
+    if (ra->table != rb->table)
+        return (ra->table < rb->table) ? -1 : 1;
+    if (ra->index != rb->index)
+        return (ra->index < rb->index) ? -1 : 1;
+
+    return 0;
+}
+
+void dasm_reloc_map_sort(struct dasm_reloc_map *m) {
+    if (m->count > 1)
+        qsort(m->ent,m->count,sizeof(*(m->ent)),dasm_reloc_qsortcb);
+
+    m->cursor = 0;
+    m->last = 0;
+}
+
+/* first entry at or after addr within [lo, hi) */
+static size_t dasm_reloc_map_bsearch(const struct dasm_reloc_map *m,size_t lo,size_t hi,uint32_t addr) {
+    while (lo < hi) {
+        const size_t mid = lo + ((hi - lo) >> 1u);
+
+        if (m->ent[mid].addr < addr)
+            lo = mid + 1u;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+size_t dasm_reloc_map_seek(struct dasm_reloc_map *m,uint32_t addr) {
+    size_t c = m->cursor;
+
+    if (addr >= m->last) {
+        unsigned int steps = 0;
+
+        /* moving forward a few entries at a time, as the listing does */
+        while (c < m->count && m->ent[c].addr < addr) {
+            if (++steps > 8u) {
+                c = dasm_reloc_map_bsearch(m,c,m->count,addr);
+                break;
+            }
+            c++;
+        }
+    }
+    else {
+        c = dasm_reloc_map_bsearch(m,0,c,addr);
+    }
+
+    m->cursor = c;
+    m->last = addr;
+    return c;
+}
+
+const struct dasm_reloc *dasm_reloc_map_find(struct dasm_reloc_map *m,uint32_t addr,uint32_t len) {
+    const size_t c = dasm_reloc_map_seek(m,addr);
+
+    if (c < m->count && (m->ent[c].addr - addr) < len)
+        return m->ent + c;
+
+    return NULL;
+}
+
+struct dasm_jobs {
+    pthread_mutex_t                     lock;
+    size_t                              next;
+    size_t                              count;
+    dasm_job_cb                         cb;
+    void*                               user;
+    FILE**                              out;            /* per job, NULL to write straight to the caller's FILE */
+    FILE*                               final_out;
+};
+
+static void *dasm_job_thread(void *arg) {
+    struct dasm_jobs *j = (struct dasm_jobs*)arg;
+    size_t job;
+
+    for (;;) {
+        pthread_mutex_lock(&j->lock);
+        job = j->next++;
+        pthread_mutex_unlock(&j->lock);
+
+        if (job >= j->count)
+            break;
+
+        j->cb(job,j->out ? j->out[job] : j->final_out,j->user);
+    }
+
+    return NULL;
+}
+
+void dasm_run_jobs(size_t count,unsigned int threads,dasm_job_cb cb,void *user,FILE *out) {
+    pthread_t *tid = NULL;
+    unsigned int i,started = 0;
+    char **buf = NULL;
+    size_t *len = NULL;
+    struct dasm_jobs j;
+    size_t n;
+
+    memset(&j,0,sizeof(j));
+    pthread_mutex_init(&j.lock,NULL);
+    j.count = count;
+    j.cb = cb;
+    j.user = user;
+    j.final_out = out;
+
+    if (threads > count) threads = (unsigned int)count;
+
+    if (threads > 1) {
+        j.out = (FILE**)calloc(count,sizeof(FILE*));
+        buf = (char**)calloc(count,sizeof(char*));
+        len = (size_t*)calloc(count,sizeof(size_t));
+        tid = (pthread_t*)malloc(sizeof(pthread_t) * threads);
+
+        n = 0;
+        if (j.out != NULL && buf != NULL && len != NULL && tid != NULL) {
+            for (;n < count;n++) {
+                if ((j.out[n]=open_memstream(&buf[n],&len[n])) == NULL)
+                    break;
+            }
+        }
+
+        /* out of memory: do it all on this thread, straight to the caller's FILE */
+        if (n < count) {
+            while (n-- > 0) {
+                fclose(j.out[n]);
+                if (buf[n]) free(buf[n]);
+            }
+
+            if (j.out) free(j.out);
+            if (tid) free(tid);
+            j.out = NULL;
+            tid = NULL;
+        }
+    }
+
+    /* the calling thread works too, so start one less */
+    if (tid != NULL) {
+        for (i=0;i < (threads-1U);i++) {
+            if (pthread_create(&tid[i],NULL,dasm_job_thread,&j) != 0)
+                break;
+            started++;
+        }
+    }
+
+    dasm_job_thread(&j);
+
+    for (i=0;i < started;i++)
+        pthread_join(tid[i],NULL);
+
+    if (j.out != NULL) {
+        for (n=0;n < count;n++) {
+            fclose(j.out[n]);
+            if (buf[n]) {
+                fwrite(buf[n],1,len[n],out);
+                free(buf[n]);
+            }
+        }
+
+        free(j.out);
+    }
+
+    if (tid) free(tid);
+    if (buf) free(buf);
+    if (len) free(len);
+    pthread_mutex_destroy(&j.lock);
+}
@@ -0,0 +1,230 @@
+
+#ifndef __DOSLIB_TOOL_DECOMPIL_DASMENG_H
+#define __DOSLIB_TOOL_DECOMPIL_DASMENG_H
+
+#include "minx86dec/types.h"
+#include "minx86dec/state.h"
+#include "minx86dec/opcodes.h"
+#include "minx86dec/coreall.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/* Code analysis engine shared by dosdasm, wnedasm and wledasm.
+ *
+ * The engine works on one region at a time (the whole .COM/.EXE image, an NE segment, an LE object).
+ * Each byte offset of the region is decoded through minx86dec at most once, into an instruction
+ * cache that the first pass (code flow) and the second pass (listing) both read from. Code flow is
+ * followed with a worklist of entry points, and a per-byte map marks which offsets have already been
+ * walked so that overlapping paths are not walked again. After the walk the visited instructions are
+ * split into basic blocks, and the branch/call edges between them are kept as the control flow graph. */
+
+/* longest x86 instruction (15 bytes) plus room for inline operands a tool may attach to an
+ * instruction, such as the two WORDs following a VxD INT 20h */
+#define DASM_INSN_MAX_BYTES             24u
+
+/* how many bytes to pull from the file at a time, when the region is not in memory */
+#define DASM_WINDOW_SIZE                4096u
+
+/* flow of control after an instruction */
+#define DASM_FLOW_NEXT                  0u      /* continues with the next instruction */
+#define DASM_FLOW_BRANCH                1u      /* conditional branch to target, or the next instruction */
+#define DASM_FLOW_CALL                  2u      /* call to target, then the next instruction */
+#define DASM_FLOW_JUMP                  3u      /* unconditional jump to target */
+#define DASM_FLOW_STOP                  4u      /* does not continue (RET, RETF, far or indirect JMP) */
+
+/* dasm_insn flags */
+#define DASM_INSN_HAS_TARGET            0x01u   /* near branch/call with an immediate target, target_ip is valid */
+
+struct dasm_insn {
+    struct minx86dec_instruction        i;              /* i.start and i.end point into bytes[] */
+    uint32_t                            offset;         /* offset within the region */
+    uint32_t                            ip;             /* instruction pointer it was decoded at */
+    uint32_t                            target_ip;      /* branch/call target, if DASM_INSN_HAS_TARGET */
+    uint8_t                             len;            /* length, including extra bytes attached by the tool */
+    uint8_t                             dlen;           /* length as decoded by minx86dec */
+    uint8_t                             flow;           /* DASM_FLOW_* */
+    uint8_t                             flags;          /* DASM_INSN_* */
+    uint8_t                             bytes[DASM_INSN_MAX_BYTES]; /* instruction bytes and the bytes that follow it */
+};
+
+/* per byte offset map */
+#define DASM_MAP_SEEN                   0x01u   /* queued or walked, do not walk again */
+#define DASM_MAP_INSN                   0x02u   /* an instruction starting here was walked */
+#define DASM_MAP_LEADER                 0x04u   /* start of a basic block */
+
+/* control flow edge */
+#define DASM_EDGE_BRANCH                0u
+#define DASM_EDGE_CALL                  1u
+#define DASM_EDGE_JUMP                  2u
+
+struct dasm_edge {
+    uint32_t                            from;           /* offset of the branching instruction */
+    uint32_t                            to;             /* offset of the target (may be outside the region) */
+    uint8_t                             kind;           /* DASM_EDGE_* */
+};
+
+struct dasm_block {
+    uint32_t                            start;          /* offset of the first instruction */
+    uint32_t                            end;            /* offset just past the last instruction */
+    uint32_t                            edge_first;     /* index of first outgoing edge in edge[] */
+    uint32_t                            edge_count;     /* number of outgoing edges, not counting fall through */
+    uint8_t                             flow;           /* flow of the last instruction */
+};
+
+struct dasm_entry {
+    uint32_t                            offset;
+    uint32_t                            ip;
+};
+
+struct dasm_engine;
+
+/* read up to len bytes at region offset. return the number of bytes read, 0 at the end, or -1 on error */
+typedef int (*dasm_engine_read_cb)(void *user,uint32_t offset,unsigned char *buf,unsigned int len);
+
+/* number of extra bytes that belong to the instruction after what minx86dec decoded.
+ * the instruction bytes and what follows them are in ins->bytes. */
+typedef unsigned int (*dasm_engine_extra_cb)(void *user,const struct dasm_insn *ins);
+
+/* called once for each instruction walked by dasm_engine_run(). return nonzero to stop the path. */
+typedef int (*dasm_engine_walk_cb)(struct dasm_engine *e,const struct dasm_insn *ins,void *user);
+
+#define DASM_INSN_CHUNK_SHIFT           12u
+#define DASM_INSN_CHUNK                 (1u << DASM_INSN_CHUNK_SHIFT)
+
+struct dasm_engine {
+    /* set by the caller before dasm_engine_setup() */
+    uint32_t                            length;         /* size of the region */
+    uint32_t                            offset_mask;    /* branch target offsets wrap around this mask */
+    unsigned char                       data32;         /* default operand and address size is 32-bit */
+    unsigned int                        max_run;        /* max instructions in one path from an entry point (0 = no limit) */
+    const unsigned char*                image;          /* whole region in memory (length bytes), or NULL to use read */
+    dasm_engine_read_cb                 read;
+    dasm_engine_extra_cb                extra;
+    void*                               user;
+
+    /* read window */
+    unsigned char*                      window;         /* DASM_WINDOW_SIZE + padding */
+    uint32_t                            window_offset;
+    uint32_t                            window_length;
+
+    /* instruction cache: index[offset] is 1 + instruction number, 0 if not decoded */
+    uint32_t*                           index;
+    struct dasm_insn**                  insn_chunk;     /* allocated DASM_INSN_CHUNK at a time, so pointers stay valid */
+    size_t                              insn_chunk_alloc;
+    size_t                              insn_count;
+    struct dasm_insn                    scratch;        /* decoded at a different IP than the cached copy */
+
+    /* code flow */
+    uint8_t*                            map;            /* DASM_MAP_* per byte offset */
+    struct dasm_entry*                  work;
+    size_t                              work_count;
+    size_t                              work_alloc;
+
+    /* control flow graph */
+    struct dasm_edge*                   edge;
+    size_t                              edge_count;
+    size_t                              edge_alloc;
+    struct dasm_block*                  block;
+    size_t                              block_count;
+    size_t                              block_alloc;
+
+    /* statistics */
+    size_t                              walked;         /* instructions walked by dasm_engine_run() */
+    unsigned long                       decoded;
+    unsigned long                       cache_hits;
+
+    struct minx86dec_state              st;
+};
+
+void dasm_engine_init(struct dasm_engine *e);
+void dasm_engine_free(struct dasm_engine *e);
+int dasm_engine_setup(struct dasm_engine *e);
+
+const unsigned char *dasm_engine_fetch(struct dasm_engine *e,uint32_t offset,unsigned int *avail);
+const struct dasm_insn *dasm_engine_decode(struct dasm_engine *e,uint32_t offset,uint32_t ip);
+
+int dasm_engine_queue(struct dasm_engine *e,uint32_t offset,uint32_t ip);
+int dasm_engine_run(struct dasm_engine *e,dasm_engine_walk_cb cb,void *user);
+int dasm_engine_build_blocks(struct dasm_engine *e);
+
+/* decode every walked instruction that is not in the cache, such as after the map was restored
+ * from an analysis database, at ip_base + offset. dasm_engine_build_blocks() needs them. */
+int dasm_engine_decode_walked(struct dasm_engine *e,uint32_t ip_base);
+
+/* walked instructions that cover offset (such as a relocation within them), decoded at ip_base + their offset.
+ * paths can overlap, so there may be more than one. start with *back = 0 and call until it returns NULL */
+const struct dasm_insn *dasm_engine_walked_at(struct dasm_engine *e,uint32_t offset,uint32_t ip_base,uint32_t *back);
+
+/* target offset of a branch/call within the region, or (uint32_t)-1 if outside */
+uint32_t dasm_insn_target_offset(const struct dasm_engine *e,const struct dasm_insn *ins);
+
+static inline int dasm_engine_seen(const struct dasm_engine *e,uint32_t offset) {
+    return (offset < e->length && e->map != NULL) ? ((e->map[offset] & DASM_MAP_SEEN) != 0) : 0;
+}
+
+/* hash index over a tool's label array, keyed by (segment or object, offset).
+ * the tool adds labels [indexed, count) before a lookup, which picks up labels added and
+ * filled in since the last lookup. clear it after sorting the array or changing a key. */
+#define DASM_LABEL_NONE                 0xFFFFFFFFUL
+
+struct dasm_label_slot {
+    uint32_t                            seg;
+    uint32_t                            ofs;
+    uint32_t                            n;              /* 1 + label index, 0 if empty */
+};
+
+struct dasm_label_index {
+    struct dasm_label_slot*             slot;
+    uint32_t                            slot_mask;      /* number of slots - 1 */
+    uint32_t                            used;
+    size_t                              indexed;        /* labels [0, indexed) are in the index */
+};
+
+void dasm_label_index_init(struct dasm_label_index *x);
+void dasm_label_index_free(struct dasm_label_index *x);
+void dasm_label_index_clear(struct dasm_label_index *x);
+int dasm_label_index_add(struct dasm_label_index *x,uint32_t seg,uint32_t ofs,uint32_t n);
+uint32_t dasm_label_index_find(const struct dasm_label_index *x,uint32_t seg,uint32_t ofs);
+
+/* relocations of a segment or object, sorted by the address they patch.
+ * lookups made in increasing address order (the listing) move a cursor forward, other lookups
+ * (the first pass following jumps) fall back to a binary search. what table and index refer to
+ * is up to the tool, they are only used to put entries at the same address in a fixed order. */
+#define DASM_RELOC_NONE                 ((size_t)-1)
+
+struct dasm_reloc {
+    uint32_t                            addr;           /* address the relocation is applied to */
+    uint32_t                            table;          /* which table the record is in */
+    uint32_t                            index;          /* record within the table */
+};
+
+struct dasm_reloc_map {
+    struct dasm_reloc*                  ent;
+    size_t                              count;
+    size_t                              alloc;
+    size_t                              cursor;         /* first entry at or after "last" */
+    uint32_t                            last;           /* address of the last lookup */
+};
+
+void dasm_reloc_map_init(struct dasm_reloc_map *m);
+void dasm_reloc_map_free(struct dasm_reloc_map *m);
+int dasm_reloc_map_add(struct dasm_reloc_map *m,uint32_t addr,uint32_t table,uint32_t index);
+void dasm_reloc_map_sort(struct dasm_reloc_map *m);
+
+/* index of the first entry at or after addr (count if none) */
+size_t dasm_reloc_map_seek(struct dasm_reloc_map *m,uint32_t addr);
+
+/* first entry within [addr, addr+len), or NULL */
+const struct dasm_reloc *dasm_reloc_map_find(struct dasm_reloc_map *m,uint32_t addr,uint32_t len);
+
+/* run jobs 0 to count-1 (one segment or object each) on up to "threads" threads.
+ * a job writes its output to the FILE it is given. with more than one thread each job writes
+ * to a memory buffer, and the buffers are copied to out in job order once all jobs are done,
+ * so the output is the same no matter how many threads there are. */
+typedef void (*dasm_job_cb)(size_t job,FILE *out,void *user);
+
+void dasm_run_jobs(size_t count,unsigned int threads,dasm_job_cb cb,void *user,FILE *out);
+
+#endif /* __DOSLIB_TOOL_DECOMPIL_DASMENG_H */
+
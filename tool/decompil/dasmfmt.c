@@ -0,0 +1,473 @@
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <assert.h>
+
+#include "minx86dec/types.h"
+#include "minx86dec/state.h"
+#include "minx86dec/opcodes.h"
+#include "minx86dec/coreall.h"
+#include "minx86dec/opcodes_str.h"
+
+#include "dasmfmt.h"
+
+/* longest operand minx86dec_regprint() writes, plus the NUL */
+#define DASM_FMT_ARG_MAX                101u
+
+static const char dasm_fmt_hex2[512+1] =
+    "000102030405060708090A0B0C0D0E0F101112131415161718191A1B1C1D1E1F"
+    "202122232425262728292A2B2C2D2E2F303132333435363738393A3B3C3D3E3F"
+    "404142434445464748494A4B4C4D4E4F505152535455565758595A5B5C5D5E5F"
+    "606162636465666768696A6B6C6D6E6F707172737475767778797A7B7C7D7E7F"
+    "808182838485868788898A8B8C8D8E8F909192939495969798999A9B9C9D9E9F"
+    "A0A1A2A3A4A5A6A7A8A9AAABACADAEAFB0B1B2B3B4B5B6B7B8B9BABBBCBDBEBF"
+    "C0C1C2C3C4C5C6C7C8C9CACBCCCDCECFD0D1D2D3D4D5D6D7D8D9DADBDCDDDEDF"
+    "E0E1E2E3E4E5E6E7E8E9EAEBECEDEEEFF0F1F2F3F4F5F6F7F8F9FAFBFCFDFEFF";
+
+int dasm_fmt_init(struct dasm_fmt *f,FILE *out,unsigned char mode) {
+    memset(f,0,sizeof(*f));
+    f->out = out;
+    f->mode = mode;
+    f->alloc = DASM_FMT_BUFFER_SIZE;
+    f->buf = (char*)malloc(f->alloc);
+    if (f->buf == NULL) {
+        f->alloc = 0;
+        return -1;
+    }
+
+    return 0;
+}
+
+void dasm_fmt_flush(struct dasm_fmt *f) {
+    if (f->len != 0 && f->out != NULL)
+        fwrite(f->buf,1,f->len,f->out);
+
+    f->len = 0;
+}
+
+void dasm_fmt_free(struct dasm_fmt *f) {
+    size_t i;
+
+    dasm_fmt_flush(f);
+
+    if (f->mnem) {
+        for (i=0;i < f->mnem_count;i++) {
+            if (f->mnem[i]) free(f->mnem[i]);
+        }
+        free(f->mnem);
+        f->mnem = NULL;
+    }
+    if (f->mnem_len) free(f->mnem_len);
+    f->mnem_len = NULL;
+    f->mnem_count = 0;
+
+    if (f->buf) free(f->buf);
+    f->buf = NULL;
+    f->alloc = 0;
+}
+
+/* make room for n more bytes. returns where to write them, or NULL if out of memory */
+static char *dasm_fmt_room(struct dasm_fmt *f,size_t n) {
+    if ((f->len + n) > f->alloc) {
+        dasm_fmt_flush(f);
+
+        if (n > f->alloc) {
+            char *np = (char*)realloc(f->buf,n);
+
+            if (np == NULL)
+                return NULL;
+
+            f->buf = np;
+            f->alloc = n;
+        }
+    }
+
+    return f->buf + f->len;
+}
+
+static void dasm_fmt_mem(struct dasm_fmt *f,const char *s,size_t n) {
+    char *d = dasm_fmt_room(f,n);
+
+    if (d != NULL) {
+        memcpy(d,s,n);
+        f->len += n;
+    }
+}
+
+static void dasm_fmt_str(struct dasm_fmt *f,const char *s) {
+    dasm_fmt_mem(f,s,strlen(s));
+}
+
+static void dasm_fmt_char(struct dasm_fmt *f,char c) {
+    char *d = dasm_fmt_room(f,1);
+
+    if (d != NULL) {
+        *d = c;
+        f->len++;
+    }
+}
+
+static void dasm_fmt_spaces(struct dasm_fmt *f,unsigned int n) {
+    char *d = dasm_fmt_room(f,n);
+
+    if (d != NULL) {
+        memset(d,' ',n);
+        f->len += n;
+    }
+}
+
+/* uppercase hex, digits is even and at most 8 */
+static void dasm_fmt_hex(struct dasm_fmt *f,uint32_t v,unsigned int digits) {
+    char *d = dasm_fmt_room(f,digits);
+    unsigned int i;
+
+    if (d == NULL)
+        return;
+
+    for (i=digits;i != 0;i -= 2u) {
+        const char *h = dasm_fmt_hex2 + ((v & 0xFFu) * 2u);
+
+        d[i-2u] = h[0];
+        d[i-1u] = h[1];
+        v >>= 8u;
+    }
+
+    f->len += digits;
+}
+
+static void dasm_fmt_dec(struct dasm_fmt *f,uint32_t v) {
+    char tmp[12];
+    unsigned int i = sizeof(tmp);
+
+    do {
+        tmp[--i] = (char)('0' + (v % 10u));
+        v /= 10u;
+    } while (v != 0);
+
+    dasm_fmt_mem(f,tmp + i,sizeof(tmp) - i);
+}
+
+static void dasm_fmt_json_str(struct dasm_fmt *f,const char *s) {
+    dasm_fmt_char(f,'\"');
+    for (;*s != 0;s++) {
+        const unsigned char c = (unsigned char)(*s);
+
+        if (c == '\"' || c == '\\') {
+            dasm_fmt_char(f,'\\');
+            dasm_fmt_char(f,(char)c);
+        }
+        else if (c < 0x20u || c >= 0x7Fu) {
+            /* names from the binary are in some DOS code page, not UTF-8. escape them byte
+             * for byte so that every line is still valid JSON */
+            dasm_fmt_str(f,"\\u00");
+            dasm_fmt_hex(f,c,2);
+        }
+        else {
+            dasm_fmt_char(f,(char)c);
+        }
+    }
+    dasm_fmt_char(f,'\"');
+}
+
+void dasm_fmt_printf(struct dasm_fmt *f,const char *fmt,...) {
+    size_t avail;
+    va_list va;
+    int r;
+
+    if (f->mode != DASM_FMT_TEXT)
+        return;
+
+    if ((f->alloc - f->len) < 256u)
+        dasm_fmt_flush(f);
+
+    avail = f->alloc - f->len;
+    va_start(va,fmt);
+    r = vsnprintf(f->buf + f->len,avail,fmt,va);
+    va_end(va);
+    if (r < 0)
+        return;
+
+    /* did not fit, make room and do it again */
+    if ((size_t)r >= avail) {
+        if (dasm_fmt_room(f,(size_t)r + 1u) == NULL)
+            return;
+
+        avail = f->alloc - f->len;
+        va_start(va,fmt);
+        r = vsnprintf(f->buf + f->len,avail,fmt,va);
+        va_end(va);
+        if (r < 0 || (size_t)r >= avail)
+            return;
+    }
+
+    f->len += (size_t)r;
+}
+
+void dasm_fmt_insn_begin(struct dasm_fmt *f,uint32_t seg,uint32_t ip,unsigned int ip_digits,uint32_t file_ofs) {
+    f->col = 0;
+    f->args = 0;
+
+    if (f->mode == DASM_FMT_JSONL) {
+        dasm_fmt_str(f,"{\"seg\":");
+        dasm_fmt_dec(f,seg);
+        dasm_fmt_str(f,",\"ip\":");
+        dasm_fmt_dec(f,ip);
+        if (file_ofs != DASM_FMT_NO_FILE) {
+            dasm_fmt_str(f,",\"file\":");
+            dasm_fmt_dec(f,file_ofs);
+        }
+        return;
+    }
+
+    dasm_fmt_hex(f,seg,4);
+    dasm_fmt_char(f,':');
+    dasm_fmt_hex(f,ip,ip_digits);
+    if (file_ofs != DASM_FMT_NO_FILE) {
+        dasm_fmt_str(f," @0x");
+        dasm_fmt_hex(f,file_ofs,8);
+        dasm_fmt_char(f,' ');
+    }
+    else {
+        dasm_fmt_spaces(f,(8u - ip_digits) + 2u);
+    }
+}
+
+void dasm_fmt_insn_bytes(struct dasm_fmt *f,const unsigned char *p,unsigned int n,int rep) {
+    unsigned int i;
+    char *d;
+
+    if (f->mode == DASM_FMT_JSONL) {
+        dasm_fmt_str(f,",\"bytes\":\"");
+        if ((d=dasm_fmt_room(f,(size_t)n * 2u)) != NULL) {
+            for (i=0;i < n;i++) {
+                const char *h = dasm_fmt_hex2 + ((unsigned int)p[i] * 2u);
+
+                *d++ = h[0];
+                *d++ = h[1];
+            }
+            f->len += (size_t)n * 2u;
+        }
+        dasm_fmt_char(f,'\"');
+
+        if (rep == MX86_REPE)
+            dasm_fmt_str(f,",\"rep\":\"REP\"");
+        else if (rep == MX86_REPNE)
+            dasm_fmt_str(f,",\"rep\":\"REPNE\"");
+
+        return;
+    }
+
+    if ((d=dasm_fmt_room(f,(size_t)n * 3u)) != NULL) {
+        for (i=0;i < n;i++) {
+            const char *h = dasm_fmt_hex2 + ((unsigned int)p[i] * 2u);
+
+            *d++ = h[0];
+            *d++ = h[1];
+            *d++ = ' ';
+        }
+        f->len += (size_t)n * 3u;
+    }
+    f->col = n;
+
+    if (rep != MX86_REP_NONE) {
+        if (f->col < 6u) dasm_fmt_spaces(f,(6u - f->col) * 3u);
+
+        if (rep == MX86_REPE)
+            dasm_fmt_str(f,"REP   ");
+        else if (rep == MX86_REPNE)
+            dasm_fmt_str(f,"REPNE ");
+    }
+    else {
+        if (f->col < 8u) dasm_fmt_spaces(f,(8u - f->col) * 3u);
+    }
+}
+
+void dasm_fmt_insn_op_name(struct dasm_fmt *f,const char *name) {
+    if (f->mode == DASM_FMT_JSONL) {
+        dasm_fmt_str(f,",\"op\":");
+        dasm_fmt_json_str(f,name);
+    }
+    else {
+        const size_t l = strlen(name);
+
+        dasm_fmt_mem(f,name,l);
+        dasm_fmt_spaces(f,(l < 8u) ? (unsigned int)(9u - l) : 1u);
+    }
+}
+
+void dasm_fmt_insn_op(struct dasm_fmt *f,unsigned int opcode) {
+    char *s;
+
+    /* make the mnemonic once, the way it is written out */
+    if (opcode >= f->mnem_count) {
+        const size_t nc = (size_t)opcode + 64u;
+        unsigned char *nl;
+        char **nm;
+
+        nm = (char**)realloc(f->mnem,nc * sizeof(char*));
+        if (nm == NULL) {
+            dasm_fmt_insn_op_name(f,opcode_string[opcode]);
+            return;
+        }
+        f->mnem = nm;
+
+        nl = (unsigned char*)realloc(f->mnem_len,nc);
+        if (nl == NULL) {
+            dasm_fmt_insn_op_name(f,opcode_string[opcode]);
+            return;
+        }
+        f->mnem_len = nl;
+
+        memset(f->mnem + f->mnem_count,0,(nc - f->mnem_count) * sizeof(char*));
+        memset(f->mnem_len + f->mnem_count,0,nc - f->mnem_count);
+        f->mnem_count = nc;
+    }
+
+    if ((s=f->mnem[opcode]) == NULL) {
+        const char *name = opcode_string[opcode];
+        size_t len;
+
+        /* write it out, then keep a copy of what was written. make room first so
+         * the buffer is not flushed part way through. escaping is at most 6 bytes a char. */
+        if (dasm_fmt_room(f,(strlen(name) * 6u) + 16u) == NULL)
+            return;
+
+        len = f->len;
+        dasm_fmt_insn_op_name(f,name);
+        if ((f->len - len) > 255u)
+            return;
+
+        if ((s=(char*)malloc(f->len - len)) != NULL) {
+            memcpy(s,f->buf + len,f->len - len);
+            f->mnem[opcode] = s;
+            f->mnem_len[opcode] = (unsigned char)(f->len - len);
+        }
+
+        return;
+    }
+
+    dasm_fmt_mem(f,s,f->mnem_len[opcode]);
+}
+
+void dasm_fmt_insn_arg_str(struct dasm_fmt *f,const char *s) {
+    if (f->mode == DASM_FMT_JSONL) {
+        dasm_fmt_str(f,(f->args == 0) ? ",\"args\":[" : ",");
+        dasm_fmt_json_str(f,s);
+    }
+    else {
+        if (f->args != 0) dasm_fmt_char(f,',');
+        dasm_fmt_str(f,s);
+    }
+
+    f->args++;
+}
+
+void dasm_fmt_insn_arg(struct dasm_fmt *f,struct minx86dec_argv *a) {
+    char *d;
+
+    if (f->mode == DASM_FMT_JSONL) {
+        char tmp[DASM_FMT_ARG_MAX];
+
+        minx86dec_regprint(a,tmp);
+        dasm_fmt_insn_arg_str(f,tmp);
+        return;
+    }
+
+    if (f->args != 0) dasm_fmt_char(f,',');
+    f->args++;
+
+    /* straight into the buffer */
+    if ((d=dasm_fmt_room(f,DASM_FMT_ARG_MAX)) != NULL) {
+        d[0] = 0;
+        minx86dec_regprint(a,d);
+        f->len += strlen(d);
+    }
+}
+
+void dasm_fmt_insn_args(struct dasm_fmt *f,struct minx86dec_instruction *i) {
+    unsigned int c;
+
+    for (c=0;c < (unsigned int)i->argc;c++)
+        dasm_fmt_insn_arg(f,&i->argv[c]);
+}
+
+void dasm_fmt_insn_end(struct dasm_fmt *f,int lock) {
+    if (f->mode == DASM_FMT_JSONL) {
+        if (f->args != 0) dasm_fmt_char(f,']');
+        if (lock) dasm_fmt_str(f,",\"lock\":true");
+        dasm_fmt_str(f,"}\n");
+        return;
+    }
+
+    if (lock) dasm_fmt_str(f,"  ; LOCK#");
+    dasm_fmt_char(f,'\n');
+}
+
+void dasm_fmt_json_label(struct dasm_fmt *f,const char *name,uint32_t seg,uint32_t ip,uint32_t file_ofs) {
+    if (f->mode != DASM_FMT_JSONL)
+        return;
+
+    dasm_fmt_str(f,"{\"label\":");
+    dasm_fmt_json_str(f,name ? name : "");
+    dasm_fmt_str(f,",\"seg\":");
+    dasm_fmt_dec(f,seg);
+    dasm_fmt_str(f,",\"ip\":");
+    dasm_fmt_dec(f,ip);
+    if (file_ofs != DASM_FMT_NO_FILE) {
+        dasm_fmt_str(f,",\"file\":");
+        dasm_fmt_dec(f,file_ofs);
+    }
+    dasm_fmt_str(f,"}\n");
+}
+
+void dasm_fmt_xrefs(struct dasm_fmt *f,uint32_t seg,uint32_t ip,const struct dasm_xref *ref,size_t count,int show_seg) {
+    size_t i;
+
+    if (count == 0)
+        return;
+
+    if (f->mode == DASM_FMT_JSONL) {
+        dasm_fmt_str(f,"{\"xrefs\":{");
+        if (show_seg) {
+            dasm_fmt_str(f,"\"seg\":");
+            dasm_fmt_dec(f,seg);
+            dasm_fmt_str(f,",\"ip\":");
+        }
+        else {
+            dasm_fmt_str(f,"\"file\":");
+        }
+        dasm_fmt_dec(f,ip);
+        dasm_fmt_str(f,"},\"from\":[");
+        for (i=0;i < count;i++) {
+            if (i != 0) dasm_fmt_char(f,',');
+            if (show_seg) {
+                dasm_fmt_str(f,"{\"seg\":");
+                dasm_fmt_dec(f,ref[i].from_seg);
+                dasm_fmt_str(f,",\"ip\":");
+            }
+            else {
+                dasm_fmt_str(f,"{\"file\":");
+            }
+            dasm_fmt_dec(f,ref[i].from);
+            dasm_fmt_str(f,",\"kind\":\"");
+            dasm_fmt_str(f,dasm_xref_kind_str(ref[i].kind));
+            dasm_fmt_str(f,"\"}");
+        }
+        dasm_fmt_str(f,"]}\n");
+        return;
+    }
+
+    dasm_fmt_str(f,"    ; xrefs:");
+    for (i=0;i < count && i < DASM_XREF_LIST_MAX;i++) {
+        if (show_seg)
+            dasm_fmt_printf(f,"%s %s %04lx:%04lx",i != 0 ? "," : "",dasm_xref_kind_str(ref[i].kind),
+                (unsigned long)ref[i].from_seg,(unsigned long)ref[i].from);
+        else
+            dasm_fmt_printf(f,"%s %s @0x%08lx",i != 0 ? "," : "",dasm_xref_kind_str(ref[i].kind),
+                (unsigned long)ref[i].from);
+    }
+    if (count > DASM_XREF_LIST_MAX)
+        dasm_fmt_printf(f," (+%lu more)",(unsigned long)(count - DASM_XREF_LIST_MAX));
+    dasm_fmt_char(f,'\n');
+}
@@ -0,0 +1,94 @@
+
+#ifndef __DOSLIB_TOOL_DECOMPIL_DASMFMT_H
+#define __DOSLIB_TOOL_DECOMPIL_DASMFMT_H
+
+#include "minx86dec/types.h"
+#include "minx86dec/state.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "dasmxref.h"
+
+/* Listing formatter shared by dosdasm, wnedasm and wledasm.
+ *
+ * Lines are built in one large buffer and written out when it fills up, instead of through
+ * a printf() call for each byte and operand. An instruction line is built piece by piece:
+ *
+ *   dasm_fmt_insn_begin()      SSSS:OOOO @0xFFFFFFFF
+ *   dasm_fmt_insn_bytes()      XX XX XX ...          REP
+ *   dasm_fmt_insn_op()         MNEMONIC
+ *   dasm_fmt_insn_args()       operand,operand
+ *   dasm_fmt_insn_end()          ; LOCK#
+ *
+ * In JSONL mode the same calls write one JSON object per instruction instead:
+ *
+ *   {"seg":4096,"ip":256,"file":512,"bytes":"B80100","op":"MOV","args":["AX","0x0001"]}
+ *
+ * and labels as {"label":"name","seg":4096,"ip":256,"file":512}, followed by what refers to the label as
+ * {"xrefs":{"seg":4096,"ip":256},"from":[{"seg":4096,"ip":128,"kind":"call"}]}. Free-form text
+ * (dasm_fmt_printf) such as relocation notes only goes into the text listing. */
+
+#define DASM_FMT_TEXT                   0u
+#define DASM_FMT_JSONL                  1u
+
+/* no file offset to show */
+#define DASM_FMT_NO_FILE                0xFFFFFFFFUL
+
+#define DASM_FMT_BUFFER_SIZE            (64u * 1024u)
+
+struct dasm_fmt {
+    FILE*                               out;
+    unsigned char                       mode;           /* DASM_FMT_* */
+    unsigned int                        col;            /* text: bytes written in dasm_fmt_insn_bytes */
+    unsigned int                        args;           /* operands written so far */
+
+    char*                               buf;
+    size_t                              len;
+    size_t                              alloc;
+
+    /* mnemonic of each opcode, as it is written out ("%-8s " in text mode), made on first use */
+    char**                              mnem;
+    unsigned char*                      mnem_len;
+    size_t                              mnem_count;
+};
+
+int dasm_fmt_init(struct dasm_fmt *f,FILE *out,unsigned char mode);
+void dasm_fmt_flush(struct dasm_fmt *f);
+void dasm_fmt_free(struct dasm_fmt *f);
+
+static inline int dasm_fmt_json(const struct dasm_fmt *f) {
+    return f->mode == DASM_FMT_JSONL;
+}
+
+/* free-form text, text mode only */
+void dasm_fmt_printf(struct dasm_fmt *f,const char *fmt,...)
+#if defined(__GNUC__)
+    __attribute__((format(printf,2,3)))
+#endif
+    ;
+
+/* ip_digits is 4 or 8. without a file offset, the address is padded to the width of a 32-bit address */
+void dasm_fmt_insn_begin(struct dasm_fmt *f,uint32_t seg,uint32_t ip,unsigned int ip_digits,uint32_t file_ofs);
+
+/* instruction bytes. rep is the instruction's rep prefix, or MX86_REP_NONE to not show one */
+void dasm_fmt_insn_bytes(struct dasm_fmt *f,const unsigned char *p,unsigned int n,int rep);
+
+void dasm_fmt_insn_op(struct dasm_fmt *f,unsigned int opcode);
+void dasm_fmt_insn_op_name(struct dasm_fmt *f,const char *name);
+
+void dasm_fmt_insn_arg(struct dasm_fmt *f,struct minx86dec_argv *a);
+void dasm_fmt_insn_args(struct dasm_fmt *f,struct minx86dec_instruction *i);
+void dasm_fmt_insn_arg_str(struct dasm_fmt *f,const char *s);
+
+void dasm_fmt_insn_end(struct dasm_fmt *f,int lock);
+
+/* label record, JSONL mode only. the text listing prints labels its own way */
+void dasm_fmt_json_label(struct dasm_fmt *f,const char *name,uint32_t seg,uint32_t ip,uint32_t file_ofs);
+
+/* references to a label, under it. the text listing shows up to DASM_XREF_LIST_MAX of them.
+ * with show_seg == 0 (dosdasm) seg is not used and addresses are image offsets */
+void dasm_fmt_xrefs(struct dasm_fmt *f,uint32_t seg,uint32_t ip,const struct dasm_xref *ref,size_t count,int show_seg);
+
+#endif /* __DOSLIB_TOOL_DECOMPIL_DASMFMT_H */
+
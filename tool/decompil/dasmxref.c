@@ -0,0 +1,398 @@
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "minx86dec/types.h"
+#include "minx86dec/state.h"
+#include "minx86dec/opcodes.h"
+#include "minx86dec/coreall.h"
+
+#include "dasmxref.h"
+
+void dasm_xref_index_init(struct dasm_xref_index *x) {
+    memset(x,0,sizeof(*x));
+}
+
+void dasm_xref_index_free(struct dasm_xref_index *x) {
+    if (x->ref) free(x->ref);
+    memset(x,0,sizeof(*x));
+}
+
+int dasm_xref_add(struct dasm_xref_index *x,uint32_t from_seg,uint32_t from,uint32_t to_seg,uint32_t to,uint8_t kind) {
+    struct dasm_xref *r;
+
+    if (x->count >= x->alloc) {
+        const size_t na = (x->alloc != 0) ? (x->alloc * 2) : 1024;
+        struct dasm_xref *np;
+
+        if (na <= x->alloc || na > (((size_t)-1) / sizeof(*np)))
+            return -1;
+
+        np = realloc(x->ref,na * sizeof(*np));
+        if (np == NULL)
+            return -1;
+
+        x->ref = np;
+        x->alloc = na;
+    }
+
+    r = x->ref + (x->count++);
+    r->to_seg = to_seg;
+    r->to = to;
+    r->from_seg = from_seg;
+    r->from = from;
+    r->kind = kind;
+    return 0;
+}
+
+int dasm_xref_add_edges(struct dasm_xref_index *x,const struct dasm_engine *e,uint32_t seg,uint32_t base) {
+    size_t i;
+
+    for (i=0;i < e->edge_count;i++) {
+        const struct dasm_edge *d = e->edge + i;
+
+        if (dasm_xref_add(x,seg,base + d->from,seg,base + d->to,d->kind))
+            return -1;
+    }
+
+    return 0;
+}
+
+static int dasm_xref_cmp(const struct dasm_xref *a,const struct dasm_xref *b) {
+    if (a->to_seg != b->to_seg)
+        return (a->to_seg < b->to_seg) ? -1 : 1;
+    if (a->to != b->to)
+        return (a->to < b->to) ? -1 : 1;
+    if (a->from_seg != b->from_seg)
+        return (a->from_seg < b->from_seg) ? -1 : 1;
+    if (a->from != b->from)
+        return (a->from < b->from) ? -1 : 1;
+    if (a->kind != b->kind)
+        return (a->kind < b->kind) ? -1 : 1;
+
+    return 0;
+}
+
+static int dasm_xref_qsort_cb(const void *a,const void *b) {
+    return dasm_xref_cmp((const struct dasm_xref*)a,(const struct dasm_xref*)b);
+}
+
+void dasm_xref_index_sort(struct dasm_xref_index *x) {
+    size_t i,o;
+
+    if (x->count < 2)
+        return;
+
+    qsort(x->ref,x->count,sizeof(*(x->ref)),dasm_xref_qsort_cb);
+
+    /* the same relocation can be seen from more than one path */
+    for (i=1,o=1;i < x->count;i++) {
+        if (dasm_xref_cmp(x->ref + i,x->ref + o - 1) != 0)
+            x->ref[o++] = x->ref[i];
+    }
+    x->count = o;
+}
+
+const struct dasm_xref *dasm_xref_find(const struct dasm_xref_index *x,uint32_t seg,uint32_t ofs,size_t *count) {
+    size_t lo = 0,hi = x->count,first;
+
+    *count = 0;
+
+    /* first entry at or after (seg, ofs) */
+    while (lo < hi) {
+        const size_t mid = lo + ((hi - lo) / 2u);
+        const struct dasm_xref *r = x->ref + mid;
+
+        if (r->to_seg < seg || (r->to_seg == seg && r->to < ofs))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    first = lo;
+    while (lo < x->count && x->ref[lo].to_seg == seg && x->ref[lo].to == ofs)
+        lo++;
+
+    if (lo == first)
+        return NULL;
+
+    *count = lo - first;
+    return x->ref + first;
+}
+
+const char *dasm_xref_kind_str(uint8_t kind) {
+    switch (kind) {
+        case DASM_XREF_BRANCH:  return "branch";
+        case DASM_XREF_CALL:    return "call";
+        case DASM_XREF_JUMP:    return "jump";
+        case DASM_XREF_DATA:    return "data";
+        default:                break;
+    }
+
+    return "?";
+}
+
+/* ---- call graph ---- */
+
+#define DASM_XREF_NO_FUNC               ((size_t)-1)
+
+struct dasm_xref_call {
+    uint32_t                            from_seg,from;  /* calling function, or the call itself if not within one */
+    uint32_t                            to_seg,to;
+};
+
+struct dasm_xref_graph {
+    size_t*                             func;           /* indices into fn[] of the labels that start functions */
+    size_t                              func_count;
+    struct dasm_xref_call*              call;
+    size_t                              call_count;
+};
+
+/* function that starts at or most closely before (seg, ofs), as an index into g->func, or DASM_XREF_NO_FUNC */
+static size_t dasm_xref_func_containing(const struct dasm_xref_graph *g,const struct dasm_xref_func *fn,uint32_t seg,uint32_t ofs) {
+    size_t lo = 0,hi = g->func_count;
+
+    /* first function after (seg, ofs) */
+    while (lo < hi) {
+        const size_t mid = lo + ((hi - lo) / 2u);
+        const struct dasm_xref_func *f = fn + g->func[mid];
+
+        if (f->seg < seg || (f->seg == seg && f->ofs <= ofs))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if (lo == 0 || fn[g->func[lo-1]].seg != seg)
+        return DASM_XREF_NO_FUNC;
+
+    return lo - 1;
+}
+
+static int dasm_xref_call_qsort_cb(const void *a,const void *b) {
+    const struct dasm_xref_call *ca = (const struct dasm_xref_call*)a;
+    const struct dasm_xref_call *cb = (const struct dasm_xref_call*)b;
+
+    if (ca->from_seg != cb->from_seg)
+        return (ca->from_seg < cb->from_seg) ? -1 : 1;
+    if (ca->from != cb->from)
+        return (ca->from < cb->from) ? -1 : 1;
+    if (ca->to_seg != cb->to_seg)
+        return (ca->to_seg < cb->to_seg) ? -1 : 1;
+    if (ca->to != cb->to)
+        return (ca->to < cb->to) ? -1 : 1;
+
+    return 0;
+}
+
+static void dasm_xref_graph_free(struct dasm_xref_graph *g) {
+    if (g->func) free(g->func);
+    if (g->call) free(g->call);
+    memset(g,0,sizeof(*g));
+}
+
+static int dasm_xref_graph_build(struct dasm_xref_graph *g,const struct dasm_xref_index *x,const struct dasm_xref_func *fn,size_t fn_count) {
+    size_t i,j,n,o;
+
+    memset(g,0,sizeof(*g));
+    g->func = malloc((fn_count != 0 ? fn_count : 1) * sizeof(*(g->func)));
+    g->call = malloc((x->count != 0 ? x->count : 1) * sizeof(*(g->call)));
+    if (g->func == NULL || g->call == NULL) {
+        dasm_xref_graph_free(g);
+        return -1;
+    }
+
+    for (i=0;i < fn_count;i++) {
+        const struct dasm_xref *r = dasm_xref_find(x,fn[i].seg,fn[i].ofs,&n);
+        int called = 0;
+
+        for (j=0;j < n;j++) {
+            if (r[j].kind == DASM_XREF_CALL) {
+                called = 1;
+                break;
+            }
+        }
+
+        /* the same address can carry more than one label */
+        if ((called || n == 0) &&
+            (g->func_count == 0 || fn[g->func[g->func_count-1]].seg != fn[i].seg || fn[g->func[g->func_count-1]].ofs != fn[i].ofs))
+            g->func[g->func_count++] = i;
+    }
+
+    for (i=0;i < x->count;i++) {
+        const struct dasm_xref *r = x->ref + i;
+        struct dasm_xref_call *c;
+        size_t f;
+
+        if (r->kind != DASM_XREF_CALL)
+            continue;
+
+        c = g->call + (g->call_count++);
+        f = dasm_xref_func_containing(g,fn,r->from_seg,r->from);
+        if (f != DASM_XREF_NO_FUNC) {
+            c->from_seg = fn[g->func[f]].seg;
+            c->from = fn[g->func[f]].ofs;
+        }
+        else {
+            c->from_seg = r->from_seg;
+            c->from = r->from;
+        }
+        c->to_seg = r->to_seg;
+        c->to = r->to;
+    }
+
+    /* one edge per caller and callee, no matter how many times it is called */
+    if (g->call_count > 1) {
+        qsort(g->call,g->call_count,sizeof(*(g->call)),dasm_xref_call_qsort_cb);
+        for (i=1,o=1;i < g->call_count;i++) {
+            if (dasm_xref_call_qsort_cb(g->call + i,g->call + o - 1) != 0)
+                g->call[o++] = g->call[i];
+        }
+        g->call_count = o;
+    }
+
+    return 0;
+}
+
+static void dasm_xref_addr_str(char *tmp,uint32_t seg,uint32_t ofs,int show_seg) {
+    if (show_seg)
+        sprintf(tmp,"%04lx:%04lx",(unsigned long)seg,(unsigned long)ofs);
+    else
+        sprintf(tmp,"@0x%08lx",(unsigned long)ofs);
+}
+
+/* string for DOT or JSON, both of which escape with backslashes */
+static void dasm_xref_quote(FILE *fp,const char *s) {
+    fputc('\"',fp);
+    for (;*s != 0;s++) {
+        const unsigned char c = (unsigned char)(*s);
+
+        if (c == '\"' || c == '\\')
+            fprintf(fp,"\\%c",c);
+        else if (c < 0x20)
+            fprintf(fp,"\\u%04x",c);
+        else
+            fputc(c,fp);
+    }
+    fputc('\"',fp);
+}
+
+int dasm_xref_write_dot(FILE *fp,const struct dasm_xref_index *x,const struct dasm_xref_func *fn,size_t fn_count,int show_seg) {
+    struct dasm_xref_graph g;
+    char a[32],b[32];
+    size_t i;
+
+    if (dasm_xref_graph_build(&g,x,fn,fn_count))
+        return -1;
+
+    fprintf(fp,"digraph callgraph {\n");
+    fprintf(fp,"    node [shape=box,fontname=\"monospace\"];\n");
+
+    for (i=0;i < g.func_count;i++) {
+        const struct dasm_xref_func *f = fn + g.func[i];
+
+        dasm_xref_addr_str(a,f->seg,f->ofs,show_seg);
+        fprintf(fp,"    \"%s\" [label=\"",a);
+        if (f->name != NULL) {
+            const char *s;
+
+            for (s=f->name;*s != 0;s++) {
+                if (*s == '\"' || *s == '\\') fputc('\\',fp);
+                if ((unsigned char)(*s) >= 0x20) fputc(*s,fp);
+            }
+            fprintf(fp,"\\n");
+        }
+        fprintf(fp,"%s\"];\n",a);
+    }
+
+    for (i=0;i < g.call_count;i++) {
+        dasm_xref_addr_str(a,g.call[i].from_seg,g.call[i].from,show_seg);
+        dasm_xref_addr_str(b,g.call[i].to_seg,g.call[i].to,show_seg);
+        fprintf(fp,"    \"%s\" -> \"%s\";\n",a,b);
+    }
+
+    fprintf(fp,"}\n");
+
+    dasm_xref_graph_free(&g);
+    return ferror(fp) ? -1 : 0;
+}
+
+static void dasm_xref_json_addr(FILE *fp,uint32_t seg,uint32_t ofs,int show_seg) {
+    if (show_seg)
+        fprintf(fp,"{\"seg\":%lu,\"ip\":%lu}",(unsigned long)seg,(unsigned long)ofs);
+    else
+        fprintf(fp,"{\"file\":%lu}",(unsigned long)ofs);
+}
+
+/* { "functions": [ {"name":...,"at":{...}} ],
+ *   "calls": [ {"from":{...},"to":{...}} ],            one per calling function and callee
+ *   "xrefs": [ {"to":{...},"from":{...},"kind":"call","in":{...}} ] }   every reference, "in" is the
+ *                                                       function the referring instruction is in, or null */
+int dasm_xref_write_json(FILE *fp,const struct dasm_xref_index *x,const struct dasm_xref_func *fn,size_t fn_count,int show_seg) {
+    struct dasm_xref_graph g;
+    size_t i,f;
+
+    if (dasm_xref_graph_build(&g,x,fn,fn_count))
+        return -1;
+
+    fprintf(fp,"{\"functions\":[");
+    for (i=0;i < g.func_count;i++) {
+        const struct dasm_xref_func *fe = fn + g.func[i];
+
+        fprintf(fp,"%s\n{\"name\":",i != 0 ? "," : "");
+        dasm_xref_quote(fp,fe->name != NULL ? fe->name : "");
+        fprintf(fp,",\"at\":");
+        dasm_xref_json_addr(fp,fe->seg,fe->ofs,show_seg);
+        fprintf(fp,"}");
+    }
+
+    fprintf(fp,"],\n\"calls\":[");
+    for (i=0;i < g.call_count;i++) {
+        fprintf(fp,"%s\n{\"from\":",i != 0 ? "," : "");
+        dasm_xref_json_addr(fp,g.call[i].from_seg,g.call[i].from,show_seg);
+        fprintf(fp,",\"to\":");
+        dasm_xref_json_addr(fp,g.call[i].to_seg,g.call[i].to,show_seg);
+        fprintf(fp,"}");
+    }
+
+    fprintf(fp,"],\n\"xrefs\":[");
+    for (i=0;i < x->count;i++) {
+        const struct dasm_xref *r = x->ref + i;
+
+        fprintf(fp,"%s\n{\"to\":",i != 0 ? "," : "");
+        dasm_xref_json_addr(fp,r->to_seg,r->to,show_seg);
+        fprintf(fp,",\"from\":");
+        dasm_xref_json_addr(fp,r->from_seg,r->from,show_seg);
+        fprintf(fp,",\"kind\":\"%s\",\"in\":",dasm_xref_kind_str(r->kind));
+        f = dasm_xref_func_containing(&g,fn,r->from_seg,r->from);
+        if (f != DASM_XREF_NO_FUNC)
+            dasm_xref_json_addr(fp,fn[g.func[f]].seg,fn[g.func[f]].ofs,show_seg);
+        else
+            fprintf(fp,"null");
+        fprintf(fp,"}");
+    }
+
+    fprintf(fp,"]}\n");
+
+    dasm_xref_graph_free(&g);
+    return ferror(fp) ? -1 : 0;
+}
+
+int dasm_xref_save(const char *path,unsigned int how,const struct dasm_xref_index *x,const struct dasm_xref_func *fn,size_t fn_count,int show_seg) {
+    FILE *fp;
+    int r;
+
+    if ((fp=fopen(path,"w")) == NULL)
+        return -1;
+
+    if (how == DASM_XREF_OUT_DOT)
+        r = dasm_xref_write_dot(fp,x,fn,fn_count,show_seg);
+    else
+        r = dasm_xref_write_json(fp,x,fn,fn_count,show_seg);
+
+    if (fclose(fp))
+        r = -1;
+
+    return r;
+}
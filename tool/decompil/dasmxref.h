@@ -0,0 +1,74 @@
+
+#ifndef __DOSLIB_TOOL_DECOMPIL_DASMXREF_H
+#define __DOSLIB_TOOL_DECOMPIL_DASMXREF_H
+
+#include "dasmeng.h"
+
+/* Cross reference index shared by dosdasm, wnedasm and wledasm.
+ *
+ * Every reference the first pass found (branch/call edges of the analysis engine, and far calls and data
+ * references through relocations) is put in one array, sorted by the address referred to. All references
+ * to an address are then one contiguous run of the array, found with a binary search. Addresses are
+ * (segment or object, offset), the same way the tool keys its labels.
+ *
+ * From the index and the label list a call graph can be written, as Graphviz DOT or as JSON. A label is
+ * taken to be the start of a function if it is called, or if nothing refers to it at all (entry points,
+ * exports, labels from the label file). Each call is charged to the function that starts at or most
+ * closely before the calling instruction. */
+
+#define DASM_XREF_BRANCH                DASM_EDGE_BRANCH
+#define DASM_XREF_CALL                  DASM_EDGE_CALL
+#define DASM_XREF_JUMP                  DASM_EDGE_JUMP
+#define DASM_XREF_DATA                  3u
+
+/* listing: how many references to show on a label before "+N more" */
+#define DASM_XREF_LIST_MAX              8u
+
+struct dasm_xref {
+    uint32_t                            to_seg;
+    uint32_t                            to;
+    uint32_t                            from_seg;       /* the referring instruction */
+    uint32_t                            from;
+    uint8_t                             kind;           /* DASM_XREF_* */
+};
+
+struct dasm_xref_index {
+    struct dasm_xref*                   ref;
+    size_t                              count;
+    size_t                              alloc;
+};
+
+/* a label, for the call graph. the tool passes its labels sorted by (seg, ofs) */
+struct dasm_xref_func {
+    uint32_t                            seg;
+    uint32_t                            ofs;
+    const char*                         name;
+};
+
+void dasm_xref_index_init(struct dasm_xref_index *x);
+void dasm_xref_index_free(struct dasm_xref_index *x);
+int dasm_xref_add(struct dasm_xref_index *x,uint32_t from_seg,uint32_t from,uint32_t to_seg,uint32_t to,uint8_t kind);
+
+/* add the branch/call edges of a region. edge offsets are made addresses by adding base */
+int dasm_xref_add_edges(struct dasm_xref_index *x,const struct dasm_engine *e,uint32_t seg,uint32_t base);
+
+/* sort by address referred to and drop duplicates. call once everything is added, before lookups */
+void dasm_xref_index_sort(struct dasm_xref_index *x);
+
+/* references to (seg, ofs): returns the first, and the number of them in *count */
+const struct dasm_xref *dasm_xref_find(const struct dasm_xref_index *x,uint32_t seg,uint32_t ofs,size_t *count);
+
+const char *dasm_xref_kind_str(uint8_t kind);
+
+/* write the call graph. with show_seg == 0 (dosdasm) addresses are image offsets, shown as @0x... */
+int dasm_xref_write_dot(FILE *fp,const struct dasm_xref_index *x,const struct dasm_xref_func *fn,size_t fn_count,int show_seg);
+int dasm_xref_write_json(FILE *fp,const struct dasm_xref_index *x,const struct dasm_xref_func *fn,size_t fn_count,int show_seg);
+
+/* the same, to a file */
+#define DASM_XREF_OUT_DOT               0u
+#define DASM_XREF_OUT_JSON              1u
+
+int dasm_xref_save(const char *path,unsigned int how,const struct dasm_xref_index *x,const struct dasm_xref_func *fn,size_t fn_count,int show_seg);
+
+#endif /* __DOSLIB_TOOL_DECOMPIL_DASMXREF_H */
+
@@ -14,6 +14,10 @@
 
 #include <hw/dos/exehdr.h>
 
+#include "dasmeng.h"
+#include "dasmfmt.h"
+#include "dasmxref.h"
+
 #ifndef O_BINARY
 #define O_BINARY 0
 #endif
@@ -49,20 +53,21 @@ void dec_label_set_name(struct dec_label *l,const char *s) {
 struct dec_label*               dec_label = NULL;
 size_t                          dec_label_count = 0;
 size_t                          dec_label_alloc = 0;
+struct dasm_label_index         dec_label_index;
 unsigned long                   dec_ofs;
+uint32_t                        dec_pos;
 uint16_t                        dec_cs;
 
 uint8_t                         dec_buffer[256];
-uint8_t*                        dec_read;
-uint8_t*                        dec_end;
-char                            arg_c[101];
-struct minx86dec_state          dec_st;
+struct dasm_engine              dec_eng;
+struct dasm_fmt                 dec_fmt;
+struct dasm_xref_index          dec_xref;
+unsigned char                   dec_xref_error = 0;
+unsigned char*                  dec_image = NULL;
 struct minx86dec_instruction    dec_i;
-minx86_read_ptr_t               iptr;
 uint16_t                        entry_cs,entry_ip;
 uint16_t                        start_cs,start_ip;
 uint32_t                        start_decom,end_decom,entry_ofs;
-uint32_t                        current_offset;
 
 uint32_t*                       exe_relocation = NULL;
 size_t                          exe_relocation_count = 0;
@@ -71,28 +76,21 @@ struct exe_dos_header           exehdr;
 
 char*                           label_file = NULL;
 
+char*                           jsonl_file = NULL;
+char*                           xref_file = NULL;
+char*                           dot_file = NULL;
+
 char*                           src_file = NULL;
 int                             src_fd = -1;
 
-uint32_t current_offset_minus_buffer() {
-    return current_offset - (uint32_t)(dec_end - dec_buffer);
-}
-
-static void minx86dec_init_state(struct minx86dec_state *st) {
-	memset(st,0,sizeof(*st));
-}
-
-static void minx86dec_set_buffer(struct minx86dec_state *st,uint8_t *buf,int sz) {
-	st->fence = buf + sz;
-	st->prefetch_fence = dec_buffer + sizeof(dec_buffer) - 16;
-	st->read_ip = buf;
-}
-
 void help() {
     fprintf(stderr,"dosdasm [options]\n");
     fprintf(stderr,"MS-DOS COM/EXE/SYS decompiler\n");
     fprintf(stderr,"    -i <file>        File to decompile\n");
     fprintf(stderr,"    -lf <file>       Text file to define labels\n");
+    fprintf(stderr,"    -jsonl <file>    Write the listing to <file> as JSON lines\n");
+    fprintf(stderr,"    -xref <file>     Write cross references and the call graph to <file> as JSON\n");
+    fprintf(stderr,"    -dot <file>      Write the call graph to <file> as Graphviz DOT\n");
 }
 
 int parse_argv(int argc,char **argv) {
@@ -113,6 +111,18 @@ int parse_argv(int argc,char **argv) {
                 label_file = argv[i++];
                 if (label_file == NULL) return 1;
             }
+            else if (!strcmp(a,"jsonl")) {
+                jsonl_file = argv[i++];
+                if (jsonl_file == NULL) return 1;
+            }
+            else if (!strcmp(a,"xref")) {
+                xref_file = argv[i++];
+                if (xref_file == NULL) return 1;
+            }
+            else if (!strcmp(a,"dot")) {
+                dot_file = argv[i++];
+                if (dot_file == NULL) return 1;
+            }
             else if (!strcmp(a,"h") || !strcmp(a,"help")) {
                 help();
                 return 1;
@@ -136,47 +146,28 @@ int parse_argv(int argc,char **argv) {
     return 0;
 }
 
-void reset_buffer() {
-    current_offset = 0;
-    dec_read = dec_end = dec_buffer;
-}
+/* read the image (start_decom to end_decom) into memory once. *plen is how much of it the file actually has. */
+unsigned char *dec_load_image(uint32_t *plen) {
+    const uint32_t len = end_decom - start_decom;
+    unsigned char *buf;
+    uint32_t got = 0;
 
-int refill() {
-    const size_t flush = sizeof(dec_buffer) / 2;
-    const size_t padding = 16;
-    size_t dlen;
-
-    if (dec_end > dec_read)
-        dlen = (size_t)(dec_end - dec_read);
-    else
-        dlen = 0;
-
-    if (dec_read >= (dec_buffer+flush)) {
-        assert((dec_read+dlen) <= (dec_buffer+sizeof(dec_buffer)-padding));
-        if (dlen != 0) memmove(dec_buffer,dec_read,dlen);
-        dec_read = dec_buffer;
-        dec_end = dec_buffer + dlen;
-    }
-    {
-        unsigned char *e = dec_buffer + sizeof(dec_buffer) - padding;
-
-        if (dec_end < e) {
-            unsigned long clen = end_decom - current_offset;
-            dlen = (size_t)(e - dec_end);
-            if ((unsigned long)dlen > clen)
-                dlen = (size_t)clen;
-
-            if (dlen != 0) {
-                int rd = read(src_fd,dec_end,dlen);
-                if (rd > 0) {
-                    dec_end += rd;
-                    current_offset += (unsigned long)rd;
-                }
-            }
+    buf = malloc(len != 0 ? (size_t)len : (size_t)1);
+    if (buf == NULL)
+        return NULL;
+
+    if ((uint32_t)lseek(src_fd,start_decom,SEEK_SET) == start_decom) {
+        while (got < len) {
+            const unsigned int want = ((len - got) > 0x8000UL) ? 0x8000u : (unsigned int)(len - got);
+            const int rd = read(src_fd,buf + got,want);
+
+            if (rd <= 0) break;
+            got += (uint32_t)rd;
         }
     }
 
-    return (dec_read < dec_end);
+    *plen = got;
+    return buf;
 }
 
 void dec_free_labels() {
@@ -193,32 +184,60 @@ void dec_free_labels() {
 
     free(dec_label);
     dec_label = NULL;
+    dec_label_count = 0;
+    dec_label_alloc = 0;
+
+    dasm_label_index_free(&dec_label_index);
 }
 
 struct dec_label *dec_find_label(const uint32_t ofs) {
-    unsigned int i=0;
+    uint32_t n;
 
     if (dec_label == NULL)
         return NULL;
 
-    while (i < dec_label_count) {
-        struct dec_label *l = dec_label + i;
+    /* index the labels added since the last lookup */
+    while (dec_label_index.indexed < dec_label_count) {
+        const struct dec_label *l = dec_label + dec_label_index.indexed;
+
+        if (dasm_label_index_add(&dec_label_index,0,l->offset,(uint32_t)dec_label_index.indexed))
+            break;
+
+        dec_label_index.indexed++;
+    }
+
+    n = dasm_label_index_find(&dec_label_index,0,ofs);
+    if (n != DASM_LABEL_NONE)
+        return dec_label + n;
+
+    /* labels the index could not take (out of memory) */
+    for (n=(uint32_t)dec_label_index.indexed;n < dec_label_count;n++) {
+        struct dec_label *l = dec_label + n;
 
         if (l->offset == ofs)
             return l;
-
-        i++;
     }
 
     return NULL;
 }
 
+/* the label array grows as needed. pointers to labels are not valid across calls to this function. */
 struct dec_label *dec_label_malloc() {
-    if (dec_label == NULL)
-        return NULL;
+    if (dec_label_count >= dec_label_alloc) {
+        const size_t na = (dec_label_alloc != 0) ? (dec_label_alloc * 2) : 4096;
+        struct dec_label *np;
 
-    if (dec_label_count >= dec_label_alloc)
-        return NULL;
+        if (na <= dec_label_alloc || na > (((size_t)-1) / sizeof(*np)))
+            return NULL;
+
+        np = realloc(dec_label,na * sizeof(*np));
+        if (np == NULL)
+            return NULL;
+
+        memset(np + dec_label_alloc,0,(na - dec_label_alloc) * sizeof(*np));
+        dec_label = np;
+        dec_label_alloc = na;
+    }
 
     return dec_label + (dec_label_count++);
 }
@@ -252,13 +271,105 @@ void dec_label_sort() {
         return;
 
     qsort(dec_label,dec_label_count,sizeof(*dec_label),dec_label_qsortcb);
+    dasm_label_index_clear(&dec_label_index);
+}
+
+/* first pass: print each instruction as it is walked, and make labels of CALL + JMP + Jcc targets */
+int first_pass_insn(struct dasm_engine *e,const struct dasm_insn *ins,void *user) {
+    struct dec_label *label;
+
+    (void)user;
+
+    dec_i = ins->i;
+
+    dasm_fmt_insn_begin(&dec_fmt,dec_cs,ins->ip,4,start_decom + ins->offset);
+    dasm_fmt_insn_bytes(&dec_fmt,dec_i.start,(unsigned int)(dec_i.end - dec_i.start),MX86_REP_NONE);
+    dasm_fmt_insn_op(&dec_fmt,dec_i.opcode);
+    dasm_fmt_insn_args(&dec_fmt,&dec_i);
+    dasm_fmt_insn_end(&dec_fmt,dec_i.lock);
+
+    if (ins->flags & DASM_INSN_HAS_TARGET) {
+        /* make a label of the target */
+        /* 1st arg is target offset */
+        uint32_t toffset = ins->target_ip;
+        uint32_t noffset = dasm_insn_target_offset(e,ins);
+
+        dasm_fmt_printf(&dec_fmt,"Target: 0x%04lx @0x%08lx\n",(unsigned long)toffset,(unsigned long)noffset);
+
+        label = dec_find_label(noffset);
+        if (label == NULL) {
+            if ((label=dec_label_malloc()) != NULL) {
+                if (ins->flow == DASM_FLOW_CALL)
+                    dec_label_set_name(label,"CALL target");
+                else
+                    dec_label_set_name(label,"JMP target");
+
+                label->offset =
+                    noffset;
+                label->seg_v =
+                    dec_cs;
+                label->ofs_v =
+                    toffset;
+            }
+        }
+    }
+    else if (dec_i.opcode == MXOP_CALL_FAR || dec_i.opcode == MXOP_JMP_FAR) {
+        const uint32_t ofs = ins->offset;
+        size_t i,inslen;
+
+        /* if it's affected by an EXE relocation entry (touches the segment part), then we *can* trace it. */
+        if (exe_relocation) {
+            inslen = ins->dlen;
+            if ((*dec_i.start == 0x9AU || *dec_i.start == 0xEAU) && dec_i.argc == 1 &&
+                dec_i.argv[0].segment == MX86_SEG_IMM &&
+                dec_i.argv[0].regtype == MX86_RT_IMM) {
+                for (i=0;i < exe_relocation_count;i++) {
+                    /* must affect the segment portion */
+                    if ((exe_relocation[i] == (ofs + 1 + 2) && inslen == 5) ||
+                        (exe_relocation[i] == (ofs + 1 + 4) && inslen == 7)) {
+                        unsigned long noffset =
+                            ((unsigned long)dec_i.argv[0].segval << 4UL) + dec_i.argv[0].value;
+                        dasm_fmt_printf(&dec_fmt,"Far jmp/call, adjusted by relocation, detected, to %04lx+reloc:%04lx\n",
+                            (unsigned long)dec_i.argv[0].segval,
+                            (unsigned long)dec_i.argv[0].value);
+
+                        if (dasm_xref_add(&dec_xref,0,ofs,0,(uint32_t)noffset,
+                            (dec_i.opcode == MXOP_JMP_FAR) ? DASM_XREF_JUMP : DASM_XREF_CALL))
+                            dec_xref_error = 1;
+
+                        label = dec_find_label(noffset);
+                        if (label == NULL) {
+                            if ((label=dec_label_malloc()) != NULL) {
+                                if (dec_i.opcode == MXOP_JMP_FAR)
+                                    dec_label_set_name(label,"JMP FAR target");
+                                else if (dec_i.opcode == MXOP_CALL_FAR)
+                                    dec_label_set_name(label,"CALL FAR target");
+
+                                label->offset =
+                                    noffset;
+                                label->seg_v =
+                                    dec_i.argv[0].segval;
+                                label->ofs_v =
+                                    dec_i.argv[0].value;
+                            }
+                        }
+
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    return 0;
 }
 
 int main(int argc,char **argv) {
     struct dec_label *label;
     unsigned int exereli;
     unsigned int labeli;
-    int c;
+    FILE *jsonl_fp = NULL;
+    char tmp[64];
 
     if (parse_argv(argc,argv))
         return 1;
@@ -456,151 +567,82 @@ int main(int argc,char **argv) {
     }
 
     /* first pass: CALL + JMP + Jcc ident and label building from it.
-     * for each label, decode until 1024 instructions or a JMP, RET */
+     * each label is an entry point for the analysis engine, which follows the code from there.
+     * code already walked from an earlier label is not walked again. */
     {
         unsigned int los = 0;
-        unsigned int inscount;
+
+        dasm_engine_init(&dec_eng);
+        dasm_xref_index_init(&dec_xref);
+        dec_image = dec_load_image(&dec_eng.length);
+        dec_eng.image = dec_image;
+        dec_eng.offset_mask = 0xFFFFFUL;
+        dec_eng.max_run = 1024;
+        if (dec_image == NULL || dasm_engine_setup(&dec_eng) || dasm_fmt_init(&dec_fmt,stdout,DASM_FMT_TEXT)) {
+            fprintf(stderr,"Failed to alloc analysis engine\n");
+            return 1;
+        }
 
         while (los < dec_label_count) {
             label = dec_label + los;
-            entry_ip = label->ofs_v;
-            dec_ofs = label->offset;
-            dec_cs = label->seg_v;
-            inscount = 0;
-
-            reset_buffer();
-            current_offset = label->offset + start_decom;
-            minx86dec_init_state(&dec_st);
-            dec_read = dec_end = dec_buffer;
-            dec_st.data32 = dec_st.addr32 = 0;
-            if ((uint32_t)lseek(src_fd,current_offset,SEEK_SET) != current_offset)
-                return 1;
 
-            printf("* %u/%u 1st pass scan at CS:IP %04x:%04x offset 0x%lx\n",
-                los,(unsigned int)dec_label_count,
-                (unsigned int)dec_cs,(unsigned int)entry_ip,(unsigned long)dec_ofs);
-
-            do {
-                uint32_t ofs = (uint32_t)(dec_read - dec_buffer) + current_offset_minus_buffer() - start_decom;
-                uint32_t ip = ofs + entry_ip - dec_ofs;
-
-                if (!refill()) break;
-
-                minx86dec_set_buffer(&dec_st,dec_read,(int)(dec_end - dec_read));
-                minx86dec_init_instruction(&dec_i);
-                dec_st.ip_value = ip;
-                minx86dec_decodeall(&dec_st,&dec_i);
-                assert(dec_i.end >= dec_read);
-                assert(dec_i.end <= (dec_buffer+sizeof(dec_buffer)));
-
-                printf("%04lX:%04lX @0x%08lX ",(unsigned long)dec_cs,(unsigned long)dec_st.ip_value,(unsigned long)(dec_read - dec_buffer) + current_offset_minus_buffer());
-                for (c=0,iptr=dec_i.start;iptr != dec_i.end;c++)
-                    printf("%02X ",*iptr++);
-                for (;c < 8;c++)
-                    printf("   ");
-                printf("%-8s ",opcode_string[dec_i.opcode]);
-                for (c=0;c < dec_i.argc;) {
-                    minx86dec_regprint(&dec_i.argv[c],arg_c);
-                    printf("%s",arg_c);
-                    if (++c < dec_i.argc) printf(",");
-                }
-                if (dec_i.lock) printf("  ; LOCK#");
-                printf("\n");
-
-                dec_read = dec_i.end;
-
-                if ((dec_i.opcode == MXOP_JMP || dec_i.opcode == MXOP_CALL || dec_i.opcode == MXOP_JCXZ ||
-                    (dec_i.opcode >= MXOP_JO && dec_i.opcode <= MXOP_JG)) && dec_i.argc == 1 &&
-                    dec_i.argv[0].regtype == MX86_RT_IMM) {
-                    /* make a label of the target */
-                    /* 1st arg is target offset */
-                    uint32_t toffset = dec_i.argv[0].value;
-                    uint32_t noffset = (((uint32_t)dec_cs << 4UL) + toffset) & 0xFFFFFUL;
-
-                    printf("Target: 0x%04lx @0x%08lx\n",(unsigned long)toffset,(unsigned long)noffset);
-
-                    label = dec_find_label(noffset);
-                    if (label == NULL) {
-                        if ((label=dec_label_malloc()) != NULL) {
-                            if (dec_i.opcode == MXOP_JMP || dec_i.opcode == MXOP_JCXZ ||
-                                (dec_i.opcode >= MXOP_JO && dec_i.opcode <= MXOP_JG))
-                                dec_label_set_name(label,"JMP target");
-                            else if (dec_i.opcode == MXOP_CALL)
-                                dec_label_set_name(label,"CALL target");
-
-                            label->offset =
-                                noffset;
-                            label->seg_v =
-                                dec_cs;
-                            label->ofs_v =
-                                toffset;
-                        }
-                    }
+            if (!dasm_engine_seen(&dec_eng,label->offset)) {
+                dasm_fmt_printf(&dec_fmt,"* %u/%u 1st pass scan at CS:IP %04x:%04x offset 0x%lx\n",
+                    los,(unsigned int)dec_label_count,
+                    (unsigned int)label->seg_v,(unsigned int)label->ofs_v,(unsigned long)label->offset);
 
-                    if (dec_i.opcode == MXOP_JMP)
-                        break;
+                dec_cs = label->seg_v;
+                if (dasm_engine_queue(&dec_eng,label->offset,label->ofs_v) < 0 ||
+                    dasm_engine_run(&dec_eng,first_pass_insn,NULL) < 0) {
+                    fprintf(stderr,"Out of memory during analysis\n");
+                    return 1;
                 }
-                else if (dec_i.opcode == MXOP_JMP)
-                    break;
-                else if (dec_i.opcode == MXOP_RET || dec_i.opcode == MXOP_RETF)
-                    break;
-                else if (dec_i.opcode == MXOP_CALL_FAR || dec_i.opcode == MXOP_JMP_FAR) {
-                    size_t i,inslen;
-
-                    /* if it's affected by an EXE relocation entry (touches the segment part), then we *can* trace it. */
-                    if (exe_relocation) {
-                        inslen = (size_t)(dec_i.end - dec_i.start);
-                        if ((*dec_i.start == 0x9AU || *dec_i.start == 0xEAU) && dec_i.argc == 1 &&
-                            dec_i.argv[0].segment == MX86_SEG_IMM &&
-                            dec_i.argv[0].regtype == MX86_RT_IMM) {
-                            for (i=0;i < exe_relocation_count;i++) {
-                                /* must affect the segment portion */
-                                if ((exe_relocation[i] == (ofs + 1 + 2) && inslen == 5) ||
-                                    (exe_relocation[i] == (ofs + 1 + 4) && inslen == 7)) {
-                                    unsigned long noffset =
-                                        ((unsigned long)dec_i.argv[0].segval << 4UL) + dec_i.argv[0].value;
-                                    printf("Far jmp/call, adjusted by relocation, detected, to %04lx+reloc:%04lx\n",
-                                        (unsigned long)dec_i.argv[0].segval,
-                                        (unsigned long)dec_i.argv[0].value);
-
-                                    label = dec_find_label(noffset);
-                                    if (label == NULL) {
-                                        if ((label=dec_label_malloc()) != NULL) {
-                                            if (dec_i.opcode == MXOP_JMP_FAR)
-                                                dec_label_set_name(label,"JMP FAR target");
-                                            else if (dec_i.opcode == MXOP_CALL_FAR)
-                                                dec_label_set_name(label,"CALL FAR target");
-
-                                            label->offset =
-                                                noffset;
-                                            label->seg_v =
-                                                dec_i.argv[0].segval;
-                                            label->ofs_v =
-                                                dec_i.argv[0].value;
-                                        }
-                                    }
-
-                                    break;
-                                }
-                            }
-                        }
-                    }
+            }
 
-                    if (dec_i.opcode == MXOP_JMP_FAR)
-                        break;
-                }
+            los++;
+        }
 
-                if (++inscount >= 1024)
-                    break;
-            } while(1);
+        dasm_fmt_free(&dec_fmt);
+        dasm_engine_build_blocks(&dec_eng);
 
-            los++;
+        /* who refers to what, by image offset like the labels */
+        if (dec_xref_error || dasm_xref_add_edges(&dec_xref,&dec_eng,0,0)) {
+            fprintf(stderr,"Out of memory during analysis\n");
+            return 1;
         }
+        dasm_xref_index_sort(&dec_xref);
+        printf("* 1st pass: %lu instructions, %lu basic blocks, %lu branch/call edges\n",
+            (unsigned long)dec_eng.insn_count,
+            (unsigned long)dec_eng.block_count,
+            (unsigned long)dec_eng.edge_count);
     }
 
     /* sort labels */
     dec_label_sort();
 
+    if (xref_file != NULL || dot_file != NULL) {
+        struct dasm_xref_func *fn = malloc((dec_label_count != 0 ? dec_label_count : 1) * sizeof(*fn));
+        size_t i;
+
+        if (fn == NULL) {
+            fprintf(stderr,"Out of memory\n");
+            return 1;
+        }
+
+        for (i=0;i < dec_label_count;i++) {
+            fn[i].seg = 0;
+            fn[i].ofs = dec_label[i].offset;
+            fn[i].name = dec_label[i].name;
+        }
+
+        if (xref_file != NULL && dasm_xref_save(xref_file,DASM_XREF_OUT_JSON,&dec_xref,fn,dec_label_count,0))
+            fprintf(stderr,"Unable to write %s\n",xref_file);
+        if (dot_file != NULL && dasm_xref_save(dot_file,DASM_XREF_OUT_DOT,&dec_xref,fn,dec_label_count,0))
+            fprintf(stderr,"Unable to write %s\n",dot_file);
+
+        free(fn);
+    }
+
     /* second pass: decompilation */
     entry_ofs = start_decom;
     entry_cs = start_cs;
@@ -608,19 +650,27 @@ int main(int argc,char **argv) {
     dec_ofs = 0;
     dec_cs = start_cs;
     printf("* 2nd pass decompiling now\n");
+    fflush(stdout);
+
+    if (jsonl_file != NULL) {
+        if ((jsonl_fp=fopen(jsonl_file,"w")) == NULL) {
+            fprintf(stderr,"Unable to open %s, %s\n",jsonl_file,strerror(errno));
+            return 1;
+        }
+    }
+
+    if (dasm_fmt_init(&dec_fmt,jsonl_fp ? jsonl_fp : stdout,jsonl_fp ? DASM_FMT_JSONL : DASM_FMT_TEXT)) {
+        fprintf(stderr,"Failed to alloc listing buffer\n");
+        return 1;
+    }
     labeli = 0;
     exereli = 0;
-    reset_buffer();
-    current_offset = start_decom;
-	minx86dec_init_state(&dec_st);
-    dec_read = dec_end = dec_buffer;
-	dec_st.data32 = dec_st.addr32 = 0;
-    if ((uint32_t)lseek(src_fd,start_decom,SEEK_SET) != start_decom)
-        return 1;
+    dec_pos = 0;
 
     do {
-        uint32_t ofs = (uint32_t)(dec_read - dec_buffer) + current_offset_minus_buffer() - start_decom;
+        uint32_t ofs = dec_pos;
         uint32_t ip = ofs + entry_ip - dec_ofs;
+        const struct dasm_insn *ins;
         unsigned char reloc_ann = 0;
         size_t inslen;
 
@@ -634,11 +684,19 @@ int main(int argc,char **argv) {
                 dec_cs = label->seg_v;
                 dec_ofs = label->offset;
 
-                printf("Label '%s' at %04lx:%04lx @0x%08lx\n",
+                dasm_fmt_printf(&dec_fmt,"Label '%s' at %04lx:%04lx @0x%08lx\n",
                         label->name ? label->name : "",
                         (unsigned long)label->seg_v,
                         (unsigned long)label->ofs_v,
                         (unsigned long)label->offset);
+                dasm_fmt_json_label(&dec_fmt,label->name,label->seg_v,label->ofs_v,label->offset);
+                {
+                    const struct dasm_xref *refs;
+                    size_t n;
+
+                    refs = dasm_xref_find(&dec_xref,0,label->offset,&n);
+                    dasm_fmt_xrefs(&dec_fmt,0,label->offset,refs,n,0);
+                }
 
                 label = dec_label + labeli;
                 dosek = 1;
@@ -647,11 +705,7 @@ int main(int argc,char **argv) {
             if (dosek) {
                 ofs = dec_ofs;
                 ip = entry_ip;
-
-                reset_buffer();
-                current_offset = start_decom + dec_ofs;
-                if ((uint32_t)lseek(src_fd,current_offset,SEEK_SET) != current_offset)
-                    return 1;
+                dec_pos = ofs;
             }
         }
 
@@ -662,43 +716,19 @@ int main(int argc,char **argv) {
             continue;
         }
 
-        if (!refill()) break;
+        /* the first pass already decoded most of this, the engine returns it from the cache */
+        ins = dasm_engine_decode(&dec_eng,ofs,ip);
+        if (ins == NULL) break;
 
-        minx86dec_set_buffer(&dec_st,dec_read,(int)(dec_end - dec_read));
-        minx86dec_init_instruction(&dec_i);
-		dec_st.ip_value = ip;
-		minx86dec_decodeall(&dec_st,&dec_i);
-        assert(dec_i.end >= dec_read);
-        assert(dec_i.end <= (dec_buffer+sizeof(dec_buffer)));
-        inslen = (size_t)(dec_i.end - dec_i.start);
+        dec_i = ins->i;
+        inslen = ins->dlen;
 
         while (exereli < exe_relocation_count && exe_relocation[exereli] < ofs)
             exereli++;
 
-		printf("%04lX:%04lX @0x%08lX ",(unsigned long)dec_cs,(unsigned long)dec_st.ip_value,(unsigned long)(dec_read - dec_buffer) + current_offset_minus_buffer());
-		for (c=0,iptr=dec_i.start;iptr != dec_i.end;c++)
-			printf("%02X ",*iptr++);
-
-        if (dec_i.rep != MX86_REP_NONE) {
-            for (;c < 6;c++)
-                printf("   ");
-
-            switch (dec_i.rep) {
-                case MX86_REPE:
-                    printf("REP   ");
-                    break;
-                case MX86_REPNE:
-                    printf("REPNE ");
-                    break;
-                default:
-                    break;
-            };
-        }
-        else {
-            for (;c < 8;c++)
-                printf("   ");
-        }
-        printf("%-8s ",opcode_string[dec_i.opcode]);
+        dasm_fmt_insn_begin(&dec_fmt,dec_cs,ip,4,start_decom + ofs);
+        dasm_fmt_insn_bytes(&dec_fmt,dec_i.start,(unsigned int)(dec_i.end - dec_i.start),dec_i.rep);
+        dasm_fmt_insn_op(&dec_fmt,dec_i.opcode);
 
         if (exereli < exe_relocation_count) {
             const uint32_t o = exe_relocation[exereli];
@@ -708,57 +738,54 @@ int main(int argc,char **argv) {
                         dec_i.argv[0].segment == MX86_SEG_IMM && dec_i.argv[0].regtype == MX86_RT_IMM) {
 
                     if (dec_i.argv[0].segval != 0)
-                        printf("<reloc_base+0x%04x>",dec_i.argv[0].segval);
+                        sprintf(tmp,"<reloc_base+0x%04x>:%04x",dec_i.argv[0].segval,dec_i.argv[0].value);
                     else
-                        printf("<reloc_base>");
-                    printf(":%04x",dec_i.argv[0].value);
+                        sprintf(tmp,"<reloc_base>:%04x",dec_i.argv[0].value);
+
+                    dasm_fmt_insn_arg_str(&dec_fmt,tmp);
                     reloc_ann = 1;
                 }
                 if ((dec_i.opcode == MXOP_MOV) && dec_i.argc == 2 &&
                         dec_i.argv[1].regtype == MX86_RT_IMM) {
 
-                    for (c=0;c < 1;) {
-                        minx86dec_regprint(&dec_i.argv[c],arg_c);
-                        printf("%s",arg_c);
-                        if (++c < dec_i.argc) printf(",");
-                    }
-
                     if (dec_i.argv[1].value != 0)
-                        printf("<reloc_base+0x%04x>",dec_i.argv[1].value);
+                        sprintf(tmp,"<reloc_base+0x%04x>",dec_i.argv[1].value);
                     else
-                        printf("<reloc_base>");
+                        sprintf(tmp,"<reloc_base>");
 
+                    dasm_fmt_insn_arg(&dec_fmt,&dec_i.argv[0]);
+                    dasm_fmt_insn_arg_str(&dec_fmt,tmp);
                     reloc_ann = 1;
                 }
             }
         }
 
-        if (!reloc_ann) {
-            for (c=0;c < dec_i.argc;) {
-                minx86dec_regprint(&dec_i.argv[c],arg_c);
-                printf("%s",arg_c);
-                if (++c < dec_i.argc) printf(",");
-            }
-        }
-		if (dec_i.lock) printf("  ; LOCK#");
-		printf("\n");
+        if (!reloc_ann)
+            dasm_fmt_insn_args(&dec_fmt,&dec_i);
+
+        dasm_fmt_insn_end(&dec_fmt,dec_i.lock);
 
         /* if any part of the instruction is affected by EXE relocations, say so */
         if (exereli < exe_relocation_count) {
             const uint32_t o = exe_relocation[exereli];
 
             if (o >= ofs && o < (ofs + inslen)) {
-                printf("             ^ EXE relocation base (WORD) added at +%u bytes (%04x:%04x 0x%08lx)\n",
+                dasm_fmt_printf(&dec_fmt,"             ^ EXE relocation base (WORD) added at +%u bytes (%04x:%04x 0x%08lx)\n",
                         (unsigned int)(o - ofs),
                         (unsigned int)dec_cs,
-                        (unsigned int)dec_st.ip_value + (unsigned int)(o - ofs),
+                        (unsigned int)ip + (unsigned int)(o - ofs),
                         (unsigned long)ofs);
             }
         }
 
-        dec_read = dec_i.end;
+        dec_pos = ofs + ins->len;
     } while(1);
 
+    dasm_fmt_free(&dec_fmt);
+    if (jsonl_fp != NULL) fclose(jsonl_fp);
+    dasm_xref_index_free(&dec_xref);
+    dasm_engine_free(&dec_eng);
+    free(dec_image);
     close(src_fd);
     dec_free_labels();
 	return 0;
@@ -883,6 +883,11 @@ const char *vxd_service_to_name(const uint16_t vid,const uint16_t sid) {
 #include <hw/dos/exelehdr.h>
 #include <hw/dos/exelepar.h>
 
+#include "dasmeng.h"
+#include "dasmfmt.h"
+#include "dasmdb.h"
+#include "dasmxref.h"
+
 #ifndef O_BINARY
 #define O_BINARY 0
 #endif
@@ -954,22 +959,13 @@ void dec_label_set_name(struct dec_label *l,const char *s) {
 struct dec_label*               dec_label = NULL;
 size_t                          dec_label_count = 0;
 size_t                          dec_label_alloc = 0;
-unsigned long                   dec_ofs;
-uint16_t                        dec_cs;
+struct dasm_label_index         dec_label_index;
+
+/* cross references, made after the first pass. read-only in the second pass */
+struct dasm_xref_index          dec_xref;
 
 char                            name_tmp[255+1];
 
-uint8_t                         dec_buffer[512];
-uint8_t*                        dec_read;
-uint8_t*                        dec_end;
-char                            arg_c[101];
-struct minx86dec_state          dec_st;
-struct minx86dec_instruction    dec_i;
-minx86_read_ptr_t               iptr;
-uint16_t                        entry_cs,entry_ip;
-uint16_t                        start_cs,start_ip;
-uint32_t                        start_decom,end_decom,entry_ofs;
-uint32_t                        current_offset;
 unsigned char                   is_vxd = 0;
 
 struct exe_dos_header           exehdr;
@@ -978,10 +974,16 @@ uint32_t                        load_base = 0x00400000;
 
 char*                           sym_file = NULL;
 char*                           label_file = NULL;
+char*                           jsonl_file = NULL;
+char*                           db_file = NULL;
+char*                           xref_file = NULL;
+char*                           dot_file = NULL;
 
 char*                           src_file = NULL;
 int                             src_fd = -1;
 
+unsigned int                    num_threads = 1; /* 0 = one per CPU */
+
 void dec_free_labels() {
     unsigned int i=0;
 
@@ -996,20 +998,10 @@ void dec_free_labels() {
 
     free(dec_label);
     dec_label = NULL;
-}
-
-uint32_t current_offset_minus_buffer() {
-    return current_offset - (uint32_t)(dec_end - dec_buffer);
-}
-
-static void minx86dec_init_state(struct minx86dec_state *st) {
-	memset(st,0,sizeof(*st));
-}
+    dec_label_count = 0;
+    dec_label_alloc = 0;
 
-static void minx86dec_set_buffer(struct minx86dec_state *st,uint8_t *buf,int sz) {
-	st->fence = buf + sz;
-	st->prefetch_fence = dec_buffer + sizeof(dec_buffer) - 16;
-	st->read_ip = buf;
+    dasm_label_index_free(&dec_label_index);
 }
 
 void help() {
@@ -1019,34 +1011,27 @@ void help() {
     fprintf(stderr,"    -lf <file>       Text file to define labels\n");
     fprintf(stderr,"    -sym <file>      Module symbols file\n");
     fprintf(stderr,"    -b <a>           Load base\n");
+    fprintf(stderr,"    -j <n>           Disassemble objects with n threads (0 = one per CPU)\n");
+    fprintf(stderr,"    -jsonl <file>    Write the listing to <file> as JSON lines\n");
+    fprintf(stderr,"    -db <file>       Analysis database, reused if made from the same file\n");
+    fprintf(stderr,"    -xref <file>     Write cross references and the call graph to <file> as JSON\n");
+    fprintf(stderr,"    -dot <file>      Write the call graph to <file> as Graphviz DOT\n");
 }
 
 void print_entry_table_locate_name_by_ordinal(const struct exe_ne_header_name_entry_table * const nonresnames,const struct exe_ne_header_name_entry_table *resnames,const unsigned int ordinal) {
+    const struct exe_ne_header_name_entry *ent;
     char tmp[255+1];
-    unsigned int i;
-
-    if (resnames->table != NULL) {
-        for (i=0;i < resnames->length;i++) {
-            struct exe_ne_header_name_entry *ent = resnames->table + i;
 
-            if (ne_name_entry_get_ordinal(resnames,ent) == ordinal) {
-                ne_name_entry_get_name(tmp,sizeof(tmp),resnames,ent);
-                printf(" RESIDENT NAME '%s' ",tmp);
-                return;
-            }
-        }
+    if ((ent=ne_name_entry_find_by_ordinal(resnames,ordinal)) != NULL) {
+        ne_name_entry_get_name(tmp,sizeof(tmp),resnames,ent);
+        printf(" RESIDENT NAME '%s' ",tmp);
+        return;
     }
 
-    if (nonresnames->table != NULL) {
-        for (i=0;i < nonresnames->length;i++) {
-            struct exe_ne_header_name_entry *ent = nonresnames->table + i;
-
-            if (ne_name_entry_get_ordinal(nonresnames,ent) == ordinal) {
-                ne_name_entry_get_name(tmp,sizeof(tmp),nonresnames,ent);
-                printf(" NONRESIDENT NAME '%s' ",tmp);
-                return;
-            }
-        }
+    if ((ent=ne_name_entry_find_by_ordinal(nonresnames,ordinal)) != NULL) {
+        ne_name_entry_get_name(tmp,sizeof(tmp),nonresnames,ent);
+        printf(" NONRESIDENT NAME '%s' ",tmp);
+        return;
     }
 }
 
@@ -1081,6 +1066,27 @@ int parse_argv(int argc,char **argv) {
                 if (a == NULL) return 1;
                 load_base = (uint32_t)strtoul(a,NULL,0);
             }
+            else if (!strcmp(a,"jsonl")) {
+                jsonl_file = argv[i++];
+                if (jsonl_file == NULL) return 1;
+            }
+            else if (!strcmp(a,"db")) {
+                db_file = argv[i++];
+                if (db_file == NULL) return 1;
+            }
+            else if (!strcmp(a,"xref")) {
+                xref_file = argv[i++];
+                if (xref_file == NULL) return 1;
+            }
+            else if (!strcmp(a,"dot")) {
+                dot_file = argv[i++];
+                if (dot_file == NULL) return 1;
+            }
+            else if (!strcmp(a,"j")) {
+                a = argv[i++];
+                if (a == NULL) return 1;
+                num_threads = (unsigned int)strtoul(a,NULL,0);
+            }
             else {
                 fprintf(stderr,"Unknown switch %s\n",a);
                 return 1;
@@ -1100,47 +1106,114 @@ int parse_argv(int argc,char **argv) {
     return 0;
 }
 
-void reset_buffer() {
-    current_offset = 0;
-    dec_read = dec_end = dec_buffer;
+/* per-object state for the analysis engine */
+struct le_object_dasm {
+    struct dasm_engine                              eng;
+    struct le_vmap_trackio                          io;
+    const struct le_header_parseinfo*               lep;
+    uint16_t                                        object;         /* 1-based */
+    uint32_t                                        ip_base;        /* IP of offset 0 (linear address if 32-bit) */
+    uint16_t                                        cs;             /* object number of labels in this object (the flat object if 32-bit) */
+    unsigned char                                   ready;
+    unsigned char                                   job;            /* has work in the current round */
+    unsigned char                                   error;
+    unsigned char                                   restored;       /* engine restored from the analysis database */
+    unsigned char                                   fixups_ready;
+    unsigned char                                   fixups_error;
+    struct dasm_fmt*                                fmt;            /* listing of this job */
+    struct dasm_reloc_map                           fixups;         /* 32-bit offset fixups by linear address */
+
+    /* labels found by this object in the current round of the first pass */
+    struct dec_label*                               newlabel;
+    size_t                                          newlabel_count;
+    size_t                                          newlabel_alloc;
+    struct dasm_label_index                         newlabel_index;
+};
+
+/* engine read callback: offset is relative to the start of the object.
+ * only used for objects that le_image_load() could not load. */
+int le_object_read(void *user,uint32_t offset,unsigned char *buf,unsigned int len) {
+    struct le_object_dasm *od = (struct le_object_dasm*)user;
+
+    if (!le_segofs_to_trackio(&od->io,od->object,offset,od->lep))
+        return 0;
+
+    return le_trackio_read(buf,(int)len,src_fd,&od->io,od->lep);
+}
+
+int is_vxdcall(const struct minx86dec_instruction *i) {
+    return is_vxd && i->opcode == MXOP_INT && i->argc == 1 &&
+        i->argv[0].regtype == MX86_RT_IMM && i->argv[0].value == 0x20;
 }
 
-int refill(struct le_vmap_trackio * const io,struct le_header_parseinfo * const p) {
-    const size_t flush = sizeof(dec_buffer) / 2;
-    const size_t padding = 16;
-    size_t dlen;
+/* engine extra bytes callback: Windows VXDs use INT 20h followed by two WORDs to call other VXDs */
+unsigned int le_object_extra(void *user,const struct dasm_insn *ins) {
+    (void)user;
+    return is_vxdcall(&ins->i) ? (2u+2u) : 0u;
+}
 
-    if (dec_end > dec_read)
-        dlen = (size_t)(dec_end - dec_read);
-    else
-        dlen = 0;
+int le_object_dasm_setup(struct le_object_dasm *od,const struct le_header_parseinfo *lep,const struct le_image *img,unsigned int objecti) {
+    const struct exe_le_header_object_table_entry *ent = lep->le_object_table + objecti;
 
-    if (dec_read >= (dec_buffer+flush)) {
-        assert((dec_read+dlen) <= (dec_buffer+sizeof(dec_buffer)-padding));
-        if (dlen != 0) memmove(dec_buffer,dec_read,dlen);
-        dec_read = dec_buffer;
-        dec_end = dec_buffer + dlen;
+    if (od->ready)
+        return 0;
+
+    dasm_engine_init(&od->eng);
+    od->lep = lep;
+    od->object = (uint16_t)(objecti + 1);
+    od->eng.length = ent->virtual_segment_size;
+    od->eng.max_run = 1024;
+    od->eng.read = le_object_read;
+    od->eng.extra = le_object_extra;
+    od->eng.user = od;
+
+    /* decode straight from the object as loaded into memory, through the page map */
+    if (objecti < img->objects && img->object[objecti].data != NULL && img->object[objecti].size >= od->eng.length)
+        od->eng.image = img->object[objecti].data;
+
+    if (ent->object_flags & LE_HEADER_OBJECT_TABLE_ENTRY_FLAGS_386_BIG_DEFAULT) {
+        od->ip_base = lep->le_object_table_loaded_linear[objecti];
+        od->eng.offset_mask = 0xFFFFFFFFUL;
+        od->eng.data32 = 1;
+        od->cs = lep->le_object_flat_32bit;
     }
-    {
-        unsigned char *e = dec_buffer + sizeof(dec_buffer) - padding;
-
-        if (dec_end < e) {
-            unsigned long clen = end_decom - current_offset;
-            dlen = (size_t)(e - dec_end);
-            if ((unsigned long)dlen > clen)
-                dlen = (size_t)clen;
-
-            if (dlen != 0) {
-                int rd = le_trackio_read(dec_end,dlen,src_fd,io,p);
-                if (rd > 0) {
-                    dec_end += rd;
-                    current_offset += (unsigned long)rd;
-                }
-            }
-        }
+    else {
+        od->ip_base = 0;
+        od->eng.offset_mask = 0xFFFFUL;
+        od->eng.data32 = 0;
+        od->cs = od->object;
     }
 
-    return (dec_read < dec_end);
+    if (dasm_engine_setup(&od->eng))
+        return -1;
+
+    od->ready = 1;
+    return 0;
+}
+
+void le_object_newlabel_clear(struct le_object_dasm *od) {
+    size_t i;
+
+    for (i=0;i < od->newlabel_count;i++)
+        cstr_free(&(od->newlabel[i].name));
+
+    od->newlabel_count = 0;
+    dasm_label_index_clear(&od->newlabel_index);
+}
+
+void le_object_dasm_free(struct le_object_dasm *od) {
+    le_object_newlabel_clear(od);
+    dasm_label_index_free(&od->newlabel_index);
+    if (od->newlabel) free(od->newlabel);
+    od->newlabel = NULL;
+    od->newlabel_alloc = 0;
+
+    dasm_engine_free(&od->eng);
+    dasm_reloc_map_free(&od->fixups);
+    od->fixups_ready = 0;
+    od->fixups_error = 0;
+    od->restored = 0;
+    od->ready = 0;
 }
 
 void dec_label_xlate_32flat(struct dec_label *l,struct le_header_parseinfo *p) {
@@ -1180,30 +1253,62 @@ void dec_label_xlate_32flat_always(struct dec_label *l,struct le_header_parseinf
     }
 }
 
-struct dec_label *dec_find_label(const uint16_t so,const uint32_t oo) {
-    unsigned int i=0;
+/* index the labels added since the last lookup */
+void dec_label_index_update() {
+    while (dec_label_index.indexed < dec_label_count) {
+        const struct dec_label *l = dec_label + dec_label_index.indexed;
+
+        if (dasm_label_index_add(&dec_label_index,l->seg_v,l->ofs_v,(uint32_t)dec_label_index.indexed))
+            break;
+
+        dec_label_index.indexed++;
+    }
+}
+
+/* look up a label without updating the index. several threads may do this at once, as long as none of them adds labels */
+struct dec_label *dec_find_label_indexed(const uint16_t so,const uint32_t oo) {
+    uint32_t n;
 
     if (dec_label == NULL)
         return NULL;
 
-    while (i < dec_label_count) {
-        struct dec_label *l = dec_label + i;
+    n = dasm_label_index_find(&dec_label_index,so,oo);
+    if (n != DASM_LABEL_NONE)
+        return dec_label + n;
+
+    /* labels the index could not take (out of memory) */
+    for (n=(uint32_t)dec_label_index.indexed;n < dec_label_count;n++) {
+        struct dec_label *l = dec_label + n;
 
         if (l->seg_v == so && l->ofs_v == oo)
             return l;
-
-        i++;
     }
 
     return NULL;
 }
 
+struct dec_label *dec_find_label(const uint16_t so,const uint32_t oo) {
+    dec_label_index_update();
+    return dec_find_label_indexed(so,oo);
+}
+
+/* the label array grows as needed. pointers to labels are not valid across calls to this function. */
 struct dec_label *dec_label_malloc() {
-    if (dec_label == NULL)
-        return NULL;
+    if (dec_label_count >= dec_label_alloc) {
+        const size_t na = (dec_label_alloc != 0) ? (dec_label_alloc * 2) : 4096;
+        struct dec_label *np;
 
-    if (dec_label_count >= dec_label_alloc)
-        return NULL;
+        if (na <= dec_label_alloc || na > (((size_t)-1) / sizeof(*np)))
+            return NULL;
+
+        np = realloc(dec_label,na * sizeof(*np));
+        if (np == NULL)
+            return NULL;
+
+        memset(np + dec_label_alloc,0,(na - dec_label_alloc) * sizeof(*np));
+        dec_label = np;
+        dec_label_alloc = na;
+    }
 
     return dec_label + (dec_label_count++);
 }
@@ -1244,108 +1349,644 @@ void dec_label_sort() {
         return;
 
     qsort(dec_label,dec_label_count,sizeof(*dec_label),dec_label_qsortcb);
+    dasm_label_index_clear(&dec_label_index);
 }
 
-struct fixup_tracking_window_ent {
-    uint32_t                                    fixup_rec_page;     // page it belongs to
-    uint32_t                                    fixup_rec_index;    // index within page record array
-    uint32_t                                    linear_address;     // linear memory address that relocation is applied to
-};
+/* load the 32-bit offset fixups of an object into a map by linear address.
+ * m->ent[].table is the fixup page the record is in, index the record within the page. */
+int le_object_load_fixups(const struct le_header_parseinfo *lep,unsigned int i,struct dasm_reloc_map *m) {
+    const struct exe_le_header_object_table_entry *ent = lep->le_object_table + i;
+    struct le_header_fixup_record_table *frtable;
+    unsigned int srcoff_count,srcoff_i;
+    unsigned char flags,src;
+    uint32_t srclinoff;
+    unsigned char *raw;
+    uint16_t srcoff;
+    uint32_t page;
+    size_t ti;
+
+    if (lep->le_fixup_records.table == NULL)
+        return 0;
 
-// table:
-//    0 <= read <= length <= alloc
-struct fixup_tracking_window {
-    struct fixup_tracking_window_ent*           table;
-    size_t                                      read;
-    size_t                                      length;
-    size_t                                      alloc;
-};
+    for (page=ent->page_map_index;page < (ent->page_map_index + ent->page_map_entries);page++) {
+        uint32_t pagelinoff =
+            ((uint32_t)page - (uint32_t)ent->page_map_index) * (uint32_t)lep->le_header.memory_page_size;
+
+        if (page == 0 || page > lep->le_header.number_of_memory_pages)
+            continue;
+
+        frtable = lep->le_fixup_records.table + page - 1;
+        if (frtable->table == NULL || frtable->length == 0)
+            continue;
+
+        for (ti=0;ti < frtable->length;ti++) {
+            raw = le_header_fixup_record_table_get_raw_entry(frtable,ti);
+
+            // caller ensures the record is long enough
+            src = *raw++;
+            flags = *raw++;
+
+            if (src & 0xC0)
+                continue;
+
+            if (src & 0x20) {
+                srcoff_count = *raw++; //number of source offsets. object follows, then array of srcoff
+            }
+            else {
+                srcoff_count = 1;
+                srcoff = *((int16_t*)raw); raw += 2;
+            }
+
+            if ((flags&3) != 0) // internal reference only
+                continue;
+
+            if (flags&0x40) {
+                raw += 2; /* tobject = *((uint16_t*)raw); */
+            }
+            else {
+                raw++; /* tobject = *raw++; */
+            }
+
+            if ((src&0xF) != 0x2) { /* not 16-bit selector fixup */
+                if (flags&0x10) { // 32-bit target offset
+                    raw += 4; /* trgoff = *((uint32_t*)raw); */
+                }
+                else { // 16-bit target offset
+                    raw += 2; /* trgoff = *((uint16_t*)raw); */
+                }
+            }
+
+            if ((src&0xF) != 0x7) // must be 32-bit offset fixup
+                continue;
+
+            for (srcoff_i=0;srcoff_i < srcoff_count;srcoff_i++) {
+                if (src & 0x20) {
+                    srcoff = *((int16_t*)raw); raw += 2;
+                }
+
+                // what is the relocation relative to the struct we just read?
+                srclinoff =
+                    lep->le_object_table_loaded_linear[i] + pagelinoff + (uint32_t)srcoff;
+                if (dasm_reloc_map_add(m,srclinoff,page,(uint32_t)ti))
+                    return -1;
+            }
+        }
+    }
+
+    dasm_reloc_map_sort(m);
+    return 0;
+}
+
+/* the fixups of an object, from the analysis database if it has them, or else from the file */
+void le_object_fixups(struct le_object_dasm *od,const struct dasm_db *db) {
+    if (od->fixups_ready || od->fixups_error)
+        return;
+
+    if (db != NULL && od->restored && dasm_db_restore_relocs(db,od->object - 1,&od->fixups) > 0)
+        od->fixups_ready = 1;
+    else if (le_object_load_fixups(od->lep,od->object - 1,&od->fixups) == 0)
+        od->fixups_ready = 1;
+    else
+        od->fixups_error = 1;
+}
+
+/* target of an internal fixup, keyed the way labels are: linear address in the flat object
+ * if the target object is 32-bit, else object:offset. returns 0 if not an internal offset fixup */
+int le_fixup_target(const struct le_header_parseinfo *lep,const struct dasm_reloc *r,uint32_t *seg,uint32_t *ofs) {
+    const struct exe_le_header_object_table_entry *tent;
+    struct le_header_fixup_record_table *frtable;
+    unsigned char flags,src;
+    unsigned char *raw;
+    uint16_t tobject;
+    uint32_t trgoff;
+
+    if (r->table == 0 || r->table > lep->le_header.number_of_memory_pages)
+        return 0;
+
+    frtable = lep->le_fixup_records.table + r->table - 1;
+    if ((raw=le_header_fixup_record_table_get_raw_entry(frtable,r->index)) == NULL)
+        return 0;
+
+    src = *raw++;
+    flags = *raw++;
 
-void fixup_tracking_window_init(struct fixup_tracking_window *w) {
-    memset(w,0,sizeof(*w));
+    if ((flags&3) != 0 || (src&0xF) == 0x2) // internal reference, not 16-bit selector fixup
+        return 0;
+
+    if (src & 0x20)
+        raw++; //number of source offsets. object follows, then array of srcoff
+    else
+        raw += 2; //srcoff
+
+    if (flags&0x40) {
+        tobject = *((uint16_t*)raw); raw += 2;
+    }
+    else {
+        tobject = *raw++;
+    }
+
+    if (flags&0x10) { // 32-bit target offset
+        trgoff = *((uint32_t*)raw); raw += 4;
+    }
+    else { // 16-bit target offset
+        trgoff = *((uint16_t*)raw); raw += 2;
+    }
+
+    if (tobject == 0 || tobject > lep->le_header.object_table_entries)
+        return 0;
+
+    tent = lep->le_object_table + tobject - 1;
+    if (tent->object_flags & LE_HEADER_OBJECT_TABLE_ENTRY_FLAGS_386_BIG_DEFAULT) {
+        *seg = lep->le_object_flat_32bit;
+        *ofs = lep->le_object_table_loaded_linear[tobject - 1] + trgoff;
+    }
+    else {
+        *seg = tobject;
+        *ofs = trgoff;
+    }
+
+    return 1;
 }
 
-void fixup_tracking_window_free(struct fixup_tracking_window *w) {
-    if (w->table) free(w->table);
-    w->table = NULL;
-    w->length = 0;
-    w->alloc = 0;
-    w->read = 0;
+/* cross references of an object: its branch/call edges, and the fixups within walked instructions */
+int le_object_xrefs(struct le_object_dasm *od,struct dasm_xref_index *x) {
+    const struct dasm_insn *ins;
+    uint32_t seg,ofs,back;
+    size_t i;
+
+    if (dasm_xref_add_edges(x,&od->eng,od->cs,od->ip_base))
+        return -1;
+
+    for (i=0;i < od->fixups.count;i++) {
+        const struct dasm_reloc *r = od->fixups.ent + i;
+
+        if (r->addr < od->ip_base || !le_fixup_target(od->lep,r,&seg,&ofs))
+            continue;
+
+        back = 0;
+        while ((ins=dasm_engine_walked_at(&od->eng,r->addr - od->ip_base,od->ip_base,&back)) != NULL) {
+            if (dasm_xref_add(x,od->cs,ins->ip,seg,ofs,DASM_XREF_DATA))
+                return -1;
+        }
+    }
+
+    return 0;
 }
 
-void fixup_tracking_window_flush(struct fixup_tracking_window *w) {
-    size_t mc;
+/* print one instruction */
+void print_insn(struct dasm_fmt *fmt,const struct dasm_insn *ins,const struct exe_le_header_object_table_entry *ent,const uint16_t dec_cs) {
+    struct minx86dec_instruction dec_i;
+    char tmp[256];
+
+    dec_i = ins->i;
 
-    if (w->table == NULL) return;
-    if (w->read == 0) return;
-    if (w->read >= w->length) return;
+    if (ent->object_flags & LE_HEADER_OBJECT_TABLE_ENTRY_FLAGS_386_BIG_DEFAULT)
+        dasm_fmt_insn_begin(fmt,dec_cs,ins->ip,8,DASM_FMT_NO_FILE);
+    else
+        dasm_fmt_insn_begin(fmt,dec_cs,ins->ip,4,DASM_FMT_NO_FILE);
+
+    /* includes the two WORDs following INT 20h VXDCALL */
+    dasm_fmt_insn_bytes(fmt,dec_i.start,ins->len,dec_i.rep);
+
+    // Special instruction:
+    //   Windows VXDs use INT 20h followed by two WORDs to call other VXDs.
+    if (is_vxdcall(&dec_i)) {
+        // INT 20h WORD, WORD
+        // the decompiler should have set the instruction pointer at the first WORD now.
+        uint16_t vxd_device,vxd_service;
+
+        vxd_service = *((uint16_t*)dec_i.end); dec_i.end += 2;
+        vxd_device = *((uint16_t*)dec_i.end); dec_i.end += 2;
+
+        // bit 15 of the service indicates a jmp, not call
+        if (vxd_service & 0x8000) {
+            dasm_fmt_insn_op_name(fmt,"VxDJmp");
+            snprintf(tmp,sizeof(tmp),"Device=0x%04X '%s' Service=0x%04X '%s'",
+                vxd_device,
+                vxd_device_to_name(vxd_device),
+                vxd_service & 0x7FFF,
+                vxd_service_to_name(vxd_device,vxd_service & 0x7FFF));
+        }
+        else {
+            dasm_fmt_insn_op_name(fmt,"VxDCall");
+            snprintf(tmp,sizeof(tmp),"Device=0x%04X '%s' Service=0x%04X '%s'",
+                vxd_device,
+                vxd_device_to_name(vxd_device),
+                vxd_service,
+                vxd_service_to_name(vxd_device,vxd_service));
+        }
 
-    mc = w->length - w->read;
-    memmove(w->table,w->table + w->read,mc * sizeof(struct fixup_tracking_window_ent));
-    w->length = mc;
-    w->read = 0;
+        dasm_fmt_insn_arg_str(fmt,tmp);
+    }
+    else {
+        dasm_fmt_insn_op(fmt,dec_i.opcode);
+        dasm_fmt_insn_args(fmt,&dec_i);
+    }
+
+    dasm_fmt_insn_end(fmt,dec_i.lock);
 }
 
-void fixup_tracking_window_lazy_flush(struct fixup_tracking_window *w) {
-    if (w->read >= (w->alloc / 2))
-        fixup_tracking_window_flush(w);
+/* remember a label found by the first pass of an object, unless it is already known.
+ * dec_label[] is only added to between rounds of the first pass (see le_object_newlabel_merge)
+ * so that objects can be walked in parallel while reading it. */
+struct dec_label *le_object_newlabel(struct le_object_dasm *od,const uint16_t so,const uint32_t oo,const char *name) {
+    struct dec_label *l;
+
+    if (dec_find_label_indexed(so,oo) != NULL)
+        return NULL;
+    if (dasm_label_index_find(&od->newlabel_index,so,oo) != DASM_LABEL_NONE)
+        return NULL;
+
+    if (od->newlabel_count >= od->newlabel_alloc) {
+        const size_t na = (od->newlabel_alloc != 0) ? (od->newlabel_alloc * 2) : 256;
+        struct dec_label *np;
+
+        if (na > (((size_t)-1) / sizeof(*np)))
+            return NULL;
+
+        np = realloc(od->newlabel,na * sizeof(*np));
+        if (np == NULL)
+            return NULL;
+
+        od->newlabel = np;
+        od->newlabel_alloc = na;
+    }
+
+    l = od->newlabel + od->newlabel_count;
+    memset(l,0,sizeof(*l));
+    dec_label_set_name(l,name);
+    l->seg_v = so;
+    l->ofs_v = oo;
+    dec_label_xlate_32flat(l,(struct le_header_parseinfo*)od->lep);
+
+    /* if the index is out of memory, the label may be added twice. merging catches that. */
+    dasm_label_index_add(&od->newlabel_index,so,oo,(uint32_t)od->newlabel_count);
+    od->newlabel_count++;
+    return l;
 }
 
-void fixup_tracking_window_alloc(struct fixup_tracking_window *w) {
-    if (w->table == NULL) {
-        w->alloc = 2048;
-        w->table = malloc(w->alloc * sizeof(struct fixup_tracking_window_ent));
-        if (w->table == NULL) return;
-        w->length = 0;
-        w->read = 0;
+/* add the labels an object found to dec_label[] */
+void le_object_newlabel_merge(struct le_object_dasm *od) {
+    struct dec_label *label;
+    size_t i;
+
+    for (i=0;i < od->newlabel_count;i++) {
+        struct dec_label *nl = od->newlabel + i;
+
+        if (dec_find_label(nl->seg_v,nl->ofs_v) != NULL)
+            continue;
+
+        if ((label=dec_label_malloc()) != NULL) {
+            label->name = nl->name; /* take the string */
+            label->seg_v = nl->seg_v;
+            label->ofs_v = nl->ofs_v;
+            nl->name = NULL;
+        }
     }
+
+    le_object_newlabel_clear(od);
 }
 
-struct fixup_tracking_window_ent *fixup_tracking_window_alloc_entry(struct fixup_tracking_window *w) {
-    size_t entry;
+/* first pass: called by the analysis engine for each instruction walked */
+int first_pass_insn(struct dasm_engine *e,const struct dasm_insn *ins,void *user) {
+    struct le_object_dasm *od = (struct le_object_dasm*)user;
+
+    (void)e;
+
+    print_insn(od->fmt,ins,od->lep->le_object_table + od->object - 1,od->cs);
+
+    if (ins->flags & DASM_INSN_HAS_TARGET) {
+        /* make a label of the target */
+        uint32_t toffset = ins->target_ip;
 
-    if (w->table == NULL) {
-        fixup_tracking_window_alloc(w);
-        if (w->table == NULL) return NULL;
+        dasm_fmt_printf(od->fmt,"Target: 0x%04lx\n",(unsigned long)toffset);
+
+        le_object_newlabel(od,od->cs,toffset,(ins->flow == DASM_FLOW_CALL) ? "CALL target" : "JMP target");
     }
 
-    if (w->length >= w->alloc) {
-        fixup_tracking_window_flush(w);
-        if (w->length >= w->alloc) return NULL;
+    return 0;
+}
+
+/* object and offset a label points at. flat 32-bit labels are linear addresses. */
+int le_label_to_object(const struct dec_label *label,const struct le_header_parseinfo *lep,unsigned int *objecti,uint32_t *offset) {
+    struct le_vmap_trackio io;
+
+    if (label->seg_v == 0 || label->seg_v > lep->le_header.object_table_entries)
+        return 0;
+
+    if (label->seg_v == lep->le_object_flat_32bit) {
+        if (!le_segofs_to_trackio(&io,0/*flat*/,label->ofs_v,lep))
+            return 0;
+
+        *objecti = io.object - 1;
+        *offset = io.offset;
     }
     else {
-        fixup_tracking_window_lazy_flush(w);
+        *objecti = label->seg_v - 1;
+        *offset = label->ofs_v;
     }
 
-    entry = w->length++;
-    return w->table + entry;
+    return 1;
 }
 
-int fixup_window_sort(const void *a,const void *b) {
-    const struct fixup_tracking_window_ent *fa =
-        (const struct fixup_tracking_window_ent *)a;
-    const struct fixup_tracking_window_ent *fb =
-        (const struct fixup_tracking_window_ent *)b;
+/* first pass of one object: walk the code from each label of this round that has not been walked yet */
+void first_pass_object(struct le_object_dasm *od,size_t label_first,size_t label_end) {
+    const struct dec_label *label;
+    unsigned int objecti;
+    uint32_t offset;
+    size_t los;
+
+    for (los=label_first;los < label_end;los++) {
+        label = dec_label + los;
+        if (!le_label_to_object(label,od->lep,&objecti,&offset) || objecti != (unsigned int)(od->object - 1))
+            continue;
+
+        if (offset < od->eng.length && !dasm_engine_seen(&od->eng,offset)) {
+            dasm_fmt_printf(od->fmt,"* NE segment #%d : 0x%04lx 1st pass from '%s'\n",
+                (unsigned int)od->cs,(unsigned long)label->ofs_v,label->name);
+
+            if (dasm_engine_queue(&od->eng,offset,od->ip_base + offset) < 0 ||
+                dasm_engine_run(&od->eng,first_pass_insn,od) < 0) {
+                od->error = 1;
+                break;
+            }
+        }
+    }
+}
 
-    if (fa->linear_address < fb->linear_address)
-        return -1;
-    if (fa->linear_address > fb->linear_address)
-        return 1;
+/* second pass of one object: the listing, with labels and fixups */
+void second_pass_object(struct le_object_dasm *od,struct dasm_fmt *fmt) {
+    const struct le_header_parseinfo *lep = od->lep;
+    const unsigned int i = od->object - 1;
+    const struct exe_le_header_object_table_entry *ent = lep->le_object_table + i;
+    const struct dasm_reloc *fixent;
+    const struct dasm_insn *ins;
+    const struct dec_label *label;
+    unsigned int labeli;
+    uint32_t page_base;
+    uint16_t dec_cs;
+    uint32_t page;
+    size_t inslen;
+    uint32_t pos;
+
+    dasm_fmt_printf(fmt,"* LE object #%u (%u-bit)\n",
+        i + 1,
+        (ent->object_flags & LE_HEADER_OBJECT_TABLE_ENTRY_FLAGS_386_BIG_DEFAULT) ? 32 : 16);
+    if (!(ent->object_flags & LE_HEADER_OBJECT_TABLE_ENTRY_FLAGS_EXECUTABLE)) {
+        dasm_fmt_printf(fmt,"    Ignoring data object\n");
+        return;
+    }
+
+    if (!od->ready)
+        return;
+
+    /* all of the object's fixups, sorted once. the listing moves through them in order */
+    le_object_fixups(od,NULL);
+    if (od->fixups_error)
+        dasm_fmt_printf(fmt,"! unable to alloc reloc tracking\n");
+
+    labeli = 0;
+    pos = 0;
+    page = ent->page_map_index;
+    page_base = od->ip_base;
+    dec_cs = od->cs;
+
+    do {
+        uint32_t ofs = pos;
+        uint32_t ip = od->ip_base + ofs;
+        unsigned char dosek = 0;
+        uint32_t label_ip = 0;
+
+        while (labeli < dec_label_count) {
+            label = dec_label + labeli;
+            if (label->seg_v != dec_cs) {
+                labeli++;
+                continue;
+            }
+
+            if (ent->object_flags & LE_HEADER_OBJECT_TABLE_ENTRY_FLAGS_386_BIG_DEFAULT) {
+                if (label->ofs_v < lep->le_object_table_loaded_linear[i]) {
+                    labeli++;
+                    continue;
+                }
+            }
+
+            if (ip < label->ofs_v)
+                break;
+
+            labeli++;
+            label_ip = label->ofs_v;
+
+            dasm_fmt_printf(fmt,"Label '%s' at %04lx:%04lx\n",
+                    label->name ? label->name : "",
+                    (unsigned long)label->seg_v,
+                    (unsigned long)label->ofs_v);
+            dasm_fmt_json_label(fmt,label->name,label->seg_v,label->ofs_v,DASM_FMT_NO_FILE);
+            {
+                const struct dasm_xref *refs;
+                size_t n;
+
+                refs = dasm_xref_find(&dec_xref,label->seg_v,label->ofs_v,&n);
+                dasm_fmt_xrefs(fmt,label->seg_v,label->ofs_v,refs,n,1);
+            }
+
+            label = dec_label + labeli;
+            dosek = 1;
+        }
+
+        if (dosek) {
+            ip = label_ip;
+            ofs = ip - od->ip_base;
+        }
+
+        ins = dasm_engine_decode(&od->eng,ofs,ip);
+        if (ins == NULL) break;
+
+        /* note the fixup pages as the listing reaches them, slightly ahead (16 bytes)
+         * because relocations that span pages reach backwards into the prior page. */
+        if (lep->le_fixup_records.table != NULL) {
+            uint32_t pob = ip + (uint32_t)16 - page_base;
+            uint32_t po = (pob / (uint32_t)lep->le_header.memory_page_size) + ent->page_map_index;
+            struct le_header_fixup_record_table *frtable;
+
+            while (page <= po) {
+                if (page != 0 && page <= lep->le_header.number_of_memory_pages) {
+                    frtable = lep->le_fixup_records.table + page - 1;
+                    if (frtable->table != NULL && frtable->length != 0)
+                        dasm_fmt_printf(fmt,"* Loading relocations for page #%u\n",page);
+                }
+
+                page++;
+            }
+        }
+
+        inslen = ins->dlen;
+
+        print_insn(fmt,ins,ent,dec_cs);
+        pos = ofs + ins->len;
+
+        /* fixup tracking */
+        if ((fixent=dasm_reloc_map_find(&od->fixups,ip,(uint32_t)inslen)) != NULL) {
+            struct le_header_fixup_record_table *frtable;
+            unsigned char flags,src;
+            unsigned char *raw;
+
+            assert(fixent->table > 0);
+            assert(fixent->table <= lep->le_header.number_of_memory_pages);
+            frtable = lep->le_fixup_records.table + fixent->table - 1;
+            raw = le_header_fixup_record_table_get_raw_entry(frtable,fixent->index);
 
-    return 0;;
+            dasm_fmt_printf(fmt,"             ^ Relocation at 0x%08lx (+%u bytes from start of instruction)\n",
+                    (unsigned long)fixent->addr,
+                    (unsigned int)(fixent->addr - ip));
+
+            if (raw != NULL) {
+                src = *raw++;
+                flags = *raw++;
+
+                dasm_fmt_printf(fmt,"                Source type:            0x%02X ",src);
+                switch (src&0xF) {
+                    case 0x2:
+                        dasm_fmt_printf(fmt,"16-bit selector fixup (16 bits)");
+                        break;
+                    case 0x7:
+                        dasm_fmt_printf(fmt,"32-bit offset fixup (32 bits)");
+                        break;
+                    case 0x8:
+                        dasm_fmt_printf(fmt,"32-bit self-relative offset fixup (32 bits)");
+                        break;
+                    default:
+                        dasm_fmt_printf(fmt,"Unknown");
+                        continue;
+                };
+                if (src & 0x10)
+                    dasm_fmt_printf(fmt," Fix-up to alias");
+                dasm_fmt_printf(fmt,"\n");
+
+                dasm_fmt_printf(fmt,"                Source flags:           0x%02X ",flags);
+                switch (flags&3) {
+                    case 0x0:
+                        dasm_fmt_printf(fmt,"Internal reference");
+                        break;
+                    case 0x1:
+                        dasm_fmt_printf(fmt,"Imported reference by ordinal");
+                        break;
+                    case 0x2:
+                        dasm_fmt_printf(fmt,"Imported reference by name");
+                        break;
+                    case 0x3:
+                        dasm_fmt_printf(fmt,"Internal reference via entry table");
+                        break;
+                };
+                if (flags&4) dasm_fmt_printf(fmt," ADDITIVE");
+                if (flags&8) dasm_fmt_printf(fmt," \"Internal chaining fixup\"");
+                if (flags&0x10) dasm_fmt_printf(fmt," \"32-bit target offset\"");
+                if (flags&0x20) dasm_fmt_printf(fmt," \"32-bit additive fixup value\"");
+                if (flags&0x40) dasm_fmt_printf(fmt," \"16-bit object number/module ordinal\"");
+                if (flags&0x80) dasm_fmt_printf(fmt," \"8-bit ordinal\"");
+                dasm_fmt_printf(fmt,"\n");
+
+                if (src & 0x20)
+                    raw++; //number of source offsets. object follows, then array of srcoff
+                else
+                    raw += 2; //srcoff
+
+                if ((flags&3) == 0) { // internal reference
+                    uint32_t trglinoff;
+                    uint16_t tobject;
+                    uint32_t trgoff;
+
+                    if (flags&0x40) {
+                        tobject = *((uint16_t*)raw); raw += 2;
+                    }
+                    else {
+                        tobject = *raw++;
+                    }
+
+                    dasm_fmt_printf(fmt,"                Target object:          #%u\n",(unsigned int)tobject);
+                    if ((src&0xF) != 0x2) { /* not 16-bit selector fixup */
+                        if (flags&0x10) { // 32-bit target offset
+                            trgoff = *((uint32_t*)raw); raw += 4;
+                        }
+                        else { // 16-bit target offset
+                            trgoff = *((uint16_t*)raw); raw += 2;
+                        }
+
+                        // for this computation, we need to convert target object:offset to linear address
+                        if (tobject != 0 && tobject <= lep->le_header.object_table_entries)
+                            trglinoff = lep->le_object_table_loaded_linear[tobject - 1] + trgoff;
+                        else
+                            trglinoff = 0;
+
+                        dasm_fmt_printf(fmt,"                Target offset:          linear=0x%08lX offset=0x%08lX\n",
+                            (unsigned long)trglinoff,(unsigned long)trgoff);
+                    }
+                }
+            }
+        }
+    } while(1);
+}
+
+/* objects to work on in a pass, one job each */
+struct le_object_jobs {
+    struct le_object_dasm**         obj;
+    unsigned char                   mode;           /* DASM_FMT_* */
+    size_t                          label_first;    /* first pass: labels of the current round */
+    size_t                          label_end;
+};
+
+void first_pass_job(size_t job,FILE *out,void *user) {
+    struct le_object_jobs *j = (struct le_object_jobs*)user;
+    struct le_object_dasm *od = j->obj[job];
+    struct dasm_fmt fmt;
+
+    if (dasm_fmt_init(&fmt,out,j->mode)) {
+        od->error = 1;
+        return;
+    }
+
+    od->fmt = &fmt;
+    first_pass_object(od,j->label_first,j->label_end);
+    dasm_fmt_free(&fmt);
+    od->fmt = NULL;
+}
+
+void second_pass_job(size_t job,FILE *out,void *user) {
+    struct le_object_jobs *j = (struct le_object_jobs*)user;
+    struct le_object_dasm *od = j->obj[job];
+    struct dasm_fmt fmt;
+
+    if (dasm_fmt_init(&fmt,out,j->mode)) {
+        od->error = 1;
+        return;
+    }
+
+    second_pass_object(od,&fmt);
+    dasm_fmt_free(&fmt);
 }
 
 int main(int argc,char **argv) {
-    struct fixup_tracking_window fixup_window;
     struct le_header_parseinfo le_parser;
     struct exe_le_header le_header;
+    struct le_object_dasm *le_object_dasm;
+    struct le_object_jobs le_jobs;
+    struct le_image le_img;
     struct le_vmap_trackio io;
     uint32_t le_header_offset;
+    struct dasm_db_label_in *db_label = NULL;
+    struct dasm_db_region_in *db_region;
+    size_t db_label_count = 0;
+    size_t analysis_first;
+    struct dasm_db_key db_key;
+    unsigned char db_dirty = 1;
     struct dec_label *label;
-    unsigned int labeli;
+    FILE *jsonl_fp = NULL;
+    struct dasm_db db;
     uint32_t file_size;
 
-    fixup_tracking_window_init(&fixup_window);
+    memset(&db,0,sizeof(db));
+    dasm_xref_index_init(&dec_xref);
+    le_image_init(&le_img);
     assert(sizeof(le_parser.le_header) == EXE_HEADER_LE_HEADER_SIZE);
     le_header_parseinfo_init(&le_parser);
     memset(&exehdr,0,sizeof(exehdr));
@@ -1353,6 +1994,11 @@ int main(int argc,char **argv) {
     if (parse_argv(argc,argv))
         return 1;
 
+    if (num_threads == 0) {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        num_threads = (n > 0) ? (unsigned int)n : 1U;
+    }
+
     assert(sizeof(exehdr) == 0x1C);
 
 #if defined(TARGET_MSDOS) && TARGET_MSDOS == 16
@@ -1626,6 +2272,7 @@ int main(int argc,char **argv) {
                 label->seg_v = ~0;
                 label->ofs_v = ~0;
                 dec_label_set_name(label,"VXD DDB entry point");
+                dasm_label_index_clear(&dec_label_index); /* changed the key */
             }
 
             if (le_segofs_to_trackio(&io,object,offset,&le_parser)) {
@@ -1759,201 +2406,279 @@ int main(int argc,char **argv) {
             }
         }
     }
- 
-    /* first pass: decompilation */
-    {
-        struct exe_le_header_object_table_entry *ent;
-        unsigned int inscount;
-        unsigned int los = 0;
 
-        while (los < dec_label_count) {
-            label = dec_label + los;
-            if (label->seg_v == 0 || label->seg_v > le_parser.le_header.object_table_entries) {
-                los++;
-                continue;
-            }
+    if (label_file != NULL) {
+        FILE *fp = fopen(label_file,"r");
+        char line[512];
 
-            ent = le_parser.le_object_table + label->seg_v - 1;
-            if (!(ent->object_flags & LE_HEADER_OBJECT_TABLE_ENTRY_FLAGS_EXECUTABLE)) {
-                los++;
-                continue;
+        if (fp == NULL) {
+            fprintf(stderr,"Failed to open label file, %s\n",label_file);
+            return 1;
+        }
+
+        while (fgets(line,sizeof(line),fp) != NULL) {
+            char *s = line;
+
+            {
+                char *e = s + strlen(s);
+                while (e > line && (e[-1] == '\r' || e[-1] == '\n')) *--e = 0;
             }
 
-            if (label->seg_v == le_parser.le_object_flat_32bit) {
-                if (!le_segofs_to_trackio(&io,0/*flat*/,label->ofs_v,&le_parser)) {
-                    los++;
-                    continue;
+            while (*s == ' ') s++;
+            if (*s == ';' || *s == '#') continue;
+
+            // seg:off label, as shown in the listing
+            if (isxdigit(*s)) {
+                uint16_t so;
+                uint32_t oo;
+
+                so = (uint16_t)strtoul(s,&s,16);
+                if (*s == ':') {
+                    s++;
+                    oo = (uint32_t)strtoul(s,&s,16);
+                    while (*s == '\t' || *s == ' ') s++;
+
+                    if ((label=dec_label_malloc()) != NULL) {
+                        dec_label_set_name(label,s);
+                        label->seg_v = so;
+                        label->ofs_v = oo;
+                    }
                 }
             }
-            else {
-                if (!le_segofs_to_trackio(&io,label->seg_v,label->ofs_v,&le_parser)) {
-                    los++;
+        }
+
+        fclose(fp);
+    }
+
+    /* load the objects into memory once, as stored in the file. the listing shows fixups separately. */
+    le_img.no_fixups = 1;
+    if (le_image_load(&le_img,src_fd,&le_parser,le_parser.load_base))
+        fprintf(stderr,"Unable to load LE image into memory, reading pages from the file instead\n");
+
+    /* first pass: decompilation.
+     * each label is an entry point for the analysis engine of its object, which follows the code from there.
+     * code already walked from an earlier label is not walked again. */
+    le_object_dasm = calloc(le_parser.le_header.object_table_entries != 0 ? le_parser.le_header.object_table_entries : 1,sizeof(*le_object_dasm));
+    memset(&le_jobs,0,sizeof(le_jobs));
+    le_jobs.obj = calloc(le_parser.le_header.object_table_entries != 0 ? le_parser.le_header.object_table_entries : 1,sizeof(*le_jobs.obj));
+    if (le_object_dasm == NULL || le_jobs.obj == NULL) {
+        fprintf(stderr,"Failed to alloc analysis engine\n");
+        return 1;
+    }
+
+    /* labels from here on are made by the analysis, and are what the database keeps */
+    analysis_first = dec_label_count;
+
+    if (db_file != NULL) {
+        memset(&db_key,0,sizeof(db_key));
+        db_key.tool = DASM_DB_TOOL('W','L','E','D');
+        if (dasm_db_hash_fd(src_fd,&db_key.hash,&db_key.size)) {
+            fprintf(stderr,"Unable to read %s to hash it\n",src_file);
+            db_file = NULL;
+        }
+        else if (dasm_db_open(&db,db_file,&db_key) == 0) {
+            unsigned int objecti;
+            uint32_t n;
+
+            for (objecti=0;objecti < le_parser.le_header.object_table_entries;objecti++) {
+                struct le_object_dasm *od = le_object_dasm + objecti;
+                const struct exe_le_header_object_table_entry *ent = le_parser.le_object_table + objecti;
+                int r;
+
+                if (objecti >= db.hdr->region_count || db.region[objecti].length == 0 ||
+                    !(ent->object_flags & LE_HEADER_OBJECT_TABLE_ENTRY_FLAGS_EXECUTABLE))
                     continue;
+
+                if (le_object_dasm_setup(od,&le_parser,&le_img,objecti)) {
+                    fprintf(stderr,"Failed to alloc analysis engine\n");
+                    return 1;
                 }
+
+                if ((r=dasm_db_restore(&db,objecti,&od->eng)) < 0)
+                    break;
+                od->restored = (r > 0);
             }
 
-            inscount = 0;
-            reset_buffer();
-            dec_ofs = 0;
-            entry_ip = 0;
-            dec_cs = label->seg_v;
-            start_decom = 0;
-            entry_cs = dec_cs;
-            current_offset = label->ofs_v;
-            dec_read = dec_end = dec_buffer;
-            end_decom = ent->virtual_segment_size;
-            if (ent->object_flags & LE_HEADER_OBJECT_TABLE_ENTRY_FLAGS_386_BIG_DEFAULT)
-                end_decom += le_parser.le_object_table_loaded_linear[label->seg_v - 1];
-            refill(&io,&le_parser);
-            minx86dec_init_state(&dec_st);
-            dec_st.data32 = dec_st.addr32 =
-                (ent->object_flags & LE_HEADER_OBJECT_TABLE_ENTRY_FLAGS_386_BIG_DEFAULT) ? 1 : 0;
-
-            printf("* NE segment #%d : 0x%04lx 1st pass from '%s'\n",
-                (unsigned int)dec_cs,(unsigned long)label->ofs_v,label->name);
-
-            do {
-                uint32_t ofs = (uint32_t)(dec_read - dec_buffer) + current_offset_minus_buffer();
-                uint32_t ip = ofs + entry_ip - dec_ofs;
-                unsigned int c;
-
-                if (!refill(&io,&le_parser)) break;
-
-                minx86dec_set_buffer(&dec_st,dec_read,(int)(dec_end - dec_read));
-                minx86dec_init_instruction(&dec_i);
-                dec_st.ip_value = ip;
-                minx86dec_decodeall(&dec_st,&dec_i);
-                assert(dec_i.end >= dec_read);
-                assert(dec_i.end <= (dec_buffer+sizeof(dec_buffer)));
-
-                if (ent->object_flags & LE_HEADER_OBJECT_TABLE_ENTRY_FLAGS_386_BIG_DEFAULT)
-                    printf("%04lX:%08lX  ",(unsigned long)dec_cs,(unsigned long)dec_st.ip_value);
-                else
-                    printf("%04lX:%04lX      ",(unsigned long)dec_cs,(unsigned long)dec_st.ip_value);
+            /* if any object could not be restored, forget the database and analyse everything */
+            if (objecti < le_parser.le_header.object_table_entries) {
+                fprintf(stderr,"Analysis database %s does not fit %s, ignoring it\n",db_file,src_file);
+                for (objecti=0;objecti < le_parser.le_header.object_table_entries;objecti++)
+                    le_object_dasm_free(le_object_dasm + objecti);
+                dasm_db_close(&db);
+            }
 
-                {
-                    unsigned char *e = dec_i.end;
+            for (n=0;db.base != NULL && n < db.hdr->label_count;n++) {
+                const struct dasm_db_label *l = db.label + n;
 
-                    // INT 20h VXDCALL
-                    if (is_vxd && dec_i.opcode == MXOP_INT && dec_i.argc == 1 &&
-                            dec_i.argv[0].regtype == MX86_RT_IMM && dec_i.argv[0].value == 0x20)
-                        e += 2+2;
+                if (dec_find_label((uint16_t)l->seg,l->ofs) != NULL)
+                    continue;
 
-                    for (c=0,iptr=dec_i.start;iptr != e;c++)
-                        printf("%02X ",*iptr++);
+                if ((label=dec_label_malloc()) != NULL) {
+                    label->seg_v = (uint16_t)l->seg;
+                    label->ofs_v = l->ofs;
+                    if (dasm_db_label_name(&db,l) != NULL)
+                        dec_label_set_name(label,dasm_db_label_name(&db,l));
                 }
+            }
 
-                if (dec_i.rep != MX86_REP_NONE) {
-                    for (;c < 6;c++)
-                        printf("   ");
-
-                    switch (dec_i.rep) {
-                        case MX86_REPE:
-                            printf("REP   ");
-                            break;
-                        case MX86_REPNE:
-                            printf("REPNE ");
-                            break;
-                        default:
-                            break;
-                    };
-                }
-                else {
-                    for (;c < 8;c++)
-                        printf("   ");
-                }
+            if (db.base != NULL) {
+                db_dirty = 0;
+                printf("* Analysis database %s loaded\n",db_file);
+            }
+        }
+    }
 
-                // Special instruction:
-                //   Windows VXDs use INT 20h followed by two WORDs to call other VXDs.
-                if (is_vxd && dec_i.opcode == MXOP_INT && dec_i.argc == 1 &&
-                    dec_i.argv[0].regtype == MX86_RT_IMM && dec_i.argv[0].value == 0x20) {
-                    // INT 20h WORD, WORD
-                    // the decompiler should have set the instruction pointer at the first WORD now.
-                    uint16_t vxd_device,vxd_service;
-
-                    vxd_service = *((uint16_t*)dec_i.end); dec_i.end += 2;
-                    vxd_device = *((uint16_t*)dec_i.end); dec_i.end += 2;
-
-                    // bit 15 of the service indicates a jmp, not call
-                    if (vxd_service & 0x8000) {
-                        printf("VxDJmp   Device=0x%04X '%s' Service=0x%04X '%s'",
-                            vxd_device,
-                            vxd_device_to_name(vxd_device),
-                            vxd_service & 0x7FFF,
-                            vxd_service_to_name(vxd_device,vxd_service & 0x7FFF));
-                    }
-                    else {
-                        printf("VxDCall  Device=0x%04X '%s' Service=0x%04X '%s'",
-                            vxd_device,
-                            vxd_device_to_name(vxd_device),
-                            vxd_service,
-                            vxd_service_to_name(vxd_device,vxd_service));
-                    }
-                }
-                else {
-                    printf("%-8s ",opcode_string[dec_i.opcode]);
+    if (le_parser.le_object_table != NULL) {
+        struct exe_le_header_object_table_entry *ent;
+        unsigned long insns = 0,blocks = 0,edges = 0;
+        size_t round_first = 0,round_end,los;
+        struct le_object_dasm *od;
+        unsigned int threads;
+        unsigned int objecti;
+        uint32_t offset;
+        size_t jobs,j;
+
+        for (objecti=0;objecti < le_parser.le_header.object_table_entries;objecti++) {
+            le_object_dasm[objecti].object = (uint16_t)(objecti + 1);
+            le_object_dasm[objecti].lep = &le_parser;
+        }
 
-                    for (c=0;c < (unsigned int)dec_i.argc;) {
-                        minx86dec_regprint(&dec_i.argv[c],arg_c);
-                        printf("%s",arg_c);
-                        if (++c < (unsigned int)dec_i.argc) printf(",");
-                    }
+        /* the first pass goes in rounds. each round walks the labels added by the round before it,
+         * one object per job. labels found by a round are walked in the next round. */
+        while (round_first < dec_label_count) {
+            round_end = dec_label_count;
+            dec_label_index_update();
+            threads = num_threads;
+
+            for (los=round_first;los < round_end;los++) {
+                label = dec_label + los;
+                if (!le_label_to_object(label,&le_parser,&objecti,&offset))
+                    continue;
+
+                ent = le_parser.le_object_table + objecti;
+                if (!(ent->object_flags & LE_HEADER_OBJECT_TABLE_ENTRY_FLAGS_EXECUTABLE))
+                    continue;
+
+                od = le_object_dasm + objecti;
+                if (le_object_dasm_setup(od,&le_parser,&le_img,objecti)) {
+                    fprintf(stderr,"Failed to alloc analysis engine\n");
+                    return 1;
                 }
-                if (dec_i.lock) printf("  ; LOCK#");
-                printf("\n");
 
-                dec_read = dec_i.end;
+                if (offset < od->eng.length && !dasm_engine_seen(&od->eng,offset))
+                    od->job = 1;
+            }
 
-                if ((dec_i.opcode == MXOP_JMP || dec_i.opcode == MXOP_CALL || dec_i.opcode == MXOP_JCXZ ||
-                    (dec_i.opcode >= MXOP_JO && dec_i.opcode <= MXOP_JG)) && dec_i.argc == 1 &&
-                    dec_i.argv[0].regtype == MX86_RT_IMM) {
-                    /* make a label of the target */
-                    /* 1st arg is target offset */
-                    uint32_t toffset = dec_i.argv[0].value;
+            jobs = 0;
+            for (objecti=0;objecti < le_parser.le_header.object_table_entries;objecti++) {
+                od = le_object_dasm + objecti;
 
-                    printf("Target: 0x%04lx\n",(unsigned long)toffset);
+                if (!od->job) continue;
+                le_jobs.obj[jobs++] = od;
+                od->job = 0;
 
-                    label = dec_find_label(dec_cs,toffset);
-                    if (label == NULL) {
-                        if ((label=dec_label_malloc()) != NULL) {
-                            if (dec_i.opcode == MXOP_JMP || dec_i.opcode == MXOP_JCXZ ||
-                                    (dec_i.opcode >= MXOP_JO && dec_i.opcode <= MXOP_JG))
-                                dec_label_set_name(label,"JMP target");
-                            else if (dec_i.opcode == MXOP_CALL)
-                                dec_label_set_name(label,"CALL target");
+                /* reading pages from the file goes through the one file descriptor */
+                if (od->eng.image == NULL)
+                    threads = 1;
+            }
 
-                            label->seg_v =
-                                dec_cs;
-                            label->ofs_v =
-                                toffset;
+            le_jobs.label_first = round_first;
+            le_jobs.label_end = round_end;
+            le_jobs.mode = DASM_FMT_TEXT;
+            dasm_run_jobs(jobs,threads,first_pass_job,&le_jobs,stdout);
 
-                            dec_label_xlate_32flat(label,&le_parser);
-                        }
-                    }
+            /* new labels go into the list in object order, so the result does not depend on thread timing */
+            for (j=0;j < jobs;j++) {
+                od = le_jobs.obj[j];
 
-                    if (dec_i.opcode == MXOP_JMP)
-                        break;
+                if (od->error) {
+                    fprintf(stderr,"Out of memory during analysis\n");
+                    return 1;
                 }
-                else if (dec_i.opcode == MXOP_JMP)
-                    break;
-                else if (dec_i.opcode == MXOP_RET || dec_i.opcode == MXOP_RETF)
-                    break;
-                else if (dec_i.opcode == MXOP_CALL_FAR || dec_i.opcode == MXOP_JMP_FAR) {
-                    if (dec_i.opcode == MXOP_JMP_FAR)
-                        break;
+
+                le_object_newlabel_merge(od);
+            }
+
+            round_first = round_end;
+        }
+
+        for (objecti=0;objecti < le_parser.le_header.object_table_entries;objecti++) {
+            od = le_object_dasm + objecti;
+
+            if (!od->ready) continue;
+
+            /* a restored engine keeps its blocks unless more code was walked this time.
+             * if so, the blocks are made again, which needs every walked instruction decoded */
+            if (!od->restored || od->eng.insn_count != 0) {
+                db_dirty = 1;
+                if (od->restored && dasm_engine_decode_walked(&od->eng,od->ip_base)) {
+                    fprintf(stderr,"Out of memory during analysis\n");
+                    return 1;
                 }
+                dasm_engine_build_blocks(&od->eng);
+            }
 
-                if (++inscount >= 1024)
-                    break;
-            } while(1);
+            insns += (unsigned long)od->eng.walked;
+            blocks += (unsigned long)od->eng.block_count;
+            edges += (unsigned long)od->eng.edge_count;
 
-            los++;
+            le_object_fixups(od,&db);
+            if (le_object_xrefs(od,&dec_xref)) {
+                fprintf(stderr,"Out of memory during analysis\n");
+                return 1;
+            }
+        }
+
+        dasm_xref_index_sort(&dec_xref);
+
+        printf("* 1st pass: %lu instructions, %lu basic blocks, %lu branch/call edges\n",
+            insns,blocks,edges);
+    }
+
+    /* the labels for the database, before sorting mixes them in with the others */
+    if (db_file != NULL && analysis_first < dec_label_count) {
+        db_label_count = dec_label_count - analysis_first;
+        if ((db_label = malloc(db_label_count * sizeof(*db_label))) != NULL) {
+            size_t i;
+
+            for (i=0;i < db_label_count;i++) {
+                db_label[i].seg = dec_label[analysis_first + i].seg_v;
+                db_label[i].ofs = dec_label[analysis_first + i].ofs_v;
+                db_label[i].name = dec_label[analysis_first + i].name;
+            }
+        }
+        else {
+            db_label_count = 0;
+            db_file = NULL;
         }
     }
 
     /* sort labels */
     dec_label_sort();
 
+    if (xref_file != NULL || dot_file != NULL) {
+        struct dasm_xref_func *fn = malloc((dec_label_count != 0 ? dec_label_count : 1) * sizeof(*fn));
+        size_t i;
+
+        if (fn == NULL) {
+            fprintf(stderr,"Out of memory\n");
+            return 1;
+        }
+
+        for (i=0;i < dec_label_count;i++) {
+            fn[i].seg = dec_label[i].seg_v;
+            fn[i].ofs = dec_label[i].ofs_v;
+            fn[i].name = dec_label[i].name;
+        }
+
+        if (xref_file != NULL && dasm_xref_save(xref_file,DASM_XREF_OUT_JSON,&dec_xref,fn,dec_label_count,1))
+            fprintf(stderr,"Unable to write %s\n",xref_file);
+        if (dot_file != NULL && dasm_xref_save(dot_file,DASM_XREF_OUT_DOT,&dec_xref,fn,dec_label_count,1))
+            fprintf(stderr,"Unable to write %s\n",dot_file);
+
+        free(fn);
+    }
+
     {
         struct dec_label *label;
         unsigned int i;
@@ -1969,445 +2694,87 @@ int main(int argc,char **argv) {
         }
     }
 
-    /* second pass decompiler */
+    /* second pass decompiler. objects are set up here, then listed one per job */
     if (le_parser.le_object_table != NULL) {
         struct exe_le_header_object_table_entry *ent;
-        struct fixup_tracking_window_ent *fixent;
-        uint32_t page_base;
+        unsigned int threads = num_threads;
+        struct le_object_dasm *od;
         unsigned int i;
-        uint32_t page;
-        size_t inslen;
+
+        if (jsonl_file != NULL) {
+            if ((jsonl_fp=fopen(jsonl_file,"w")) == NULL) {
+                fprintf(stderr,"Unable to open %s, %s\n",jsonl_file,strerror(errno));
+                return 1;
+            }
+        }
 
         for (i=0;i < le_parser.le_header.object_table_entries;i++) {
             ent = le_parser.le_object_table + i;
+            od = le_object_dasm + i;
+            le_jobs.obj[i] = od;
 
-            fixup_tracking_window_free(&fixup_window);
-
-            printf("* LE object #%u (%u-bit)\n",
-                i + 1,
-                (ent->object_flags & LE_HEADER_OBJECT_TABLE_ENTRY_FLAGS_386_BIG_DEFAULT) ? 32 : 16);
-            if (!(ent->object_flags & LE_HEADER_OBJECT_TABLE_ENTRY_FLAGS_EXECUTABLE)) {
-                printf("    Ignoring data object\n");
+            if (!(ent->object_flags & LE_HEADER_OBJECT_TABLE_ENTRY_FLAGS_EXECUTABLE))
                 continue;
-            }
 
-            if (ent->object_flags & LE_HEADER_OBJECT_TABLE_ENTRY_FLAGS_386_BIG_DEFAULT) {
-                if (!le_segofs_to_trackio(&io,0/*flat*/,le_parser.le_object_table_loaded_linear[i],&le_parser))
-                    continue;
-            }
-            else {
-                if (!le_segofs_to_trackio(&io,i + 1,0,&le_parser))
-                    continue;
+            if (!le_segofs_to_trackio(&io,i + 1,0,&le_parser)) {
+                le_object_dasm_free(od);
+                continue;
             }
 
-            reset_buffer();
-            labeli = 0;
-            dec_ofs = 0;
-            entry_ip = 0;
-            start_decom = 0;
-            page = ent->page_map_index;
-            end_decom = ent->virtual_segment_size;
-
-            if (ent->object_flags & LE_HEADER_OBJECT_TABLE_ENTRY_FLAGS_386_BIG_DEFAULT) {
-                current_offset = le_parser.le_object_table_loaded_linear[i];
-                end_decom += le_parser.le_object_table_loaded_linear[i];
-                page_base = le_parser.le_object_table_loaded_linear[i];
-                dec_cs = le_parser.le_object_flat_32bit;
-            }
-            else {
-                current_offset = 0;
-                dec_cs = i + 1;
-                page_base = 0;
+            /* instructions already decoded by the first pass come from the analysis engine cache */
+            if (le_object_dasm_setup(od,&le_parser,&le_img,i)) {
+                fprintf(stderr,"Failed to alloc analysis engine\n");
+                return 1;
             }
 
-            entry_cs = dec_cs;
-            dec_read = dec_end = dec_buffer;
-            refill(&io,&le_parser);
-            minx86dec_init_state(&dec_st);
-            dec_st.data32 = dec_st.addr32 =
-                (ent->object_flags & LE_HEADER_OBJECT_TABLE_ENTRY_FLAGS_386_BIG_DEFAULT) ? 1 : 0;
-
-            do {
-                uint32_t ofs = (uint32_t)(dec_read - dec_buffer) + current_offset_minus_buffer();
-                uint32_t ip = ofs + entry_ip - dec_ofs;
-                unsigned char dosek = 0;
-                uint32_t label_ip = 0;
-                unsigned int c;
-
-                while (labeli < dec_label_count) {
-                    label = dec_label + labeli;
-                    if (label->seg_v != dec_cs) {
-                        labeli++;
-                        continue;
-                    }
-
-                    if (ent->object_flags & LE_HEADER_OBJECT_TABLE_ENTRY_FLAGS_386_BIG_DEFAULT) {
-                        if (label->ofs_v < le_parser.le_object_table_loaded_linear[i]) {
-                            labeli++;
-                            continue;
-                        }
-                    }
-
-                    if (ip < label->ofs_v)
-                        break;
-
-                    labeli++;
-                    label_ip = label->ofs_v;
 
-                    printf("Label '%s' at %04lx:%04lx\n",
-                            label->name ? label->name : "",
-                            (unsigned long)label->seg_v,
-                            (unsigned long)label->ofs_v);
-
-                    label = dec_label + labeli;
-                    dosek = 1;
-                }
-
-                if (dosek) {
-                    ip = label_ip;
-                    reset_buffer();
-                    current_offset = ofs;
-                    if (ent->object_flags & LE_HEADER_OBJECT_TABLE_ENTRY_FLAGS_386_BIG_DEFAULT) {
-                        if (!le_segofs_to_trackio(&io,0/*flat*/,ip,&le_parser))
-                            break;
-                    }
-                    else {
-                        if (!le_segofs_to_trackio(&io,i + 1,ip,&le_parser))
-                            break;
-                    }
-                }
-
-                if (!refill(&io,&le_parser)) break;
-
-                /* track page.
-                 * load new entries slightly ahead (16 bytes) because
-                 * relocations that span pages reach backwards into the prior page.
-                 * since we only read forward, we can free older relocations from memory
-                 * when we load new ones. */
-                if (le_parser.le_fixup_records.table != NULL) {
-                    uint32_t pob = ip + (uint32_t)16 - page_base;
-                    uint32_t po = (pob / (uint32_t)le_parser.le_header.memory_page_size) + ent->page_map_index;
-                    struct le_header_fixup_record_table *frtable;
-                    unsigned int srcoff_count,srcoff_i;
-                    unsigned char flags,src;
-                    uint32_t srclinoff;
-                    unsigned char *raw;
-                    uint16_t srcoff;
-                    uint8_t chk=0;
-                    size_t ti;
-
-                    /* setup */
-
-                    /* free old entries */
-                    fixup_tracking_window_lazy_flush(&fixup_window);
-
-                    /* load new entries */
-                    while (page <= po) {
-                        uint32_t pagelinoff =
-                            ((uint32_t)page - (uint32_t)ent->page_map_index) * (uint32_t)le_parser.le_header.memory_page_size;
-
-                        if (page != 0 && page <= le_parser.le_header.number_of_memory_pages) {
-                            frtable = le_parser.le_fixup_records.table + page - 1;
-                            if (frtable->table != NULL && frtable->length != 0) {
-                                printf("* Loading relocations for page #%u\n",page);
-
-                                chk = 1;
-                                for (ti=0;ti < frtable->length;ti++) {
-                                    raw = le_header_fixup_record_table_get_raw_entry(frtable,ti);
-
-                                    // caller ensures the record is long enough
-                                    src = *raw++;
-                                    flags = *raw++;
-
-                                    if (src & 0xC0)
-                                        continue;
-
-                                    if (src & 0x20) {
-                                        srcoff_count = *raw++; //number of source offsets. object follows, then array of srcoff
-                                    }
-                                    else {
-                                        srcoff_count = 1;
-                                        srcoff = *((int16_t*)raw); raw += 2;
-                                    }
-
-                                    if ((flags&3) == 0) { // internal reference
-                                        if (flags&0x40) {
-                                            raw += 2; /* tobject = *((uint16_t*)raw); */
-                                        }
-                                        else {
-                                            raw++; /* tobject = *raw++; */
-                                        }
-
-                                        if ((src&0xF) != 0x2) { /* not 16-bit selector fixup */
-                                            if (flags&0x10) { // 32-bit target offset
-                                                raw += 4; /* trgoff = *((uint32_t*)raw); */
-                                            }
-                                            else { // 16-bit target offset
-                                                raw += 2; /* trgoff = *((uint16_t*)raw); */
-                                            }
-                                        }
-
-                                        if (src & 0x20) {
-                                            for (srcoff_i=0;srcoff_i < srcoff_count;srcoff_i++) {
-                                                srcoff = *((int16_t*)raw); raw += 2;
-
-                                                if ((src&0xF) == 0x7) { // must be 32-bit offset fixup
-                                                    // what is the relocation relative to the struct we just read?
-                                                    srclinoff =
-                                                        le_parser.le_object_table_loaded_linear[i] + pagelinoff + (uint32_t)srcoff;
-                                                    fixent =
-                                                        fixup_tracking_window_alloc_entry(&fixup_window);
-                                                    if (fixent) {
-                                                        fixent->fixup_rec_page = page;
-                                                        fixent->fixup_rec_index = ti;
-                                                        fixent->linear_address = srclinoff;
-                                                    }
-                                                    else {
-                                                        printf("! unable to alloc reloc tracking\n");
-                                                    }
-                                                }
-                                            }
-                                        }
-                                        else {
-                                            if ((src&0xF) == 0x7) { // must be 32-bit offset fixup
-                                                // what is the relocation relative to the struct we just read?
-                                                srclinoff =
-                                                    le_parser.le_object_table_loaded_linear[i] + pagelinoff + (uint32_t)srcoff;
-                                                fixent =
-                                                    fixup_tracking_window_alloc_entry(&fixup_window);
-                                                if (fixent) {
-                                                    fixent->fixup_rec_page = page;
-                                                    fixent->fixup_rec_index = ti;
-                                                    fixent->linear_address = srclinoff;
-                                                }
-                                                else {
-                                                    printf("! unable to alloc reloc tracking\n");
-                                                }
-                                            }
-                                        }
-                                    }
-                                }
-                            }
-                        }
-
-                        page++;
-                    }
-
-                    if (chk) {
-                        /* sort entries (past read pointer) so code below can read entry-by-entry.
-                         * ONLY sort the entries yet to be read, not the ones already read. */
-                        assert(fixup_window.table != NULL);
-                        assert(fixup_window.read <= fixup_window.length);
-                        if (fixup_window.read < fixup_window.length) {
-                            qsort(fixup_window.table+fixup_window.read,
-                                  fixup_window.length-fixup_window.read,
-                                  sizeof(*(fixup_window.table)),fixup_window_sort);
-                        }
-                    }
-                }
-
-                minx86dec_set_buffer(&dec_st,dec_read,(int)(dec_end - dec_read));
-                minx86dec_init_instruction(&dec_i);
-                dec_st.ip_value = ip;
-                minx86dec_decodeall(&dec_st,&dec_i);
-                assert(dec_i.end >= dec_read);
-                assert(dec_i.end <= (dec_buffer+sizeof(dec_buffer)));
-                inslen = (size_t)(dec_i.end - dec_i.start);
-
-                /* fixup tracking */
-                while (fixup_window.table != NULL && fixup_window.read < fixup_window.length) {
-                    fixent = fixup_window.table + fixup_window.read;
-                    if (dec_st.ip_value < fixent->linear_address) break;
-                    fixup_window.read++;
-                }
-
-                if (ent->object_flags & LE_HEADER_OBJECT_TABLE_ENTRY_FLAGS_386_BIG_DEFAULT)
-                    printf("%04lX:%08lX  ",(unsigned long)dec_cs,(unsigned long)dec_st.ip_value);
-                else
-                    printf("%04lX:%04lX      ",(unsigned long)dec_cs,(unsigned long)dec_st.ip_value);
-
-                {
-                    unsigned char *e = dec_i.end;
-
-                    // INT 20h VXDCALL
-                    if (is_vxd && dec_i.opcode == MXOP_INT && dec_i.argc == 1 &&
-                        dec_i.argv[0].regtype == MX86_RT_IMM && dec_i.argv[0].value == 0x20)
-                        e += 2+2;
+            /* reading pages from the file goes through the one file descriptor */
+            if (od->eng.image == NULL)
+                threads = 1;
+        }
 
-                    for (c=0,iptr=dec_i.start;iptr != e;c++)
-                        printf("%02X ",*iptr++);
-                }
+        le_jobs.mode = jsonl_fp ? DASM_FMT_JSONL : DASM_FMT_TEXT;
+        dasm_run_jobs(le_parser.le_header.object_table_entries,threads,second_pass_job,&le_jobs,jsonl_fp ? jsonl_fp : stdout);
 
-                if (dec_i.rep != MX86_REP_NONE) {
-                    for (;c < 6;c++)
-                        printf("   ");
-
-                    switch (dec_i.rep) {
-                        case MX86_REPE:
-                            printf("REP   ");
-                            break;
-                        case MX86_REPNE:
-                            printf("REPNE ");
-                            break;
-                        default:
-                            break;
-                    };
-                }
-                else {
-                    for (;c < 8;c++)
-                        printf("   ");
-                }
+        for (i=0;i < le_parser.le_header.object_table_entries;i++) {
+            if (le_object_dasm[i].error) {
+                fprintf(stderr,"Out of memory during listing\n");
+                return 1;
+            }
+        }
 
-                // Special instruction:
-                //   Windows VXDs use INT 20h followed by two WORDs to call other VXDs.
-                if (is_vxd && dec_i.opcode == MXOP_INT && dec_i.argc == 1 &&
-                    dec_i.argv[0].regtype == MX86_RT_IMM && dec_i.argv[0].value == 0x20) {
-                    // INT 20h WORD, WORD
-                    // the decompiler should have set the instruction pointer at the first WORD now.
-                    uint16_t vxd_device,vxd_service;
-
-                    vxd_service = *((uint16_t*)dec_i.end); dec_i.end += 2;
-                    vxd_device = *((uint16_t*)dec_i.end); dec_i.end += 2;
-
-                    // bit 15 of the service indicates a jmp, not call
-                    if (vxd_service & 0x8000) {
-                        printf("VxDJmp   Device=0x%04X '%s' Service=0x%04X '%s'",
-                            vxd_device,
-                            vxd_device_to_name(vxd_device),
-                            vxd_service & 0x7FFF,
-                            vxd_service_to_name(vxd_device,vxd_service & 0x7FFF));
-                    }
-                    else {
-                        printf("VxDCall  Device=0x%04X '%s' Service=0x%04X '%s'",
-                            vxd_device,
-                            vxd_device_to_name(vxd_device),
-                            vxd_service,
-                            vxd_service_to_name(vxd_device,vxd_service));
-                    }
-                }
-                else {
-                    printf("%-8s ",opcode_string[dec_i.opcode]);
+        /* save what the first pass found, unless it all came from the database */
+        if (db_file != NULL && db_dirty && (db_region=calloc(i,sizeof(*db_region))) != NULL) {
+            for (i=0;i < le_parser.le_header.object_table_entries;i++) {
+                od = le_object_dasm + i;
+                if (!od->ready) continue;
 
-                    for (c=0;c < (unsigned int)dec_i.argc;) {
-                        minx86dec_regprint(&dec_i.argv[c],arg_c);
-                        printf("%s",arg_c);
-                        if (++c < (unsigned int)dec_i.argc) printf(",");
-                    }
+                /* an object whose fixups could not be loaded is analysed again next time */
+                if (od->fixups_ready) {
+                    db_region[i].eng = &od->eng;
+                    db_region[i].reloc = &od->fixups;
                 }
-                if (dec_i.lock) printf("  ; LOCK#");
-                printf("\n");
-
-                dec_read = dec_i.end;
-
-                if (fixup_window.table != NULL && fixup_window.read < fixup_window.length) {
-                    fixent = fixup_window.table + fixup_window.read;
-                    if (fixent->linear_address >= dec_st.ip_value &&
-                        fixent->linear_address < (dec_st.ip_value + inslen)) {
-                        struct le_header_fixup_record_table *frtable;
-                        unsigned char flags,src;
-                        unsigned char *raw;
-
-                        assert(fixent->fixup_rec_page > 0);
-                        assert(fixent->fixup_rec_page <= le_parser.le_header.number_of_memory_pages);
-                        frtable = le_parser.le_fixup_records.table + fixent->fixup_rec_page - 1;
-                        raw = le_header_fixup_record_table_get_raw_entry(frtable,fixent->fixup_rec_index);
-
-                        printf("             ^ Relocation at 0x%08lx (+%u bytes from start of instruction)\n",
-                                (unsigned long)fixent->linear_address,
-                                (unsigned int)(fixent->linear_address - dec_st.ip_value));
-
-                        if (raw != NULL) {
-                            src = *raw++;
-                            flags = *raw++;
-
-                            printf("                Source type:            0x%02X ",src);
-                            switch (src&0xF) {
-                                case 0x2:
-                                    printf("16-bit selector fixup (16 bits)");
-                                    break;
-                                case 0x7:
-                                    printf("32-bit offset fixup (32 bits)");
-                                    break;
-                                case 0x8:
-                                    printf("32-bit self-relative offset fixup (32 bits)");
-                                    break;
-                                default:
-                                    printf("Unknown");
-                                    continue;
-                            };
-                            if (src & 0x10)
-                                printf(" Fix-up to alias");
-                            printf("\n");
-
-                            printf("                Source flags:           0x%02X ",flags);
-                            switch (flags&3) {
-                                case 0x0:
-                                    printf("Internal reference");
-                                    break;
-                                case 0x1:
-                                    printf("Imported reference by ordinal");
-                                    break;
-                                case 0x2:
-                                    printf("Imported reference by name");
-                                    break;
-                                case 0x3:
-                                    printf("Internal reference via entry table");
-                                    break;
-                            };
-                            if (flags&4) printf(" ADDITIVE");
-                            if (flags&8) printf(" \"Internal chaining fixup\"");
-                            if (flags&0x10) printf(" \"32-bit target offset\"");
-                            if (flags&0x20) printf(" \"32-bit additive fixup value\"");
-                            if (flags&0x40) printf(" \"16-bit object number/module ordinal\"");
-                            if (flags&0x80) printf(" \"8-bit ordinal\"");
-                            printf("\n");
-
-                            if (src & 0x20)
-                                raw++; //number of source offsets. object follows, then array of srcoff
-                            else
-                                raw += 2; //srcoff
-
-                            if ((flags&3) == 0) { // internal reference
-                                uint32_t trglinoff;
-                                uint16_t tobject;
-                                uint32_t trgoff;
-
-                                if (flags&0x40) {
-                                    tobject = *((uint16_t*)raw); raw += 2;
-                                }
-                                else {
-                                    tobject = *raw++;
-                                }
-
-                                printf("                Target object:          #%u\n",(unsigned int)tobject);
-                                if ((src&0xF) != 0x2) { /* not 16-bit selector fixup */
-                                    if (flags&0x10) { // 32-bit target offset
-                                        trgoff = *((uint32_t*)raw); raw += 4;
-                                    }
-                                    else { // 16-bit target offset
-                                        trgoff = *((uint16_t*)raw); raw += 2;
-                                    }
+            }
 
-                                    // for this computation, we need to convert target object:offset to linear address
-                                    if (tobject != 0 && tobject <= le_parser.le_header.object_table_entries)
-                                        trglinoff = le_parser.le_object_table_loaded_linear[tobject - 1] + trgoff;
-                                    else
-                                        trglinoff = 0;
+            if (dasm_db_save(db_file,&db_key,db_region,i,db_label,db_label_count) == 0)
+                printf("* Analysis database %s saved\n",db_file);
+            else
+                fprintf(stderr,"Unable to write analysis database %s\n",db_file);
 
-                                    printf("                Target offset:          linear=0x%08lX offset=0x%08lX\n",
-                                        (unsigned long)trglinoff,(unsigned long)trgoff);
-                                }
-                            }
-                        }
-                    }
-                }
-            } while(1);
-
-            fixup_tracking_window_free(&fixup_window);
+            free(db_region);
         }
+
+        for (i=0;i < le_parser.le_header.object_table_entries;i++)
+            le_object_dasm_free(le_object_dasm + i);
     }
 
-    fixup_tracking_window_free(&fixup_window);
+    if (jsonl_fp != NULL) fclose(jsonl_fp);
+    if (db_label != NULL) free(db_label);
+    dasm_db_close(&db);
+    dasm_xref_index_free(&dec_xref);
+    free(le_jobs.obj);
+    free(le_object_dasm);
+    le_image_free(&le_img);
     le_header_parseinfo_free(&le_parser);
     dec_free_labels();
     close(src_fd);
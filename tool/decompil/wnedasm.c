@@ -41,6 +41,10 @@
 #include <hw/dos/exenehdr.h>
 #include <hw/dos/exenepar.h>
 
+#include "dasmeng.h"
+#include "dasmfmt.h"
+#include "dasmxref.h"
+
 #ifndef O_BINARY
 #define O_BINARY 0
 #endif
@@ -111,31 +115,37 @@ void dec_label_set_name(struct dec_label *l,const char *s) {
 struct dec_label*               dec_label = NULL;
 size_t                          dec_label_count = 0;
 size_t                          dec_label_alloc = 0;
-unsigned long                   dec_ofs;
-uint16_t                        dec_cs;
+struct dasm_label_index         dec_label_index;
 
 char                            name_tmp[255+1];
 
 uint8_t                         dec_buffer[512];
-uint8_t*                        dec_read;
-uint8_t*                        dec_end;
-char                            arg_c[101];
-struct minx86dec_state          dec_st;
-struct minx86dec_instruction    dec_i;
-minx86_read_ptr_t               iptr;
-uint16_t                        entry_cs,entry_ip;
-uint16_t                        start_cs,start_ip;
-uint32_t                        start_decom,end_decom,entry_ofs;
-uint32_t                        current_offset;
 
 struct exe_dos_header           exehdr;
 
 char*                           sym_file = NULL;
 char*                           label_file = NULL;
+char*                           jsonl_file = NULL;
+char*                           xref_file = NULL;
+char*                           dot_file = NULL;
 
 char*                           src_file = NULL;
 int                             src_fd = -1;
 
+unsigned int                    num_threads = 1; /* 0 = one per CPU */
+
+/* cross references by segment:offset, made after the first pass. read-only in the second pass */
+struct dasm_xref_index          dec_xref;
+
+/* NE tables, read-only once the segments are being disassembled */
+struct exe_ne_header_segment_reloc_table*   ne_segment_relocs = NULL;
+struct exe_ne_header_imported_name_table    ne_imported_name_table;
+struct exe_ne_header_entry_table_table      ne_entry_table;
+struct exe_ne_header_name_entry_table       ne_nonresname;
+struct exe_ne_header_name_entry_table       ne_resname;
+struct exe_ne_header_segment_table          ne_segments;
+struct mod_symbols_list                     mod_syms;
+
 void dec_free_labels() {
     unsigned int i=0;
 
@@ -150,20 +160,10 @@ void dec_free_labels() {
 
     free(dec_label);
     dec_label = NULL;
-}
-
-uint32_t current_offset_minus_buffer() {
-    return current_offset - (uint32_t)(dec_end - dec_buffer);
-}
-
-static void minx86dec_init_state(struct minx86dec_state *st) {
-	memset(st,0,sizeof(*st));
-}
+    dec_label_count = 0;
+    dec_label_alloc = 0;
 
-static void minx86dec_set_buffer(struct minx86dec_state *st,uint8_t *buf,int sz) {
-	st->fence = buf + sz;
-	st->prefetch_fence = dec_buffer + sizeof(dec_buffer) - 16;
-	st->read_ip = buf;
+    dasm_label_index_free(&dec_label_index);
 }
 
 void help() {
@@ -172,6 +172,10 @@ void help() {
     fprintf(stderr,"    -i <file>        File to decompile\n");
     fprintf(stderr,"    -lf <file>       Text file to define labels\n");
     fprintf(stderr,"    -sym <file>      Module symbols file\n");
+    fprintf(stderr,"    -j <n>           Disassemble segments with n threads (0 = one per CPU)\n");
+    fprintf(stderr,"    -jsonl <file>    Write the listing to <file> as JSON lines\n");
+    fprintf(stderr,"    -xref <file>     Write cross references and the call graph to <file> as JSON\n");
+    fprintf(stderr,"    -dot <file>      Write the call graph to <file> as Graphviz DOT\n");
 }
 
 int parse_argv(int argc,char **argv) {
@@ -196,6 +200,23 @@ int parse_argv(int argc,char **argv) {
                 sym_file = argv[i++];
                 if (sym_file == NULL) return 1;
             }
+            else if (!strcmp(a,"jsonl")) {
+                jsonl_file = argv[i++];
+                if (jsonl_file == NULL) return 1;
+            }
+            else if (!strcmp(a,"xref")) {
+                xref_file = argv[i++];
+                if (xref_file == NULL) return 1;
+            }
+            else if (!strcmp(a,"dot")) {
+                dot_file = argv[i++];
+                if (dot_file == NULL) return 1;
+            }
+            else if (!strcmp(a,"j")) {
+                a = argv[i++];
+                if (a == NULL) return 1;
+                num_threads = (unsigned int)strtoul(a,NULL,0);
+            }
             else if (!strcmp(a,"h") || !strcmp(a,"help")) {
                 help();
                 return 1;
@@ -219,73 +240,178 @@ int parse_argv(int argc,char **argv) {
     return 0;
 }
 
-void reset_buffer() {
-    current_offset = 0;
-    dec_read = dec_end = dec_buffer;
+/* per-segment state for the analysis engine */
+struct ne_segment_dasm {
+    struct dasm_engine                              eng;
+    struct exe_ne_header_segment_reloc_table*       reloc;
+    struct dasm_reloc_map                           relocmap;       /* reloc->table by seg_offset */
+    unsigned char*                                  image;          /* segment contents, read once */
+    uint32_t                                        file_offset;
+    uint32_t                                        length;         /* segment size. eng.length is how much of it is in the file */
+    unsigned int                                    segment;        /* segment number, 1-based */
+    unsigned char                                   ready;
+    unsigned char                                   job;            /* has work in the current pass or round */
+    unsigned char                                   error;
+    struct dasm_fmt*                                fmt;            /* listing of this job */
+
+    /* labels found by this segment in the current round of the first pass */
+    struct dec_label*                               newlabel;
+    size_t                                          newlabel_count;
+    size_t                                          newlabel_alloc;
+    struct dasm_label_index                         newlabel_index;
+};
+
+/* read the whole segment into memory, so the analysis engine can decode from it directly */
+unsigned char *ne_segment_load(const uint32_t file_offset,const uint32_t length,uint32_t *plen) {
+    unsigned char *buf;
+    uint32_t got = 0;
+
+    buf = malloc(length != 0 ? (size_t)length : (size_t)1);
+    if (buf == NULL)
+        return NULL;
+
+    if ((uint32_t)lseek(src_fd,file_offset,SEEK_SET) == file_offset) {
+        while (got < length) {
+            const int rd = read(src_fd,buf + got,(unsigned int)(length - got));
+
+            if (rd <= 0) break;
+            got += (uint32_t)rd;
+        }
+    }
+
+    *plen = got;
+    return buf;
+}
+
+void ne_segment_newlabel_clear(struct ne_segment_dasm *sd) {
+    size_t i;
+
+    for (i=0;i < sd->newlabel_count;i++)
+        cstr_free(&(sd->newlabel[i].name));
+
+    sd->newlabel_count = 0;
+    dasm_label_index_clear(&sd->newlabel_index);
 }
 
-int refill() {
-    const size_t flush = sizeof(dec_buffer) / 2;
-    const size_t padding = 16;
-    size_t dlen;
-
-    if (dec_end > dec_read)
-        dlen = (size_t)(dec_end - dec_read);
-    else
-        dlen = 0;
-
-    if (dec_read >= (dec_buffer+flush)) {
-        assert((dec_read+dlen) <= (dec_buffer+sizeof(dec_buffer)-padding));
-        if (dlen != 0) memmove(dec_buffer,dec_read,dlen);
-        dec_read = dec_buffer;
-        dec_end = dec_buffer + dlen;
+void ne_segment_dasm_free(struct ne_segment_dasm *sd) {
+    ne_segment_newlabel_clear(sd);
+    dasm_label_index_free(&sd->newlabel_index);
+    if (sd->newlabel) free(sd->newlabel);
+    sd->newlabel = NULL;
+    sd->newlabel_alloc = 0;
+
+    dasm_reloc_map_free(&sd->relocmap);
+    dasm_engine_free(&sd->eng);
+    if (sd->image) free(sd->image);
+    sd->image = NULL;
+    sd->ready = 0;
+}
+
+int ne_segment_dasm_setup(struct ne_segment_dasm *sd,const struct exe_ne_header_segment_table *segs,unsigned int segmenti,struct exe_ne_header_segment_reloc_table *relocs) {
+    const struct exe_ne_header_segment_entry *segent = segs->table + segmenti;
+
+    if (sd->ready)
+        return 0;
+
+    dasm_engine_init(&sd->eng);
+    dasm_reloc_map_init(&sd->relocmap);
+    sd->file_offset = (uint32_t)segent->offset_in_segments << (uint32_t)segs->sector_shift;
+    sd->reloc = (relocs != NULL) ? &relocs[segmenti] : NULL;
+    sd->segment = segmenti + 1;
+    sd->length = (segent->length == 0 ? 0x10000UL : segent->length);
+    sd->image = ne_segment_load(sd->file_offset,sd->length,&sd->eng.length);
+    sd->eng.image = sd->image;
+    sd->eng.offset_mask = 0xFFFFUL;
+    sd->eng.max_run = 1024;
+    sd->eng.user = sd;
+    if (sd->image == NULL || dasm_engine_setup(&sd->eng)) {
+        ne_segment_dasm_free(sd);
+        return -1;
     }
-    {
-        unsigned char *e = dec_buffer + sizeof(dec_buffer) - padding;
-
-        if (dec_end < e) {
-            unsigned long clen = end_decom - current_offset;
-            dlen = (size_t)(e - dec_end);
-            if ((unsigned long)dlen > clen)
-                dlen = (size_t)clen;
-
-            if (dlen != 0) {
-                int rd = read(src_fd,dec_end,dlen);
-                if (rd > 0) {
-                    dec_end += rd;
-                    current_offset += (unsigned long)rd;
-                }
+
+    if (sd->reloc != NULL) {
+        unsigned int i;
+
+        for (i=0;i < sd->reloc->length;i++) {
+            if (dasm_reloc_map_add(&sd->relocmap,sd->reloc->table[i].r.seg_offset,0,i)) {
+                ne_segment_dasm_free(sd);
+                return -1;
             }
         }
+
+        dasm_reloc_map_sort(&sd->relocmap);
     }
 
-    return (dec_read < dec_end);
+    sd->ready = 1;
+    return 0;
 }
 
-struct dec_label *dec_find_label(const uint16_t so,const uint16_t oo) {
-    unsigned int i=0;
+/* first relocation of the segment at or after ip, or NULL */
+const union exe_ne_header_segment_relocation_entry *ne_segment_reloc_at(struct ne_segment_dasm *sd,uint32_t ip) {
+    const size_t i = dasm_reloc_map_seek(&sd->relocmap,ip);
+
+    if (sd->reloc == NULL || i >= sd->relocmap.count)
+        return NULL;
+
+    return sd->reloc->table + sd->relocmap.ent[i].index;
+}
+
+/* index the labels added since the last lookup */
+void dec_label_index_update() {
+    while (dec_label_index.indexed < dec_label_count) {
+        const struct dec_label *l = dec_label + dec_label_index.indexed;
+
+        if (dasm_label_index_add(&dec_label_index,l->seg_v,l->ofs_v,(uint32_t)dec_label_index.indexed))
+            break;
+
+        dec_label_index.indexed++;
+    }
+}
+
+/* look up a label without updating the index. several threads may do this at once, as long as none of them adds labels */
+struct dec_label *dec_find_label_indexed(const uint16_t so,const uint16_t oo) {
+    uint32_t n;
 
     if (dec_label == NULL)
         return NULL;
 
-    while (i < dec_label_count) {
-        struct dec_label *l = dec_label + i;
+    n = dasm_label_index_find(&dec_label_index,so,oo);
+    if (n != DASM_LABEL_NONE)
+        return dec_label + n;
+
+    /* labels the index could not take (out of memory) */
+    for (n=(uint32_t)dec_label_index.indexed;n < dec_label_count;n++) {
+        struct dec_label *l = dec_label + n;
 
         if (l->seg_v == so && l->ofs_v == oo)
             return l;
-
-        i++;
     }
 
     return NULL;
 }
 
+struct dec_label *dec_find_label(const uint16_t so,const uint16_t oo) {
+    dec_label_index_update();
+    return dec_find_label_indexed(so,oo);
+}
+
+/* the label array grows as needed. pointers to labels are not valid across calls to this function. */
 struct dec_label *dec_label_malloc() {
-    if (dec_label == NULL)
-        return NULL;
+    if (dec_label_count >= dec_label_alloc) {
+        const size_t na = (dec_label_alloc != 0) ? (dec_label_alloc * 2) : 4096;
+        struct dec_label *np;
 
-    if (dec_label_count >= dec_label_alloc)
-        return NULL;
+        if (na <= dec_label_alloc || na > (((size_t)-1) / sizeof(*np)))
+            return NULL;
+
+        np = realloc(dec_label,na * sizeof(*np));
+        if (np == NULL)
+            return NULL;
+
+        memset(np + dec_label_alloc,0,(na - dec_label_alloc) * sizeof(*np));
+        dec_label = np;
+        dec_label_alloc = na;
+    }
 
     return dec_label + (dec_label_count++);
 }
@@ -326,6 +452,7 @@ void dec_label_sort() {
         return;
 
     qsort(dec_label,dec_label_count,sizeof(*dec_label),dec_label_qsortcb);
+    dasm_label_index_clear(&dec_label_index);
 }
 
 const char *mod_symbols_list_lookup(
@@ -449,52 +576,38 @@ void print_segment_reloc_table(const struct exe_ne_header_segment_reloc_table *
 }
 
 void get_entry_name_by_ordinal(char *tmp,size_t tmplen,const struct exe_ne_header_name_entry_table * const nonresnames,const struct exe_ne_header_name_entry_table *resnames,const unsigned int ordinal) {
-    unsigned int i;
+    const struct exe_ne_header_name_entry *ent;
 
     tmp[0] = 0;
     if (tmplen <= 1) return;
 
-    if (resnames->table != NULL) {
-        for (i=0;i < resnames->length;i++) {
-            struct exe_ne_header_name_entry *ent = resnames->table + i;
-
-            if (ne_name_entry_get_ordinal(resnames,ent) == ordinal) {
-                ne_name_entry_get_name(tmp,tmplen,resnames,ent);
-                return;
-            }
-        }
-    }
-
-    if (nonresnames->table != NULL) {
-        for (i=0;i < nonresnames->length;i++) {
-            struct exe_ne_header_name_entry *ent = nonresnames->table + i;
-
-            if (ne_name_entry_get_ordinal(nonresnames,ent) == ordinal) {
-                ne_name_entry_get_name(tmp,tmplen,nonresnames,ent);
-                return;
-            }
-        }
-    }
+    if ((ent=ne_name_entry_find_by_ordinal(resnames,ordinal)) != NULL)
+        ne_name_entry_get_name(tmp,tmplen,resnames,ent);
+    else if ((ent=ne_name_entry_find_by_ordinal(nonresnames,ordinal)) != NULL)
+        ne_name_entry_get_name(tmp,tmplen,nonresnames,ent);
 }
 
 void print_relocation_farptr(
+    struct dasm_fmt *fmt,
     const struct exe_ne_header_imported_name_table *ne_imported_name_table,
     const struct exe_ne_header_entry_table_table *ne_entry_table,
     const struct exe_ne_header_name_entry_table *ne_nonresname,
     const struct exe_ne_header_name_entry_table *ne_resname,
     const union exe_ne_header_segment_relocation_entry *relocent,
     const struct mod_symbols_list * const mod_syms) {
+    char tmp[255+1];
+
     // caller has established relocation is 2-byte SEGMENT value.
     switch (relocent->r.reloc_type&EXE_NE_HEADER_SEGMENT_RELOC_TYPE_MASK) {
         case EXE_NE_HEADER_SEGMENT_RELOC_TYPE_INTERNAL_REFERENCE:
             if (relocent->intref.segment_index == 0xFF) {
-                get_entry_name_by_ordinal(name_tmp,sizeof(name_tmp),ne_nonresname,ne_resname,relocent->movintref.entry_ordinal);
+                get_entry_name_by_ordinal(tmp,sizeof(tmp),ne_nonresname,ne_resname,relocent->movintref.entry_ordinal);
 
-                if (name_tmp[0] != 0)
-                    printf("entry %s ordinal #%d",
-                            name_tmp,relocent->movintref.entry_ordinal);
+                if (tmp[0] != 0)
+                    dasm_fmt_printf(fmt,"entry %s ordinal #%d",
+                            tmp,relocent->movintref.entry_ordinal);
                 else
-                    printf("entry ordinal #%d",
+                    dasm_fmt_printf(fmt,"entry ordinal #%d",
                             relocent->movintref.entry_ordinal);
 
                 /* ordinal is 1-based */
@@ -507,7 +620,7 @@ void print_relocation_farptr(
                             struct exe_ne_header_entry_table_movable_segment_entry *ment =
                                 (struct exe_ne_header_entry_table_movable_segment_entry*)rawd;
 
-                            printf(" -- segment #%d -- 0x%04x : 0x%04x",
+                            dasm_fmt_printf(fmt," -- segment #%d -- 0x%04x : 0x%04x",
                                     ment->segid,
                                     ment->segid,
                                     ment->seg_offs);
@@ -517,7 +630,7 @@ void print_relocation_farptr(
                             struct exe_ne_header_entry_table_fixed_segment_entry *fent =
                                 (struct exe_ne_header_entry_table_fixed_segment_entry*)rawd;
 
-                            printf(" -- segment #%d -- 0x%04x : 0x%04x",
+                            dasm_fmt_printf(fmt," -- segment #%d -- 0x%04x : 0x%04x",
                                     ent->segment_id,
                                     ent->segment_id,
                                     fent->v.seg_offs);
@@ -526,58 +639,61 @@ void print_relocation_farptr(
                 }
             }
             else {
-                printf("segment #%d : 0x%04X",
+                dasm_fmt_printf(fmt,"segment #%d : 0x%04X",
                         relocent->intref.segment_index,
                         relocent->intref.seg_offset);
             }
             break;
         case EXE_NE_HEADER_SEGMENT_RELOC_TYPE_IMPORTED_ORDINAL:
-            ne_imported_name_table_entry_get_module_ref_name(name_tmp,sizeof(name_tmp),ne_imported_name_table,relocent->ordinal.module_reference_index);
-            printf("module reference #%d '%s', ordinal %d",
-                    relocent->ordinal.module_reference_index,name_tmp,
+            ne_imported_name_table_entry_get_module_ref_name(tmp,sizeof(tmp),ne_imported_name_table,relocent->ordinal.module_reference_index);
+            dasm_fmt_printf(fmt,"module reference #%d '%s', ordinal %d",
+                    relocent->ordinal.module_reference_index,tmp,
                     relocent->ordinal.ordinal);
             {
                 const char *sym = mod_symbols_list_lookup(
                     mod_syms,
                     relocent->ordinal.module_reference_index,
                     relocent->ordinal.ordinal);
-                if (sym != NULL) printf(" '%s'",sym);
+                if (sym != NULL) dasm_fmt_printf(fmt," '%s'",sym);
             }
             break;
         case EXE_NE_HEADER_SEGMENT_RELOC_TYPE_IMPORTED_NAME:
-            ne_imported_name_table_entry_get_module_ref_name(name_tmp,sizeof(name_tmp),ne_imported_name_table,relocent->ordinal.module_reference_index);
-            printf("module reference #%d '%s', imp name offset %d",
-                    relocent->name.module_reference_index,name_tmp,
+            ne_imported_name_table_entry_get_module_ref_name(tmp,sizeof(tmp),ne_imported_name_table,relocent->ordinal.module_reference_index);
+            dasm_fmt_printf(fmt,"module reference #%d '%s', imp name offset %d",
+                    relocent->name.module_reference_index,tmp,
                     relocent->name.imported_name_offset);
 
-            ne_imported_name_table_entry_get_name(name_tmp,sizeof(name_tmp),ne_imported_name_table,relocent->name.imported_name_offset);
-            if (name_tmp[0] != 0) printf(" '%s'",name_tmp);
+            ne_imported_name_table_entry_get_name(tmp,sizeof(tmp),ne_imported_name_table,relocent->name.imported_name_offset);
+            if (tmp[0] != 0) dasm_fmt_printf(fmt," '%s'",tmp);
             break;
         case EXE_NE_HEADER_SEGMENT_RELOC_TYPE_OSFIXUP:
-            printf("OSFIXUP type=0x%04x",
+            dasm_fmt_printf(fmt,"OSFIXUP type=0x%04x",
                     relocent->osfixup.fixup);
             break;
     }
 }
 
 void print_relocation_segment(
+    struct dasm_fmt *fmt,
     const struct exe_ne_header_imported_name_table *ne_imported_name_table,
     const struct exe_ne_header_entry_table_table *ne_entry_table,
     const struct exe_ne_header_name_entry_table *ne_nonresname,
     const struct exe_ne_header_name_entry_table *ne_resname,
     const union exe_ne_header_segment_relocation_entry *relocent,
     const struct mod_symbols_list * const mod_syms) {
+    char tmp[255+1];
+
     // caller has established relocation is 2-byte SEGMENT value.
     switch (relocent->r.reloc_type&EXE_NE_HEADER_SEGMENT_RELOC_TYPE_MASK) {
         case EXE_NE_HEADER_SEGMENT_RELOC_TYPE_INTERNAL_REFERENCE:
             if (relocent->intref.segment_index == 0xFF) {
-                get_entry_name_by_ordinal(name_tmp,sizeof(name_tmp),ne_nonresname,ne_resname,relocent->movintref.entry_ordinal);
+                get_entry_name_by_ordinal(tmp,sizeof(tmp),ne_nonresname,ne_resname,relocent->movintref.entry_ordinal);
 
-                if (name_tmp[0] != 0)
-                    printf("segment of entry %s ordinal #%d",
-                            name_tmp,relocent->movintref.entry_ordinal);
+                if (tmp[0] != 0)
+                    dasm_fmt_printf(fmt,"segment of entry %s ordinal #%d",
+                            tmp,relocent->movintref.entry_ordinal);
                 else
-                    printf("segment of entry ordinal #%d",
+                    dasm_fmt_printf(fmt,"segment of entry ordinal #%d",
                             relocent->movintref.entry_ordinal);
 
                 /* ordinal is 1-based */
@@ -590,13 +706,13 @@ void print_relocation_segment(
                             struct exe_ne_header_entry_table_movable_segment_entry *ment =
                                 (struct exe_ne_header_entry_table_movable_segment_entry*)rawd;
 
-                            printf(" -- segment #%d -- 0x%04x",
+                            dasm_fmt_printf(fmt," -- segment #%d -- 0x%04x",
                                     ment->segid,
                                     ment->segid);
                         }
                         else {
                             /* NTS: raw_entry() function guarantees that the data available is large enough to hold this struct */
-                            printf(" -- segment #%d -- 0x%04x",
+                            dasm_fmt_printf(fmt," -- segment #%d -- 0x%04x",
                                     ent->segment_id,
                                     ent->segment_id);
                         }
@@ -604,55 +720,58 @@ void print_relocation_segment(
                 }
             }
             else {
-                printf("segment #%d=0x%04X",
+                dasm_fmt_printf(fmt,"segment #%d=0x%04X",
                         relocent->intref.segment_index,
                         relocent->intref.segment_index);
             }
             break;
         case EXE_NE_HEADER_SEGMENT_RELOC_TYPE_IMPORTED_ORDINAL:
-            ne_imported_name_table_entry_get_module_ref_name(name_tmp,sizeof(name_tmp),ne_imported_name_table,relocent->ordinal.module_reference_index);
-            printf("segment of module reference #%d '%s', ordinal %d",
-                    relocent->ordinal.module_reference_index,name_tmp,
+            ne_imported_name_table_entry_get_module_ref_name(tmp,sizeof(tmp),ne_imported_name_table,relocent->ordinal.module_reference_index);
+            dasm_fmt_printf(fmt,"segment of module reference #%d '%s', ordinal %d",
+                    relocent->ordinal.module_reference_index,tmp,
                     relocent->ordinal.ordinal);
             {
                 const char *sym = mod_symbols_list_lookup(
                     mod_syms,
                     relocent->ordinal.module_reference_index,
                     relocent->ordinal.ordinal);
-                if (sym != NULL) printf(" '%s'",sym);
+                if (sym != NULL) dasm_fmt_printf(fmt," '%s'",sym);
             }
             break;
         case EXE_NE_HEADER_SEGMENT_RELOC_TYPE_IMPORTED_NAME:
-            ne_imported_name_table_entry_get_module_ref_name(name_tmp,sizeof(name_tmp),ne_imported_name_table,relocent->ordinal.module_reference_index);
-            printf("segment of module reference #%d '%s', imp name offset %d",
-                    relocent->name.module_reference_index,name_tmp,
+            ne_imported_name_table_entry_get_module_ref_name(tmp,sizeof(tmp),ne_imported_name_table,relocent->ordinal.module_reference_index);
+            dasm_fmt_printf(fmt,"segment of module reference #%d '%s', imp name offset %d",
+                    relocent->name.module_reference_index,tmp,
                     relocent->name.imported_name_offset);
             break;
         case EXE_NE_HEADER_SEGMENT_RELOC_TYPE_OSFIXUP:
-            printf("segment of OSFIXUP type=0x%04x ???",
+            dasm_fmt_printf(fmt,"segment of OSFIXUP type=0x%04x ???",
                     relocent->osfixup.fixup);
             break;
     }
 }
 
 void print_relocation_offset(
+    struct dasm_fmt *fmt,
     const struct exe_ne_header_imported_name_table *ne_imported_name_table,
     const struct exe_ne_header_entry_table_table *ne_entry_table,
     const struct exe_ne_header_name_entry_table *ne_nonresname,
     const struct exe_ne_header_name_entry_table *ne_resname,
     const union exe_ne_header_segment_relocation_entry *relocent,
     const struct mod_symbols_list * const mod_syms) {
+    char tmp[255+1];
+
     // caller has established relocation is 2-byte SEGMENT value.
     switch (relocent->r.reloc_type&EXE_NE_HEADER_SEGMENT_RELOC_TYPE_MASK) {
         case EXE_NE_HEADER_SEGMENT_RELOC_TYPE_INTERNAL_REFERENCE:
             if (relocent->intref.segment_index == 0xFF) {
-                get_entry_name_by_ordinal(name_tmp,sizeof(name_tmp),ne_nonresname,ne_resname,relocent->movintref.entry_ordinal);
+                get_entry_name_by_ordinal(tmp,sizeof(tmp),ne_nonresname,ne_resname,relocent->movintref.entry_ordinal);
 
-                if (name_tmp[0] != 0)
-                    printf("offset of entry %s ordinal #%d",
-                            name_tmp,relocent->movintref.entry_ordinal);
+                if (tmp[0] != 0)
+                    dasm_fmt_printf(fmt,"offset of entry %s ordinal #%d",
+                            tmp,relocent->movintref.entry_ordinal);
                 else
-                    printf("offset of entry ordinal #%d",
+                    dasm_fmt_printf(fmt,"offset of entry ordinal #%d",
                             relocent->movintref.entry_ordinal);
 
                 /* ordinal is 1-based */
@@ -665,7 +784,7 @@ void print_relocation_offset(
                             struct exe_ne_header_entry_table_movable_segment_entry *ment =
                                 (struct exe_ne_header_entry_table_movable_segment_entry*)rawd;
 
-                            printf(" -- 0x%04x",
+                            dasm_fmt_printf(fmt," -- 0x%04x",
                                     ment->seg_offs);
                         }
                         else {
@@ -673,59 +792,788 @@ void print_relocation_offset(
                             struct exe_ne_header_entry_table_fixed_segment_entry *fent =
                                 (struct exe_ne_header_entry_table_fixed_segment_entry*)rawd;
 
-                            printf(" -- 0x%04x",
-                                    fent->v.seg_offs);
-                        }
+                            dasm_fmt_printf(fmt," -- 0x%04x",
+                                    fent->v.seg_offs);
+                        }
+                    }
+                }
+            }
+            else {
+                dasm_fmt_printf(fmt,"NOTIMPL");
+            }
+            break;
+        case EXE_NE_HEADER_SEGMENT_RELOC_TYPE_IMPORTED_ORDINAL:
+            ne_imported_name_table_entry_get_module_ref_name(tmp,sizeof(tmp),ne_imported_name_table,relocent->ordinal.module_reference_index);
+            dasm_fmt_printf(fmt,"offset of module reference #%d '%s', ordinal %d",
+                    relocent->ordinal.module_reference_index,tmp,
+                    relocent->ordinal.ordinal);
+            {
+                const char *sym = mod_symbols_list_lookup(
+                    mod_syms,
+                    relocent->ordinal.module_reference_index,
+                    relocent->ordinal.ordinal);
+                if (sym != NULL) dasm_fmt_printf(fmt," '%s'",sym);
+            }
+            break;
+        case EXE_NE_HEADER_SEGMENT_RELOC_TYPE_IMPORTED_NAME:
+            ne_imported_name_table_entry_get_module_ref_name(tmp,sizeof(tmp),ne_imported_name_table,relocent->ordinal.module_reference_index);
+            dasm_fmt_printf(fmt,"offset of module reference #%d '%s', imp name offset %d",
+                    relocent->name.module_reference_index,tmp,
+                    relocent->name.imported_name_offset);
+            break;
+        case EXE_NE_HEADER_SEGMENT_RELOC_TYPE_OSFIXUP:
+            dasm_fmt_printf(fmt,"offset of OSFIXUP type=0x%04x ???",
+                    relocent->osfixup.fixup);
+            break;
+    }
+}
+
+/* remember a label found by the first pass of a segment, unless it is already known.
+ * dec_label[] is only added to between rounds of the first pass (see ne_segment_newlabel_merge)
+ * so that segments can be walked in parallel while reading it. */
+struct dec_label *ne_segment_newlabel(struct ne_segment_dasm *sd,const uint16_t so,const uint16_t oo,const char *name) {
+    struct dec_label *l;
+
+    if (dec_find_label_indexed(so,oo) != NULL)
+        return NULL;
+    if (dasm_label_index_find(&sd->newlabel_index,so,oo) != DASM_LABEL_NONE)
+        return NULL;
+
+    if (sd->newlabel_count >= sd->newlabel_alloc) {
+        const size_t na = (sd->newlabel_alloc != 0) ? (sd->newlabel_alloc * 2) : 256;
+        struct dec_label *np;
+
+        if (na > (((size_t)-1) / sizeof(*np)))
+            return NULL;
+
+        np = realloc(sd->newlabel,na * sizeof(*np));
+        if (np == NULL)
+            return NULL;
+
+        sd->newlabel = np;
+        sd->newlabel_alloc = na;
+    }
+
+    l = sd->newlabel + sd->newlabel_count;
+    memset(l,0,sizeof(*l));
+    dec_label_set_name(l,name);
+    l->seg_v = so;
+    l->ofs_v = oo;
+
+    /* if the index is out of memory, the label may be added twice. merging catches that. */
+    dasm_label_index_add(&sd->newlabel_index,so,oo,(uint32_t)sd->newlabel_count);
+    sd->newlabel_count++;
+    return l;
+}
+
+/* add the labels a segment found to dec_label[] */
+void ne_segment_newlabel_merge(struct ne_segment_dasm *sd) {
+    struct dec_label *label;
+    size_t i;
+
+    for (i=0;i < sd->newlabel_count;i++) {
+        struct dec_label *nl = sd->newlabel + i;
+
+        if (dec_find_label(nl->seg_v,nl->ofs_v) != NULL)
+            continue;
+
+        if ((label=dec_label_malloc()) != NULL) {
+            label->name = nl->name; /* take the string */
+            label->seg_v = nl->seg_v;
+            label->ofs_v = nl->ofs_v;
+            nl->name = NULL;
+        }
+    }
+
+    ne_segment_newlabel_clear(sd);
+}
+
+/* first pass: print each instruction as it is walked, make labels of CALL + JMP + Jcc targets
+ * and of far calls and jumps to other segments through internal reference relocations */
+int first_pass_insn(struct dasm_engine *e,const struct dasm_insn *ins,void *user) {
+    struct ne_segment_dasm *sd = (struct ne_segment_dasm*)user;
+    const union exe_ne_header_segment_relocation_entry *nextrel;
+    const uint32_t ip = ins->ip;
+    const size_t inslen = ins->dlen;
+    const uint16_t dec_cs = (uint16_t)sd->segment;
+    struct minx86dec_instruction dec_i;
+    struct dec_label *label;
+    struct dasm_fmt *fmt = sd->fmt;
+
+    (void)e;
+
+    dec_i = ins->i;
+
+    /* paths are not walked in address order, the map searches when ip goes backwards */
+    nextrel = ne_segment_reloc_at(sd,ip);
+
+    dasm_fmt_insn_begin(fmt,dec_cs,ip,4,sd->file_offset + ins->offset);
+    dasm_fmt_insn_bytes(fmt,dec_i.start,(unsigned int)(dec_i.end - dec_i.start),dec_i.rep);
+    dasm_fmt_insn_op(fmt,dec_i.opcode);
+    dasm_fmt_insn_args(fmt,&dec_i);
+    dasm_fmt_insn_end(fmt,dec_i.lock);
+
+    if (ins->flags & DASM_INSN_HAS_TARGET) {
+        /* make a label of the target */
+        /* 1st arg is target offset */
+        uint32_t toffset = ins->target_ip;
+        uint32_t noffset = sd->file_offset + toffset;
+
+        dasm_fmt_printf(fmt,"Target: 0x%04lx @0x%08lx\n",(unsigned long)toffset,(unsigned long)noffset);
+
+        ne_segment_newlabel(sd,dec_cs,toffset,(ins->flow == DASM_FLOW_CALL) ? "CALL target" : "JMP target");
+    }
+    else if (dec_i.opcode == MXOP_CALL_FAR || dec_i.opcode == MXOP_JMP_FAR) {
+        if (nextrel != NULL) {
+            const union exe_ne_header_segment_relocation_entry *relocent = nextrel;
+            const uint32_t o = relocent->r.seg_offset;
+
+            if (o >= ip && o < (ip + inslen)) {
+                if (relocent->r.reloc_type&EXE_NE_HEADER_SEGMENT_RELOC_TYPE_ADDITIVE) {
+                }
+                else {
+                    if ((relocent->r.reloc_address_type&EXE_NE_HEADER_SEGMENT_RELOC_ADDR_TYPE_MASK) ==
+                        EXE_NE_HEADER_SEGMENT_RELOC_ADDR_TYPE_SEGMENT) {
+                        if ((relocent->r.reloc_type&EXE_NE_HEADER_SEGMENT_RELOC_TYPE_MASK) ==
+                            EXE_NE_HEADER_SEGMENT_RELOC_TYPE_INTERNAL_REFERENCE) {
+                            if (dec_i.argv[0].segment == MX86_SEG_IMM && dec_i.argv[0].regtype == MX86_RT_IMM) {
+                                /* we can and should track internal references.
+                                 * do not track movable entry ordinal refs, because we already added those entry points to the label list */
+                                if (relocent->intref.segment_index != 0xFF) {
+                                    label = ne_segment_newlabel(sd,relocent->intref.segment_index,dec_i.argv[0].value,
+                                        (dec_i.opcode == MXOP_JMP_FAR) ? "JMP FAR target" : "CALL FAR target");
+                                    if (label != NULL) {
+                                        dasm_fmt_printf(fmt,"Target: 0x%04lx:0x%04lx internal ref, relocation by segment value\n",
+                                            (unsigned long)label->seg_v,
+                                            (unsigned long)label->ofs_v);
+                                    }
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+
+/* first pass of one segment: walk the code from each label of this round that has not been walked yet */
+void first_pass_segment(struct ne_segment_dasm *sd,size_t label_first,size_t label_end) {
+    const struct dec_label *label;
+    size_t los;
+
+    for (los=label_first;los < label_end;los++) {
+        label = dec_label + los;
+        if (label->seg_v != sd->segment)
+            continue;
+
+        if (!dasm_engine_seen(&sd->eng,label->ofs_v)) {
+            dasm_fmt_printf(sd->fmt,"* NE segment #%d (0x%lx bytes @0x%lx) 1st pass\n",
+                    sd->segment,(unsigned long)sd->length,(unsigned long)sd->file_offset);
+
+            if (dasm_engine_queue(&sd->eng,label->ofs_v,label->ofs_v) < 0 ||
+                dasm_engine_run(&sd->eng,first_pass_insn,sd) < 0) {
+                sd->error = 1;
+                break;
+            }
+        }
+    }
+}
+
+/* cross references of a segment: its branch/call edges, and the internal reference relocations
+ * within walked instructions (far calls and jumps, and offsets of data or code in other segments) */
+int ne_segment_xrefs(struct ne_segment_dasm *sd) {
+    const union exe_ne_header_segment_relocation_entry *relocent;
+    const struct dasm_insn *ins;
+    unsigned int type;
+    uint32_t back;
+    size_t i;
+
+    if (dasm_xref_add_edges(&dec_xref,&sd->eng,sd->segment,0))
+        return -1;
+
+    if (sd->reloc == NULL)
+        return 0;
+
+    for (i=0;i < sd->relocmap.count;i++) {
+        relocent = sd->reloc->table + sd->relocmap.ent[i].index;
+
+        if ((relocent->r.reloc_type&EXE_NE_HEADER_SEGMENT_RELOC_TYPE_ADDITIVE) ||
+            (relocent->r.reloc_type&EXE_NE_HEADER_SEGMENT_RELOC_TYPE_MASK) != EXE_NE_HEADER_SEGMENT_RELOC_TYPE_INTERNAL_REFERENCE ||
+            relocent->intref.segment_index == 0xFF)
+            continue;
+
+        type = relocent->r.reloc_address_type&EXE_NE_HEADER_SEGMENT_RELOC_ADDR_TYPE_MASK;
+        back = 0;
+        while ((ins=dasm_engine_walked_at(&sd->eng,relocent->r.seg_offset,0,&back)) != NULL) {
+            if (type == EXE_NE_HEADER_SEGMENT_RELOC_ADDR_TYPE_SEGMENT) {
+                /* the offset is in the instruction */
+                if ((ins->i.opcode == MXOP_CALL_FAR || ins->i.opcode == MXOP_JMP_FAR) &&
+                    ins->i.argv[0].segment == MX86_SEG_IMM && ins->i.argv[0].regtype == MX86_RT_IMM) {
+                    if (dasm_xref_add(&dec_xref,sd->segment,ins->ip,relocent->intref.segment_index,(uint16_t)ins->i.argv[0].value,
+                        (ins->i.opcode == MXOP_JMP_FAR) ? DASM_XREF_JUMP : DASM_XREF_CALL))
+                        return -1;
+                }
+            }
+            else if (type == EXE_NE_HEADER_SEGMENT_RELOC_ADDR_TYPE_OFFSET || type == EXE_NE_HEADER_SEGMENT_RELOC_ADDR_TYPE_FAR_POINTER) {
+                if (dasm_xref_add(&dec_xref,sd->segment,ins->ip,relocent->intref.segment_index,relocent->intref.seg_offset,DASM_XREF_DATA))
+                    return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+/* second pass of one segment: the listing, with labels and relocations */
+void second_pass_segment(struct ne_segment_dasm *sd) {
+    const struct exe_ne_header_segment_entry *segent = ne_segments.table + sd->segment - 1;
+    struct minx86dec_instruction dec_i;
+    const struct dec_label *label;
+    struct dasm_fmt *fmt = sd->fmt;
+    uint32_t segment_ofs;
+    const union exe_ne_header_segment_relocation_entry *nextrel;
+    unsigned int labeli;
+    char tmp[255+1];
+    uint32_t dec_pos;
+    uint16_t dec_cs;
+
+    segment_ofs = sd->file_offset;
+    dec_cs = sd->segment;
+
+    dasm_fmt_printf(fmt,"* NE segment #%d (0x%lx bytes @0x%lx)\n",
+        sd->segment,(unsigned long)sd->length,(unsigned long)segment_ofs);
+
+    labeli = 0;
+    dec_pos = 0;
+
+    if (segent->flags & EXE_NE_HEADER_SEGMENT_ENTRY_FLAGS_DATA) {
+        unsigned int col = 0;
+
+        do {
+            uint32_t ip = dec_pos;
+            const unsigned char *p;
+            unsigned int avail;
+            uint32_t ofs;
+
+            while (labeli < dec_label_count) {
+                label = dec_label + labeli;
+                if (label->seg_v != dec_cs) {
+                    labeli++;
+                    continue;
+                }
+                if (ip < label->ofs_v)
+                    break;
+
+                labeli++;
+                ip = label->ofs_v;
+                dec_cs = label->seg_v;
+                ofs = segment_ofs + ip;
+
+                if (col != 0) {
+                    dasm_fmt_printf(fmt,"\n");
+                    col = 0;
+                }
+
+                dasm_fmt_printf(fmt,"Label '%s' at %04lx:%04lx @0x%08lx\n",
+                        label->name ? label->name : "",
+                        (unsigned long)label->seg_v,
+                        (unsigned long)label->ofs_v,
+                        (unsigned long)ofs);
+                dasm_fmt_json_label(fmt,label->name,label->seg_v,label->ofs_v,ofs);
+                {
+                    const struct dasm_xref *refs;
+                    size_t n;
+
+                    refs = dasm_xref_find(&dec_xref,label->seg_v,label->ofs_v,&n);
+                    dasm_fmt_xrefs(fmt,label->seg_v,label->ofs_v,refs,n,1);
+                }
+
+                label = dec_label + labeli;
+            }
+
+            if ((p=dasm_engine_fetch(&sd->eng,ip,&avail)) == NULL) break;
+
+            nextrel = ne_segment_reloc_at(sd,ip);
+
+            /* if any part of the instruction is affected by EXE relocations, say so */
+            if (nextrel != NULL) {
+                const union exe_ne_header_segment_relocation_entry *relocent = nextrel;
+                const uint32_t o = relocent->r.seg_offset;
+
+                if (o == ip) {
+                    if (col != 0) {
+                        dasm_fmt_printf(fmt,"\n");
+                        col = 0;
+                    }
+                    dasm_fmt_printf(fmt,"%04lX:%04lX @0x%08lX ",
+                            (unsigned long)dec_cs,
+                            (unsigned long)ip,
+                            (unsigned long)(segment_ofs + ip));
+
+                    dasm_fmt_printf(fmt," <--- EXE relocation ");
+
+                    switch (relocent->r.reloc_type&EXE_NE_HEADER_SEGMENT_RELOC_TYPE_MASK) {
+                        case EXE_NE_HEADER_SEGMENT_RELOC_TYPE_INTERNAL_REFERENCE:
+                            dasm_fmt_printf(fmt,"Internal ref");
+                            break;
+                        case EXE_NE_HEADER_SEGMENT_RELOC_TYPE_IMPORTED_ORDINAL:
+                            dasm_fmt_printf(fmt,"Import by ordinal");
+                            break;
+                        case EXE_NE_HEADER_SEGMENT_RELOC_TYPE_IMPORTED_NAME:
+                            dasm_fmt_printf(fmt,"Import by name");
+                            break;
+                        case EXE_NE_HEADER_SEGMENT_RELOC_TYPE_OSFIXUP:
+                            dasm_fmt_printf(fmt,"OSFIXUP");
+                            break;
+                    }
+                    if (relocent->r.reloc_type&EXE_NE_HEADER_SEGMENT_RELOC_TYPE_ADDITIVE)
+                        dasm_fmt_printf(fmt," (ADDITIVE)");
+                    dasm_fmt_printf(fmt," ");
+
+                    switch (relocent->r.reloc_address_type&EXE_NE_HEADER_SEGMENT_RELOC_ADDR_TYPE_MASK) {
+                        case EXE_NE_HEADER_SEGMENT_RELOC_ADDR_TYPE_OFFSET_LOBYTE:
+                            dasm_fmt_printf(fmt,"addr=OFFSET_LOBYTE");
+                            break;
+                        case EXE_NE_HEADER_SEGMENT_RELOC_ADDR_TYPE_SEGMENT:
+                            dasm_fmt_printf(fmt,"addr=SEGMENT");
+                            break;
+                        case EXE_NE_HEADER_SEGMENT_RELOC_ADDR_TYPE_FAR_POINTER:
+                            dasm_fmt_printf(fmt,"addr=FAR_POINTER(16:16)");
+                            break;
+                        case EXE_NE_HEADER_SEGMENT_RELOC_ADDR_TYPE_OFFSET:
+                            dasm_fmt_printf(fmt,"addr=OFFSET");
+                            break;
+                        case EXE_NE_HEADER_SEGMENT_RELOC_ADDR_TYPE_FAR48_POINTER:
+                            dasm_fmt_printf(fmt,"addr=FAR_POINTER(16:32)");
+                            break;
+                        case EXE_NE_HEADER_SEGMENT_RELOC_ADDR_TYPE_OFFSET32:
+                            dasm_fmt_printf(fmt,"addr=OFFSET32");
+                            break;
+                        default:
+                            dasm_fmt_printf(fmt,"addr=0x%02x",relocent->r.reloc_address_type);
+                            break;
+                    }
+                    dasm_fmt_printf(fmt,"\n");
+
+                    switch (relocent->r.reloc_type&EXE_NE_HEADER_SEGMENT_RELOC_TYPE_MASK) {
+                        case EXE_NE_HEADER_SEGMENT_RELOC_TYPE_INTERNAL_REFERENCE:
+                            if (relocent->intref.segment_index == 0xFF) {
+                                get_entry_name_by_ordinal(tmp,sizeof(tmp),&ne_nonresname,&ne_resname,relocent->movintref.entry_ordinal);
+
+                                dasm_fmt_printf(fmt,"                    Refers to movable segment, entry ordinal #%d",
+                                        relocent->movintref.entry_ordinal);
+                                if (tmp[0] != 0)
+                                    dasm_fmt_printf(fmt," '%s'",tmp);
+                                dasm_fmt_printf(fmt,"\n");
+                            }
+                            else {
+                                dasm_fmt_printf(fmt,"                    Refers to segment #%d : 0x%04x\n",
+                                        relocent->intref.segment_index,
+                                        relocent->intref.seg_offset);
+                            }
+                            break;
+                        case EXE_NE_HEADER_SEGMENT_RELOC_TYPE_IMPORTED_ORDINAL:
+                            ne_imported_name_table_entry_get_module_ref_name(tmp,sizeof(tmp),&ne_imported_name_table,relocent->ordinal.module_reference_index);
+                            dasm_fmt_printf(fmt,"                    Refers to module reference #%d '%s', ordinal %d",
+                                    relocent->ordinal.module_reference_index,tmp,
+                                    relocent->ordinal.ordinal);
+                            {
+                                const char *sym = mod_symbols_list_lookup(
+                                    &mod_syms,
+                                    relocent->ordinal.module_reference_index,
+                                    relocent->ordinal.ordinal);
+                                if (sym != NULL) dasm_fmt_printf(fmt," '%s'",sym);
+                            }
+                            dasm_fmt_printf(fmt,"\n");
+                            break;
+                        case EXE_NE_HEADER_SEGMENT_RELOC_TYPE_IMPORTED_NAME:
+                            ne_imported_name_table_entry_get_module_ref_name(tmp,sizeof(tmp),&ne_imported_name_table,relocent->ordinal.module_reference_index);
+                            dasm_fmt_printf(fmt,"                    Refers to module reference #%d '%s', imp name offset %d",
+                                    relocent->name.module_reference_index,tmp,
+                                    relocent->name.imported_name_offset);
+
+                            ne_imported_name_table_entry_get_name(tmp,sizeof(tmp),&ne_imported_name_table,relocent->name.imported_name_offset);
+                            dasm_fmt_printf(fmt," '%s'\n",
+                                    tmp);
+                            break;
+                        case EXE_NE_HEADER_SEGMENT_RELOC_TYPE_OSFIXUP:
+                            dasm_fmt_printf(fmt,"                    OSFIXUP type=0x%04x\n",
+                                    relocent->osfixup.fixup);
+                            break;
+                    }
+
+                    col = 0;
+                    dasm_fmt_printf(fmt,"                    at +%u bytes (%04x:%04x)\n",
+                            (unsigned int)(o - ip),
+                            (unsigned int)dec_cs,
+                            (unsigned int)ip + (unsigned int)(o - ip));
+                }
+            }
+
+            if (col == 0) {
+                dasm_fmt_printf(fmt,"%04lX:%04lX @0x%08lX ",
+                    (unsigned long)dec_cs,
+                    (unsigned long)ip,
+                    (unsigned long)(segment_ofs + ip));
+            }
+
+            while (col < ((unsigned int)(ip & 0xF))) {
+                dasm_fmt_printf(fmt,"   ");
+                col++;
+            }
+
+            assert(avail != 0);
+            dasm_fmt_printf(fmt,"%02X ",*p);
+            dec_pos = ip + 1;
+            col++;
+
+            if (col >= 16) {
+                dasm_fmt_printf(fmt,"\n");
+                col = 0;
+            }
+        } while(1);
+
+        if (col != 0) {
+            dasm_fmt_printf(fmt,"\n");
+            col = 0;
+        }
+    }
+    else {
+        do {
+            uint32_t ip = dec_pos;
+            const struct dasm_insn *ins;
+            unsigned char reloc_ann = 0;
+            uint32_t ofs;
+            size_t inslen;
+
+            while (labeli < dec_label_count) {
+                label = dec_label + labeli;
+                if (label->seg_v != dec_cs) {
+                    labeli++;
+                    continue;
+                }
+                if (ip < label->ofs_v)
+                    break;
+
+                labeli++;
+                ip = label->ofs_v;
+                dec_cs = label->seg_v;
+                ofs = segment_ofs + ip;
+
+                dasm_fmt_printf(fmt,"Label '%s' at %04lx:%04lx @0x%08lx\n",
+                        label->name ? label->name : "",
+                        (unsigned long)label->seg_v,
+                        (unsigned long)label->ofs_v,
+                        (unsigned long)ofs);
+                dasm_fmt_json_label(fmt,label->name,label->seg_v,label->ofs_v,ofs);
+                {
+                    const struct dasm_xref *refs;
+                    size_t n;
+
+                    refs = dasm_xref_find(&dec_xref,label->seg_v,label->ofs_v,&n);
+                    dasm_fmt_xrefs(fmt,label->seg_v,label->ofs_v,refs,n,1);
+                }
+
+                label = dec_label + labeli;
+            }
+
+            /* the first pass already decoded most of this, the engine returns it from the cache */
+            ins = dasm_engine_decode(&sd->eng,ip,ip);
+            if (ins == NULL) break;
+
+            dec_i = ins->i;
+            inslen = ins->dlen;
+
+            nextrel = ne_segment_reloc_at(sd,ip);
+
+            dasm_fmt_insn_begin(fmt,dec_cs,ip,4,segment_ofs + ip);
+            dasm_fmt_insn_bytes(fmt,dec_i.start,(unsigned int)(dec_i.end - dec_i.start),dec_i.rep);
+            dasm_fmt_insn_op(fmt,dec_i.opcode);
+
+            /* relocation notes in the operands are for the text listing only */
+            if (nextrel != NULL && !dasm_fmt_json(fmt)) {
+                const union exe_ne_header_segment_relocation_entry *relocent = nextrel;
+                const uint32_t o = relocent->r.seg_offset;
+
+                if (o >= ip && o < (ip + inslen)) {
+                    if ((dec_i.opcode == MXOP_JMP_FAR || dec_i.opcode == MXOP_CALL_FAR) && dec_i.argc == 1 &&
+                        dec_i.argv[0].segment == MX86_SEG_IMM && dec_i.argv[0].regtype == MX86_RT_IMM) {
+
+                        switch (relocent->r.reloc_address_type&EXE_NE_HEADER_SEGMENT_RELOC_ADDR_TYPE_MASK) {
+                            case EXE_NE_HEADER_SEGMENT_RELOC_ADDR_TYPE_SEGMENT:
+                                if (o == (ip + 1 + 2)) { // CALL/JMP FAR segment relocation affecting segment portion
+                                    dasm_fmt_printf(fmt,"<");
+                                    print_relocation_segment(fmt,&ne_imported_name_table,&ne_entry_table,&ne_nonresname,&ne_resname,relocent,&mod_syms);
+                                    if (relocent->r.reloc_type&EXE_NE_HEADER_SEGMENT_RELOC_TYPE_ADDITIVE) {
+                                        dasm_fmt_printf(fmt," + 0x%04x>:0x%04x",
+                                            (unsigned int)dec_i.argv[0].segval,
+                                            (unsigned int)dec_i.argv[0].value);
+                                    }
+                                    else {
+                                        dasm_fmt_printf(fmt,">:0x%04x",
+                                            (unsigned int)dec_i.argv[0].value);
+                                    }
+
+                                    reloc_ann = 1;
+                                }
+                                break;
+                            case EXE_NE_HEADER_SEGMENT_RELOC_ADDR_TYPE_FAR_POINTER:
+                                if (o == (ip + 1)) {
+                                    if (!(relocent->r.reloc_type&EXE_NE_HEADER_SEGMENT_RELOC_TYPE_ADDITIVE)) {
+                                        dasm_fmt_printf(fmt,"<");
+                                        print_relocation_farptr(fmt,&ne_imported_name_table,&ne_entry_table,&ne_nonresname,&ne_resname,relocent,&mod_syms);
+                                        dasm_fmt_printf(fmt,">");
+                                    }
+
+                                    reloc_ann = 1;
+                                }
+                                break;
+                        };
+                    }
+                    if ((dec_i.opcode == MXOP_PUSH) && dec_i.argc == 1 &&
+                        dec_i.argv[0].regtype == MX86_RT_IMM) {
+
+                        switch (relocent->r.reloc_address_type&EXE_NE_HEADER_SEGMENT_RELOC_ADDR_TYPE_MASK) {
+                            case EXE_NE_HEADER_SEGMENT_RELOC_ADDR_TYPE_SEGMENT:
+                                {
+                                    dasm_fmt_printf(fmt,"<");
+                                    print_relocation_segment(fmt,&ne_imported_name_table,&ne_entry_table,&ne_nonresname,&ne_resname,relocent,&mod_syms);
+                                    if (relocent->r.reloc_type&EXE_NE_HEADER_SEGMENT_RELOC_TYPE_ADDITIVE) {
+                                        dasm_fmt_printf(fmt," + 0x%04x>",
+                                            (unsigned int)dec_i.argv[0].value);
+                                    }
+                                    else {
+                                        dasm_fmt_printf(fmt,">");
+                                    }
+                                }
+                                break;
+                            case EXE_NE_HEADER_SEGMENT_RELOC_ADDR_TYPE_OFFSET:
+                                {
+                                    dasm_fmt_printf(fmt,"<");
+                                    print_relocation_offset(fmt,&ne_imported_name_table,&ne_entry_table,&ne_nonresname,&ne_resname,relocent,&mod_syms);
+                                    if (relocent->r.reloc_type&EXE_NE_HEADER_SEGMENT_RELOC_TYPE_ADDITIVE) {
+                                        dasm_fmt_printf(fmt," + 0x%04x>",
+                                            (unsigned int)dec_i.argv[0].value);
+                                    }
+                                    else {
+                                        dasm_fmt_printf(fmt,">");
+                                    }
+                                }
+                                break;
+                        };
+
+                        reloc_ann = 1;
+                    }
+                    if ((dec_i.opcode == MXOP_MOV || dec_i.opcode == MXOP_ADD || dec_i.opcode == MXOP_SUB ||
+                         dec_i.opcode == MXOP_CMP || dec_i.opcode == MXOP_XOR) && dec_i.argc == 2 &&
+                        dec_i.argv[1].regtype == MX86_RT_IMM) {
+
+                        dasm_fmt_insn_arg(fmt,&dec_i.argv[0]);
+                        dasm_fmt_printf(fmt,",");
+
+                        switch (relocent->r.reloc_address_type&EXE_NE_HEADER_SEGMENT_RELOC_ADDR_TYPE_MASK) {
+                            case EXE_NE_HEADER_SEGMENT_RELOC_ADDR_TYPE_SEGMENT:
+                                {
+                                    dasm_fmt_printf(fmt,"<");
+                                    print_relocation_segment(fmt,&ne_imported_name_table,&ne_entry_table,&ne_nonresname,&ne_resname,relocent,&mod_syms);
+                                    if (relocent->r.reloc_type&EXE_NE_HEADER_SEGMENT_RELOC_TYPE_ADDITIVE) {
+                                        dasm_fmt_printf(fmt," + 0x%04x>",
+                                            (unsigned int)dec_i.argv[0].value);
+                                    }
+                                    else {
+                                        dasm_fmt_printf(fmt,">");
+                                    }
+                                }
+                                break;
+                            case EXE_NE_HEADER_SEGMENT_RELOC_ADDR_TYPE_OFFSET:
+                                {
+                                    dasm_fmt_printf(fmt,"<");
+                                    print_relocation_offset(fmt,&ne_imported_name_table,&ne_entry_table,&ne_nonresname,&ne_resname,relocent,&mod_syms);
+                                    if (relocent->r.reloc_type&EXE_NE_HEADER_SEGMENT_RELOC_TYPE_ADDITIVE) {
+                                        dasm_fmt_printf(fmt," + 0x%04x>",
+                                            (unsigned int)dec_i.argv[0].value);
+                                    }
+                                    else {
+                                        dasm_fmt_printf(fmt,">");
+                                    }
+                                }
+                                break;
+                        };
+
+                        reloc_ann = 1;
+                    }
+                }
+            }
+
+            if (!reloc_ann)
+                dasm_fmt_insn_args(fmt,&dec_i);
+
+            dasm_fmt_insn_end(fmt,dec_i.lock);
+
+            /* if any part of the instruction is affected by EXE relocations, say so */
+            if (nextrel != NULL) {
+                const union exe_ne_header_segment_relocation_entry *relocent = nextrel;
+                const uint32_t o = relocent->r.seg_offset;
+
+                if (o >= ip && o < (ip + inslen)) {
+                    dasm_fmt_printf(fmt,"             ^ EXE relocation ");
+
+                    switch (relocent->r.reloc_type&EXE_NE_HEADER_SEGMENT_RELOC_TYPE_MASK) {
+                        case EXE_NE_HEADER_SEGMENT_RELOC_TYPE_INTERNAL_REFERENCE:
+                            dasm_fmt_printf(fmt,"Internal ref");
+                            break;
+                        case EXE_NE_HEADER_SEGMENT_RELOC_TYPE_IMPORTED_ORDINAL:
+                            dasm_fmt_printf(fmt,"Import by ordinal");
+                            break;
+                        case EXE_NE_HEADER_SEGMENT_RELOC_TYPE_IMPORTED_NAME:
+                            dasm_fmt_printf(fmt,"Import by name");
+                            break;
+                        case EXE_NE_HEADER_SEGMENT_RELOC_TYPE_OSFIXUP:
+                            dasm_fmt_printf(fmt,"OSFIXUP");
+                            break;
+                    }
+                    if (relocent->r.reloc_type&EXE_NE_HEADER_SEGMENT_RELOC_TYPE_ADDITIVE)
+                        dasm_fmt_printf(fmt," (ADDITIVE)");
+                    dasm_fmt_printf(fmt," ");
+
+                    switch (relocent->r.reloc_address_type&EXE_NE_HEADER_SEGMENT_RELOC_ADDR_TYPE_MASK) {
+                        case EXE_NE_HEADER_SEGMENT_RELOC_ADDR_TYPE_OFFSET_LOBYTE:
+                            dasm_fmt_printf(fmt,"addr=OFFSET_LOBYTE");
+                            break;
+                        case EXE_NE_HEADER_SEGMENT_RELOC_ADDR_TYPE_SEGMENT:
+                            dasm_fmt_printf(fmt,"addr=SEGMENT");
+                            break;
+                        case EXE_NE_HEADER_SEGMENT_RELOC_ADDR_TYPE_FAR_POINTER:
+                            dasm_fmt_printf(fmt,"addr=FAR_POINTER(16:16)");
+                            break;
+                        case EXE_NE_HEADER_SEGMENT_RELOC_ADDR_TYPE_OFFSET:
+                            dasm_fmt_printf(fmt,"addr=OFFSET");
+                            break;
+                        case EXE_NE_HEADER_SEGMENT_RELOC_ADDR_TYPE_FAR48_POINTER:
+                            dasm_fmt_printf(fmt,"addr=FAR_POINTER(16:32)");
+                            break;
+                        case EXE_NE_HEADER_SEGMENT_RELOC_ADDR_TYPE_OFFSET32:
+                            dasm_fmt_printf(fmt,"addr=OFFSET32");
+                            break;
+                        default:
+                            dasm_fmt_printf(fmt,"addr=0x%02x",relocent->r.reloc_address_type);
+                            break;
+                    }
+                    dasm_fmt_printf(fmt,"\n");
+
+                    switch (relocent->r.reloc_type&EXE_NE_HEADER_SEGMENT_RELOC_TYPE_MASK) {
+                        case EXE_NE_HEADER_SEGMENT_RELOC_TYPE_INTERNAL_REFERENCE:
+                            if (relocent->intref.segment_index == 0xFF) {
+                                get_entry_name_by_ordinal(tmp,sizeof(tmp),&ne_nonresname,&ne_resname,relocent->movintref.entry_ordinal);
+
+                                dasm_fmt_printf(fmt,"                    Refers to movable segment, entry ordinal #%d",
+                                        relocent->movintref.entry_ordinal);
+                                if (tmp[0] != 0)
+                                    dasm_fmt_printf(fmt," '%s'",tmp);
+                                dasm_fmt_printf(fmt,"\n");
+                            }
+                            else {
+                                dasm_fmt_printf(fmt,"                    Refers to segment #%d : 0x%04x\n",
+                                        relocent->intref.segment_index,
+                                        relocent->intref.seg_offset);
+                            }
+                            break;
+                        case EXE_NE_HEADER_SEGMENT_RELOC_TYPE_IMPORTED_ORDINAL:
+                            ne_imported_name_table_entry_get_module_ref_name(tmp,sizeof(tmp),&ne_imported_name_table,relocent->ordinal.module_reference_index);
+                            dasm_fmt_printf(fmt,"                    Refers to module reference #%d '%s', ordinal %d",
+                                    relocent->ordinal.module_reference_index,tmp,
+                                    relocent->ordinal.ordinal);
+                            {
+                                const char *sym = mod_symbols_list_lookup(
+                                    &mod_syms,
+                                    relocent->ordinal.module_reference_index,
+                                    relocent->ordinal.ordinal);
+                                if (sym != NULL) dasm_fmt_printf(fmt," '%s'",sym);
+                            }
+                            dasm_fmt_printf(fmt,"\n");
+                            break;
+                        case EXE_NE_HEADER_SEGMENT_RELOC_TYPE_IMPORTED_NAME:
+                            ne_imported_name_table_entry_get_module_ref_name(tmp,sizeof(tmp),&ne_imported_name_table,relocent->ordinal.module_reference_index);
+                            dasm_fmt_printf(fmt,"                    Refers to module reference #%d '%s', imp name offset %d",
+                                    relocent->name.module_reference_index,tmp,
+                                    relocent->name.imported_name_offset);
+
+                            ne_imported_name_table_entry_get_name(tmp,sizeof(tmp),&ne_imported_name_table,relocent->name.imported_name_offset);
+                            dasm_fmt_printf(fmt," '%s'\n",
+                                    tmp);
+                            break;
+                        case EXE_NE_HEADER_SEGMENT_RELOC_TYPE_OSFIXUP:
+                            dasm_fmt_printf(fmt,"                    OSFIXUP type=0x%04x\n",
+                                    relocent->osfixup.fixup);
+                            break;
                     }
+
+                    dasm_fmt_printf(fmt,"                    at +%u bytes (%04x:%04x)\n",
+                            (unsigned int)(o - ip),
+                            (unsigned int)dec_cs,
+                            (unsigned int)ip + (unsigned int)(o - ip));
                 }
             }
-            else {
-                printf("NOTIMPL");
-            }
-            break;
-        case EXE_NE_HEADER_SEGMENT_RELOC_TYPE_IMPORTED_ORDINAL:
-            ne_imported_name_table_entry_get_module_ref_name(name_tmp,sizeof(name_tmp),ne_imported_name_table,relocent->ordinal.module_reference_index);
-            printf("offset of module reference #%d '%s', ordinal %d",
-                    relocent->ordinal.module_reference_index,name_tmp,
-                    relocent->ordinal.ordinal);
-            {
-                const char *sym = mod_symbols_list_lookup(
-                    mod_syms,
-                    relocent->ordinal.module_reference_index,
-                    relocent->ordinal.ordinal);
-                if (sym != NULL) printf(" '%s'",sym);
-            }
-            break;
-        case EXE_NE_HEADER_SEGMENT_RELOC_TYPE_IMPORTED_NAME:
-            ne_imported_name_table_entry_get_module_ref_name(name_tmp,sizeof(name_tmp),ne_imported_name_table,relocent->ordinal.module_reference_index);
-            printf("offset of module reference #%d '%s', imp name offset %d",
-                    relocent->name.module_reference_index,name_tmp,
-                    relocent->name.imported_name_offset);
-            break;
-        case EXE_NE_HEADER_SEGMENT_RELOC_TYPE_OSFIXUP:
-            printf("offset of OSFIXUP type=0x%04x ???",
-                    relocent->osfixup.fixup);
-            break;
+
+            dec_pos = ip + ins->len;
+        } while(1);
+    }
+}
+
+/* segments to work on in a pass, one job each */
+struct ne_segment_jobs {
+    struct ne_segment_dasm**        seg;
+    unsigned char                   mode;           /* DASM_FMT_* */
+    size_t                          label_first;    /* first pass: labels of the current round */
+    size_t                          label_end;
+};
+
+void first_pass_job(size_t job,FILE *out,void *user) {
+    struct ne_segment_jobs *j = (struct ne_segment_jobs*)user;
+    struct ne_segment_dasm *sd = j->seg[job];
+    struct dasm_fmt fmt;
+
+    if (dasm_fmt_init(&fmt,out,j->mode)) {
+        sd->error = 1;
+        return;
     }
+
+    sd->fmt = &fmt;
+    first_pass_segment(sd,j->label_first,j->label_end);
+    dasm_fmt_free(&fmt);
+    sd->fmt = NULL;
+}
+
+void second_pass_job(size_t job,FILE *out,void *user) {
+    struct ne_segment_jobs *j = (struct ne_segment_jobs*)user;
+    struct ne_segment_dasm *sd = j->seg[job];
+    struct dasm_fmt fmt;
+
+    if (dasm_fmt_init(&fmt,out,j->mode)) {
+        sd->error = 1;
+        return;
+    }
+
+    sd->fmt = &fmt;
+    second_pass_segment(sd);
+    dasm_fmt_free(&fmt);
+    sd->fmt = NULL;
 }
 
 int main(int argc,char **argv) {
-    struct exe_ne_header_segment_reloc_table *ne_segment_relocs = NULL;
-    struct exe_ne_header_imported_name_table ne_imported_name_table;
-    struct exe_ne_header_entry_table_table ne_entry_table;
-    struct exe_ne_header_name_entry_table ne_nonresname;
     struct exe_ne_header_resource_table_t ne_resources;
-    struct exe_ne_header_name_entry_table ne_resname;
-    struct exe_ne_header_segment_table ne_segments;
-    struct mod_symbols_list mod_syms;
+    struct ne_segment_dasm *ne_segment_dasm = NULL;
+    struct ne_segment_jobs ne_jobs;
     struct exe_ne_header ne_header;
     uint32_t ne_header_offset;
     struct dec_label *label;
     unsigned int segmenti;
-    unsigned int reloci;
-    unsigned int labeli;
+    FILE *jsonl_fp = NULL;
     uint32_t file_size;
-    int c;
+    size_t jobs,j;
 
     assert(sizeof(ne_header) == 0x40);
     memset(&exehdr,0,sizeof(exehdr));
@@ -740,6 +1588,11 @@ int main(int argc,char **argv) {
     if (parse_argv(argc,argv))
         return 1;
 
+    if (num_threads == 0) {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        num_threads = (n > 0) ? (unsigned int)n : 1U;
+    }
+
     dec_label_alloc = 4096;
     dec_label_count = 0;
     dec_label = malloc(sizeof(*dec_label) * dec_label_alloc);
@@ -1317,745 +2170,170 @@ int main(int argc,char **argv) {
         }
     }
 
-    /* first pass: decompilation */
-    {
-        unsigned int los = 0;
-        unsigned int inscount;
-
-        while (los < dec_label_count) {
-            label = dec_label + los;
-            if (label->seg_v == 0) {
-                los++;
-                continue;
-            }
-
-            segmenti = label->seg_v - 1;
-            {
-                const struct exe_ne_header_segment_entry *segent = ne_segments.table + segmenti;
-                uint32_t segment_ofs = (uint32_t)segent->offset_in_segments << (uint32_t)ne_segments.sector_shift;
-                struct exe_ne_header_segment_reloc_table *reloc;
-                uint32_t segment_sz;
-
-                if (segent->offset_in_segments == 0) {
-                    los++;
-                    continue;
-                }
-
-                segment_sz =
-                    (segent->length == 0 ? 0x10000UL : segent->length);
-                dec_cs = segmenti + 1;
-                dec_ofs = 0;
-
-                if ((uint32_t)lseek(src_fd,segment_ofs + label->ofs_v,SEEK_SET) != (segment_ofs + label->ofs_v))
-                    return 1;
-
-                printf("* NE segment #%d (0x%lx bytes @0x%lx) 1st pass\n",
-                        segmenti + 1,(unsigned long)segment_sz,(unsigned long)segment_ofs);
-
-                reloci = 0;
-                inscount = 0;
-                entry_ip = 0;
-                reset_buffer();
-                entry_cs = dec_cs;
-                current_offset = segment_ofs + label->ofs_v;
-                end_decom = segment_ofs + segment_sz;
-                minx86dec_init_state(&dec_st);
-                dec_read = dec_end = dec_buffer;
-                dec_st.data32 = dec_st.addr32 = 0;
-
-                if (ne_segment_relocs)
-                    reloc = &ne_segment_relocs[segmenti];
-                else
-                    reloc = NULL;
-
-                if (segent->flags & EXE_NE_HEADER_SEGMENT_ENTRY_FLAGS_DATA) {
-                }
-                else {
-                    do {
-                        uint32_t ofs = (uint32_t)(dec_read - dec_buffer) + current_offset_minus_buffer() - segment_ofs;
-                        uint32_t ip = ofs + entry_ip - dec_ofs;
-                        size_t inslen;
-
-                        if (!refill()) break;
-
-                        minx86dec_set_buffer(&dec_st,dec_read,(int)(dec_end - dec_read));
-                        minx86dec_init_instruction(&dec_i);
-                        dec_st.ip_value = ip;
-                        minx86dec_decodeall(&dec_st,&dec_i);
-                        assert(dec_i.end >= dec_read);
-                        assert(dec_i.end <= (dec_buffer+sizeof(dec_buffer)));
-                        inslen = (size_t)(dec_i.end - dec_i.start);
-
-                        if (reloc) {
-                            while (reloci < reloc->length && reloc->table[reloci].r.seg_offset < ip)
-                                reloci++;
-                        }
-
-                        printf("%04lX:%04lX @0x%08lX ",(unsigned long)dec_cs,(unsigned long)dec_st.ip_value,(unsigned long)(dec_read - dec_buffer) + current_offset_minus_buffer());
-                        for (c=0,iptr=dec_i.start;iptr != dec_i.end;c++)
-                            printf("%02X ",*iptr++);
-
-                        if (dec_i.rep != MX86_REP_NONE) {
-                            for (;c < 6;c++)
-                                printf("   ");
-
-                            switch (dec_i.rep) {
-                                case MX86_REPE:
-                                    printf("REP   ");
-                                    break;
-                                case MX86_REPNE:
-                                    printf("REPNE ");
-                                    break;
-                                default:
-                                    break;
-                            };
-                        }
-                        else {
-                            for (;c < 8;c++)
-                                printf("   ");
-                        }
-                        printf("%-8s ",opcode_string[dec_i.opcode]);
-
-                        for (c=0;c < dec_i.argc;) {
-                            minx86dec_regprint(&dec_i.argv[c],arg_c);
-                            printf("%s",arg_c);
-                            if (++c < dec_i.argc) printf(",");
-                        }
-                        if (dec_i.lock) printf("  ; LOCK#");
-                        printf("\n");
-
-                        dec_read = dec_i.end;
-
-                        if ((dec_i.opcode == MXOP_JMP || dec_i.opcode == MXOP_CALL || dec_i.opcode == MXOP_JCXZ ||
-                                (dec_i.opcode >= MXOP_JO && dec_i.opcode <= MXOP_JG)) && dec_i.argc == 1 &&
-                                dec_i.argv[0].regtype == MX86_RT_IMM) {
-                            /* make a label of the target */
-                            /* 1st arg is target offset */
-                            uint32_t toffset = dec_i.argv[0].value;
-                            uint32_t noffset = segment_ofs + toffset;
-
-                            printf("Target: 0x%04lx @0x%08lx\n",(unsigned long)toffset,(unsigned long)noffset);
-
-                            label = dec_find_label(dec_cs,toffset);
-                            if (label == NULL) {
-                                if ((label=dec_label_malloc()) != NULL) {
-                                    if (dec_i.opcode == MXOP_JMP || dec_i.opcode == MXOP_JCXZ ||
-                                            (dec_i.opcode >= MXOP_JO && dec_i.opcode <= MXOP_JG))
-                                        dec_label_set_name(label,"JMP target");
-                                    else if (dec_i.opcode == MXOP_CALL)
-                                        dec_label_set_name(label,"CALL target");
-
-                                    label->seg_v =
-                                        dec_cs;
-                                    label->ofs_v =
-                                        toffset;
-                                }
-                            }
-
-                            if (dec_i.opcode == MXOP_JMP)
-                                break;
-                        }
-                        else if (dec_i.opcode == MXOP_JMP)
-                            break;
-                        else if (dec_i.opcode == MXOP_RET || dec_i.opcode == MXOP_RETF)
-                            break;
-                        else if (dec_i.opcode == MXOP_CALL_FAR || dec_i.opcode == MXOP_JMP_FAR) {
-                            if (reloc && reloci < reloc->length) {
-                                const union exe_ne_header_segment_relocation_entry *relocent = reloc->table + reloci;
-                                const uint32_t o = relocent->r.seg_offset;
-
-                                if (o >= ip && o < (ip + inslen)) {
-                                    if (relocent->r.reloc_type&EXE_NE_HEADER_SEGMENT_RELOC_TYPE_ADDITIVE) {
-                                    }
-                                    else {
-                                        if ((relocent->r.reloc_address_type&EXE_NE_HEADER_SEGMENT_RELOC_ADDR_TYPE_MASK) ==
-                                            EXE_NE_HEADER_SEGMENT_RELOC_ADDR_TYPE_SEGMENT) {
-                                            if ((relocent->r.reloc_type&EXE_NE_HEADER_SEGMENT_RELOC_TYPE_MASK) ==
-                                                EXE_NE_HEADER_SEGMENT_RELOC_TYPE_INTERNAL_REFERENCE) {
-                                                if (dec_i.argv[0].segment == MX86_SEG_IMM && dec_i.argv[0].regtype == MX86_RT_IMM) {
-                                                    /* we can and should track internal references.
-                                                     * do not track movable entry ordinal refs, because we already added those entry points to the label list */
-                                                    if (relocent->intref.segment_index != 0xFF) {
-                                                        label = dec_find_label(relocent->intref.segment_index,dec_i.argv[0].value);
-                                                        if (label == NULL) {
-                                                            if ((label=dec_label_malloc()) != NULL) {
-                                                                if (dec_i.opcode == MXOP_JMP_FAR)
-                                                                    dec_label_set_name(label,"JMP FAR target");
-                                                                else if (dec_i.opcode == MXOP_CALL_FAR)
-                                                                    dec_label_set_name(label,"CALL FAR target");
-
-                                                                label->seg_v =
-                                                                    relocent->intref.segment_index;
-                                                                label->ofs_v =
-                                                                    dec_i.argv[0].value;
-
-                                                                printf("Target: 0x%04lx:0x%04lx internal ref, relocation by segment value\n",
-                                                                    (unsigned long)label->seg_v,
-                                                                    (unsigned long)label->ofs_v);
-                                                            }
-                                                        }
-                                                    }
-                                                }
-                                            }
-                                        }
-                                    }
-                                }
-                            }
-
-                            if (dec_i.opcode == MXOP_JMP_FAR)
-                                break;
-                        }
-
-                        if (++inscount >= 1024)
-                            break;
-                    } while(1);
-                }
-            }
-
-            los++;
-        }
+    /* first pass: decompilation.
+     * each label is an entry point for the analysis engine of its segment, which follows the code from there.
+     * code already walked from an earlier label is not walked again. */
+    ne_segment_dasm = calloc(ne_segments.length != 0 ? ne_segments.length : 1,sizeof(*ne_segment_dasm));
+    memset(&ne_jobs,0,sizeof(ne_jobs));
+    ne_jobs.seg = calloc(ne_segments.length != 0 ? ne_segments.length : 1,sizeof(*ne_jobs.seg));
+    if (ne_segment_dasm == NULL || ne_jobs.seg == NULL) {
+        fprintf(stderr,"Failed to alloc analysis engine\n");
+        return 1;
     }
 
-    /* sort labels */
-    dec_label_sort();
-
-    /* second pass: decompilation */
-    for (segmenti=0;segmenti < ne_segments.length;segmenti++) {
-        const struct exe_ne_header_segment_entry *segent = ne_segments.table + segmenti;
-        uint32_t segment_ofs = (uint32_t)segent->offset_in_segments << (uint32_t)ne_segments.sector_shift;
-        struct exe_ne_header_segment_reloc_table *reloc;
-        uint32_t segment_sz;
-
-        if (segent->offset_in_segments == 0)
-            continue;
-
-        segment_sz =
-            (segent->length == 0 ? 0x10000UL : segent->length);
-        dec_cs = segmenti + 1;
-        dec_ofs = 0;
+    {
+        unsigned long insns = 0,blocks = 0,edges = 0;
+        size_t round_first = 0,round_end,los,j;
+
+        /* the first pass goes in rounds. each round walks the labels added by the round before it,
+         * one segment per job. far calls and jumps into other segments are walked in the next round. */
+        while (round_first < dec_label_count) {
+            round_end = dec_label_count;
+            dec_label_index_update();
+
+            /* segments are read in here, not in the jobs, because they share the file descriptor */
+            for (los=round_first;los < round_end;los++) {
+                label = dec_label + los;
+                if (label->seg_v == 0 || label->seg_v > ne_segments.length)
+                    continue;
 
-        if ((uint32_t)lseek(src_fd,segment_ofs,SEEK_SET) != segment_ofs)
-            return 1;
+                segmenti = label->seg_v - 1;
+                {
+                    const struct exe_ne_header_segment_entry *segent = ne_segments.table + segmenti;
+                    struct ne_segment_dasm *sd = ne_segment_dasm + segmenti;
 
-        printf("* NE segment #%d (0x%lx bytes @0x%lx)\n",
-            segmenti + 1,(unsigned long)segment_sz,(unsigned long)segment_ofs);
-
-        labeli = 0;
-        reloci = 0;
-        entry_ip = 0;
-        reset_buffer();
-        entry_cs = dec_cs;
-        current_offset = segment_ofs;
-        end_decom = segment_ofs + segment_sz;
-        minx86dec_init_state(&dec_st);
-        dec_read = dec_end = dec_buffer;
-        dec_st.data32 = dec_st.addr32 = 0;
-
-        if (ne_segment_relocs)
-            reloc = &ne_segment_relocs[segmenti];
-        else
-            reloc = NULL;
-
-        if (segent->flags & EXE_NE_HEADER_SEGMENT_ENTRY_FLAGS_DATA) {
-            unsigned int col = 0;
-
-            do {
-                uint32_t ofs = (uint32_t)(dec_read - dec_buffer) + current_offset_minus_buffer() - segment_ofs;
-                uint32_t ip = ofs + entry_ip - dec_ofs;
-
-                while (labeli < dec_label_count) {
-                    label = dec_label + labeli;
-                    if (label->seg_v != dec_cs) {
-                        labeli++;
+                    if (segent->offset_in_segments == 0 || (segent->flags & EXE_NE_HEADER_SEGMENT_ENTRY_FLAGS_DATA))
                         continue;
-                    }
-                    if (ip < label->ofs_v)
-                        break;
-
-                    labeli++;
-                    ip = label->ofs_v;
-                    dec_cs = label->seg_v;
-                    ofs = segment_ofs + ip;
 
-                    if (col != 0) {
-                        printf("\n");
-                        col = 0;
+                    if (ne_segment_dasm_setup(sd,&ne_segments,segmenti,ne_segment_relocs)) {
+                        fprintf(stderr,"Failed to alloc analysis engine\n");
+                        return 1;
                     }
 
-                    printf("Label '%s' at %04lx:%04lx @0x%08lx\n",
-                            label->name ? label->name : "",
-                            (unsigned long)label->seg_v,
-                            (unsigned long)label->ofs_v,
-                            (unsigned long)ofs);
-
-                    label = dec_label + labeli;
-                }
-
-                if (!refill()) break;
-
-                if (reloc) {
-                    while (reloci < reloc->length && reloc->table[reloci].r.seg_offset < ip)
-                        reloci++;
+                    if (!dasm_engine_seen(&sd->eng,label->ofs_v))
+                        sd->job = 1;
                 }
+            }
 
-                /* if any part of the instruction is affected by EXE relocations, say so */
-                if (reloc && reloci < reloc->length) {
-                    const union exe_ne_header_segment_relocation_entry *relocent = reloc->table + reloci;
-                    const uint32_t o = relocent->r.seg_offset;
-
-                    if (o == ip) {
-                        if (col != 0) {
-                            printf("\n");
-                            col = 0;
-                        }
-                        printf("%04lX:%04lX @0x%08lX ",
-                                (unsigned long)dec_cs,
-                                (unsigned long)ip,
-                                (unsigned long)(dec_read - dec_buffer) + current_offset_minus_buffer());
+            jobs = 0;
+            for (segmenti=0;segmenti < ne_segments.length;segmenti++) {
+                struct ne_segment_dasm *sd = ne_segment_dasm + segmenti;
 
-                        printf(" <--- EXE relocation ");
+                if (!sd->job) continue;
+                ne_jobs.seg[jobs++] = sd;
+                sd->job = 0;
+            }
 
-                        switch (relocent->r.reloc_type&EXE_NE_HEADER_SEGMENT_RELOC_TYPE_MASK) {
-                            case EXE_NE_HEADER_SEGMENT_RELOC_TYPE_INTERNAL_REFERENCE:
-                                printf("Internal ref");
-                                break;
-                            case EXE_NE_HEADER_SEGMENT_RELOC_TYPE_IMPORTED_ORDINAL:
-                                printf("Import by ordinal");
-                                break;
-                            case EXE_NE_HEADER_SEGMENT_RELOC_TYPE_IMPORTED_NAME:
-                                printf("Import by name");
-                                break;
-                            case EXE_NE_HEADER_SEGMENT_RELOC_TYPE_OSFIXUP:
-                                printf("OSFIXUP");
-                                break;
-                        }
-                        if (relocent->r.reloc_type&EXE_NE_HEADER_SEGMENT_RELOC_TYPE_ADDITIVE)
-                            printf(" (ADDITIVE)");
-                        printf(" ");
+            ne_jobs.label_first = round_first;
+            ne_jobs.label_end = round_end;
+            ne_jobs.mode = DASM_FMT_TEXT;
+            dasm_run_jobs(jobs,num_threads,first_pass_job,&ne_jobs,stdout);
 
-                        switch (relocent->r.reloc_address_type&EXE_NE_HEADER_SEGMENT_RELOC_ADDR_TYPE_MASK) {
-                            case EXE_NE_HEADER_SEGMENT_RELOC_ADDR_TYPE_OFFSET_LOBYTE:
-                                printf("addr=OFFSET_LOBYTE");
-                                break;
-                            case EXE_NE_HEADER_SEGMENT_RELOC_ADDR_TYPE_SEGMENT:
-                                printf("addr=SEGMENT");
-                                break;
-                            case EXE_NE_HEADER_SEGMENT_RELOC_ADDR_TYPE_FAR_POINTER:
-                                printf("addr=FAR_POINTER(16:16)");
-                                break;
-                            case EXE_NE_HEADER_SEGMENT_RELOC_ADDR_TYPE_OFFSET:
-                                printf("addr=OFFSET");
-                                break;
-                            case EXE_NE_HEADER_SEGMENT_RELOC_ADDR_TYPE_FAR48_POINTER:
-                                printf("addr=FAR_POINTER(16:32)");
-                                break;
-                            case EXE_NE_HEADER_SEGMENT_RELOC_ADDR_TYPE_OFFSET32:
-                                printf("addr=OFFSET32");
-                                break;
-                            default:
-                                printf("addr=0x%02x",relocent->r.reloc_address_type);
-                                break;
-                        }
-                        printf("\n");
-
-                        switch (relocent->r.reloc_type&EXE_NE_HEADER_SEGMENT_RELOC_TYPE_MASK) {
-                            case EXE_NE_HEADER_SEGMENT_RELOC_TYPE_INTERNAL_REFERENCE:
-                                if (relocent->intref.segment_index == 0xFF) {
-                                    get_entry_name_by_ordinal(name_tmp,sizeof(name_tmp),&ne_nonresname,&ne_resname,relocent->movintref.entry_ordinal);
-
-                                    printf("                    Refers to movable segment, entry ordinal #%d",
-                                            relocent->movintref.entry_ordinal);
-                                    if (name_tmp[0] != 0)
-                                        printf(" '%s'",name_tmp);
-                                    printf("\n");
-                                }
-                                else {
-                                    printf("                    Refers to segment #%d : 0x%04x\n",
-                                            relocent->intref.segment_index,
-                                            relocent->intref.seg_offset);
-                                }
-                                break;
-                            case EXE_NE_HEADER_SEGMENT_RELOC_TYPE_IMPORTED_ORDINAL:
-                                ne_imported_name_table_entry_get_module_ref_name(name_tmp,sizeof(name_tmp),&ne_imported_name_table,relocent->ordinal.module_reference_index);
-                                printf("                    Refers to module reference #%d '%s', ordinal %d",
-                                        relocent->ordinal.module_reference_index,name_tmp,
-                                        relocent->ordinal.ordinal);
-                                {
-                                    const char *sym = mod_symbols_list_lookup(
-                                        &mod_syms,
-                                        relocent->ordinal.module_reference_index,
-                                        relocent->ordinal.ordinal);
-                                    if (sym != NULL) printf(" '%s'",sym);
-                                }
-                                printf("\n");
-                                break;
-                            case EXE_NE_HEADER_SEGMENT_RELOC_TYPE_IMPORTED_NAME:
-                                ne_imported_name_table_entry_get_module_ref_name(name_tmp,sizeof(name_tmp),&ne_imported_name_table,relocent->ordinal.module_reference_index);
-                                printf("                    Refers to module reference #%d '%s', imp name offset %d",
-                                        relocent->name.module_reference_index,name_tmp,
-                                        relocent->name.imported_name_offset);
-
-                                ne_imported_name_table_entry_get_name(name_tmp,sizeof(name_tmp),&ne_imported_name_table,relocent->name.imported_name_offset);
-                                printf(" '%s'\n",
-                                        name_tmp);
-                                break;
-                            case EXE_NE_HEADER_SEGMENT_RELOC_TYPE_OSFIXUP:
-                                printf("                    OSFIXUP type=0x%04x\n",
-                                        relocent->osfixup.fixup);
-                                break;
-                        }
+            /* new labels go into the list in segment order, so the result does not depend on thread timing */
+            for (j=0;j < jobs;j++) {
+                struct ne_segment_dasm *sd = ne_jobs.seg[j];
 
-                        col = 0;
-                        printf("                    at +%u bytes (%04x:%04x)\n",
-                                (unsigned int)(o - ip),
-                                (unsigned int)dec_cs,
-                                (unsigned int)dec_st.ip_value + (unsigned int)(o - ip));
-                    }
+                if (sd->error) {
+                    fprintf(stderr,"Out of memory during analysis\n");
+                    return 1;
                 }
 
-                if (col == 0) {
-                    printf("%04lX:%04lX @0x%08lX ",
-                        (unsigned long)dec_cs,
-                        (unsigned long)ip,
-                        (unsigned long)(dec_read - dec_buffer) + current_offset_minus_buffer());
-                }
+                ne_segment_newlabel_merge(sd);
+            }
 
-                while (col < ((unsigned int)(ip & 0xF))) {
-                    printf("   ");
-                    col++;
-                }
+            round_first = round_end;
+        }
 
-                assert(dec_read < dec_end);
-                printf("%02X ",*dec_read++);
-                col++;
+        for (segmenti=0;segmenti < ne_segments.length;segmenti++) {
+            struct ne_segment_dasm *sd = ne_segment_dasm + segmenti;
 
-                if (col >= 16) {
-                    printf("\n");
-                    col = 0;
-                }
-            } while(1);
+            if (!sd->ready) continue;
+            dasm_engine_build_blocks(&sd->eng);
+            insns += (unsigned long)sd->eng.insn_count;
+            blocks += (unsigned long)sd->eng.block_count;
+            edges += (unsigned long)sd->eng.edge_count;
 
-            if (col != 0) {
-                printf("\n");
-                col = 0;
+            if (ne_segment_xrefs(sd)) {
+                fprintf(stderr,"Out of memory during analysis\n");
+                return 1;
             }
         }
-        else {
-            do {
-                uint32_t ofs = (uint32_t)(dec_read - dec_buffer) + current_offset_minus_buffer() - segment_ofs;
-                uint32_t ip = ofs + entry_ip - dec_ofs;
-                unsigned char reloc_ann = 0;
-                unsigned char dosek = 0;
-                size_t inslen;
-
-                while (labeli < dec_label_count) {
-                    label = dec_label + labeli;
-                    if (label->seg_v != dec_cs) {
-                        labeli++;
-                        continue;
-                    }
-                    if (ip < label->ofs_v)
-                        break;
-
-                    labeli++;
-                    ip = label->ofs_v;
-                    dec_cs = label->seg_v;
-                    ofs = segment_ofs + ip;
-
-                    printf("Label '%s' at %04lx:%04lx @0x%08lx\n",
-                            label->name ? label->name : "",
-                            (unsigned long)label->seg_v,
-                            (unsigned long)label->ofs_v,
-                            (unsigned long)ofs);
-
-                    label = dec_label + labeli;
-                    dosek = 1;
-                }
-
-                if (dosek) {
-                    reset_buffer();
-                    current_offset = ofs;
-                    if ((uint32_t)lseek(src_fd,current_offset,SEEK_SET) != current_offset)
-                        return 1;
-                }
 
-                if (!refill()) break;
+        dasm_xref_index_sort(&dec_xref);
 
-                minx86dec_set_buffer(&dec_st,dec_read,(int)(dec_end - dec_read));
-                minx86dec_init_instruction(&dec_i);
-                dec_st.ip_value = ip;
-                minx86dec_decodeall(&dec_st,&dec_i);
-                assert(dec_i.end >= dec_read);
-                assert(dec_i.end <= (dec_buffer+sizeof(dec_buffer)));
-                inslen = (size_t)(dec_i.end - dec_i.start);
+        printf("* 1st pass: %lu instructions, %lu basic blocks, %lu branch/call edges\n",
+            insns,blocks,edges);
+    }
 
-                if (reloc) {
-                    while (reloci < reloc->length && reloc->table[reloci].r.seg_offset < ip)
-                        reloci++;
-                }
+    /* sort labels */
+    dec_label_sort();
 
-                printf("%04lX:%04lX @0x%08lX ",(unsigned long)dec_cs,(unsigned long)dec_st.ip_value,(unsigned long)(dec_read - dec_buffer) + current_offset_minus_buffer());
-                for (c=0,iptr=dec_i.start;iptr != dec_i.end;c++)
-                    printf("%02X ",*iptr++);
+    if (xref_file != NULL || dot_file != NULL) {
+        struct dasm_xref_func *fn = malloc((dec_label_count != 0 ? dec_label_count : 1) * sizeof(*fn));
+        size_t i;
 
-                if (dec_i.rep != MX86_REP_NONE) {
-                    for (;c < 6;c++)
-                        printf("   ");
+        if (fn == NULL) {
+            fprintf(stderr,"Out of memory\n");
+            return 1;
+        }
 
-                    switch (dec_i.rep) {
-                        case MX86_REPE:
-                            printf("REP   ");
-                            break;
-                        case MX86_REPNE:
-                            printf("REPNE ");
-                            break;
-                        default:
-                            break;
-                    };
-                }
-                else {
-                    for (;c < 8;c++)
-                        printf("   ");
-                }
-                printf("%-8s ",opcode_string[dec_i.opcode]);
-
-                if (reloc && reloci < reloc->length) {
-                    const union exe_ne_header_segment_relocation_entry *relocent = reloc->table + reloci;
-                    const uint32_t o = relocent->r.seg_offset;
-
-                    if (o >= ip && o < (ip + inslen)) {
-                        if ((dec_i.opcode == MXOP_JMP_FAR || dec_i.opcode == MXOP_CALL_FAR) && dec_i.argc == 1 &&
-                            dec_i.argv[0].segment == MX86_SEG_IMM && dec_i.argv[0].regtype == MX86_RT_IMM) {
-
-                            switch (relocent->r.reloc_address_type&EXE_NE_HEADER_SEGMENT_RELOC_ADDR_TYPE_MASK) {
-                                case EXE_NE_HEADER_SEGMENT_RELOC_ADDR_TYPE_SEGMENT:
-                                    if (o == (ip + 1 + 2)) { // CALL/JMP FAR segment relocation affecting segment portion
-                                        printf("<");
-                                        print_relocation_segment(&ne_imported_name_table,&ne_entry_table,&ne_nonresname,&ne_resname,relocent,&mod_syms);
-                                        if (relocent->r.reloc_type&EXE_NE_HEADER_SEGMENT_RELOC_TYPE_ADDITIVE) {
-                                            printf(" + 0x%04x>:0x%04x",
-                                                (unsigned int)dec_i.argv[0].segval,
-                                                (unsigned int)dec_i.argv[0].value);
-                                        }
-                                        else {
-                                            printf(">:0x%04x",
-                                                (unsigned int)dec_i.argv[0].value);
-                                        }
-
-                                        reloc_ann = 1;
-                                    }
-                                    break;
-                                case EXE_NE_HEADER_SEGMENT_RELOC_ADDR_TYPE_FAR_POINTER:
-                                    if (o == (ip + 1)) {
-                                        if (!(relocent->r.reloc_type&EXE_NE_HEADER_SEGMENT_RELOC_TYPE_ADDITIVE)) {
-                                            printf("<");
-                                            print_relocation_farptr(&ne_imported_name_table,&ne_entry_table,&ne_nonresname,&ne_resname,relocent,&mod_syms);
-                                            printf(">");
-                                        }
-
-                                        reloc_ann = 1;
-                                    }
-                                    break;
-                            };
-                        }
-                        if ((dec_i.opcode == MXOP_PUSH) && dec_i.argc == 1 &&
-                            dec_i.argv[0].regtype == MX86_RT_IMM) {
-
-                            switch (relocent->r.reloc_address_type&EXE_NE_HEADER_SEGMENT_RELOC_ADDR_TYPE_MASK) {
-                                case EXE_NE_HEADER_SEGMENT_RELOC_ADDR_TYPE_SEGMENT:
-                                    {
-                                        printf("<");
-                                        print_relocation_segment(&ne_imported_name_table,&ne_entry_table,&ne_nonresname,&ne_resname,relocent,&mod_syms);
-                                        if (relocent->r.reloc_type&EXE_NE_HEADER_SEGMENT_RELOC_TYPE_ADDITIVE) {
-                                            printf(" + 0x%04x>",
-                                                (unsigned int)dec_i.argv[0].value);
-                                        }
-                                        else {
-                                            printf(">");
-                                        }
-                                    }
-                                    break;
-                                case EXE_NE_HEADER_SEGMENT_RELOC_ADDR_TYPE_OFFSET:
-                                    {
-                                        printf("<");
-                                        print_relocation_offset(&ne_imported_name_table,&ne_entry_table,&ne_nonresname,&ne_resname,relocent,&mod_syms);
-                                        if (relocent->r.reloc_type&EXE_NE_HEADER_SEGMENT_RELOC_TYPE_ADDITIVE) {
-                                            printf(" + 0x%04x>",
-                                                (unsigned int)dec_i.argv[0].value);
-                                        }
-                                        else {
-                                            printf(">");
-                                        }
-                                    }
-                                    break;
-                            };
+        for (i=0;i < dec_label_count;i++) {
+            fn[i].seg = dec_label[i].seg_v;
+            fn[i].ofs = dec_label[i].ofs_v;
+            fn[i].name = dec_label[i].name;
+        }
 
-                            reloc_ann = 1;
-                        }
-                        if ((dec_i.opcode == MXOP_MOV || dec_i.opcode == MXOP_ADD || dec_i.opcode == MXOP_SUB ||
-                             dec_i.opcode == MXOP_CMP || dec_i.opcode == MXOP_XOR) && dec_i.argc == 2 &&
-                            dec_i.argv[1].regtype == MX86_RT_IMM) {
-
-                            for (c=0;c < 1;) {
-                                minx86dec_regprint(&dec_i.argv[c],arg_c);
-                                printf("%s",arg_c);
-                                if (++c < dec_i.argc) printf(",");
-                            }
+        if (xref_file != NULL && dasm_xref_save(xref_file,DASM_XREF_OUT_JSON,&dec_xref,fn,dec_label_count,1))
+            fprintf(stderr,"Unable to write %s\n",xref_file);
+        if (dot_file != NULL && dasm_xref_save(dot_file,DASM_XREF_OUT_DOT,&dec_xref,fn,dec_label_count,1))
+            fprintf(stderr,"Unable to write %s\n",dot_file);
 
-                            switch (relocent->r.reloc_address_type&EXE_NE_HEADER_SEGMENT_RELOC_ADDR_TYPE_MASK) {
-                                case EXE_NE_HEADER_SEGMENT_RELOC_ADDR_TYPE_SEGMENT:
-                                    {
-                                        printf("<");
-                                        print_relocation_segment(&ne_imported_name_table,&ne_entry_table,&ne_nonresname,&ne_resname,relocent,&mod_syms);
-                                        if (relocent->r.reloc_type&EXE_NE_HEADER_SEGMENT_RELOC_TYPE_ADDITIVE) {
-                                            printf(" + 0x%04x>",
-                                                (unsigned int)dec_i.argv[0].value);
-                                        }
-                                        else {
-                                            printf(">");
-                                        }
-                                    }
-                                    break;
-                                case EXE_NE_HEADER_SEGMENT_RELOC_ADDR_TYPE_OFFSET:
-                                    {
-                                        printf("<");
-                                        print_relocation_offset(&ne_imported_name_table,&ne_entry_table,&ne_nonresname,&ne_resname,relocent,&mod_syms);
-                                        if (relocent->r.reloc_type&EXE_NE_HEADER_SEGMENT_RELOC_TYPE_ADDITIVE) {
-                                            printf(" + 0x%04x>",
-                                                (unsigned int)dec_i.argv[0].value);
-                                        }
-                                        else {
-                                            printf(">");
-                                        }
-                                    }
-                                    break;
-                            };
+        free(fn);
+    }
 
-                            reloc_ann = 1;
-                        }
-                    }
-                }
+    /* second pass: decompilation. segments are read in here, then listed one per job */
+    if (jsonl_file != NULL) {
+        if ((jsonl_fp=fopen(jsonl_file,"w")) == NULL) {
+            fprintf(stderr,"Unable to open %s, %s\n",jsonl_file,strerror(errno));
+            return 1;
+        }
+    }
 
-                if (!reloc_ann) {
-                    for (c=0;c < dec_i.argc;) {
-                        minx86dec_regprint(&dec_i.argv[c],arg_c);
-                        printf("%s",arg_c);
-                        if (++c < dec_i.argc) printf(",");
-                    }
-                }
-                if (dec_i.lock) printf("  ; LOCK#");
-                printf("\n");
+    jobs = 0;
+    for (segmenti=0;segmenti < ne_segments.length;segmenti++) {
+        const struct exe_ne_header_segment_entry *segent = ne_segments.table + segmenti;
+        struct ne_segment_dasm *sd = ne_segment_dasm + segmenti;
 
-                /* if any part of the instruction is affected by EXE relocations, say so */
-                if (reloc && reloci < reloc->length) {
-                    const union exe_ne_header_segment_relocation_entry *relocent = reloc->table + reloci;
-                    const uint32_t o = relocent->r.seg_offset;
+        if (segent->offset_in_segments == 0)
+            continue;
 
-                    if (o >= ip && o < (ip + inslen)) {
-                        printf("             ^ EXE relocation ");
+        /* code segments reached in the first pass are already decoded in the engine's cache */
+        if (ne_segment_dasm_setup(sd,&ne_segments,segmenti,ne_segment_relocs)) {
+            fprintf(stderr,"Failed to alloc analysis engine\n");
+            return 1;
+        }
 
-                        switch (relocent->r.reloc_type&EXE_NE_HEADER_SEGMENT_RELOC_TYPE_MASK) {
-                            case EXE_NE_HEADER_SEGMENT_RELOC_TYPE_INTERNAL_REFERENCE:
-                                printf("Internal ref");
-                                break;
-                            case EXE_NE_HEADER_SEGMENT_RELOC_TYPE_IMPORTED_ORDINAL:
-                                printf("Import by ordinal");
-                                break;
-                            case EXE_NE_HEADER_SEGMENT_RELOC_TYPE_IMPORTED_NAME:
-                                printf("Import by name");
-                                break;
-                            case EXE_NE_HEADER_SEGMENT_RELOC_TYPE_OSFIXUP:
-                                printf("OSFIXUP");
-                                break;
-                        }
-                        if (relocent->r.reloc_type&EXE_NE_HEADER_SEGMENT_RELOC_TYPE_ADDITIVE)
-                            printf(" (ADDITIVE)");
-                        printf(" ");
+        ne_jobs.seg[jobs++] = sd;
+    }
 
-                        switch (relocent->r.reloc_address_type&EXE_NE_HEADER_SEGMENT_RELOC_ADDR_TYPE_MASK) {
-                            case EXE_NE_HEADER_SEGMENT_RELOC_ADDR_TYPE_OFFSET_LOBYTE:
-                                printf("addr=OFFSET_LOBYTE");
-                                break;
-                            case EXE_NE_HEADER_SEGMENT_RELOC_ADDR_TYPE_SEGMENT:
-                                printf("addr=SEGMENT");
-                                break;
-                            case EXE_NE_HEADER_SEGMENT_RELOC_ADDR_TYPE_FAR_POINTER:
-                                printf("addr=FAR_POINTER(16:16)");
-                                break;
-                            case EXE_NE_HEADER_SEGMENT_RELOC_ADDR_TYPE_OFFSET:
-                                printf("addr=OFFSET");
-                                break;
-                            case EXE_NE_HEADER_SEGMENT_RELOC_ADDR_TYPE_FAR48_POINTER:
-                                printf("addr=FAR_POINTER(16:32)");
-                                break;
-                            case EXE_NE_HEADER_SEGMENT_RELOC_ADDR_TYPE_OFFSET32:
-                                printf("addr=OFFSET32");
-                                break;
-                            default:
-                                printf("addr=0x%02x",relocent->r.reloc_address_type);
-                                break;
-                        }
-                        printf("\n");
-
-                        switch (relocent->r.reloc_type&EXE_NE_HEADER_SEGMENT_RELOC_TYPE_MASK) {
-                            case EXE_NE_HEADER_SEGMENT_RELOC_TYPE_INTERNAL_REFERENCE:
-                                if (relocent->intref.segment_index == 0xFF) {
-                                    get_entry_name_by_ordinal(name_tmp,sizeof(name_tmp),&ne_nonresname,&ne_resname,relocent->movintref.entry_ordinal);
-
-                                    printf("                    Refers to movable segment, entry ordinal #%d",
-                                            relocent->movintref.entry_ordinal);
-                                    if (name_tmp[0] != 0)
-                                        printf(" '%s'",name_tmp);
-                                    printf("\n");
-                                }
-                                else {
-                                    printf("                    Refers to segment #%d : 0x%04x\n",
-                                            relocent->intref.segment_index,
-                                            relocent->intref.seg_offset);
-                                }
-                                break;
-                            case EXE_NE_HEADER_SEGMENT_RELOC_TYPE_IMPORTED_ORDINAL:
-                                ne_imported_name_table_entry_get_module_ref_name(name_tmp,sizeof(name_tmp),&ne_imported_name_table,relocent->ordinal.module_reference_index);
-                                printf("                    Refers to module reference #%d '%s', ordinal %d",
-                                        relocent->ordinal.module_reference_index,name_tmp,
-                                        relocent->ordinal.ordinal);
-                                {
-                                    const char *sym = mod_symbols_list_lookup(
-                                        &mod_syms,
-                                        relocent->ordinal.module_reference_index,
-                                        relocent->ordinal.ordinal);
-                                    if (sym != NULL) printf(" '%s'",sym);
-                                }
-                                printf("\n");
-                                break;
-                            case EXE_NE_HEADER_SEGMENT_RELOC_TYPE_IMPORTED_NAME:
-                                ne_imported_name_table_entry_get_module_ref_name(name_tmp,sizeof(name_tmp),&ne_imported_name_table,relocent->ordinal.module_reference_index);
-                                printf("                    Refers to module reference #%d '%s', imp name offset %d",
-                                        relocent->name.module_reference_index,name_tmp,
-                                        relocent->name.imported_name_offset);
-
-                                ne_imported_name_table_entry_get_name(name_tmp,sizeof(name_tmp),&ne_imported_name_table,relocent->name.imported_name_offset);
-                                printf(" '%s'\n",
-                                        name_tmp);
-                                break;
-                            case EXE_NE_HEADER_SEGMENT_RELOC_TYPE_OSFIXUP:
-                                printf("                    OSFIXUP type=0x%04x\n",
-                                        relocent->osfixup.fixup);
-                                break;
-                        }
+    ne_jobs.mode = jsonl_fp ? DASM_FMT_JSONL : DASM_FMT_TEXT;
+    dasm_run_jobs(jobs,num_threads,second_pass_job,&ne_jobs,jsonl_fp ? jsonl_fp : stdout);
 
-                        printf("                    at +%u bytes (%04x:%04x)\n",
-                                (unsigned int)(o - ip),
-                                (unsigned int)dec_cs,
-                                (unsigned int)dec_st.ip_value + (unsigned int)(o - ip));
-                    }
-                }
+    if (jsonl_fp != NULL) fclose(jsonl_fp);
 
-                dec_read = dec_i.end;
-            } while(1);
+    for (j=0;j < jobs;j++) {
+        if (ne_jobs.seg[j]->error) {
+            fprintf(stderr,"Out of memory during listing\n");
+            return 1;
         }
     }
 
+    for (segmenti=0;segmenti < ne_segments.length;segmenti++)
+        ne_segment_dasm_free(ne_segment_dasm + segmenti);
+
+    free(ne_jobs.seg);
+    free(ne_segment_dasm);
+
     if (ne_segment_relocs) {
         unsigned int i;
 
@@ -2072,6 +2350,7 @@ int main(int argc,char **argv) {
     exe_ne_header_name_entry_table_free(&ne_resname);
     exe_ne_header_resource_table_free(&ne_resources);
     exe_ne_header_segment_table_free(&ne_segments);
+    dasm_xref_index_free(&dec_xref);
     dec_free_labels();
     close(src_fd);
 	return 0;
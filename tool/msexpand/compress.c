@@ -0,0 +1,1002 @@
+
+/* Host side replacement for Microsoft COMPRESS.EXE.
+ *
+ * compress [-k] [-r] [-j n] [-d dir] [-q] <files or directories>
+ * compress [-k] <input file> -o <output file>
+ *
+ * Writes SZDD (the LZSS format EXPAND.EXE and LZEXPAND.DLL read) or with -k KWAJ method 3 (LZSS
+ * plus Huffman). Output names follow COMPRESS -r: the last character of the extension becomes
+ * '_' and is stored in the SZDD header so that EXPAND -r can put it back (FOO.DLL -> FOO.DL_).
+ *
+ * Both formats use a 4KB window that starts out filled with spaces. Matches are found with hash
+ * chains and lazy evaluation, the same way zlib does it, with the chains kept short because the
+ * longest match is only 17 or 18 bytes. */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#define LZ_WINDOW               4096
+#define MAX_THREADS             64
+#define LZ_FILL                 ' '
+#define LZ_MIN_MATCH            3
+
+#define SZDD_MAX_MATCH          18          /* 4 bit length + 3 */
+#define SZDD_MAX_DIST           4096
+
+#define KWAJ_MAX_MATCH          17          /* MATCHLEN symbol 1-15, + 2 */
+#define KWAJ_MAX_DIST           4095        /* the offset is 12 bits, 0 is not used */
+
+#define HASH_BITS               13
+#define HASH_SIZE               (1u << HASH_BITS)
+#define CHAIN_SIZE              (LZ_WINDOW * 2u)
+#define CHAIN_MASK              (CHAIN_SIZE - 1u)
+#define MAX_CHAIN               256         /* how far down a hash chain to look */
+
+#define FMT_SZDD                0
+#define FMT_KWAJ                1
+
+/* KWAJ header */
+#define KWAJ_COMP_LZH           3
+#define KWAJ_HDR_HASLENGTH      0x01
+#define KWAJ_HDR_HASFILENAME    0x08
+#define KWAJ_HDR_HASFILEEXT     0x10
+
+/* KWAJ method 3 Huffman tables */
+#define KWAJ_MATCHLEN1          0
+#define KWAJ_MATCHLEN2          1
+#define KWAJ_LITLEN             2
+#define KWAJ_OFFSET             3
+#define KWAJ_LITERAL            4
+#define KWAJ_TABLES             5
+#define KWAJ_MAX_BITS           15          /* lengths are stored in 4 bits */
+
+static const unsigned int kwaj_table_syms[KWAJ_TABLES] = { 16, 16, 32, 64, 256 };
+
+/* output buffer */
+struct outbuf {
+    unsigned char*          p;
+    size_t                  len;
+    size_t                  alloc;
+    int                     err;
+    uint64_t                bitbuf;         /* KWAJ bitstream, MSB first */
+    unsigned int            bits;
+};
+
+/* match finder state */
+struct lz {
+    const unsigned char*    buf;            /* LZ_WINDOW bytes of LZ_FILL, then the input */
+    size_t                  len;            /* of buf */
+    int32_t                 head[HASH_SIZE];
+    int32_t                 prev[CHAIN_SIZE];
+    size_t                  inserted;       /* positions below this are in the chains */
+    unsigned int            max_match;
+    unsigned int            max_dist;
+};
+
+/* tokens for KWAJ, which needs symbol counts before it can write anything.
+ * a literal is the byte value, a match is TOKEN_MATCH | (len << 12) | dist */
+#define TOKEN_MATCH             0x80000000u
+
+struct tokens {
+    const unsigned char*    buf;
+    uint32_t*               t;
+    size_t                  count;
+    size_t                  alloc;
+    int                     err;
+};
+
+struct huff {
+    unsigned char           len[256];
+    uint16_t                code[256];
+};
+
+struct batch_file {
+    char*                   in_path;
+    char*                   out_path;
+};
+
+static struct batch_file*   batch = NULL;
+static size_t               batch_count = 0;
+static size_t               batch_alloc = 0;
+static size_t               batch_next = 0;
+static unsigned long        batch_errors = 0;
+static uint64_t             batch_in_bytes = 0;
+static uint64_t             batch_out_bytes = 0;
+static pthread_mutex_t      batch_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int                  opt_format = FMT_SZDD;
+static int                  opt_recurse = 0;
+static int                  opt_quiet = 0;
+static int                  opt_threads = 0;
+static const char*          opt_out_dir = NULL;
+static const char*          opt_out_file = NULL;
+
+static void out_reserve(struct outbuf *o,size_t more) {
+    if (o->err) return;
+    if ((o->len + more) > o->alloc) {
+        size_t na = o->alloc ? o->alloc : 4096u;
+        unsigned char *np;
+
+        while ((o->len + more) > na) na *= 2u;
+        if ((np=realloc(o->p,na)) == NULL) {
+            o->err = 1;
+            return;
+        }
+        o->p = np;
+        o->alloc = na;
+    }
+}
+
+static void out_bytes(struct outbuf *o,const void *p,size_t n) {
+    out_reserve(o,n);
+    if (o->err) return;
+    memcpy(o->p + o->len,p,n);
+    o->len += n;
+}
+
+static void out_byte(struct outbuf *o,unsigned char c) {
+    out_bytes(o,&c,1);
+}
+
+static void out_le16(struct outbuf *o,unsigned int v) {
+    unsigned char b[2] = { (unsigned char)v, (unsigned char)(v >> 8u) };
+    out_bytes(o,b,2);
+}
+
+static void out_le32(struct outbuf *o,uint32_t v) {
+    unsigned char b[4] = { (unsigned char)v, (unsigned char)(v >> 8u), (unsigned char)(v >> 16u), (unsigned char)(v >> 24u) };
+    out_bytes(o,b,4);
+}
+
+static void out_bits(struct outbuf *o,unsigned int v,unsigned int n) {
+    o->bitbuf = (o->bitbuf << (uint64_t)n) | (uint64_t)v;
+    o->bits += n;
+    while (o->bits >= 8u) {
+        o->bits -= 8u;
+        out_byte(o,(unsigned char)(o->bitbuf >> (uint64_t)o->bits));
+    }
+}
+
+static void out_bits_flush(struct outbuf *o) {
+    if (o->bits != 0u) out_bits(o,0,8u - o->bits);
+}
+
+static inline unsigned int lz_hash(const unsigned char *p) {
+    uint32_t v = ((uint32_t)p[0] << 16u) | ((uint32_t)p[1] << 8u) | (uint32_t)p[2];
+    return (uint32_t)(v * 2654435761u) >> (32u - HASH_BITS);
+}
+
+static void lz_init(struct lz *lz,const unsigned char *buf,size_t len,unsigned int max_match,unsigned int max_dist) {
+    lz->buf = buf;
+    lz->len = len;
+    lz->inserted = 0;
+    lz->max_match = max_match;
+    lz->max_dist = max_dist;
+    memset(lz->head,0xFF,sizeof(lz->head));
+}
+
+/* put every position up to (not including) pos into the hash chains */
+static void lz_insert_to(struct lz *lz,size_t pos) {
+    if (pos > (lz->len - (LZ_MIN_MATCH - 1u))) pos = lz->len - (LZ_MIN_MATCH - 1u);
+
+    while (lz->inserted < pos) {
+        unsigned int h = lz_hash(lz->buf + lz->inserted);
+
+        lz->prev[lz->inserted & CHAIN_MASK] = lz->head[h];
+        lz->head[h] = (int32_t)lz->inserted;
+        lz->inserted++;
+    }
+}
+
+/* longest match for the bytes at pos. returns the length, or 0 */
+static unsigned int lz_find(struct lz *lz,size_t pos,unsigned int *dist) {
+    const unsigned char *cur = lz->buf + pos;
+    unsigned int best = 0,chain = MAX_CHAIN;
+    unsigned int max = lz->max_match;
+    int32_t cand;
+
+    if ((lz->len - pos) < LZ_MIN_MATCH) return 0;
+    if ((lz->len - pos) < max) max = (unsigned int)(lz->len - pos);
+
+    lz_insert_to(lz,pos);
+
+    for (cand=lz->head[lz_hash(cur)];cand >= 0 && chain-- > 0;cand=lz->prev[(size_t)cand & CHAIN_MASK]) {
+        const unsigned char *m = lz->buf + cand;
+        unsigned int l;
+
+        if ((pos - (size_t)cand) > lz->max_dist) break;
+
+        /* quick reject on the byte that would make it longer than what we have */
+        if (m[best] != cur[best] || m[0] != cur[0]) continue;
+
+        for (l=0;l < max && m[l] == cur[l];l++);
+        if (l > best) {
+            best = l;
+            *dist = (unsigned int)(pos - (size_t)cand);
+            if (best >= max) break;
+        }
+    }
+
+    return (best >= LZ_MIN_MATCH) ? best : 0;
+}
+
+/* parse the input into literals and matches, with one step of lazy evaluation.
+ * emit(user,len,dist) is called with len == 0 for a literal */
+typedef void (*lz_emit_t)(void *user,size_t pos,unsigned int len,unsigned int dist);
+
+static void lz_parse(struct lz *lz,lz_emit_t emit,void *user) {
+    size_t pos = LZ_WINDOW;
+    unsigned int len,dist = 0,nlen,ndist = 0;
+
+    /* matches against the initial spaces are allowed, but only up to the window size back */
+    lz_insert_to(lz,LZ_WINDOW);
+
+    len = lz_find(lz,pos,&dist);
+    while (pos < lz->len) {
+        if (len != 0 && len < lz->max_match) {
+            /* a longer match one byte on is worth a literal */
+            nlen = lz_find(lz,pos+1,&ndist);
+            if (nlen > len) {
+                emit(user,pos,0,0);
+                pos++;
+                len = nlen;
+                dist = ndist;
+                continue;
+            }
+        }
+
+        if (len != 0) {
+            emit(user,pos,len,dist);
+            pos += len;
+        }
+        else {
+            emit(user,pos,0,0);
+            pos++;
+        }
+
+        len = (pos < lz->len) ? lz_find(lz,pos,&dist) : 0;
+    }
+}
+
+/* SZDD: groups of 8 items, each group led by a byte of flags, bit set = literal */
+struct szdd_state {
+    struct outbuf*          o;
+    const unsigned char*    buf;
+    size_t                  flag_at;
+    unsigned int            flag_bit;
+};
+
+static void szdd_emit(void *user,size_t pos,unsigned int len,unsigned int dist) {
+    struct szdd_state *s = (struct szdd_state*)user;
+
+    if (s->flag_bit == 0x100u) {
+        s->flag_at = s->o->len;
+        s->flag_bit = 1u;
+        out_byte(s->o,0);
+    }
+
+    if (len == 0) {
+        if (!s->o->err) s->o->p[s->flag_at] |= (unsigned char)s->flag_bit;
+        out_byte(s->o,s->buf[pos]);
+    }
+    else {
+        /* the match is given by its position in the ring buffer, which starts at 4096-16 */
+        unsigned int ring = (unsigned int)((pos - dist) - LZ_WINDOW + (LZ_WINDOW - 16u)) & (LZ_WINDOW - 1u);
+
+        out_byte(s->o,(unsigned char)ring);
+        out_byte(s->o,(unsigned char)(((ring >> 4u) & 0xF0u) | (len - LZ_MIN_MATCH)));
+    }
+
+    s->flag_bit <<= 1u;
+}
+
+static void szdd_compress(struct outbuf *o,const unsigned char *buf,size_t len,char missing) {
+    static const unsigned char sig[8] = { 'S','Z','D','D',0x88,0xF0,0x27,0x33 };
+    struct szdd_state s;
+    struct lz *lz;
+
+    out_bytes(o,sig,8);
+    out_byte(o,'A');
+    out_byte(o,(unsigned char)missing);
+    out_le32(o,(uint32_t)(len - LZ_WINDOW));
+
+    if ((lz=malloc(sizeof(*lz))) == NULL) {
+        o->err = 1;
+        return;
+    }
+
+    s.o = o;
+    s.buf = buf;
+    s.flag_at = 0;
+    s.flag_bit = 0x100u;
+
+    lz_init(lz,buf,len,SZDD_MAX_MATCH,SZDD_MAX_DIST);
+    lz_parse(lz,szdd_emit,&s);
+    free(lz);
+}
+
+static void tokens_emit(void *user,size_t pos,unsigned int len,unsigned int dist) {
+    struct tokens *t = (struct tokens*)user;
+
+    if (t->err) return;
+
+    if (t->count == t->alloc) {
+        size_t na = t->alloc ? (t->alloc * 2u) : 4096u;
+        uint32_t *nt = realloc(t->t,na * sizeof(*nt));
+
+        if (nt == NULL) {
+            t->err = 1;
+            return;
+        }
+        t->t = nt;
+        t->alloc = na;
+    }
+
+    if (len == 0)
+        t->t[t->count++] = (uint32_t)t->buf[pos];
+    else
+        t->t[t->count++] = TOKEN_MATCH | ((uint32_t)len << 12u) | (uint32_t)dist;
+}
+
+/* Huffman code lengths, no longer than maxbits. every symbol with a nonzero count gets a code,
+ * and there must be at least two of them: the decoder will not accept an incomplete code */
+static void huff_lengths(const uint32_t *freq,unsigned int n,unsigned char *len,unsigned int maxbits) {
+    uint32_t f[512],fr[256];
+    int parent[512];
+    unsigned int i,nodes,active,maxlen;
+
+    for (i=0;i < n;i++) fr[i] = freq[i];
+
+    do {
+        for (i=0;i < n;i++) {
+            f[i] = fr[i];
+            parent[i] = -1;
+        }
+
+        /* join the two smallest live nodes until one is left. n is at most 256, so a plain scan is fine */
+        for (nodes=n,active=0,i=0;i < n;i++) if (f[i] != 0) active++;
+        while (active > 1) {
+            int a = -1,b = -1;
+
+            for (i=0;i < nodes;i++) {
+                if (f[i] == 0 || parent[i] != -1) continue;
+                if (a < 0 || f[i] < f[a]) { b = a; a = (int)i; }
+                else if (b < 0 || f[i] < f[b]) b = (int)i;
+            }
+
+            f[nodes] = f[a] + f[b];
+            parent[nodes] = -1;
+            parent[a] = parent[b] = (int)nodes;
+            nodes++;
+            active--;
+        }
+
+        for (maxlen=0,i=0;i < n;i++) {
+            unsigned int d = 0;
+            int p;
+
+            if (f[i] != 0) for (p=parent[i];p >= 0;p=parent[p]) d++;
+            len[i] = (unsigned char)d;
+            if (maxlen < d) maxlen = d;
+        }
+
+        /* too long: flatten the counts and try again */
+        if (maxlen > maxbits) {
+            for (i=0;i < n;i++) if (fr[i] != 0) fr[i] = (fr[i] >> 1u) | 1u;
+        }
+    } while (maxlen > maxbits);
+}
+
+/* canonical codes, shortest first and by symbol within a length, as make_decode_table() expects */
+static void huff_codes(struct huff *h,unsigned int n) {
+    unsigned int bits,i,next = 0;
+
+    for (bits=1;bits <= KWAJ_MAX_BITS;bits++) {
+        for (i=0;i < n;i++) {
+            if (h->len[i] == bits) h->code[i] = (uint16_t)next++;
+        }
+        next <<= 1u;
+    }
+}
+
+/* the code lengths themselves are stored one of four ways. returns the cost in bits, or -1 if
+ * the type cannot represent them */
+static long kwaj_lens_cost(const unsigned char *len,unsigned int n,unsigned int type) {
+    unsigned int i,c;
+    long cost = 4;
+
+    switch (type) {
+        case 0: /* all the same, and that is the natural size of the table */
+            c = (n == 16) ? 4 : (n == 32) ? 5 : (n == 64) ? 6 : 8;
+            for (i=0;i < n;i++) if (len[i] != c) return -1;
+            return 0;
+        case 1: /* same, one more, or 4 bits */
+            for (c=len[0],i=1;i < n;c=len[i],i++)
+                cost += (len[i] == c) ? 1 : (len[i] == (c+1u)) ? 2 : 6;
+            return cost;
+        case 2: /* one less, same, one more, or 4 bits */
+            for (c=len[0],i=1;i < n;c=len[i],i++)
+                cost += ((len[i] + 1u) >= c && len[i] <= (c + 1u)) ? 2 : 6;
+            return cost;
+        case 3:
+            return (long)n * 4l;
+    }
+
+    return -1;
+}
+
+static unsigned int kwaj_lens_type(const unsigned char *len,unsigned int n) {
+    unsigned int type,best = 3;
+    long c,bc = kwaj_lens_cost(len,n,3);
+
+    for (type=0;type < 3;type++) {
+        c = kwaj_lens_cost(len,n,type);
+        if (c >= 0 && c < bc) {
+            bc = c;
+            best = type;
+        }
+    }
+
+    return best;
+}
+
+static void kwaj_lens_write(struct outbuf *o,const unsigned char *len,unsigned int n,unsigned int type) {
+    unsigned int i,c;
+
+    if (type == 0) return;
+
+    if (type == 3) {
+        for (i=0;i < n;i++) out_bits(o,len[i],4);
+        return;
+    }
+
+    out_bits(o,len[0],4);
+    for (c=len[0],i=1;i < n;c=len[i],i++) {
+        if (type == 1) {
+            if (len[i] == c) out_bits(o,0,1);
+            else if (len[i] == (c+1u)) out_bits(o,2,2);
+            else out_bits(o,(3u << 4u) | len[i],6);
+        }
+        else {
+            if ((len[i] + 1u) >= c && len[i] <= (c + 1u)) out_bits(o,(len[i] + 1u) - c,2);
+            else out_bits(o,(3u << 4u) | len[i],6);
+        }
+    }
+}
+
+/* libmspack's decoder reads up to 23 bits ahead, and leaves its loop after the match or literal
+ * run in which that read-ahead hits the end of the input. The data must therefore end with one
+ * long literal run: turn the last 32 bytes into literals, whatever matches covered them */
+static void kwaj_tail_literals(struct tokens *t,size_t len) {
+    size_t pos = len,want = ((len - LZ_WINDOW) > 32u) ? (len - 32u) : LZ_WINDOW;
+
+    while (t->count > 0 && pos > want) {
+        uint32_t tok = t->t[--t->count];
+        pos -= (tok & TOKEN_MATCH) ? ((tok >> 12u) & 0xFFu) : 1u;
+    }
+
+    while (pos < len) tokens_emit(t,pos++,0,0);
+}
+
+/* walk the tokens, either counting symbols (o == NULL) or writing them. literal runs are at most
+ * 32 long; after a shorter run the next match length comes from the MATCHLEN2 table. the literals
+ * at the end are split with the short run first, so the last run is a full 32. returns the table
+ * the next match length would come from */
+static unsigned int kwaj_walk(const struct tokens *t,uint32_t freq[KWAJ_TABLES][256],const struct huff *h,struct outbuf *o) {
+    unsigned int mtbl = KWAJ_MATCHLEN1;
+    size_t i = 0,tail = t->count;
+
+    while (tail > 0 && !(t->t[tail-1] & TOKEN_MATCH)) tail--;
+
+#define KWAJ_SYM(tbl,sym) do { \
+        if (o == NULL) freq[tbl][sym]++; \
+        else out_bits(o,h[tbl].code[sym],h[tbl].len[sym]); \
+    } while (0)
+
+    while (i < t->count) {
+        uint32_t tok = t->t[i];
+
+        if (tok & TOKEN_MATCH) {
+            unsigned int len = (tok >> 12u) & 0xFFu,dist = tok & 0xFFFu;
+
+            KWAJ_SYM(mtbl,len - 2u);
+            KWAJ_SYM(KWAJ_OFFSET,dist >> 6u);
+            if (o != NULL) out_bits(o,dist & 63u,6);
+            mtbl = KWAJ_MATCHLEN1;
+            i++;
+        }
+        else {
+            size_t run = 0,k;
+
+            if (i >= tail && ((t->count - i) & 31u) != 0)
+                run = (t->count - i) & 31u;
+            else
+                while ((i+run) < t->count && run < 32u && !(t->t[i+run] & TOKEN_MATCH)) run++;
+
+            KWAJ_SYM(mtbl,0);
+            KWAJ_SYM(KWAJ_LITLEN,run - 1u);
+            for (k=0;k < run;k++) KWAJ_SYM(KWAJ_LITERAL,t->t[i+k]);
+            mtbl = (run == 32u) ? KWAJ_MATCHLEN1 : KWAJ_MATCHLEN2;
+            i += run;
+        }
+    }
+
+#undef KWAJ_SYM
+    return mtbl;
+}
+
+static void kwaj_compress(struct outbuf *o,const unsigned char *buf,size_t len,const char *name) {
+    static const unsigned char sig[8] = { 'K','W','A','J',0x88,0xF0,0x27,0xD1 };
+    uint32_t freq[KWAJ_TABLES][256];
+    struct huff h[KWAJ_TABLES];
+    unsigned int types[KWAJ_TABLES];
+    char fname[9],fext[4];
+    unsigned int i,flags,mtbl;
+    const char *dot;
+    size_t start;
+    uint64_t bits;
+    struct tokens t;
+    struct lz *lz;
+
+    /* the stored name is 8.3 */
+    dot = strrchr(name,'.');
+    snprintf(fname,sizeof(fname),"%.*s",(int)(dot ? (size_t)(dot - name) : strlen(name)),name);
+    snprintf(fext,sizeof(fext),"%s",dot ? (dot + 1) : "");
+
+    flags = KWAJ_HDR_HASLENGTH;
+    if (*fname) flags |= KWAJ_HDR_HASFILENAME;
+    if (*fext) flags |= KWAJ_HDR_HASFILEEXT;
+
+    out_bytes(o,sig,8);
+    out_le16(o,KWAJ_COMP_LZH);
+    out_le16(o,14u + 4u + (*fname ? (strlen(fname) + 1u) : 0u) + (*fext ? (strlen(fext) + 1u) : 0u));
+    out_le16(o,flags);
+    out_le32(o,(uint32_t)(len - LZ_WINDOW));
+    if (*fname) out_bytes(o,fname,strlen(fname) + 1u);
+    if (*fext) out_bytes(o,fext,strlen(fext) + 1u);
+
+    if ((lz=malloc(sizeof(*lz))) == NULL) {
+        o->err = 1;
+        return;
+    }
+
+    memset(&t,0,sizeof(t));
+    t.buf = buf;
+    lz_init(lz,buf,len,KWAJ_MAX_MATCH,KWAJ_MAX_DIST);
+    lz_parse(lz,tokens_emit,&t);
+    free(lz);
+    kwaj_tail_literals(&t,len);
+
+    if (t.err) {
+        free(t.t);
+        o->err = 1;
+        return;
+    }
+
+    /* count symbols. the end of the stream is padded with the start of a match (see below),
+     * which needs MATCHLEN symbol 1 and an OFFSET symbol. every table needs two symbols */
+    memset(freq,0,sizeof(freq));
+    kwaj_walk(&t,freq,h,NULL);
+    for (i=0;i < KWAJ_TABLES;i++) {
+        if (freq[i][0] == 0) freq[i][0] = 1;
+        if (freq[i][1] == 0) freq[i][1] = 1;
+
+        huff_lengths(freq[i],kwaj_table_syms[i],h[i].len,KWAJ_MAX_BITS);
+        huff_codes(&h[i],kwaj_table_syms[i]);
+        types[i] = kwaj_lens_type(h[i].len,kwaj_table_syms[i]);
+    }
+
+    start = o->len;
+    for (i=0;i < KWAJ_TABLES;i++) out_bits(o,types[i],4);
+    out_bits(o,0,4); /* sixth type, unused, keeps the types to 3 bytes */
+    for (i=0;i < KWAJ_TABLES;i++) kwaj_lens_write(o,h[i].len,kwaj_table_syms[i],types[i]);
+
+    mtbl = kwaj_walk(&t,freq,h,o);
+    free(t.t);
+
+    /* There is no end marker: the decoder stops when it runs out of bits partway through a
+     * symbol (or early, see kwaj_tail_literals). The spare bits in the last byte must not decode
+     * as a literal, so fill them with the start of a match, which is always more than 7 bits long. */
+    bits = ((uint64_t)(o->len - start) * 8u) + o->bits;
+    out_bits(o,h[mtbl].code[1],h[mtbl].len[1]);
+    out_bits(o,h[KWAJ_OFFSET].code[0],h[KWAJ_OFFSET].len[0]);
+    out_bits(o,0,6);
+    out_bits_flush(o);
+    if (!o->err) o->len = start + (size_t)((bits + 7u) >> 3u);
+}
+
+/* output name as COMPRESS -r makes it, and the character EXPAND -r has to put back */
+static void compressed_name(char *out,size_t out_sz,const char *name,char *missing) {
+    const char *dot = strrchr(name,'.');
+    size_t l;
+
+    *missing = 0;
+    snprintf(out,out_sz,"%s",name);
+    l = strlen(out);
+
+    if (dot == NULL) {
+        snprintf(out + l,out_sz - l,"._");
+    }
+    else if (strlen(dot + 1) >= 3u) {
+        *missing = out[l-1];
+        out[l-1] = '_';
+    }
+    else {
+        snprintf(out + l,out_sz - l,"_");
+    }
+}
+
+static int read_file(const char *path,unsigned char **buf,size_t *len) {
+    struct stat st;
+    size_t got = 0;
+    ssize_t rd;
+    int fd;
+
+    if ((fd=open(path,O_RDONLY)) < 0)
+        return 0;
+
+    if (fstat(fd,&st) || (*buf=malloc(LZ_WINDOW + (size_t)st.st_size + 1u)) == NULL) {
+        close(fd);
+        return 0;
+    }
+
+    /* the window starts out full of spaces, which matches can refer to */
+    memset(*buf,LZ_FILL,LZ_WINDOW);
+    while (got < (size_t)st.st_size && (rd=read(fd,*buf + LZ_WINDOW + got,(size_t)st.st_size - got)) > 0)
+        got += (size_t)rd;
+
+    close(fd);
+    *len = LZ_WINDOW + got;
+    return (got == (size_t)st.st_size);
+}
+
+static int write_file(const char *path,const struct outbuf *o) {
+    size_t done = 0;
+    ssize_t wd;
+    int fd;
+
+    if ((fd=open(path,O_WRONLY|O_CREAT|O_TRUNC,0644)) < 0)
+        return 0;
+
+    while (done < o->len && (wd=write(fd,o->p + done,o->len - done)) > 0)
+        done += (size_t)wd;
+
+    if (close(fd) || done != o->len) {
+        unlink(path);
+        return 0;
+    }
+
+    return 1;
+}
+
+/* make every directory leading up to the file at path */
+static int make_parent_dirs(const char *file) {
+    char path[PATH_MAX],*s;
+
+    snprintf(path,sizeof(path),"%s",file);
+    for (s=path+1;(s=strchr(s,'/')) != NULL;s++) {
+        *s = 0;
+        if (mkdir(path,0755) && errno != EEXIST) return 0;
+        *s = '/';
+    }
+
+    return 1;
+}
+
+static int compress_one(const struct batch_file *b,uint64_t *in_bytes,uint64_t *out_bytes) {
+    const char *base = strrchr(b->in_path,'/');
+    unsigned char *buf = NULL;
+    struct outbuf o;
+    char name[NAME_MAX + 3],missing;
+    size_t len;
+
+    base = base ? (base + 1) : b->in_path;
+
+    if (!read_file(b->in_path,&buf,&len)) {
+        fprintf(stderr,"%s: cannot read, %s\n",b->in_path,strerror(errno));
+        free(buf);
+        return 0;
+    }
+
+    /* don't compress twice */
+    if ((len - LZ_WINDOW) >= 8u && (!memcmp(buf + LZ_WINDOW,"SZDD\x88\xF0\x27\x33",8) || !memcmp(buf + LZ_WINDOW,"KWAJ\x88\xF0\x27\xD1",8))) {
+        if (!opt_quiet) printf("%s: already compressed, skipped\n",b->in_path);
+        free(buf);
+        return 1;
+    }
+
+    memset(&o,0,sizeof(o));
+    compressed_name(name,sizeof(name),base,&missing);
+    if (opt_format == FMT_KWAJ)
+        kwaj_compress(&o,buf,len,base);
+    else
+        szdd_compress(&o,buf,len,missing);
+    free(buf);
+
+    if (o.err) {
+        fprintf(stderr,"%s: out of memory\n",b->in_path);
+        free(o.p);
+        return 0;
+    }
+
+    if (!make_parent_dirs(b->out_path) || !write_file(b->out_path,&o)) {
+        fprintf(stderr,"%s: cannot write, %s\n",b->out_path,strerror(errno));
+        free(o.p);
+        return 0;
+    }
+
+    if (!opt_quiet)
+        printf("%s -> %s (%lu -> %lu bytes)\n",b->in_path,b->out_path,(unsigned long)(len - LZ_WINDOW),(unsigned long)o.len);
+
+    *in_bytes += (uint64_t)(len - LZ_WINDOW);
+    *out_bytes += (uint64_t)o.len;
+    free(o.p);
+    return 1;
+}
+
+static int batch_add(const char *in_path,const char *out_dir) {
+    const char *base = strrchr(in_path,'/');
+    char out[PATH_MAX],name[NAME_MAX + 3],missing;
+    struct batch_file *b;
+
+    base = base ? (base + 1) : in_path;
+
+    if (opt_out_file != NULL) {
+        snprintf(out,sizeof(out),"%s",opt_out_file);
+    }
+    else {
+        compressed_name(name,sizeof(name),base,&missing);
+        snprintf(out,sizeof(out),"%s/%s",out_dir,name);
+    }
+
+    /* never write over the input */
+    if (!strcmp(out,in_path)) {
+        if (!opt_quiet) printf("%s: already named as compressed, skipped\n",in_path);
+        return 1;
+    }
+
+    if (batch_count == batch_alloc) {
+        size_t na = batch_alloc ? (batch_alloc * 2u) : 256u;
+        struct batch_file *nb = realloc(batch,na * sizeof(*nb));
+
+        if (nb == NULL) return 0;
+        batch = nb;
+        batch_alloc = na;
+    }
+
+    b = &batch[batch_count];
+    b->in_path = strdup(in_path);
+    b->out_path = strdup(out);
+    if (b->in_path == NULL || b->out_path == NULL) {
+        free(b->in_path);
+        free(b->out_path);
+        return 0;
+    }
+
+    batch_count++;
+    return 1;
+}
+
+/* add a file, or with -r everything in a directory. out_dir is where the outputs go */
+static int batch_scan(const char *path,const char *out_dir,int top) {
+    char sub_in[PATH_MAX],sub_out[PATH_MAX];
+    struct dirent *d;
+    struct stat st;
+    DIR *dir;
+
+    if (stat(path,&st)) {
+        fprintf(stderr,"Cannot stat %s, %s\n",path,strerror(errno));
+        return 0;
+    }
+
+    if (!S_ISDIR(st.st_mode))
+        return batch_add(path,out_dir);
+
+    if (!opt_recurse) {
+        if (top) fprintf(stderr,"%s is a directory (use -r)\n",path);
+        return top ? 0 : 1;
+    }
+
+    if ((dir=opendir(path)) == NULL) {
+        fprintf(stderr,"Cannot open %s, %s\n",path,strerror(errno));
+        return 0;
+    }
+
+    while ((d=readdir(dir)) != NULL) {
+        if (!strcmp(d->d_name,".") || !strcmp(d->d_name,".."))
+            continue;
+
+        snprintf(sub_in,sizeof(sub_in),"%s/%s",path,d->d_name);
+        snprintf(sub_out,sizeof(sub_out),"%s/%s",out_dir,d->d_name);
+
+        if (stat(sub_in,&st) == 0 && S_ISDIR(st.st_mode)) {
+            if (!batch_scan(sub_in,sub_out,0)) {
+                closedir(dir);
+                return 0;
+            }
+        }
+        else if (!batch_add(sub_in,out_dir)) {
+            closedir(dir);
+            return 0;
+        }
+    }
+
+    closedir(dir);
+    return 1;
+}
+
+static void *batch_worker(void *arg) {
+    uint64_t in_bytes = 0,out_bytes = 0;
+    unsigned long errors = 0;
+    size_t i;
+
+    (void)arg;
+
+    do {
+        pthread_mutex_lock(&batch_lock);
+        i = batch_next < batch_count ? batch_next++ : batch_count;
+        pthread_mutex_unlock(&batch_lock);
+
+        if (i >= batch_count)
+            break;
+
+        if (!compress_one(&batch[i],&in_bytes,&out_bytes))
+            errors++;
+    } while (1);
+
+    pthread_mutex_lock(&batch_lock);
+    batch_errors += errors;
+    batch_in_bytes += in_bytes;
+    batch_out_bytes += out_bytes;
+    pthread_mutex_unlock(&batch_lock);
+    return NULL;
+}
+
+static double now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (double)ts.tv_sec + ((double)ts.tv_nsec / 1000000000.0);
+}
+
+static void help(const char *argv0) {
+    fprintf(stderr,"Usage: %s [-k] [-r] [-j n] [-d dir] [-q] <files or directories>\n",argv0);
+    fprintf(stderr,"       %s [-k] <input file> -o <output file>\n",argv0);
+    fprintf(stderr,"  -k       KWAJ method 3 (LZ + Huffman) instead of SZDD\n");
+    fprintf(stderr,"  -r       Recurse into directories\n");
+    fprintf(stderr,"  -j n     Compress with n threads (default: one per CPU)\n");
+    fprintf(stderr,"  -d dir   Write the compressed files here (default: next to the input)\n");
+    fprintf(stderr,"  -o file  Name of the compressed file, for one input file\n");
+    fprintf(stderr,"  -q       Only show errors\n");
+}
+
+int main(int argc,char **argv) {
+    pthread_t *threads;
+    int i,started,t,names = 0;
+    double t_start;
+    size_t fi;
+
+    for (i=1;i < argc;i++) {
+        if (!strcmp(argv[i],"-o") && (i+1) < argc) opt_out_file = argv[++i];
+        else if (!strcmp(argv[i],"-j") || !strcmp(argv[i],"-d")) i++;
+        else if (argv[i][0] != '-') names++;
+    }
+
+    if (names == 0 || (opt_out_file != NULL && names != 1)) {
+        help(argv[0]);
+        return 1;
+    }
+
+    for (i=1;i < argc;i++) {
+        const char *a = argv[i];
+
+        if (!strcmp(a,"-k")) {
+            opt_format = FMT_KWAJ;
+        }
+        else if (!strcmp(a,"-r")) {
+            opt_recurse = 1;
+        }
+        else if (!strcmp(a,"-q")) {
+            opt_quiet = 1;
+        }
+        else if (!strcmp(a,"-j") && (i+1) < argc) {
+            char *end;
+            long n = strtol(argv[++i],&end,10);
+
+            if (end == argv[i] || *end != 0 || n < 1) {
+                fprintf(stderr, "-j needs a number of threads, 1 or more\n");
+                return 1;
+            }
+            opt_threads = (n > MAX_THREADS) ? MAX_THREADS : (int)n;
+        }
+        else if (!strcmp(a,"-d") && (i+1) < argc) {
+            opt_out_dir = argv[++i];
+        }
+        else if (!strcmp(a,"-o") && (i+1) < argc) {
+            i++;
+        }
+        else if (*a == '-') {
+            fprintf(stderr,"Unknown switch %s\n",a);
+            help(argv[0]);
+            return 1;
+        }
+        else {
+            char dir[PATH_MAX];
+            struct stat st;
+
+            /* outputs go to -d, keeping the layout under a directory given, or next to the input */
+            if (opt_out_dir != NULL) {
+                snprintf(dir,sizeof(dir),"%s",opt_out_dir);
+            }
+            else if (stat(a,&st) == 0 && S_ISDIR(st.st_mode)) {
+                snprintf(dir,sizeof(dir),"%s",a);
+            }
+            else {
+                const char *s = strrchr(a,'/');
+                if (s != NULL) snprintf(dir,sizeof(dir),"%.*s",(int)(s - a),a);
+                else strcpy(dir,".");
+            }
+
+            if (!batch_scan(a,dir,1))
+                return 1;
+        }
+    }
+
+    if (batch_count == 0)
+        return 0;
+
+    if (opt_threads <= 0) {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        opt_threads = (n > 0) ? (int)n : 1;
+        if (opt_threads > MAX_THREADS) opt_threads = MAX_THREADS;
+    }
+    if ((size_t)opt_threads > batch_count)
+        opt_threads = (int)batch_count;
+
+    if ((threads=calloc((size_t)opt_threads,sizeof(pthread_t))) == NULL)
+        return 1;
+
+    t_start = now();
+    for (started=0;started < opt_threads;started++) {
+        if (pthread_create(&threads[started],NULL,batch_worker,NULL) != 0)
+            break;
+    }
+
+    if (started == 0)
+        batch_worker(NULL);
+
+    for (t=0;t < started;t++)
+        pthread_join(threads[t],NULL);
+
+    free(threads);
+
+    if (!opt_quiet || batch_errors != 0) {
+        double el = now() - t_start;
+
+        fprintf(stderr,"%lu files, %lu errors, %llu -> %llu bytes",
+            (unsigned long)batch_count,batch_errors,(unsigned long long)batch_in_bytes,(unsigned long long)batch_out_bytes);
+        if (el > 0)
+            fprintf(stderr,", %.2f MB/s",((double)batch_in_bytes / el) / 1000000.0);
+        fprintf(stderr,"\n");
+    }
+
+    for (fi=0;fi < batch_count;fi++) {
+        free(batch[fi].in_path);
+        free(batch[fi].out_path);
+    }
+    free(batch);
+
+    return (batch_errors != 0) ? 1 : 0;
+}
+
@@ -2,9 +2,20 @@
 /* argh, because libmspack cares so much about the off_t datatype */
 #define _FILE_OFFSET_BITS 64
 
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <pthread.h>
 #include <mspack.h>
 
 static const char *ERROR(void *x) {
@@ -12,6 +23,507 @@ static const char *ERROR(void *x) {
 	return "ERROR";
 }
 
+/* Batch mode.
+ *
+ * expand [-r] [-j n] [-d dir] [-q] <files or directories>
+ *
+ * The list of files is made first, then n worker threads take files from it in turn. Each worker
+ * makes one SZDD and one KWAJ decompressor and uses them for every file it gets. Input files are
+ * mmap'd by our own mspack_system instead of read through stdio. The output name is the input
+ * name with the trailing underscore replaced by the character the SZDD header says is missing
+ * (FOO.DL_ -> FOO.DLL), or for KWAJ the name stored in the header, if any. A stored name that
+ * is not a plain file name is ignored, it must not put the output outside the directory. */
+
+#define MAX_THREADS             64
+
+struct batch_file {
+    char*               in_path;
+    char*               out_dir;        /* where the output goes */
+};
+
+static struct batch_file*   batch = NULL;
+static size_t               batch_count = 0;
+static size_t               batch_alloc = 0;
+static size_t               batch_next = 0;
+static unsigned long        batch_errors = 0;
+static pthread_mutex_t      batch_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int                  opt_recurse = 0;
+static int                  opt_quiet = 0;
+static int                  opt_threads = 0;
+static const char*          opt_out_dir = NULL;
+
+/* mspack_system: inputs mmap'd, outputs written with write() */
+struct mmap_file {
+    int                     fd;
+    int                     mode;
+    unsigned char*          map;            /* MSPACK_SYS_OPEN_READ */
+    size_t                  size;
+    size_t                  pos;
+    const char*             name;
+};
+
+static struct mspack_file *mmap_open(struct mspack_system *self,const char *filename,int mode) {
+    struct mmap_file *f;
+    struct stat st;
+
+    (void)self;
+
+    if ((f=calloc(1,sizeof(*f))) == NULL)
+        return NULL;
+
+    f->fd = -1;
+    f->mode = mode;
+    f->name = filename;
+
+    if (mode == MSPACK_SYS_OPEN_READ) {
+        if ((f->fd=open(filename,O_RDONLY)) < 0)
+            goto fail;
+
+        if (fstat(f->fd,&st))
+            goto fail;
+
+        f->size = (size_t)st.st_size;
+        if (f->size != 0) {
+            f->map = mmap(NULL,f->size,PROT_READ,MAP_PRIVATE,f->fd,0);
+            if (f->map == MAP_FAILED)
+                goto fail;
+        }
+
+        close(f->fd);
+        f->fd = -1;
+    }
+    else if (mode == MSPACK_SYS_OPEN_WRITE) {
+        if ((f->fd=open(filename,O_WRONLY|O_CREAT|O_TRUNC,0644)) < 0)
+            goto fail;
+    }
+    else {
+        /* the decompressors never update or append */
+        goto fail;
+    }
+
+    return (struct mspack_file*)f;
+fail:
+    if (f->fd >= 0) close(f->fd);
+    free(f);
+    return NULL;
+}
+
+static void mmap_close(struct mspack_file *file) {
+    struct mmap_file *f = (struct mmap_file*)file;
+
+    if (f == NULL) return;
+    if (f->map != NULL && f->map != MAP_FAILED) munmap(f->map,f->size);
+    if (f->fd >= 0) close(f->fd);
+    free(f);
+}
+
+static int mmap_read(struct mspack_file *file,void *buffer,int bytes) {
+    struct mmap_file *f = (struct mmap_file*)file;
+    size_t n;
+
+    if (f == NULL || buffer == NULL || bytes < 0 || f->mode != MSPACK_SYS_OPEN_READ)
+        return -1;
+
+    n = f->size - f->pos;
+    if (n > (size_t)bytes) n = (size_t)bytes;
+    if (n != 0) memcpy(buffer,f->map + f->pos,n);
+    f->pos += n;
+    return (int)n;
+}
+
+static int mmap_write(struct mspack_file *file,void *buffer,int bytes) {
+    struct mmap_file *f = (struct mmap_file*)file;
+    ssize_t w;
+
+    if (f == NULL || buffer == NULL || bytes < 0 || f->fd < 0)
+        return -1;
+
+    w = write(f->fd,buffer,(size_t)bytes);
+    if (w > 0) f->pos += (size_t)w;
+    return (int)w;
+}
+
+static int mmap_seek(struct mspack_file *file,off_t offset,int mode) {
+    struct mmap_file *f = (struct mmap_file*)file;
+    off_t base;
+
+    if (f == NULL) return -1;
+
+    switch (mode) {
+        case MSPACK_SYS_SEEK_START: base = 0; break;
+        case MSPACK_SYS_SEEK_CUR:   base = (off_t)f->pos; break;
+        case MSPACK_SYS_SEEK_END:   base = (off_t)f->size; break;
+        default: return -1;
+    }
+
+    if ((base + offset) < 0 || (f->mode == MSPACK_SYS_OPEN_READ && (size_t)(base + offset) > f->size))
+        return -1;
+    if (f->fd >= 0 && lseek(f->fd,base + offset,SEEK_SET) < 0)
+        return -1;
+
+    f->pos = (size_t)(base + offset);
+    return 0;
+}
+
+static off_t mmap_tell(struct mspack_file *file) {
+    struct mmap_file *f = (struct mmap_file*)file;
+    return f ? (off_t)f->pos : 0;
+}
+
+static void mmap_message(struct mspack_file *file,const char *format,...) {
+    struct mmap_file *f = (struct mmap_file*)file;
+    va_list ap;
+
+    if (f != NULL) fprintf(stderr,"%s: ",f->name);
+    va_start(ap,format);
+    vfprintf(stderr,format,ap);
+    va_end(ap);
+    fputc('\n',stderr);
+}
+
+static void *mmap_alloc(struct mspack_system *self,size_t bytes) {
+    (void)self;
+    return malloc(bytes);
+}
+
+static void mmap_free(void *ptr) {
+    free(ptr);
+}
+
+static void mmap_copy(void *src,void *dest,size_t bytes) {
+    memcpy(dest,src,bytes);
+}
+
+static struct mspack_system mmap_system = {
+    mmap_open,
+    mmap_close,
+    mmap_read,
+    mmap_write,
+    mmap_seek,
+    mmap_tell,
+    mmap_message,
+    mmap_alloc,
+    mmap_free,
+    mmap_copy,
+    NULL
+};
+
+static int batch_add(const char *in_path,const char *out_dir) {
+    struct batch_file *b;
+
+    if (batch_count == batch_alloc) {
+        size_t na = batch_alloc ? (batch_alloc * 2u) : 256u;
+        struct batch_file *nb = realloc(batch,na * sizeof(*nb));
+
+        if (nb == NULL) return 0;
+        batch = nb;
+        batch_alloc = na;
+    }
+
+    b = &batch[batch_count];
+    b->in_path = strdup(in_path);
+    b->out_dir = strdup(out_dir);
+    if (b->in_path == NULL || b->out_dir == NULL) {
+        free(b->in_path);
+        free(b->out_dir);
+        return 0;
+    }
+
+    batch_count++;
+    return 1;
+}
+
+/* add a file, or with -r everything in a directory. out_dir is where the outputs go */
+static int batch_scan(const char *path,const char *out_dir,int top) {
+    char sub_in[PATH_MAX],sub_out[PATH_MAX];
+    struct dirent *d;
+    struct stat st;
+    DIR *dir;
+
+    if (stat(path,&st)) {
+        fprintf(stderr,"Cannot stat %s, %s\n",path,strerror(errno));
+        return 0;
+    }
+
+    if (!S_ISDIR(st.st_mode))
+        return batch_add(path,out_dir);
+
+    if (!opt_recurse) {
+        if (top) fprintf(stderr,"%s is a directory (use -r)\n",path);
+        return top ? 0 : 1;
+    }
+
+    if ((dir=opendir(path)) == NULL) {
+        fprintf(stderr,"Cannot open %s, %s\n",path,strerror(errno));
+        return 0;
+    }
+
+    while ((d=readdir(dir)) != NULL) {
+        if (!strcmp(d->d_name,".") || !strcmp(d->d_name,".."))
+            continue;
+
+        snprintf(sub_in,sizeof(sub_in),"%s/%s",path,d->d_name);
+        snprintf(sub_out,sizeof(sub_out),"%s/%s",out_dir,d->d_name);
+
+        if (stat(sub_in,&st) == 0 && S_ISDIR(st.st_mode)) {
+            if (!batch_scan(sub_in,sub_out,0)) {
+                closedir(dir);
+                return 0;
+            }
+        }
+        else if (!batch_add(sub_in,out_dir)) {
+            closedir(dir);
+            return 0;
+        }
+    }
+
+    closedir(dir);
+    return 1;
+}
+
+/* make every directory leading up to and including path */
+static int make_dirs(char *path) {
+    char *s;
+
+    for (s=path+1;(s=strchr(s,'/')) != NULL;s++) {
+        *s = 0;
+        if (mkdir(path,0755) && errno != EEXIST) {
+            *s = '/';
+            return 0;
+        }
+        *s = '/';
+    }
+
+    return (mkdir(path,0755) == 0 || errno == EEXIST);
+}
+
+/* a KWAJ stored name comes from the file, so only a plain name without a path will do */
+static int kwaj_name_ok(const char *name) {
+    return *name != 0 && strpbrk(name,"/\\:") == NULL && strstr(name,"..") == NULL;
+}
+
+/* the input and output are the same file, whatever the paths look like */
+static int same_file(const char *a,const char *b) {
+    struct stat sa,sb;
+
+    if (stat(a,&sa) || stat(b,&sb))
+        return 0;
+
+    return sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+}
+
+/* the output name: the input name with the last character put back */
+static void output_name(char *out,size_t out_sz,const struct batch_file *b,char missing,const char *kwaj_name) {
+    const char *base = strrchr(b->in_path,'/');
+    size_t l;
+
+    base = base ? (base + 1) : b->in_path;
+
+    if (kwaj_name != NULL && *kwaj_name != 0) {
+        snprintf(out,out_sz,"%s/%s",b->out_dir,kwaj_name);
+        return;
+    }
+
+    snprintf(out,out_sz,"%s/%s",b->out_dir,base);
+    l = strlen(out);
+    if (missing != 0 && l > 0 && out[l-1] == '_') {
+        /* match the case of the name: FOO.DL_ -> FOO.DLL, foo.dl_ -> foo.dll */
+        int lower = (l > 1 && islower((unsigned char)out[l-2]));
+        out[l-1] = lower ? (char)tolower((unsigned char)missing) : (char)toupper((unsigned char)missing);
+    }
+    else if (l > 1 && out[l-1] == '_' && (out[l-2] == '.' || strchr(base,'.') != NULL)) {
+        /* nothing was taken off, the underscore was added: FOO.TX_ -> FOO.TX, FOO._ -> FOO */
+        out[--l] = 0;
+        if (out[l-1] == '.') out[--l] = 0;
+    }
+}
+
+static int expand_one(struct msszdd_decompressor *szddd,struct mskwaj_decompressor *kwajd,const struct batch_file *b) {
+    char out[PATH_MAX],dir[PATH_MAX];
+    struct msszddd_header *szdd;
+    struct mskwajd_header *kwaj;
+    int err;
+
+    if ((szdd = szddd->open(szddd, b->in_path))) {
+        output_name(out,sizeof(out),b,szdd->missing_char,NULL);
+    }
+    else if (szddd->last_error(szddd) == MSPACK_ERR_SIGNATURE && (kwaj = kwajd->open(kwajd, b->in_path))) {
+        if (kwaj->filename != NULL && *kwaj->filename != 0 && !kwaj_name_ok(kwaj->filename)) {
+            fprintf(stderr, "%s: ignoring stored name %s\n", b->in_path, kwaj->filename);
+            output_name(out,sizeof(out),b,0,NULL);
+        }
+        else {
+            output_name(out,sizeof(out),b,0,kwaj->filename);
+        }
+    }
+    else {
+        fprintf(stderr, "%s: not SZDD or KWAJ compressed\n", b->in_path);
+        return 0;
+    }
+
+    /* never write over the input. the output is opened with O_TRUNC, and the input is mmap'd */
+    if (!strcmp(out,b->in_path) || same_file(out,b->in_path)) {
+        fprintf(stderr, "%s: cannot tell the output name, use -d\n", b->in_path);
+        if (szdd) szddd->close(szddd, szdd);
+        else kwajd->close(kwajd, kwaj);
+        return 0;
+    }
+
+    snprintf(dir,sizeof(dir),"%s",b->out_dir);
+    if (!make_dirs(dir)) {
+        fprintf(stderr, "%s: cannot create directory %s, %s\n", b->in_path, b->out_dir, strerror(errno));
+        err = MSPACK_ERR_OPEN;
+    }
+    else if (szdd) {
+        err = szddd->extract(szddd, szdd, out);
+    }
+    else {
+        err = kwajd->extract(kwajd, kwaj, out);
+    }
+
+    if (szdd) szddd->close(szddd, szdd);
+    else kwajd->close(kwajd, kwaj);
+
+    if (err != MSPACK_ERR_OK) {
+        fprintf(stderr, "%s -> %s: %s extract error %d\n", b->in_path, out, szdd ? "SZDD" : "KWAJ", err);
+        return 0;
+    }
+
+    if (!opt_quiet)
+        printf("%s -> %s\n", b->in_path, out);
+
+    return 1;
+}
+
+static void *batch_worker(void *arg) {
+    struct msszdd_decompressor *szddd;
+    struct mskwaj_decompressor *kwajd;
+    unsigned long errors = 0;
+    size_t i;
+
+    (void)arg;
+
+    szddd = mspack_create_szdd_decompressor(&mmap_system);
+    kwajd = mspack_create_kwaj_decompressor(&mmap_system);
+
+    do {
+        pthread_mutex_lock(&batch_lock);
+        i = batch_next < batch_count ? batch_next++ : batch_count;
+        pthread_mutex_unlock(&batch_lock);
+
+        if (i >= batch_count)
+            break;
+
+        if (!szddd || !kwajd || !expand_one(szddd,kwajd,&batch[i]))
+            errors++;
+    } while (1);
+
+    if (!szddd || !kwajd)
+        fprintf(stderr, "can't make either SZDD or KWAJ decompressor\n");
+
+    mspack_destroy_szdd_decompressor(szddd);
+    mspack_destroy_kwaj_decompressor(kwajd);
+
+    pthread_mutex_lock(&batch_lock);
+    batch_errors += errors;
+    pthread_mutex_unlock(&batch_lock);
+    return NULL;
+}
+
+static int batch_main(int argc, char *argv[]) {
+    pthread_t *threads;
+    int i,started,t;
+    size_t fi;
+
+    for (i=1;i < argc;i++) {
+        const char *a = argv[i];
+
+        if (!strcmp(a,"-r")) {
+            opt_recurse = 1;
+        }
+        else if (!strcmp(a,"-q")) {
+            opt_quiet = 1;
+        }
+        else if (!strcmp(a,"-j") && (i+1) < argc) {
+            char *end;
+            long n = strtol(argv[++i],&end,10);
+
+            if (end == argv[i] || *end != 0 || n < 1) {
+                fprintf(stderr, "-j needs a number of threads, 1 or more\n");
+                return 1;
+            }
+            opt_threads = (n > MAX_THREADS) ? MAX_THREADS : (int)n;
+        }
+        else if (!strcmp(a,"-d") && (i+1) < argc) {
+            opt_out_dir = argv[++i];
+        }
+        else if (*a == '-') {
+            fprintf(stderr, "Unknown switch %s\n", a);
+            return 1;
+        }
+        else {
+            char dir[PATH_MAX];
+            struct stat st;
+
+            /* outputs go to -d, keeping the layout under a directory given, or next to the input */
+            if (opt_out_dir != NULL) {
+                snprintf(dir,sizeof(dir),"%s",opt_out_dir);
+            }
+            else if (stat(a,&st) == 0 && S_ISDIR(st.st_mode)) {
+                snprintf(dir,sizeof(dir),"%s",a);
+            }
+            else {
+                const char *s = strrchr(a,'/');
+                if (s != NULL) snprintf(dir,sizeof(dir),"%.*s",(int)(s - a),a);
+                else strcpy(dir,".");
+            }
+
+            if (!batch_scan(a,dir,1))
+                return 1;
+        }
+    }
+
+    if (batch_count == 0) {
+        fprintf(stderr, "Nothing to expand\n");
+        return 1;
+    }
+
+    if (opt_threads <= 0) {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        opt_threads = (n > 0) ? (int)n : 1;
+        if (opt_threads > MAX_THREADS) opt_threads = MAX_THREADS;
+    }
+    if ((size_t)opt_threads > batch_count)
+        opt_threads = (int)batch_count;
+
+    if ((threads=calloc((size_t)opt_threads,sizeof(pthread_t))) == NULL)
+        return 1;
+
+    for (started=0;started < opt_threads;started++) {
+        if (pthread_create(&threads[started],NULL,batch_worker,NULL) != 0)
+            break;
+    }
+
+    if (started == 0)
+        batch_worker(NULL);
+
+    for (t=0;t < started;t++)
+        pthread_join(threads[t],NULL);
+
+    free(threads);
+
+    fprintf(stderr, "%lu files, %lu errors\n", (unsigned long)batch_count, batch_errors);
+
+    for (fi=0;fi < batch_count;fi++) {
+        free(batch[fi].in_path);
+        free(batch[fi].out_dir);
+    }
+    free(batch);
+
+    return (batch_errors != 0) ? 1 : 0;
+}
+
 int main(int argc, char *argv[]) {
     struct msszdd_decompressor *szddd;
     struct mskwaj_decompressor *kwajd;
@@ -19,11 +531,6 @@ int main(int argc, char *argv[]) {
     struct mskwajd_header *kwaj;
     int err;
 
-    if (argc != 3) {
-	fprintf(stderr, "Usage: %s <input file> <output file>\n", argv[0]);
-	return 1;
-    }
-
     /* if self-test reveals an error */
     MSPACK_SYS_SELFTEST(err);
     if (err) {
@@ -31,6 +538,21 @@ int main(int argc, char *argv[]) {
 	    return 1;
     }
 
+    /* anything but "expand <input file> <output file>" is batch mode */
+    if (argc != 3 || argv[1][0] == '-' || argv[2][0] == '-') {
+	if (argc < 2) {
+	    fprintf(stderr, "Usage: %s <input file> <output file>\n", argv[0]);
+	    fprintf(stderr, "       %s [-r] [-j n] [-d dir] [-q] <files or directories>\n", argv[0]);
+	    fprintf(stderr, "  -r       Recurse into directories\n");
+	    fprintf(stderr, "  -j n     Expand with n threads (default: one per CPU)\n");
+	    fprintf(stderr, "  -d dir   Write the expanded files here (default: next to the input)\n");
+	    fprintf(stderr, "  -q       Only show errors\n");
+	    return 1;
+	}
+
+	return batch_main(argc, argv);
+    }
+
     szddd = mspack_create_szdd_decompressor(NULL);
     kwajd = mspack_create_kwaj_decompressor(NULL);
 
@@ -82,3 +604,4 @@ int main(int argc, char *argv[]) {
     mspack_destroy_kwaj_decompressor(kwajd);
     return 0;
 }
+
@@ -0,0 +1,50 @@
+#!/bin/bash
+#
+# Compress files with compress (SZDD and KWAJ), expand them again with
+# expand (libmspack), and check that the result is what went in.
+#
+#   ./roundtrip.sh [files...]
+#
+# With no files, a set of generated inputs is used: empty and tiny files,
+# long runs, short repeating patterns with an odd last byte, and random data.
+
+cd "$(dirname "$0")" || exit 1
+make -s bin || exit 1
+
+tmp=$(mktemp -d) || exit 1
+trap 'rm -Rf "$tmp"' EXIT
+
+files=("$@")
+if [ ${#files[@]} -eq 0 ]; then
+    mkdir "$tmp/in"
+    : >"$tmp/in/empty"
+    printf 'x' >"$tmp/in/one"
+    printf 'ab' >"$tmp/in/two"
+    for n in 31 32 33 100 4095 4096 4097 100000; do
+        { head -c $n /dev/zero | tr '\0' ' '; echo; } >"$tmp/in/spaces$n"
+    done
+    for n in 100 1000 20000 100000; do
+        { yes ab | head -n $n | tr -d '\n'; printf 'Q'; } >"$tmp/in/ab$n"
+    done
+    head -c 65536 /dev/zero >"$tmp/in/zeros"
+    head -c 65537 /dev/urandom >"$tmp/in/random"
+    cat compress.c expand.c >"$tmp/in/source.c"
+    files=("$tmp"/in/*)
+fi
+
+fail=0
+for f in "${files[@]}"; do
+    for fmt in szdd kwaj; do
+        opt=; [ $fmt == kwaj ] && opt=-k
+        if ! linux-host/compress $opt "$f" -o "$tmp/c" >/dev/null 2>&1 ||
+           ! linux-host/expand "$tmp/c" "$tmp/x" >/dev/null 2>&1 ||
+           ! cmp -s "$f" "$tmp/x"; then
+            echo "FAILED: $fmt $f ($(stat -c %s "$f") bytes in, $(stat -c %s "$tmp/x" 2>/dev/null || echo 0) out)"
+            fail=1
+        fi
+        rm -f "$tmp/c" "$tmp/x"
+    done
+done
+
+[ $fail == 0 ] && echo "${#files[@]} files OK"
+exit $fail
@@ -0,0 +1,73 @@
+#!/bin/bash
+#
+# Measure remctl throughput against remsim, no DOS machine needed.
+#
+#   ./bench.sh [remsim options] [-- remctlclient options]
+#
+#   ./bench.sh -b 115200 -latency 4                 115200 baud null modem, 4ms turnaround
+#   ./bench.sh -b 115200 -latency 4 -ber 1e-5       ...with line noise
+#   ./bench.sh -b 115200 -latency 4 -- -win 0 -nostream    the old stop-and-wait protocol
+#
+# Reports bytes/sec for memread (memdump), file read (download) and file
+# write (upload), and checks that what came across is what was sent.
+# SIZE=<bytes> sets how much is moved (default 65536), PORT=<n> the port.
+
+cd "$(dirname "$0")" || exit 1
+make -s all || exit 1
+
+sim_opts=()
+client_opts=()
+while [ $# -gt 0 ]; do
+    if [ "$1" == "--" ]; then shift; client_opts=("$@"); break; fi
+    sim_opts+=("$1"); shift
+done
+
+size=${SIZE:-65536}
+port=${PORT:-$((20000 + $$ % 10000))}
+tmp=$(mktemp -d) || exit 1
+
+# a random memory image and a random file, so anything out of place shows
+head -c $((0x110000)) /dev/urandom >"$tmp/mem.img"
+mkdir "$tmp/c"
+head -c $size /dev/urandom >"$tmp/c/BENCH.DAT"
+
+linux-host/remsim -p $port -root "$tmp/c" -mem "$tmp/mem.img" "${sim_opts[@]}" >"$tmp/remsim.log" 2>&1 &
+sim=$!
+trap 'kill $sim 2>/dev/null; wait $sim 2>/dev/null; rm -Rf "$tmp"' EXIT
+
+for i in $(seq 50); do
+    grep -q listening "$tmp/remsim.log" && break
+    sleep 0.1
+done
+if ! grep -q listening "$tmp/remsim.log"; then cat "$tmp/remsim.log"; exit 1; fi
+
+client() {
+    linux-host/remctlclient -l -p $port "${client_opts[@]}" "$@" >/dev/null 2>>"$tmp/client.log"
+}
+
+# run "$@", then print bytes/sec and whether $check passed
+bench() {
+    local what=$1 check=$2 start end
+    shift 2
+
+    start=$(date +%s%N)
+    client "$@"
+    end=$(date +%s%N)
+
+    if eval "$check"; then result=OK; else result=FAILED; fi
+    awk -v w="$what" -v n=$size -v ns=$((end - start)) -v r=$result \
+        'BEGIN { printf("%-10s %9d bytes %8.3f s %10.1f bytes/sec  %s\n",w,n,ns/1e9,n/(ns/1e9),r); }'
+}
+
+echo "remsim ${sim_opts[*]}, remctlclient ${client_opts[*]}"
+bench memread  'cmp -s "$tmp/memread.bin" <(tail -c +$((0x10001)) "$tmp/mem.img" | head -c $size)' \
+    -c memdump -maddr 0x10000 -msz $size -o "$tmp/memread.bin"
+bench fileread 'cmp -s "$tmp/fileread.bin" "$tmp/c/BENCH.DAT"' \
+    -c download -mstr 'C:\BENCH.DAT' -o "$tmp/fileread.bin"
+bench filewrite 'cmp -s "$tmp/c/UPLOAD.DAT" "$tmp/c/BENCH.DAT"' \
+    -c upload -mstr 'C:\UPLOAD.DAT' -i "$tmp/c/BENCH.DAT"
+
+if grep -q . "$tmp/client.log" 2>/dev/null; then
+    echo "client complaints:"
+    sort "$tmp/client.log" | uniq -c | sort -rn | head -5
+fi
@@ -0,0 +1,23 @@
+
+/* CRC-16/CCITT (polynomial 0x1021, initial value 0xFFFF, MSB first) for
+ * REMCTL_SERIAL_TYPE_STREAM frames. Shared by remsrv.c and remctlclient.c.
+ *
+ * Four bits at a time, so the table is 32 bytes instead of 512. That matters
+ * more to a TSR than the speed does, the serial line is the bottleneck. */
+
+#define REMCTL_CRC16_INIT       0xFFFFU
+
+static const unsigned short remctl_crc16_nibble[16] = {
+    0x0000,0x1021,0x2042,0x3063,0x4084,0x50A5,0x60C6,0x70E7,
+    0x8108,0x9129,0xA14A,0xB16B,0xC18C,0xD1AD,0xE1CE,0xF1EF
+};
+
+static unsigned short remctl_crc16_update(unsigned short crc,const unsigned char *p,unsigned int len) {
+    while (len-- != 0U) {
+        crc = (unsigned short)((crc << 4U) ^ remctl_crc16_nibble[((crc >> 12U) ^ (*p >> 4U)) & 0xFU]);
+        crc = (unsigned short)((crc << 4U) ^ remctl_crc16_nibble[((crc >> 12U) ^ *p) & 0xFU]);
+        p++;
+    }
+
+    return crc;
+}
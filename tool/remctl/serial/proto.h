@@ -17,7 +17,11 @@ struct remctl_serial_packet {
 
 #define REMCTL_SERIAL_MARK      0x01
 
+/* largest window either end will ever ask for (see REMCTL_SERIAL_TYPE_WINDOW) */
+#define REMCTL_SERIAL_WINDOW_MAX 16
+
 enum {
+    REMCTL_SERIAL_TYPE_ACK=0x41,        /* windowed mode: cumulative ACK from server, sent in place of a bad packet's response */
     REMCTL_SERIAL_TYPE_DOS=0x44,        /* MS-DOS specific */
     REMCTL_SERIAL_TYPE_ERROR=0x45,
     REMCTL_SERIAL_TYPE_FILE=0x46,       /* file I/O specific */
@@ -26,9 +30,73 @@ enum {
     REMCTL_SERIAL_TYPE_OUTPORT=0x4F,    /* output to port */
     REMCTL_SERIAL_TYPE_MEMREAD=0x52,    /* read from memory */
     REMCTL_SERIAL_TYPE_PING=0x50,
-    REMCTL_SERIAL_TYPE_MEMWRITE=0x57    /* write to memory */
+    REMCTL_SERIAL_TYPE_STREAM=0x53,     /* server pushes a memory range or file as a stream of frames */
+    REMCTL_SERIAL_TYPE_MEMWRITE=0x57,   /* write to memory */
+    REMCTL_SERIAL_TYPE_WINDOW=0x4E      /* negotiate windowed mode */
 };
 
+/* REMCTL_SERIAL_TYPE_WINDOW
+ *
+ * request:  data[0] = window size the client wants (0 = back to stop-and-wait)
+ * response: data[0] = window size the server grants (0 = stop-and-wait)
+ *
+ * Both the request and the response carry sequence number 0xFF, so both ends
+ * start over from sequence 0 whichever way the mode changes. A server that
+ * does not know this packet answers REMCTL_SERIAL_TYPE_ERROR and the client
+ * stays in stop-and-wait.
+ *
+ * In windowed mode the client may have up to that many requests outstanding.
+ * Each response carries the sequence number of the request it answers, and
+ * requests are processed and answered in the order they arrive. Only
+ * requests that are safe to repeat should be pipelined (MEMREAD, FILE READ_AT,
+ * FILE WRITE_AT) because the client retransmits whatever it has no answer for.
+ *
+ * If a packet arrives with a bad checksum, the server answers with
+ * REMCTL_SERIAL_TYPE_ACK instead:
+ *
+ *   data[0]    = cumulative ACK: every sequence number before this one was received
+ *   data[1..2] = bitmap (little endian) of the sequence numbers received after it,
+ *                bit N = sequence (data[0] + N)
+ *
+ * so the client can retransmit only what was lost. */
+
+/* REMCTL_SERIAL_TYPE_STREAM
+ *
+ * request:  data[0]    = REMCTL_SERIAL_TYPE_STREAM_MEMORY or REMCTL_SERIAL_TYPE_STREAM_FILE
+ *           data[1..4] = linear memory address, or offset into the open file
+ *           data[5..8] = byte count
+ * response: the request echoed back, or data[0] = REMCTL_SERIAL_TYPE_FILE_MSDOS_ERROR
+ *
+ * After the response the server sends the range without waiting for the
+ * client, as frames of REMCTL_SERIAL_STREAM_FRAME bytes:
+ *
+ *   data[0]      = REMCTL_SERIAL_TYPE_STREAM_DATA
+ *   data[1..4]   = offset of the bytes from the start of the range
+ *   data[5..n-3] = the bytes
+ *   data[n-2..]  = CRC-16 (see crc16.h, big endian) of data[0..n-3]
+ *
+ * and then one REMCTL_SERIAL_TYPE_STREAM_DONE frame with data[1..4] = where the
+ * range ended, which is less than the byte count if the file ended first.
+ * Frames carry sequence number 0xFF and do not advance the server's sequence.
+ *
+ * The client answers a damaged or missing frame with REMCTL_SERIAL_TYPE_STREAM_NAK,
+ * data[1..4] = the offset, and the server sends that frame again as soon as
+ * the one it is sending now is out. A NAK gets no other response. When the
+ * client has everything it sends REMCTL_SERIAL_TYPE_STREAM_END, which the
+ * server echoes back. NAK and END are sent with sequence number 0xFF, so a
+ * damaged one does not throw off stop-and-wait sequencing. */
+#define REMCTL_SERIAL_STREAM_FRAME      248     /* 255 - subcommand, offset and CRC-16 */
+
+enum {
+    REMCTL_SERIAL_TYPE_STREAM_DATA=0x44,        /* frame: bytes of the range */
+    REMCTL_SERIAL_TYPE_STREAM_END=0x45,         /* client is done with the stream */
+    REMCTL_SERIAL_TYPE_STREAM_FILE=0x46,        /* stream the open file */
+    REMCTL_SERIAL_TYPE_STREAM_MEMORY=0x4D,      /* stream memory */
+    REMCTL_SERIAL_TYPE_STREAM_NAK=0x4E,         /* send this frame again */
+    REMCTL_SERIAL_TYPE_STREAM_DONE=0x5A         /* frame: end of the range */
+};
+
+
 /* REMCTL_SERIAL_TYPE_DOS */
 enum {
     REMCTL_SERIAL_TYPE_DOS_LOL=0x4C,    /* return List of Lists pointer */
@@ -53,6 +121,8 @@ enum {
     REMCTL_SERIAL_TYPE_FILE_CREATE=0x72,            /* create a new file. will close prior file. */
     REMCTL_SERIAL_TYPE_FILE_READ=0x79,              /* read file */
     REMCTL_SERIAL_TYPE_FILE_WRITE=0x7A,             /* write file */
-    REMCTL_SERIAL_TYPE_FILE_SEEK=0x7B               /* seek file pointer */
+    REMCTL_SERIAL_TYPE_FILE_SEEK=0x7B,              /* seek file pointer */
+    REMCTL_SERIAL_TYPE_FILE_READ_AT=0x7C,           /* read file at offset data[2..5], does not depend on the file pointer */
+    REMCTL_SERIAL_TYPE_FILE_WRITE_AT=0x7D           /* write file at offset data[2..5], does not depend on the file pointer */
 };
 
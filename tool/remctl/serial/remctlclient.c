@@ -3,10 +3,12 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 
 /* for connecting to localhost (DOSBox null modem emulation) */
 #include <netinet/in.h>
 #include <netinet/ip.h>
+#include <netinet/tcp.h>
 
 /* for connecting to serial port */
 #include <termios.h>
@@ -21,9 +23,11 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
+#include <poll.h>
 #include <time.h>
 
 #include "proto.h"
+#include "crc16.h"
 
 #ifndef O_BINARY
 #define O_BINARY (0)
@@ -46,9 +50,18 @@ static char*            memstr = NULL;
 static char*            input_file = NULL;
 static char*            output_file = NULL;
 static unsigned char    enterkey = 0;
+static int              window_request = 4;
+static int              stream_request = 1;
 
 static int              conn_fd = -1;
 
+/* bytes received from conn_fd, so packet framing doesn't take a read() per byte */
+static unsigned char    rx_ring[4096];          /* must be a power of 2 */
+static unsigned int     rx_ring_head = 0;       /* next byte from conn_fd goes here */
+static unsigned int     rx_ring_tail = 0;       /* next byte to hand out comes from here */
+
+#define RX_RING_MASK    ((unsigned int)sizeof(rx_ring) - 1u)
+
 static void help(void) {
     fprintf(stderr,"remctlclient [options]\n");
     fprintf(stderr,"Remote control client for RS-232 control of a DOS system.\n");
@@ -69,6 +82,8 @@ static void help(void) {
     fprintf(stderr,"  -data <n>         data value\n");
     fprintf(stderr,"  -o <file>         Output file\n");
     fprintf(stderr,"  -i <file>         Input file\n");
+    fprintf(stderr,"  -win <n>          Packets in flight for memdump/upload/download (default 4, 0=stop-and-wait)\n");
+    fprintf(stderr,"  -nostream         Don't use streaming for memdump/snapshot/download\n");
     fprintf(stderr,"\n");
     fprintf(stderr,"Commands are:\n");
     fprintf(stderr,"   ping             Ping the server (test connection)\n");
@@ -86,6 +101,7 @@ static void help(void) {
     fprintf(stderr,"   memwrite -msz <n> -maddr <n> -data <n> Write server memory\n");
     fprintf(stderr,"   memwrite -maddr <n> -mstr <x> Write server memory with string\n");
     fprintf(stderr,"   memdump -msz <n> -maddr <n> -o <file> Dump memory starting at -maddr\n");
+    fprintf(stderr,"   snapshot -o <file> Dump the first 1MB of memory (or -maddr/-msz)\n");
     fprintf(stderr,"   dos_lol          Report MS-DOS List of Lists location\n");
     fprintf(stderr,"   indos            Report MS-DOS InDOS flag\n");
     fprintf(stderr,"   pwd              Report current working path\n");
@@ -199,6 +215,16 @@ static int parse_argv(int argc,char **argv) {
             else if (!strcmp(a,"w")) {
                 waitconn = 1;
             }
+            else if (!strcmp(a,"win")) {
+                a = argv[i++];
+                if (a == NULL) return 1;
+                window_request = atoi(a);
+                if (window_request < 0) window_request = 0;
+                else if (window_request > REMCTL_SERIAL_WINDOW_MAX) window_request = REMCTL_SERIAL_WINDOW_MAX;
+            }
+            else if (!strcmp(a,"nostream")) {
+                stream_request = 0;
+            }
             else if (!strcmp(a,"d")) {
                 debug = 1;
             }
@@ -221,8 +247,9 @@ static int parse_argv(int argc,char **argv) {
 
     if (serial_tty != NULL) {
         /* Motherboard RS-232 ports are usually /dev/ttyS0, /dev/ttyS1, etc.
-         * USB RS-232 ports are usually /dev/ttyUSB0, /dev/ttyUSB1, etc. */
-        if (!strncmp(serial_tty,"/dev/tty",8)) {
+         * USB RS-232 ports are usually /dev/ttyUSB0, /dev/ttyUSB1, etc.
+         * remsim -pty is a /dev/pts/N */
+        if (!strncmp(serial_tty,"/dev/tty",8) || !strncmp(serial_tty,"/dev/pts/",9)) {
             /* good */
         }
         else {
@@ -266,6 +293,8 @@ void drop_connection(void) {
         close(conn_fd);
         conn_fd = -1;
     }
+
+    rx_ring_head = rx_ring_tail = 0;
 }
 
 int do_connection(void) {
@@ -292,6 +321,14 @@ int do_connection(void) {
             return -1;
         }
 
+        /* packets are small and every one waits on an answer, don't let Nagle hold them back */
+        {
+            int one = 1;
+
+            if (setsockopt(conn_fd,IPPROTO_TCP,TCP_NODELAY,&one,sizeof(one)) < 0)
+                fprintf(stderr,"WARNING: failed to set TCP_NODELAY\n");
+        }
+
         if (nonblocking_fd(conn_fd) < 0)
             fprintf(stderr,"WARNING: failed to make socket non-blocking\n");
     }
@@ -414,64 +451,150 @@ int do_send_packet(const struct remctl_serial_packet * const pkt) {
         dump_packet(pkt);
     }
 
-    if (write_persistent(conn_fd,(const void*)(&(pkt->hdr)),sizeof(pkt->hdr)) != sizeof(pkt->hdr)) {
-        fprintf(stderr,"Send failed: header\n");
+    /* header and data in one go, data follows the header directly */
+    if (write_persistent(conn_fd,(const void*)pkt,sizeof(pkt->hdr)+pkt->hdr.length) != (int)(sizeof(pkt->hdr)+pkt->hdr.length)) {
+        fprintf(stderr,"Send failed\n");
         drop_connection();
         return -1;
     }
 
-    if (pkt->hdr.length != 0 && write_persistent(conn_fd,pkt->data,pkt->hdr.length) != pkt->hdr.length) {
-        fprintf(stderr,"Send failed: data\n");
-        drop_connection();
-        return -1;
+    return 0;
+}
+
+/* deadlines are on the monotonic clock */
+void deadline_set(struct timespec * const d,const int ms) {
+    clock_gettime(CLOCK_MONOTONIC,d);
+    d->tv_sec += ms / 1000;
+    d->tv_nsec += (long)(ms % 1000) * 1000000L;
+    if (d->tv_nsec >= 1000000000L) {
+        d->tv_nsec -= 1000000000L;
+        d->tv_sec++;
     }
+}
 
-    return 0;
+/* milliseconds left until the deadline, rounded up, for poll() */
+int deadline_ms(const struct timespec * const d) {
+    struct timespec now;
+    long long ns;
+
+    clock_gettime(CLOCK_MONOTONIC,&now);
+    ns = ((long long)(d->tv_sec - now.tv_sec) * 1000000000LL) + (long long)(d->tv_nsec - now.tv_nsec);
+    if (ns <= 0LL)
+        return 0;
+
+    return (int)((ns + 999999LL) / 1000000LL);
 }
 
-int read_persistent(const int fd,void *p,int sz) {
-    int patience = 5000; /* 5000 x 1ms = 5 seconds */
-    int rd = 0;
-    int rt;
+unsigned int rx_ring_count(void) {
+    return (rx_ring_head - rx_ring_tail) & RX_RING_MASK;
+}
 
-    while (sz > 0) {
-        rt = read(fd,p,sz);
-        if (rt < 0) {
-            if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                if (--patience < 0) {
-                    fprintf(stderr,"Read timeout\n");
-                    if (rd != 0)
-                        break;
-                    else
-                        return -1;
-                }
+unsigned char rx_ring_peek(const unsigned int i) {
+    return rx_ring[(rx_ring_tail + i) & RX_RING_MASK];
+}
 
-                /* non-blocking handling */
-                usleep(1000); /* 1ms */
-                continue;
-            }
-            return rt;
+/* copy count bytes out of the ring, without taking them */
+void rx_ring_copy(void *p,const unsigned int count) {
+    const unsigned int first = (unsigned int)sizeof(rx_ring) - rx_ring_tail;
+
+    assert(count <= rx_ring_count());
+    if (count > first) {
+        memcpy(p,rx_ring + rx_ring_tail,first);
+        memcpy((unsigned char*)p + first,rx_ring,count - first);
+    }
+    else {
+        memcpy(p,rx_ring + rx_ring_tail,count);
+    }
+}
+
+void rx_ring_skip(const unsigned int count) {
+    assert(count <= rx_ring_count());
+    rx_ring_tail = (rx_ring_tail + count) & RX_RING_MASK;
+}
+
+/* wait until conn_fd has something or the deadline passes, then move whatever it has into the ring.
+ * returns the number of bytes read, 0 if the deadline passed, or -1 if the connection failed or closed */
+int rx_ring_fill(const struct timespec * const deadline) {
+    const unsigned int space = RX_RING_MASK - rx_ring_count(); /* one byte stays unused, so full != empty */
+    struct pollfd pfd;
+    struct iovec iov[2];
+    int iovcnt = 1;
+    int r;
+
+    if (conn_fd < 0)
+        return -1;
+
+    assert(space != 0);
+    iov[0].iov_base = rx_ring + rx_ring_head;
+    iov[0].iov_len = space;
+    if ((rx_ring_head + space) > sizeof(rx_ring)) {
+        iov[0].iov_len = sizeof(rx_ring) - rx_ring_head;
+        iov[1].iov_base = rx_ring;
+        iov[1].iov_len = space - iov[0].iov_len;
+        iovcnt = 2;
+    }
+
+    do {
+        pfd.fd = conn_fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+
+        r = poll(&pfd,1,deadline_ms(deadline));
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            return -1;
         }
-        if (rt == 0) break; /* EOF */
-        assert(rt <= sz);
-        p = (void*)((char*)p + rt);
-        sz -= rt;
-        rd += rt;
+        if (r == 0)
+            return 0;
+
+        r = (int)readv(conn_fd,iov,iovcnt);
+        if (r < 0) {
+            if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK) continue;
+            return -1;
+        }
+        if (r == 0)
+            return -1; /* EOF */
+
+        rx_ring_head = (rx_ring_head + (unsigned int)r) & RX_RING_MASK;
+        return r;
+    } while (1);
+}
+
+/* wait until the ring has at least count bytes. returns 1 if it does, 0 if the deadline passed, -1 on error */
+int rx_ring_wait(const unsigned int count,const struct timespec * const deadline) {
+    int r;
+
+    assert(count <= RX_RING_MASK);
+    while (rx_ring_count() < count) {
+        if ((r=rx_ring_fill(deadline)) <= 0)
+            return r;
     }
 
-    return rd;
+    return 1;
 }
 
 int write_persistent(const int fd,const void *p,int sz) {
+    struct pollfd pfd;
     int rd = 0;
     int rt;
 
     while (sz > 0) {
         rt = write(fd,p,sz);
         if (rt < 0) {
+            if (errno == EINTR)
+                continue;
             if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                /* non-blocking handling */
-                usleep(1000);
+                /* non-blocking handling: wait until it takes more */
+                pfd.fd = fd;
+                pfd.events = POLLOUT;
+                pfd.revents = 0;
+                if ((rt=poll(&pfd,1,5000/*ms*/)) == 0) {
+                    fprintf(stderr,"Write timeout\n");
+                    break;
+                }
+                if (rt < 0 && errno != EINTR)
+                    return rt;
+
                 continue;
             }
             return rt;
@@ -503,38 +626,48 @@ void reset_packet_io(void) {
     }
 }
 
-int do_recv_packet(struct remctl_serial_packet * const pkt) {
+enum {
+    RECV_OK=0,
+    RECV_TIMEOUT,       /* no packet started before the deadline */
+    RECV_SHORT,         /* a packet started, but the rest didn't come before the deadline */
+    RECV_CHECKSUM       /* a packet arrived with a bad checksum */
+};
+
+/* take the next packet out of the ring, reading more as needed until the deadline.
+ * returns RECV_OK etc, or -1 if the connection failed. */
+int recv_packet(struct remctl_serial_packet * const pkt,const struct timespec * const deadline) {
+    unsigned int count;
+    int r;
+
     if (conn_fd < 0)
         return -1;
 
+    /* hunt for the mark */
     do {
-        if (read_persistent(conn_fd,&(pkt->hdr.mark),1) != 1) {
-            reset_packet_io();
-            drop_connection();
-            return -1;
-        }
-    } while (pkt->hdr.mark != REMCTL_SERIAL_MARK);
+        while (rx_ring_count() != 0 && rx_ring_peek(0) != REMCTL_SERIAL_MARK)
+            rx_ring_skip(1);
+
+        if (rx_ring_count() != 0)
+            break;
+        if ((r=rx_ring_fill(deadline)) <= 0)
+            return r < 0 ? -1 : RECV_TIMEOUT;
+    } while (1);
 
     /* length is the first field after mark */
-    if (read_persistent(conn_fd,&(pkt->hdr.length),sizeof(pkt->hdr)-offsetof(struct remctl_serial_packet_header,length)) !=
-            (sizeof(pkt->hdr)-offsetof(struct remctl_serial_packet_header,length))) {
-        reset_packet_io();
-        drop_connection();
+    if ((r=rx_ring_wait(sizeof(pkt->hdr),deadline)) > 0)
+        r = rx_ring_wait(sizeof(pkt->hdr) + rx_ring_peek(offsetof(struct remctl_serial_packet_header,length)),deadline);
+
+    if (r < 0)
         return -1;
-    }
 
-    if (pkt->hdr.length != 0) {
-        if (read_persistent(conn_fd,pkt->data,pkt->hdr.length) != pkt->hdr.length) {
-            reset_packet_io();
-            drop_connection();
-            return -1;
-        }
+    /* a packet cut short, or a 0x01 that wasn't a mark. whatever follows may still be good */
+    if (r == 0) {
+        rx_ring_skip(1);
+        return RECV_SHORT;
     }
 
-    if (debug) {
-        fprintf(stderr,"Received packet:\n");
-        dump_packet(pkt);
-    }
+    count = sizeof(pkt->hdr) + rx_ring_peek(offsetof(struct remctl_serial_packet_header,length));
+    rx_ring_copy(pkt,count);
 
     {
         unsigned char sum = pkt->hdr.chksum;
@@ -544,12 +677,49 @@ int do_recv_packet(struct remctl_serial_packet * const pkt) {
             sum += pkt->data[i];
 
         if (sum != 0) {
-            fprintf(stderr,"Checksum failed\n");
-            drop_connection();
-            return -1;
+            /* same as above, the next mark may be inside what looked like this packet */
+            rx_ring_skip(1);
+            return RECV_CHECKSUM;
         }
     }
 
+    rx_ring_skip(count);
+
+    if (debug) {
+        fprintf(stderr,"Received packet:\n");
+        dump_packet(pkt);
+    }
+
+    return RECV_OK;
+}
+
+int do_recv_packet(struct remctl_serial_packet * const pkt) {
+    struct timespec deadline;
+    int r;
+
+    if (conn_fd < 0)
+        return -1;
+
+    deadline_set(&deadline,5000);
+
+    r = recv_packet(pkt,&deadline);
+    if (r == RECV_TIMEOUT || r == RECV_SHORT) {
+        fprintf(stderr,"Read timeout\n");
+        reset_packet_io();
+        drop_connection();
+        return -1;
+    }
+    else if (r == RECV_CHECKSUM) {
+        fprintf(stderr,"Checksum failed\n");
+        drop_connection();
+        return -1;
+    }
+    else if (r != RECV_OK) {
+        reset_packet_io();
+        drop_connection();
+        return -1;
+    }
+
     if (pkt->hdr.sequence == 0xFF)
         cur_pkt_recv_seq = 0xFF;
 
@@ -566,6 +736,37 @@ int do_recv_packet(struct remctl_serial_packet * const pkt) {
         cur_pkt_recv_seq = (pkt->hdr.sequence+1)&0x7F;
     }
 
+    /* the server still expects the sequence number of whatever it rejected, but
+     * a retry gets a new one. start over at 0xFF so the retry isn't rejected too */
+    if (pkt->hdr.type == REMCTL_SERIAL_TYPE_ERROR)
+        cur_pkt_seq = 0xFF;
+
+    return 0;
+}
+
+/* windowed mode receive. the sequence number is the caller's business, and a
+ * damaged packet is not the end of the connection.
+ * returns 0 if a packet arrived, 1 if nothing arrived within patience ms,
+ * 2 if the packet was damaged, or -1 if the connection failed. */
+int do_recv_window_packet(struct remctl_serial_packet * const pkt,const int patience) {
+    struct timespec deadline;
+    int r;
+
+    deadline_set(&deadline,patience);
+
+    r = recv_packet(pkt,&deadline);
+    if (r < 0) {
+        drop_connection();
+        return -1;
+    }
+    else if (r == RECV_TIMEOUT) {
+        return 1;
+    }
+    else if (r != RECV_OK) {
+        if (debug) fprintf(stderr,"Damaged packet\n");
+        return 2;
+    }
+
     return 0;
 }
 
@@ -1325,6 +1526,85 @@ retry:
     return 0;
 }
 
+/* after a failed request. the connection may have been dropped, and either way neither
+ * end can be sure which sequence number the other expects next. 0xFF starts over */
+int do_reconnect(void) {
+    fprintf(stderr,"\nReconnecting...\n");
+    cur_pkt_seq = 0xFF;
+    cur_pkt_recv_seq = 0xFF;
+    return do_connect();
+}
+
+/* the file requests below fail the same way for line noise and for an MS-DOS error.
+ * only the first is worth another try */
+static int msdos_error_reply(void) {
+    return cur_pkt.hdr.type == REMCTL_SERIAL_TYPE_FILE && cur_pkt.data[0] == REMCTL_SERIAL_TYPE_FILE_MSDOS_ERROR;
+}
+
+#define FILE_RETRIES 16
+
+/* open or create the file at the start of an upload or download */
+int do_file_begin(const char * const path,const int create) {
+    unsigned int tries;
+
+    for (tries=0;(create ? do_file_create(path) : do_file_open(path)) < 0;tries++) {
+        if (tries >= FILE_RETRIES || msdos_error_reply())
+            return -1;
+
+        do_reconnect();
+    }
+
+    return 0;
+}
+
+/* put the remote file pointer at offset, so that a failed read or write can be sent again */
+int do_file_resume(const unsigned long offset) {
+    unsigned long data;
+    unsigned int tries;
+
+    for (tries=0;do_file_seek(&data,offset,0/*SEEK_SET*/) < 0 || data != offset;tries++) {
+        if (tries >= FILE_RETRIES || msdos_error_reply()) {
+            fprintf(stderr,"Cannot resume at offset %lu\n",offset);
+            return -1;
+        }
+
+        do_reconnect();
+    }
+
+    return 0;
+}
+
+/* size of the open file. leaves the file pointer at 0 */
+int do_file_size(unsigned long * const size) {
+    unsigned int tries;
+
+    for (tries=0;do_file_seek(size,0,2/*SEEK_END*/) < 0;tries++) {
+        if (tries >= FILE_RETRIES || msdos_error_reply())
+            return -1;
+
+        do_reconnect();
+    }
+
+    return do_file_resume(0);
+}
+
+/* close at the end of an upload or download. if a close went through but the answer was
+ * lost, there is no open file left to close and the retry gets an MS-DOS error */
+int do_file_end(void) {
+    unsigned int tries;
+
+    for (tries=0;do_file_close() < 0;tries++) {
+        if (tries != 0 && msdos_error_reply())
+            break;
+        if (tries >= FILE_RETRIES)
+            return -1;
+
+        do_reconnect();
+    }
+
+    return 0;
+}
+
 unsigned char *do_file_read(int * const got_rd,const int do_rd) {
     if (do_rd > 188)
         return NULL;
@@ -1464,6 +1744,725 @@ retry:
     return 0;
 }
 
+/* after a packet taken with do_recv_window_packet(), do what do_recv_packet() would have done with the sequence number */
+void recv_seq_sync(const struct remctl_serial_packet * const pkt) {
+    if (pkt->hdr.sequence == 0xFF)
+        cur_pkt_recv_seq = 0;
+    else
+        cur_pkt_recv_seq = (pkt->hdr.sequence+1)&0x7F;
+}
+
+/* ask the server for windowed mode (see REMCTL_SERIAL_TYPE_WINDOW in proto.h), or
+ * with size == 0, go back to stop-and-wait.
+ * returns the window size granted (0 if the server only does stop-and-wait) or -1 on error */
+int do_window(const unsigned char size) {
+    int r;
+
+    /* the switch happens at sequence 0xFF both ways, so both ends start over from 0 */
+    cur_pkt_seq = 0xFF;
+
+    remctl_serial_packet_begin(&cur_pkt,REMCTL_SERIAL_TYPE_WINDOW);
+    cur_pkt.data[cur_pkt.hdr.length++] = size;
+    remctl_serial_packet_end(&cur_pkt);
+
+    if (do_send_packet(&cur_pkt) < 0) {
+        fprintf(stderr,"Failed to send packet\n");
+        return -1;
+    }
+
+    /* skip anything left over from windowed mode, answers to retransmits and the like */
+    do {
+        if ((r=do_recv_window_packet(&cur_pkt,5000)) == 0) {
+            if (cur_pkt.hdr.type == REMCTL_SERIAL_TYPE_WINDOW || cur_pkt.hdr.type == REMCTL_SERIAL_TYPE_ERROR)
+                break;
+        }
+        else if (r != 2) {
+            fprintf(stderr,"Failed to recv packet\n");
+            if (r > 0) reset_packet_io();
+            return -1;
+        }
+    } while (1);
+
+    recv_seq_sync(&cur_pkt);
+
+    /* older servers don't know the packet */
+    if (cur_pkt.hdr.type == REMCTL_SERIAL_TYPE_ERROR)
+        return 0;
+
+    return cur_pkt.data[0];
+}
+
+/* windowed transfer.
+ * requests must be safe to send more than once: whatever is not answered is sent again. */
+struct window_op {
+    /* build request #index, begin to end */
+    int         (*request)(struct remctl_serial_packet * const pkt,const unsigned long index,void * const user);
+    /* does the response answer the request? 0 = yes, 1 = ask again later (MS-DOS busy), -1 = failed */
+    int         (*check)(const struct remctl_serial_packet * const req,const struct remctl_serial_packet * const resp);
+    /* responses, in order */
+    int         (*response)(const struct remctl_serial_packet * const req,const struct remctl_serial_packet * const resp,
+                            const unsigned long index,void * const user);
+};
+
+enum {
+    WINDOW_SLOT_FREE=0,
+    WINDOW_SLOT_SENT,
+    WINDOW_SLOT_ANSWERED
+};
+
+struct window_slot {
+    struct remctl_serial_packet         req;
+    struct remctl_serial_packet         resp;
+    unsigned long                       sent;       /* when it was last sent, in packets sent */
+    unsigned int                        tries;
+    unsigned char                       state;
+};
+
+/* how many times a request is sent before giving up, and how many timeouts in a row */
+#define WINDOW_MAX_TRIES                16
+#define WINDOW_MAX_TIMEOUTS             8
+
+static int window_resend(struct window_slot * const s,unsigned long * const sent,const int count_try) {
+    if (count_try && ++s->tries >= WINDOW_MAX_TRIES) {
+        fprintf(stderr,"Too many retransmits\n");
+        return -1;
+    }
+
+    if (debug) fprintf(stderr,"Retransmit sequence %u\n",s->req.hdr.sequence);
+
+    s->sent = ++(*sent);
+    return do_send_packet(&s->req);
+}
+
+/* did the server see this sequence number, according to its ACK? */
+static int window_acked(const unsigned char seq,const unsigned char ack,const unsigned int rcvd) {
+    const unsigned char d = (seq - ack) & 0x7F;
+
+    if (d >= 0x40) return 1;                    /* before the cumulative ACK */
+    if (d < 16) return (rcvd >> d) & 1U;
+    return 0;
+}
+
+/* run count requests with up to window of them outstanding.
+ * returns how many were answered and handed to op->response(), in order. less than count on failure. */
+unsigned long do_window_transfer(const struct window_op * const op,const unsigned long count,const unsigned int window,void * const user) {
+    struct window_slot slots[REMCTL_SERIAL_WINDOW_MAX];
+    struct remctl_serial_packet pkt;
+    unsigned long next = 0,done = 0,sent = 0,i;
+    unsigned int timeouts = 0;
+    struct window_slot *s,*t;
+    int patience,r;
+
+    assert(window != 0 && window <= REMCTL_SERIAL_WINDOW_MAX);
+
+    /* long enough for a full window of the largest packets to cross the wire, and then some */
+    patience = 250 + (int)(((unsigned long)(window + 1U) * sizeof(pkt) * 10UL * 1000UL) / (unsigned long)baud_rate);
+
+    for (i=0;i < window;i++)
+        slots[i].state = WINDOW_SLOT_FREE;
+
+    while (done < count) {
+        /* keep the window full */
+        while (next < count && (next - done) < window) {
+            s = &slots[next % window];
+            if (op->request(&s->req,next,user) < 0)
+                return done;
+
+            s->state = WINDOW_SLOT_SENT;
+            s->sent = ++sent;
+            s->tries = 0;
+            if (do_send_packet(&s->req) < 0)
+                return done;
+
+            next++;
+        }
+
+        r = do_recv_window_packet(&pkt,patience);
+        if (r < 0) {
+            fprintf(stderr,"Failed to recv packet\n");
+            return done;
+        }
+        else if (r == 1) {
+            /* nothing for a while. the oldest request, or its answer, went missing */
+            if (++timeouts >= WINDOW_MAX_TIMEOUTS) {
+                fprintf(stderr,"Read timeout\n");
+                reset_packet_io();
+                return done;
+            }
+
+            s = NULL;
+            for (i=done;i < next;i++) {
+                t = &slots[i % window];
+                if (t->state == WINDOW_SLOT_SENT && (s == NULL || t->sent < s->sent))
+                    s = t;
+            }
+
+            if (s != NULL && window_resend(s,&sent,1) < 0)
+                return done;
+
+            continue;
+        }
+        else if (r == 2) {
+            /* damaged. a later answer or a timeout will tell us what to send again */
+            continue;
+        }
+
+        timeouts = 0;
+
+        if (pkt.hdr.type == REMCTL_SERIAL_TYPE_ACK) {
+            const unsigned int rcvd = pkt.data[1] + ((unsigned int)pkt.data[2] << 8U);
+
+            /* the server got a damaged packet. it answered everything it saw
+             * before that, so whatever it saw without an answer here was lost
+             * on the way back. the oldest one it did not see is the damaged one. */
+            s = NULL;
+            for (i=done;i < next;i++) {
+                t = &slots[i % window];
+                if (t->state != WINDOW_SLOT_SENT)
+                    continue;
+
+                if (window_acked(t->req.hdr.sequence,pkt.data[0],rcvd)) {
+                    if (window_resend(t,&sent,1) < 0)
+                        return done;
+                }
+                else if (s == NULL || t->sent < s->sent) {
+                    s = t;
+                }
+            }
+
+            if (s != NULL && window_resend(s,&sent,1) < 0)
+                return done;
+
+            continue;
+        }
+
+        /* which request does it answer? */
+        s = NULL;
+        for (i=done;i < next;i++) {
+            t = &slots[i % window];
+            if (t->state == WINDOW_SLOT_SENT && t->req.hdr.sequence == pkt.hdr.sequence) {
+                s = t;
+                break;
+            }
+        }
+
+        /* a second answer to something sent twice */
+        if (s == NULL)
+            continue;
+
+        if ((r=op->check(&s->req,&pkt)) < 0)
+            return done;
+        if (r > 0) {
+            usleep(10000);
+            if (window_resend(s,&sent,0) < 0)
+                return done;
+
+            continue;
+        }
+
+        memcpy(&s->resp,&pkt,sizeof(pkt.hdr)+pkt.hdr.length);
+        s->state = WINDOW_SLOT_ANSWERED;
+
+        /* requests are answered in the order they arrive. anything sent
+         * before this one that has no answer yet was lost one way or the other */
+        for (i=done;i < next;i++) {
+            t = &slots[i % window];
+            if (t->state == WINDOW_SLOT_SENT && t->sent < s->sent) {
+                if (window_resend(t,&sent,1) < 0)
+                    return done;
+            }
+        }
+
+        while (done < next && slots[done % window].state == WINDOW_SLOT_ANSWERED) {
+            s = &slots[done % window];
+            if (op->response(&s->req,&s->resp,done,user) < 0)
+                return done;
+
+            s->state = WINDOW_SLOT_FREE;
+            done++;
+        }
+    }
+
+    return done;
+}
+
+/* run count requests in windowed mode, if the server does it.
+ * returns how many were done, or -1 if windowed mode is not in use (anything left is the caller's to do the old way) */
+long do_windowed(const struct window_op * const op,const unsigned long count,void * const user) {
+    unsigned long done;
+    int w;
+
+    if (window_request <= 0 || count == 0UL)
+        return -1;
+    if ((w=do_window((unsigned char)window_request)) <= 0)
+        return -1;
+    if (w > REMCTL_SERIAL_WINDOW_MAX)
+        w = REMCTL_SERIAL_WINDOW_MAX;
+
+    done = do_window_transfer(op,count,(unsigned int)w,user);
+
+    /* and back to stop-and-wait for whatever comes next */
+    if (do_window(0) != 0) {
+        do_connect();
+        do_window(0);
+    }
+
+    return (long)done;
+}
+
+struct window_xfer {
+    int                                 fd;         /* local file */
+    long                                count;      /* bytes done, in order */
+    long                                size;       /* bytes total */
+    time_t                              next;       /* next progress report */
+};
+
+void print_progress(const char * const what,const long count,const long file_size,time_t * const next) {
+    time_t now = time(NULL);
+    unsigned long percent;
+
+    if (now < *next)
+        return;
+
+    percent = (count >> 7UL) * 100UL;
+    percent /= ((file_size + 127UL) >> 7UL);
+
+    *next = now + 1;
+    printf("\x0D" "%s, %lu%% %lu / %lu... ",
+        what,percent,count,file_size);
+    fflush(stdout);
+}
+
+static int file_window_check(const struct remctl_serial_packet * const req,const struct remctl_serial_packet * const resp) {
+    if (resp->hdr.type == REMCTL_SERIAL_TYPE_FILE &&
+        resp->data[0] == REMCTL_SERIAL_TYPE_FILE_MSDOS_IS_BUSY) {
+        fprintf(stderr,"MS-DOS is busy...\n");
+        return 1;
+    }
+
+    if (resp->hdr.type == REMCTL_SERIAL_TYPE_FILE &&
+        resp->data[0] == REMCTL_SERIAL_TYPE_FILE_MSDOS_ERROR) {
+        fprintf(stderr,"MS-DOS returned an error\n");
+        return -1;
+    }
+
+    /* opcode and offset */
+    if (resp->hdr.type != REMCTL_SERIAL_TYPE_FILE || resp->hdr.length < 6 ||
+        resp->data[0] != req->data[0] || memcmp(resp->data+2,req->data+2,4) != 0) {
+        fprintf(stderr,"I/O failed, mismatched response\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+static void file_window_request(struct remctl_serial_packet * const pkt,const unsigned char op,const unsigned long offset,const unsigned char len) {
+    remctl_serial_packet_begin(pkt,REMCTL_SERIAL_TYPE_FILE);
+
+    pkt->data[pkt->hdr.length++] = op;
+    pkt->data[pkt->hdr.length++] = len;
+    pkt->data[pkt->hdr.length++] = (unsigned char)(offset >> 0UL);
+    pkt->data[pkt->hdr.length++] = (unsigned char)(offset >> 8UL);
+    pkt->data[pkt->hdr.length++] = (unsigned char)(offset >> 16UL);
+    pkt->data[pkt->hdr.length++] = (unsigned char)(offset >> 24UL);
+}
+
+static int download_window_request(struct remctl_serial_packet * const pkt,const unsigned long index,void * const user) {
+    const struct window_xfer * const x = (const struct window_xfer*)user;
+    const long offset = (long)index * 188L;
+
+    file_window_request(pkt,REMCTL_SERIAL_TYPE_FILE_READ_AT,offset,(x->size - offset) > 188L ? 188 : (unsigned char)(x->size - offset));
+    remctl_serial_packet_end(pkt);
+    return 0;
+}
+
+static int download_window_check(const struct remctl_serial_packet * const req,const struct remctl_serial_packet * const resp) {
+    int r;
+
+    if ((r=file_window_check(req,resp)) != 0)
+        return r;
+
+    if (resp->data[1] != req->data[1] || resp->hdr.length != (6 + resp->data[1])) {
+        fprintf(stderr,"Unexpected end of file\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+static int download_window_response(const struct remctl_serial_packet * const req,const struct remctl_serial_packet * const resp,
+                                    const unsigned long index,void * const user) {
+    struct window_xfer * const x = (struct window_xfer*)user;
+
+    (void)req;
+    (void)index;
+
+    if (write(x->fd,resp->data+6,resp->data[1]) != resp->data[1])
+        return -1;
+
+    x->count += resp->data[1];
+    print_progress("Download",x->count,x->size,&x->next);
+    return 0;
+}
+
+static const struct window_op download_window_op = {
+    download_window_request,
+    download_window_check,
+    download_window_response
+};
+
+static int upload_window_request(struct remctl_serial_packet * const pkt,const unsigned long index,void * const user) {
+    const struct window_xfer * const x = (const struct window_xfer*)user;
+    const long offset = (long)index * 188L;
+    const int len = (x->size - offset) > 188L ? 188 : (int)(x->size - offset);
+
+    file_window_request(pkt,REMCTL_SERIAL_TYPE_FILE_WRITE_AT,offset,len);
+    if (pread(x->fd,pkt->data+pkt->hdr.length,len,offset) != len)
+        return -1;
+
+    pkt->hdr.length += len;
+    remctl_serial_packet_end(pkt);
+    return 0;
+}
+
+static int upload_window_response(const struct remctl_serial_packet * const req,const struct remctl_serial_packet * const resp,
+                                  const unsigned long index,void * const user) {
+    struct window_xfer * const x = (struct window_xfer*)user;
+
+    (void)index;
+
+    if (resp->data[1] < req->data[1]) {
+        fprintf(stderr,"Remote end incomplete write\n");
+        return -1;
+    }
+
+    x->count += req->data[1];
+    print_progress("Uploading",x->count,x->size,&x->next);
+    return 0;
+}
+
+static const struct window_op upload_window_op = {
+    upload_window_request,
+    file_window_check,
+    upload_window_response
+};
+
+static int memdump_window_request(struct remctl_serial_packet * const pkt,const unsigned long index,void * const user) {
+    const struct window_xfer * const x = (const struct window_xfer*)user;
+    const long offset = (long)index * 192L;
+    const unsigned long addr = memaddr + (unsigned long)offset;
+
+    remctl_serial_packet_begin(pkt,REMCTL_SERIAL_TYPE_MEMREAD);
+
+    pkt->data[pkt->hdr.length++] = (unsigned char)( addr & 0xFF);
+    pkt->data[pkt->hdr.length++] = (unsigned char)((addr >> 8UL) & 0xFF);
+    pkt->data[pkt->hdr.length++] = (unsigned char)((addr >> 16UL) & 0xFF);
+    pkt->data[pkt->hdr.length++] = (unsigned char)((addr >> 24UL) & 0xFF);
+    pkt->data[pkt->hdr.length++] = (x->size - offset) > 192L ? 192 : (unsigned char)(x->size - offset);
+
+    remctl_serial_packet_end(pkt);
+    return 0;
+}
+
+static int memdump_window_check(const struct remctl_serial_packet * const req,const struct remctl_serial_packet * const resp) {
+    /* address and size */
+    if (resp->hdr.type != REMCTL_SERIAL_TYPE_MEMREAD || resp->hdr.length != (5 + req->data[4]) ||
+        memcmp(resp->data,req->data,5) != 0) {
+        fprintf(stderr,"I/O read failed\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+static int memdump_window_response(const struct remctl_serial_packet * const req,const struct remctl_serial_packet * const resp,
+                                   const unsigned long index,void * const user) {
+    struct window_xfer * const x = (struct window_xfer*)user;
+
+    (void)req;
+    (void)index;
+
+    printf("\x0D" "Reading 0x%08lX + %u bytes",memaddr + (unsigned long)x->count,resp->data[4]);
+    fflush(stdout);
+
+    if (write(x->fd,resp->data+5,resp->data[4]) != resp->data[4])
+        return -1;
+
+    x->count += resp->data[4];
+    return 0;
+}
+
+static const struct window_op memdump_window_op = {
+    memdump_window_request,
+    memdump_window_check,
+    memdump_window_response
+};
+
+/* streaming (see REMCTL_SERIAL_TYPE_STREAM in proto.h) */
+struct stream_xfer {
+    int                                 fd;         /* local file, written with pwrite() at the frame's offset */
+    off_t                               fd_base;    /* where the range starts in the local file */
+    unsigned long                       length;     /* bytes in the range, less if the server says it ended early */
+    unsigned long                       count;      /* bytes received */
+    unsigned long                       expect;     /* offset of the frame expected next, in the server's order */
+    unsigned char*                      have;       /* one per frame, nonzero if received */
+    const char*                         what;
+    time_t                              next;       /* next progress report */
+};
+
+/* how many times in a row nothing arrives before giving up, and NAKs sent at once.
+ * the server remembers 8 NAKs, anything more is sent again later */
+#define STREAM_MAX_TIMEOUTS             8
+#define STREAM_NAK_BURST                8
+
+/* send a stream request with sequence 0xFF, so a damaged one doesn't throw off sequencing */
+static int stream_send(const unsigned char op,const unsigned long a,const unsigned long b,const int with_b) {
+    struct remctl_serial_packet pkt;
+
+    cur_pkt_seq = 0xFF;
+    remctl_serial_packet_begin(&pkt,REMCTL_SERIAL_TYPE_STREAM);
+
+    pkt.data[pkt.hdr.length++] = op;
+    pkt.data[pkt.hdr.length++] = (unsigned char)(a >> 0UL);
+    pkt.data[pkt.hdr.length++] = (unsigned char)(a >> 8UL);
+    pkt.data[pkt.hdr.length++] = (unsigned char)(a >> 16UL);
+    pkt.data[pkt.hdr.length++] = (unsigned char)(a >> 24UL);
+    if (with_b) {
+        pkt.data[pkt.hdr.length++] = (unsigned char)(b >> 0UL);
+        pkt.data[pkt.hdr.length++] = (unsigned char)(b >> 8UL);
+        pkt.data[pkt.hdr.length++] = (unsigned char)(b >> 16UL);
+        pkt.data[pkt.hdr.length++] = (unsigned char)(b >> 24UL);
+    }
+
+    remctl_serial_packet_end(&pkt);
+    return do_send_packet(&pkt);
+}
+
+/* send a stream request and wait for the answer, skipping any frames still on the way.
+ * returns 0 if the server did it, 1 if the server doesn't know streaming or refused, -1 on error */
+static int stream_control(const unsigned char op,const unsigned long a,const unsigned long b) {
+    unsigned int tries = 0;
+    int r;
+
+    if (stream_send(op,a,b,1) < 0)
+        return -1;
+
+    do {
+        if ((r=do_recv_window_packet(&cur_pkt,1000)) == 1 ||
+            (r == 0 && cur_pkt.hdr.type == REMCTL_SERIAL_TYPE_ERROR && op == REMCTL_SERIAL_TYPE_STREAM_END)) {
+            /* lost one way or the other. both requests are safe to send again */
+            if (++tries >= 5) {
+                fprintf(stderr,"Read timeout\n");
+                reset_packet_io();
+                return -1;
+            }
+
+            if (stream_send(op,a,b,1) < 0)
+                return -1;
+
+            continue;
+        }
+        else if (r < 0) {
+            fprintf(stderr,"Failed to recv packet\n");
+            return -1;
+        }
+        else if (r == 2) {
+            continue;
+        }
+
+        /* older servers don't know the packet */
+        if (cur_pkt.hdr.type == REMCTL_SERIAL_TYPE_ERROR) {
+            recv_seq_sync(&cur_pkt);
+            return 1;
+        }
+
+        /* frames are told apart by data[0] (DATA or DONE) */
+        if (cur_pkt.hdr.type == REMCTL_SERIAL_TYPE_STREAM &&
+            (cur_pkt.data[0] == op || cur_pkt.data[0] == REMCTL_SERIAL_TYPE_FILE_MSDOS_ERROR)) {
+            recv_seq_sync(&cur_pkt);
+            if (cur_pkt.data[0] == REMCTL_SERIAL_TYPE_FILE_MSDOS_ERROR) {
+                fprintf(stderr,"Server refused to stream\n");
+                return 1;
+            }
+
+            return 0;
+        }
+    } while (1);
+}
+
+static unsigned long stream_frame_size(const struct stream_xfer * const x,const unsigned long offset) {
+    return (x->length - offset) > REMCTL_SERIAL_STREAM_FRAME ? REMCTL_SERIAL_STREAM_FRAME : (x->length - offset);
+}
+
+/* NAK up to STREAM_NAK_BURST missing frames from offset from up to offset to */
+static int stream_nak_missing(const struct stream_xfer * const x,unsigned long from,unsigned long to) {
+    unsigned int naks = 0;
+
+    if (to > x->length)
+        to = x->length;
+
+    for (;from < to && naks < STREAM_NAK_BURST;from += REMCTL_SERIAL_STREAM_FRAME) {
+        if (x->have[from / REMCTL_SERIAL_STREAM_FRAME])
+            continue;
+
+        if (debug) fprintf(stderr,"NAK offset %lu\n",from);
+        if (stream_send(REMCTL_SERIAL_TYPE_STREAM_NAK,from,0,0) < 0)
+            return -1;
+
+        naks++;
+    }
+
+    return 0;
+}
+
+/* take frames until the whole range is here. returns 0 if it is, -1 if not */
+static int stream_receive(struct stream_xfer * const x) {
+    struct remctl_serial_packet pkt;
+    unsigned int timeouts = 0;
+    unsigned long offset,n;
+    unsigned short crc;
+    int patience,r;
+
+    /* long enough for a few of the largest frames to cross the wire, and then some */
+    patience = 250 + (int)((4UL * sizeof(pkt) * 10UL * 1000UL) / (unsigned long)baud_rate);
+
+    while (x->count < x->length) {
+        r = do_recv_window_packet(&pkt,patience);
+        if (r < 0) {
+            fprintf(stderr,"Failed to recv packet\n");
+            return -1;
+        }
+        else if (r == 1) {
+            /* nothing for a while. the end of the stream, or the NAKs, went missing */
+            if (++timeouts >= STREAM_MAX_TIMEOUTS) {
+                fprintf(stderr,"Read timeout\n");
+                return -1;
+            }
+
+            if (stream_nak_missing(x,0,x->length) < 0)
+                return -1;
+
+            continue;
+        }
+        else if (r == 2) {
+            /* damaged. the gap it leaves will tell us what to NAK */
+            continue;
+        }
+
+        /* anything else is an answer to a damaged NAK */
+        if (pkt.hdr.type != REMCTL_SERIAL_TYPE_STREAM || pkt.hdr.length < 7 ||
+            (pkt.data[0] != REMCTL_SERIAL_TYPE_STREAM_DATA && pkt.data[0] != REMCTL_SERIAL_TYPE_STREAM_DONE))
+            continue;
+
+        crc = remctl_crc16_update(REMCTL_CRC16_INIT,pkt.data,pkt.hdr.length - 2U);
+        if (pkt.data[pkt.hdr.length - 2U] != (unsigned char)(crc >> 8U) ||
+            pkt.data[pkt.hdr.length - 1U] != (unsigned char)(crc >> 0U)) {
+            if (debug) fprintf(stderr,"Stream frame CRC failed\n");
+            continue;
+        }
+
+        timeouts = 0;
+        n = pkt.hdr.length - 7U;
+        offset =
+            ((unsigned long)pkt.data[1] << 0UL) +
+            ((unsigned long)pkt.data[2] << 8UL) +
+            ((unsigned long)pkt.data[3] << 16UL) +
+            ((unsigned long)pkt.data[4] << 24UL);
+
+        if (pkt.data[0] == REMCTL_SERIAL_TYPE_STREAM_DONE) {
+            if (offset < x->length) {
+                /* the file ended early. nothing was sent past this point */
+                x->length = offset;
+                if (x->expect > offset)
+                    x->expect = offset;
+            }
+
+            /* whatever is missing now is not coming without a NAK */
+            if (stream_nak_missing(x,0,x->length) < 0)
+                return -1;
+
+            continue;
+        }
+
+        if ((offset % REMCTL_SERIAL_STREAM_FRAME) != 0 ||
+            offset >= x->length || n == 0 || n > stream_frame_size(x,offset)) {
+            fprintf(stderr,"Unexpected stream frame\n");
+            return -1;
+        }
+
+        /* a short frame is the end of the file */
+        if (n < stream_frame_size(x,offset))
+            x->length = offset + n;
+
+        if (!x->have[offset / REMCTL_SERIAL_STREAM_FRAME]) {
+            if (pwrite(x->fd,pkt.data+5,n,x->fd_base + (off_t)offset) != (ssize_t)n)
+                return -1;
+
+            x->have[offset / REMCTL_SERIAL_STREAM_FRAME] = 1;
+            x->count += n;
+        }
+
+        /* the server sends in order, except what we NAKed. a gap is what got lost */
+        if (offset >= x->expect) {
+            if (stream_nak_missing(x,x->expect,offset) < 0)
+                return -1;
+
+            x->expect = offset + n;
+        }
+
+        print_progress(x->what,(long)x->count,(long)x->length,&x->next);
+    }
+
+    return 0;
+}
+
+/* have the server stream a range into local file fd, starting at its current position.
+ * returns how many bytes at the start of the range made it, in order, with the file
+ * position just past them, or -1 if the server doesn't stream */
+long do_streamed(const unsigned char op,const unsigned long base,const unsigned long length,const int fd,const char * const what) {
+    struct stream_xfer x;
+    unsigned long i;
+    off_t start;
+    int r;
+
+    if (!stream_request || length == 0UL)
+        return -1;
+
+    if ((start=lseek(fd,0,SEEK_CUR)) < 0)
+        return -1;
+
+    if ((r=stream_control(op,base,length)) != 0) {
+        if (r < 0) do_connect();
+        return -1;
+    }
+
+    memset(&x,0,sizeof(x));
+    x.fd = fd;
+    x.fd_base = start;
+    x.length = length;
+    x.what = what;
+    x.have = calloc((length + REMCTL_SERIAL_STREAM_FRAME - 1UL) / REMCTL_SERIAL_STREAM_FRAME,1);
+    if (x.have == NULL) {
+        stream_control(REMCTL_SERIAL_TYPE_STREAM_END,0,0);
+        return -1;
+    }
+
+    stream_receive(&x);
+
+    if (stream_control(REMCTL_SERIAL_TYPE_STREAM_END,0,0) != 0) {
+        do_connect();
+        if (conn_fd >= 0) stream_control(REMCTL_SERIAL_TYPE_STREAM_END,0,0);
+    }
+
+    /* what made it in order. whatever follows is the caller's to do another way */
+    for (i=0;i < x.length && x.have[i / REMCTL_SERIAL_STREAM_FRAME];i += REMCTL_SERIAL_STREAM_FRAME);
+    if (i > x.length) i = x.length;
+    free(x.have);
+
+    lseek(fd,start + (off_t)i,SEEK_SET);
+    return (long)i;
+}
+
 void do_print_dir(void) {
     /* the contents are a MS-DOS FileInfoRec */
     unsigned char *p = cur_pkt.data + 1;
@@ -1649,12 +2648,17 @@ int main(int argc,char **argv) {
 
         printf("Wrtie OK: %lu bytes\n",memsz);
     }
-    else if (!strcmp(command,"memdump")) {
+    else if (!strcmp(command,"memdump") || !strcmp(command,"snapshot")) {
         const unsigned char *ptr;
         unsigned long addr;
+        long done;
         int do_read;
         int fd;
 
+        /* snapshot: the whole real mode address space, unless told otherwise */
+        if (!strcmp(command,"snapshot") && memsz < 0)
+            memsz = 0x100000L - (long)memaddr;
+
         if (output_file == NULL)
             return 1;
         if (memsz <= 0)
@@ -1666,7 +2670,18 @@ int main(int argc,char **argv) {
             return 1;
         }
 
-        addr = memaddr;
+        if ((done=do_streamed(REMCTL_SERIAL_TYPE_STREAM_MEMORY,memaddr,(unsigned long)memsz,fd,"Reading")) >= 0) {
+            addr = memaddr + (unsigned long)done;
+            memsz -= done;
+        }
+        else {
+            struct window_xfer x = { fd, 0L, memsz, 0 };
+
+            do_windowed(&memdump_window_op,(unsigned long)((memsz + 191L) / 192L),&x);
+            addr = memaddr + (unsigned long)x.count;
+            memsz -= x.count;
+        }
+
         while (memsz > 0) {
             if (memsz > 192)
                 do_read = 192;
@@ -1677,8 +2692,7 @@ int main(int argc,char **argv) {
             fflush(stdout);
 
             if ((ptr=do_memread(do_read,addr)) == NULL) {
-                fprintf(stderr,"\nReconnecting...\n");
-                do_connect();
+                do_reconnect();
                 continue;
             }
             if (write(fd,ptr,do_read) != do_read)
@@ -1886,7 +2900,7 @@ int main(int argc,char **argv) {
         unsigned char tmp[256];
         long file_size,count;
         int ifd,rwd,wd,doc;
-        time_t now,next;
+        time_t next;
 
         next = 0;
 
@@ -1911,24 +2925,28 @@ int main(int argc,char **argv) {
         }
         lseek(ifd,0,SEEK_SET);
 
-        if (do_file_create(memstr) < 0)
+        if (do_file_begin(memstr,1/*create*/) < 0)
             return 1;
 
         count = 0L;
-        while (count < file_size) {
-            now = time(NULL);
-            if (now >= next) {
-                unsigned long percent;
-
-                percent = (count >> 7UL) * 100UL;
-                percent /= ((file_size + 127UL) >> 7UL);
+        {
+            struct window_xfer x = { ifd, 0L, file_size, 0 };
 
-                next = now + 1;
-                printf("\x0D" "Uploading, %lu%% %lu / %lu... ",
-                    percent,count,file_size);
-                fflush(stdout);
+            if (do_windowed(&upload_window_op,(unsigned long)((file_size + 187L) / 188L),&x) >= 0 && x.count < file_size) {
+                /* windowed mode gave up partway. carry on from there the old way */
+                if (lseek(ifd,x.count,SEEK_SET) != x.count)
+                    return 1;
+                if (do_file_resume((unsigned long)x.count) < 0)
+                    return 1;
             }
 
+            count = x.count;
+            next = x.next;
+        }
+
+        while (count < file_size) {
+            print_progress("Uploading",count,file_size,&next);
+
             if ((file_size - count) > 188)
                 doc = 188;
             else
@@ -1939,13 +2957,12 @@ int main(int argc,char **argv) {
             if (wd == 0) break;
 
             if ((rwd=do_file_write(tmp,wd)) < 0) {
-                fprintf(stderr,"\nReconnecting...\n");
-                do_connect(); /* retry */
+                do_reconnect(); /* retry */
 
                 /* now, where were we...? */
                 if (lseek(ifd,count,SEEK_SET) != count)
                     return 1;
-                if (do_file_seek(&data,count,0/*SEEK_SET*/) < 0 || (unsigned long)data != (unsigned long)count)
+                if (do_file_resume((unsigned long)count) < 0)
                     return 1;
 
                 continue;
@@ -1959,7 +2976,7 @@ int main(int argc,char **argv) {
             count += wd;
         }
 
-        if (do_file_close() < 0)
+        if (do_file_end() < 0)
             return 1;
 
         if (count != file_size) {
@@ -1975,7 +2992,7 @@ int main(int argc,char **argv) {
         long file_size,count;
         unsigned char *str;
         int ofd,rwd,wd,doc;
-        time_t now,next;
+        time_t next;
 
         next = 0;
 
@@ -1994,31 +3011,35 @@ int main(int argc,char **argv) {
             return 1;
         }
 
-        if (do_file_open(memstr) < 0)
+        if (do_file_begin(memstr,0/*open*/) < 0)
             return 1;
 
-        if (do_file_seek(&data,0,2/*SEEK_END*/) < 0)
+        if (do_file_size(&data) < 0)
             return 1;
 
         count = 0L;
         file_size = data;
 
-        if (do_file_seek(&data,0,0/*SEEK_SET*/) < 0)
-            return 1;
+        if ((count=do_streamed(REMCTL_SERIAL_TYPE_STREAM_FILE,0,(unsigned long)file_size,ofd,"Download")) >= 0) {
+            /* streaming gave up partway. carry on from there the old way */
+            if (count < file_size && do_file_resume((unsigned long)count) < 0)
+                return 1;
+        }
+        else {
+            struct window_xfer x = { ofd, 0L, file_size, 0 };
 
-        while (count < file_size) {
-            now = time(NULL);
-            if (now >= next) {
-                unsigned long percent;
+            if (do_windowed(&download_window_op,(unsigned long)((file_size + 187L) / 188L),&x) >= 0 && x.count < file_size) {
+                /* windowed mode gave up partway. carry on from there the old way */
+                if (do_file_resume((unsigned long)x.count) < 0)
+                    return 1;
+            }
 
-                percent = (count >> 7UL) * 100UL;
-                percent /= ((file_size + 127UL) >> 7UL);
+            count = x.count;
+            next = x.next;
+        }
 
-                next = now + 1;
-                printf("\x0D" "Download, %lu%% %lu / %lu... ",
-                    percent,count,file_size);
-                fflush(stdout);
-            }
+        while (count < file_size) {
+            print_progress("Download",count,file_size,&next);
 
             if ((file_size - count) > 188)
                 doc = 188;
@@ -2027,11 +3048,10 @@ int main(int argc,char **argv) {
 
             assert(doc != 0);
             if ((str=do_file_read(&wd,doc)) == NULL) {
-                fprintf(stderr,"\nReconnecting...\n");
-                do_connect(); /* retry */
+                do_reconnect(); /* retry */
 
                 /* now, where were we...? */
-                if (do_file_seek(&data,count,0/*SEEK_SET*/) < 0 || (unsigned long)data != (unsigned long)count)
+                if (do_file_resume((unsigned long)count) < 0)
                     return 1;
 
                 continue;
@@ -2054,7 +3074,7 @@ int main(int argc,char **argv) {
             count += wd;
         }
 
-        if (do_file_close() < 0)
+        if (do_file_end() < 0)
             return 1;
 
         if (count != file_size) {
@@ -0,0 +1,1488 @@
+
+/* remsim: the REMSRV.EXE side of the protocol, on Linux.
+ *
+ * Answers remctlclient over TCP (like DOSBox's nullmodem) or a pty, with a
+ * fake 1MB+64KB address space and a host directory standing in for the DOS
+ * filesystem. The serial line can be slowed to a baud rate, given a
+ * turnaround delay and made to flip bits, so protocol changes can be
+ * measured without DOS hardware (see bench.sh).
+ *
+ * The packet handling follows remsrv.c as closely as it can: one packet in,
+ * one packet out, sequence numbers, windowed mode and streaming work the same. */
+
+#define _GNU_SOURCE /* posix_openpt() and friends */
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+#include <dirent.h>
+#include <strings.h>
+#include <termios.h>
+#include <ctype.h>
+#include <signal.h>
+#include <limits.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <poll.h>
+#include <time.h>
+
+#include "proto.h"
+#include "crc16.h"
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+static int                              listen_port = 2323;
+static int                              use_pty = 0;
+static char*                            pty_link = NULL;
+static char*                            root_dir = ".";
+static char*                            mem_file = NULL;
+static unsigned long                    baud_rate = 0;              // 0 = as fast as the host goes
+static unsigned long                    latency_ms = 0;             // turnaround, from a request arriving to its answer starting
+static double                           bit_error_rate = 0;         // chance of any one bit flipping, both directions
+static unsigned long                    seed = 1;
+static int                              verbose = 0;
+
+static int                              conn_fd = -1;
+static int                              listen_fd = -1;
+
+/* the fake machine */
+#define MEM_SIZE                        0x110000UL                  // 1MB + the HMA, like real mode with A20 on
+static unsigned char*                   mem = NULL;
+static unsigned char                    halt_system = 0;
+static char                             root_path[PATH_MAX];
+static char                             dos_cwd[128] = "";          // relative to the root, backslashes, no leading backslash
+static int                              open_file_fd = -1;
+
+/* where the fake List of Lists and InDOS flag are */
+#define FAKE_LOL_SEG                    0x00C9
+#define FAKE_LOL_OFF                    0x0026
+#define FAKE_INDOS_SEG                  0x00C9
+#define FAKE_INDOS_OFF                  0x0321
+
+/* the same state remsrv.c keeps */
+static struct remctl_serial_packet      cur_pkt_in;
+static unsigned int                     cur_pkt_in_write = 0;
+static unsigned char                    cur_pkt_in_seq = 0xFF;
+
+static struct remctl_serial_packet      cur_pkt_out;
+static unsigned int                     cur_pkt_out_write = 0;
+static unsigned char                    cur_pkt_out_seq = 0xFF;
+
+static unsigned char                    window_size = 0;
+static unsigned char                    window_ack = 0;
+static unsigned int                     window_rcvd = 0;
+#define WINDOW_MAX                      4
+static struct remctl_serial_packet      window_reply[WINDOW_MAX];
+
+/* remsrv.c counts timer ticks, this counts real time */
+#define CLIENT_IDLE_US                  5000000ULL
+static uint64_t                         client_last = 0;            // when the last packet arrived or stream frame went out
+
+#define STREAM_NAK_MAX                  8
+static unsigned char                    stream_mode = 0;
+static unsigned char                    stream_done_sent = 0;
+static unsigned long                    stream_base = 0;
+static unsigned long                    stream_length = 0;
+static unsigned long                    stream_next = 0;
+static unsigned long                    stream_nak[STREAM_NAK_MAX];
+static unsigned char                    stream_nak_count = 0;
+#define STREAM_IDLE_FRAMES              64
+
+/* the line. received bytes wait in rx_q until the baud rate says they are
+ * all here, sent bytes leave no faster than the baud rate allows. times are in us. */
+struct rx_byte {
+    uint64_t                            t;
+    unsigned char                       c;
+};
+
+static struct rx_byte*                  rx_q = NULL;
+static size_t                           rx_q_head = 0,rx_q_tail = 0,rx_q_alloc = 0;
+static uint64_t                         rx_last = 0;                // when the last received byte finished arriving
+static uint64_t                         tx_next = 0;                // when the next byte can start going out
+static uint64_t                         out_ready = 0;              // when cur_pkt_out may start going out
+
+/* statistics */
+static unsigned long long               stat_rx_bytes = 0,stat_tx_bytes = 0,stat_rx_flips = 0,stat_tx_flips = 0;
+static unsigned long long               stat_packets = 0,stat_bad_packets = 0,stat_frames = 0;
+
+static void help(void) {
+    fprintf(stderr,"remsim [options]\n");
+    fprintf(stderr,"Simulates the REMSRV.EXE end of remctl for remctlclient.\n");
+    fprintf(stderr,"  -h --help         Show this help\n");
+    fprintf(stderr,"  -p <N>            Listen on localhost port N (default 2323), use remctlclient -l -p N\n");
+    fprintf(stderr,"  -pty [link]       Use a pty instead, optionally symlinked as [link]\n");
+    fprintf(stderr,"  -root <dir>       Directory that is drive C: (default .)\n");
+    fprintf(stderr,"  -mem <file>       Initial memory contents (default: a pattern)\n");
+    fprintf(stderr,"  -b <rate>         Pace the line at this baud rate, 8N1 (default: unpaced)\n");
+    fprintf(stderr,"  -latency <ms>     Delay before answering each packet\n");
+    fprintf(stderr,"  -ber <rate>       Bit error rate, e.g. 1e-5, both directions\n");
+    fprintf(stderr,"  -seed <n>         Random seed for bit errors\n");
+    fprintf(stderr,"  -v                Verbose\n");
+}
+
+static int parse_argv(int argc,char **argv) {
+    char *a;
+    int i=1;
+
+    while (i < argc) {
+        a = argv[i++];
+
+        if (*a == '-') {
+            do { a++; } while (*a == '-');
+
+            if (!strcmp(a,"h") || !strcmp(a,"help")) {
+                help();
+                return 1;
+            }
+            else if (!strcmp(a,"p")) {
+                a = argv[i++];
+                if (a == NULL) return 1;
+                listen_port = atoi(a);
+            }
+            else if (!strcmp(a,"pty")) {
+                use_pty = 1;
+                if (i < argc && argv[i][0] != '-')
+                    pty_link = argv[i++];
+            }
+            else if (!strcmp(a,"root")) {
+                a = argv[i++];
+                if (a == NULL) return 1;
+                root_dir = a;
+            }
+            else if (!strcmp(a,"mem")) {
+                a = argv[i++];
+                if (a == NULL) return 1;
+                mem_file = a;
+            }
+            else if (!strcmp(a,"b")) {
+                a = argv[i++];
+                if (a == NULL) return 1;
+                baud_rate = strtoul(a,NULL,0);
+            }
+            else if (!strcmp(a,"latency")) {
+                a = argv[i++];
+                if (a == NULL) return 1;
+                latency_ms = strtoul(a,NULL,0);
+            }
+            else if (!strcmp(a,"ber")) {
+                a = argv[i++];
+                if (a == NULL) return 1;
+                bit_error_rate = strtod(a,NULL);
+            }
+            else if (!strcmp(a,"seed")) {
+                a = argv[i++];
+                if (a == NULL) return 1;
+                seed = strtoul(a,NULL,0);
+            }
+            else if (!strcmp(a,"v")) {
+                verbose = 1;
+            }
+            else {
+                fprintf(stderr,"Unknown switch %s\n",a);
+                return 1;
+            }
+        }
+        else {
+            fprintf(stderr,"Unexpected argv\n");
+            return 1;
+        }
+    }
+
+    if (listen_port < 1 || listen_port > 65534) {
+        fprintf(stderr,"Invalid port\n");
+        return 1;
+    }
+
+    return 0;
+}
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return ((uint64_t)ts.tv_sec * 1000000ULL) + ((uint64_t)ts.tv_nsec / 1000ULL);
+}
+
+/* 8N1: 10 bits per byte */
+static uint64_t byte_time_us(void) {
+    if (baud_rate == 0)
+        return 0;
+
+    return (10ULL * 1000000ULL) / baud_rate;
+}
+
+static uint64_t stream_idle_us(void) {
+    const uint64_t t = (uint64_t)STREAM_IDLE_FRAMES * sizeof(struct remctl_serial_packet) * byte_time_us();
+
+    return (t > 1000000ULL) ? t : 1000000ULL;
+}
+
+/* flip bits at the bit error rate. returns the number flipped */
+static unsigned int line_noise(unsigned char * const c) {
+    unsigned int flips = 0,b;
+
+    if (bit_error_rate <= 0)
+        return 0;
+
+    for (b=0;b < 8;b++) {
+        if (drand48() < bit_error_rate) {
+            *c ^= 1U << b;
+            flips++;
+        }
+    }
+
+    return flips;
+}
+
+/*----------------------------------------------------------------------------*/
+/* the fake DOS filesystem */
+
+/* MS-DOS path to host path. drive letters are ignored, everything is C:.
+ * each component is matched case insensitively against what exists.
+ * returns 0 if OK, -1 if the path is bad */
+static int dos_to_host_path(char * const out,const size_t outsz,const char *dos) {
+    char comp[PATH_MAX];
+    char tmp[PATH_MAX];
+    char rel[PATH_MAX];
+    const char *s;
+    size_t rl = 0;
+    char *d;
+
+    if (isalpha((unsigned char)dos[0]) && dos[1] == ':')
+        dos += 2;
+
+    /* relative paths start from the current directory */
+    rel[0] = 0;
+    if (*dos != '\\' && *dos != '/') {
+        snprintf(rel,sizeof(rel),"%s",dos_cwd);
+        rl = strlen(rel);
+        if (rl != 0 && rl < (sizeof(rel)-1)) {
+            rel[rl++] = '\\';
+            rel[rl] = 0;
+        }
+    }
+    if ((rl + strlen(dos) + 1) > sizeof(rel))
+        return -1;
+    strcpy(rel+rl,dos);
+
+    snprintf(tmp,sizeof(tmp),"%s",root_path);
+
+    s = rel;
+    while (*s != 0) {
+        while (*s == '\\' || *s == '/') s++;
+        if (*s == 0) break;
+
+        d = comp;
+        while (*s != 0 && *s != '\\' && *s != '/') {
+            if ((size_t)(d - comp) >= (sizeof(comp)-1)) return -1;
+            *d++ = *s++;
+        }
+        *d = 0;
+
+        if (!strcmp(comp,"."))
+            continue;
+
+        if (!strcmp(comp,"..")) {
+            /* never above the root */
+            if (strlen(tmp) > strlen(root_path)) {
+                d = strrchr(tmp,'/');
+                if (d != NULL) *d = 0;
+            }
+            continue;
+        }
+
+        /* use the name on disk if there is one, whatever its case */
+        {
+            struct dirent *de;
+            DIR *dir;
+
+            if ((dir=opendir(tmp)) != NULL) {
+                while ((de=readdir(dir)) != NULL) {
+                    if (!strcasecmp(de->d_name,comp)) {
+                        snprintf(comp,sizeof(comp),"%s",de->d_name);
+                        break;
+                    }
+                }
+                closedir(dir);
+            }
+        }
+
+        if ((strlen(tmp) + 1 + strlen(comp) + 1) > sizeof(tmp))
+            return -1;
+        strcat(tmp,"/");
+        strcat(tmp,comp);
+    }
+
+    if ((strlen(tmp) + 1) > outsz)
+        return -1;
+
+    strcpy(out,tmp);
+    return 0;
+}
+
+/* DOS wildcard match, case insensitive. "*.*" matches names without a dot too */
+static int dos_wildcard_match(const char *pat,const char *name) {
+    if (!strcmp(pat,"*.*"))
+        return 1;
+
+    while (*pat != 0) {
+        if (*pat == '*') {
+            pat++;
+            if (*pat == 0) return 1;
+            while (*name != 0) {
+                if (dos_wildcard_match(pat,name)) return 1;
+                name++;
+            }
+            return dos_wildcard_match(pat,name);
+        }
+        else if (*pat == '?') {
+            if (*name != 0 && *name != '.') name++;
+            pat++;
+        }
+        else {
+            if (toupper((unsigned char)*pat) != toupper((unsigned char)*name))
+                return 0;
+
+            pat++;
+            name++;
+        }
+    }
+
+    return *name == 0;
+}
+
+static void dos_time_date(const time_t t,unsigned short * const dtime,unsigned short * const ddate) {
+    struct tm *tm = localtime(&t);
+
+    if (tm == NULL || tm->tm_year < 80) {
+        *dtime = 0;
+        *ddate = (1 << 5) | 1;
+        return;
+    }
+
+    *dtime = (unsigned short)((tm->tm_hour << 11) | (tm->tm_min << 5) | (tm->tm_sec / 2));
+    *ddate = (unsigned short)(((tm->tm_year - 80) << 9) | ((tm->tm_mon + 1) << 5) | tm->tm_mday);
+}
+
+/*----------------------------------------------------------------------------*/
+/* output */
+
+int has_output(void) {
+    if (cur_pkt_out.hdr.mark == REMCTL_SERIAL_MARK)
+        return 1;
+
+    return 0;
+}
+
+void begin_output_packet(const unsigned char type) {
+    cur_pkt_out.hdr.mark = REMCTL_SERIAL_MARK;
+    cur_pkt_out.hdr.length = 0;
+    cur_pkt_out.hdr.sequence = cur_pkt_out_seq;
+    cur_pkt_out.hdr.type = type;
+    cur_pkt_out.hdr.chksum = 0;
+    cur_pkt_out_write = 0;
+
+    // answers wait for the turnaround, stream frames don't come through here
+    out_ready = now_us() + ((uint64_t)latency_ms * 1000ULL);
+
+    if (window_size != 0) {
+        cur_pkt_out.hdr.sequence = cur_pkt_in.hdr.sequence;
+        return;
+    }
+
+    if (cur_pkt_out_seq == 0xFF)
+        cur_pkt_out_seq = 0;
+    else
+        cur_pkt_out_seq = (cur_pkt_out_seq + 1) & 0x7F;
+}
+
+void end_output_packet(void) {
+    unsigned char sum = 0;
+    unsigned int i;
+
+    for (i=0;i < cur_pkt_out.hdr.length;i++)
+        sum += cur_pkt_out.data[i];
+
+    cur_pkt_out.hdr.chksum = 0x100 - sum;
+}
+
+static int write_all(const int fd,const unsigned char *p,size_t sz) {
+    ssize_t r;
+
+    while (sz > 0) {
+        r = write(fd,p,sz);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                struct pollfd pfd;
+
+                pfd.fd = fd;
+                pfd.events = POLLOUT;
+                pfd.revents = 0;
+                poll(&pfd,1,1000);
+                continue;
+            }
+            return -1;
+        }
+
+        p += r;
+        sz -= (size_t)r;
+    }
+
+    return 0;
+}
+
+/* send what the baud rate allows of cur_pkt_out by now. returns -1 if the connection is gone */
+static int transmit(const uint64_t now) {
+    unsigned char buf[sizeof(cur_pkt_out)];
+    const uint64_t bt = byte_time_us();
+    size_t n = 0;
+
+    if (!has_output() || now < out_ready)
+        return 0;
+
+    if (tx_next < out_ready)
+        tx_next = out_ready;
+
+    while (has_output() && tx_next <= now) {
+        unsigned char c = ((unsigned char*)(&cur_pkt_out))[cur_pkt_out_write];
+
+        stat_tx_flips += line_noise(&c);
+        buf[n++] = c;
+        tx_next += bt;
+
+        if ((++cur_pkt_out_write) >= (sizeof(cur_pkt_out.hdr)+cur_pkt_out.hdr.length)) {
+            cur_pkt_out_write = 0;
+            cur_pkt_out.hdr.mark = 0;
+        }
+    }
+
+    stat_tx_bytes += n;
+    if (n != 0 && write_all(conn_fd,buf,n) < 0)
+        return -1;
+
+    return 0;
+}
+
+/*----------------------------------------------------------------------------*/
+/* commands */
+
+void read_memory(unsigned char *dst,const unsigned long memaddr,const unsigned int len) {
+    unsigned int i;
+
+    /* past the HMA would be flat real mode. pretend we're in virtual 8086 mode like under EMM386 */
+    for (i=0;i < len;i++)
+        dst[i] = ((memaddr + i) < MEM_SIZE) ? mem[memaddr + i] : 'V';
+}
+
+void write_memory(const unsigned char *src,const unsigned long memaddr,const unsigned int len) {
+    unsigned int i;
+
+    for (i=0;i < len;i++) {
+        if ((memaddr + i) < MEM_SIZE)
+            mem[memaddr + i] = src[i];
+    }
+}
+
+static unsigned long get32(const unsigned char *p) {
+    return ((unsigned long)p[0] << 0UL) + ((unsigned long)p[1] << 8UL) +
+        ((unsigned long)p[2] << 16UL) + ((unsigned long)p[3] << 24UL);
+}
+
+static void put32(unsigned char *p,const unsigned long v) {
+    p[0] = (unsigned char)(v >> 0UL);
+    p[1] = (unsigned char)(v >> 8UL);
+    p[2] = (unsigned char)(v >> 16UL);
+    p[3] = (unsigned char)(v >> 24UL);
+}
+
+static void file_error(void) {
+    cur_pkt_out.data[0] = REMCTL_SERIAL_TYPE_FILE_MSDOS_ERROR;
+    cur_pkt_out.hdr.length = 1;
+}
+
+void close_open_file(void) {
+    if (open_file_fd >= 0) {
+        close(open_file_fd);
+        open_file_fd = -1;
+    }
+}
+
+/* one packet per match, like send_dta_find(). the caller sends FINISHED after */
+void do_file_find_command(void) {
+    char host[PATH_MAX];
+    char spec[256];
+    struct dirent *de;
+    char *pat;
+    DIR *dir;
+
+    cur_pkt_in.data[cur_pkt_in.hdr.length] = 0; // ASCIIZ snip
+    snprintf(spec,sizeof(spec),"%s",(const char*)(cur_pkt_in.data+1));
+
+    /* the directory is everything up to and including the last separator (or drive letter) */
+    pat = strrchr(spec,'\\');
+    if (pat == NULL) pat = strrchr(spec,'/');
+    if (pat == NULL && isalpha((unsigned char)spec[0]) && spec[1] == ':') pat = spec + 1;
+    pat = (pat != NULL) ? pat + 1 : spec;
+
+    {
+        char c = *pat;
+
+        *pat = 0;
+        if (dos_to_host_path(host,sizeof(host),spec) < 0) return;
+        *pat = c;
+    }
+
+    if ((dir=opendir(host)) == NULL)
+        return;
+
+    while ((de=readdir(dir)) != NULL) {
+        char path[PATH_MAX + 256];
+        unsigned short dtime,ddate;
+        struct stat st;
+        unsigned char attr;
+        size_t nl;
+
+        if (de->d_name[0] == '.' || !dos_wildcard_match(pat,de->d_name))
+            continue;
+
+        snprintf(path,sizeof(path),"%s/%s",host,de->d_name);
+        if (stat(path,&st) < 0)
+            continue;
+
+        attr = S_ISDIR(st.st_mode) ? 0x10 : 0x20;
+        dos_time_date(st.st_mtime,&dtime,&ddate);
+
+        /* DOS FileInfoRec, DTA bytes 21-42 */
+        begin_output_packet(REMCTL_SERIAL_TYPE_FILE);
+        cur_pkt_out.data[0] = REMCTL_SERIAL_TYPE_FILE_FIND;
+        cur_pkt_out.data[1] = attr;
+        cur_pkt_out.data[2] = (unsigned char)(dtime >> 0U);
+        cur_pkt_out.data[3] = (unsigned char)(dtime >> 8U);
+        cur_pkt_out.data[4] = (unsigned char)(ddate >> 0U);
+        cur_pkt_out.data[5] = (unsigned char)(ddate >> 8U);
+        put32(cur_pkt_out.data+6,S_ISDIR(st.st_mode) ? 0UL : (unsigned long)st.st_size);
+        memset(cur_pkt_out.data+10,0,13);
+        nl = strlen(de->d_name);
+        if (nl > 12) nl = 12;
+        memcpy(cur_pkt_out.data+10,de->d_name,nl);
+        cur_pkt_out.hdr.length = 1 + (43 - 21);
+        end_output_packet();
+
+        /* remsrv.c waits right there for it to go out */
+        while (has_output()) {
+            uint64_t now = now_us();
+
+            if (transmit(now) < 0)
+                break;
+            if (has_output())
+                usleep(1000);
+        }
+    }
+
+    closedir(dir);
+}
+
+void do_file_command(void) {
+    char host[PATH_MAX];
+    const char *arg;
+    struct stat st;
+    unsigned long off;
+    unsigned int len;
+    ssize_t r;
+
+    cur_pkt_in.data[cur_pkt_in.hdr.length] = 0; // ASCIIZ snip, for those that take a path
+    arg = (const char*)(cur_pkt_in.data+1);
+
+    switch (cur_pkt_in.data[0]) {
+        case REMCTL_SERIAL_TYPE_FILE_FIND:
+            do_file_find_command();
+            begin_output_packet(REMCTL_SERIAL_TYPE_FILE);
+            cur_pkt_out.data[0] = REMCTL_SERIAL_TYPE_FILE_MSDOS_FINISHED;
+            cur_pkt_out.hdr.length = 1;
+            break;
+        case REMCTL_SERIAL_TYPE_FILE_RMDIR:
+            if (dos_to_host_path(host,sizeof(host),arg) < 0 || rmdir(host) < 0)
+                file_error();
+            break;
+        case REMCTL_SERIAL_TYPE_FILE_MKDIR:
+            if (dos_to_host_path(host,sizeof(host),arg) < 0 || mkdir(host,0755) < 0)
+                file_error();
+            break;
+        case REMCTL_SERIAL_TYPE_FILE_CHDIR:
+            if (dos_to_host_path(host,sizeof(host),arg) < 0 || stat(host,&st) < 0 || !S_ISDIR(st.st_mode)) {
+                file_error();
+            }
+            else {
+                /* keep it as a DOS path from the root */
+                const char *p = host + strlen(root_path);
+                char *d;
+
+                while (*p == '/') p++;
+                snprintf(dos_cwd,sizeof(dos_cwd),"%s",p);
+                for (d=dos_cwd;*d != 0;d++) {
+                    if (*d == '/') *d = '\\';
+                }
+            }
+            break;
+        case REMCTL_SERIAL_TYPE_FILE_PWD:
+            cur_pkt_out.data[1] = 'C';
+            cur_pkt_out.data[2] = ':';
+            cur_pkt_out.data[3] = '\\';
+            len = (unsigned int)strlen(dos_cwd);
+            if (len > 180) len = 180;
+            memcpy(cur_pkt_out.data+4,dos_cwd,len);
+            cur_pkt_out.hdr.length = 4 + len;
+            cur_pkt_out.data[cur_pkt_out.hdr.length] = 0;
+            break;
+        case REMCTL_SERIAL_TYPE_FILE_OPEN:
+            close_open_file();
+            if (dos_to_host_path(host,sizeof(host),arg) < 0 || (open_file_fd=open(host,O_RDWR|O_BINARY)) < 0)
+                file_error();
+            break;
+        case REMCTL_SERIAL_TYPE_FILE_CREATE:
+            close_open_file();
+            if (dos_to_host_path(host,sizeof(host),arg) < 0 || (open_file_fd=open(host,O_RDWR|O_BINARY|O_CREAT|O_TRUNC,0644)) < 0)
+                file_error();
+            break;
+        case REMCTL_SERIAL_TYPE_FILE_CLOSE:
+            if (open_file_fd >= 0)
+                close_open_file();
+            else
+                file_error();
+            break;
+        case REMCTL_SERIAL_TYPE_FILE_SEEK:
+            {
+                static const int whence[3] = { SEEK_SET, SEEK_CUR, SEEK_END };
+                off_t o;
+
+                if (open_file_fd < 0 || cur_pkt_in.data[1] > 2 ||
+                    (o=lseek(open_file_fd,(off_t)(int32_t)get32(cur_pkt_in.data+2),whence[cur_pkt_in.data[1]])) < 0) {
+                    file_error();
+                    break;
+                }
+
+                put32(cur_pkt_out.data+2,(unsigned long)o);
+                cur_pkt_out.hdr.length = 6;
+            }
+            break;
+        case REMCTL_SERIAL_TYPE_FILE_READ:
+            if (open_file_fd < 0 || (r=read(open_file_fd,cur_pkt_out.data+2,cur_pkt_in.data[1])) < 0) {
+                file_error();
+                break;
+            }
+            if (r > 252) r = 252;
+            cur_pkt_out.data[1] = (unsigned char)r;
+            cur_pkt_out.hdr.length = 2 + (unsigned int)r;
+            break;
+        case REMCTL_SERIAL_TYPE_FILE_WRITE:
+            if (open_file_fd < 0) {
+                file_error();
+                break;
+            }
+            if (cur_pkt_in.data[1] == 0) {
+                // write with length == 0 truncates the file in DOS, see remsrv.c
+                cur_pkt_out.data[1] = 0;
+                cur_pkt_out.hdr.length = 2;
+                break;
+            }
+            if ((r=write(open_file_fd,cur_pkt_in.data+2,cur_pkt_in.data[1])) < 0) {
+                file_error();
+                break;
+            }
+            cur_pkt_out.data[1] = (unsigned char)r;
+            cur_pkt_out.hdr.length = 2;
+            break;
+        case REMCTL_SERIAL_TYPE_FILE_TRUNCATE:
+            {
+                off_t o;
+
+                if (open_file_fd < 0 || (o=lseek(open_file_fd,0,SEEK_CUR)) < 0 || ftruncate(open_file_fd,o) < 0)
+                    file_error();
+            }
+            break;
+        case REMCTL_SERIAL_TYPE_FILE_READ_AT:
+            len = cur_pkt_in.data[1];
+            off = get32(cur_pkt_in.data+2);
+            if (len > (255 - 6)) len = 255 - 6;
+            if (open_file_fd < 0 || (r=pread(open_file_fd,cur_pkt_out.data+6,len,(off_t)off)) < 0) {
+                file_error();
+                break;
+            }
+            cur_pkt_out.data[1] = (unsigned char)r;
+            cur_pkt_out.hdr.length = 6 + (unsigned int)r;
+            break;
+        case REMCTL_SERIAL_TYPE_FILE_WRITE_AT:
+            len = cur_pkt_in.data[1];
+            off = get32(cur_pkt_in.data+2);
+            if (open_file_fd < 0 || cur_pkt_in.hdr.length < 6 || len > (cur_pkt_in.hdr.length - 6U)) {
+                file_error();
+                break;
+            }
+            if (len != 0 && (r=pwrite(open_file_fd,cur_pkt_in.data+6,len,(off_t)off)) < 0) {
+                file_error();
+                break;
+            }
+            cur_pkt_out.data[1] = (unsigned char)len;
+            cur_pkt_out.hdr.length = 6;
+            break;
+        default:
+            begin_output_packet(REMCTL_SERIAL_TYPE_ERROR);
+            cur_pkt_out_seq = 0xFF;
+            break;
+    }
+}
+
+void do_dos_stuff_bios_keyboard_command(void) {
+    unsigned short head = mem[0x41A] + (mem[0x41B] << 8U);
+    unsigned short tail = mem[0x41C] + (mem[0x41D] << 8U);
+
+    if (head < 0x1E || head >= 0x3E || tail < 0x1E || tail >= 0x3E) {
+        cur_pkt_out.data[0] = REMCTL_SERIAL_TYPE_FILE_MSDOS_ERROR;
+        cur_pkt_out.hdr.length = 1;
+        return;
+    }
+
+    if (((head+2-0x1E)&0x1F) == (tail-0x1E)) {
+        /* buffer full */
+        cur_pkt_out.data[0] = REMCTL_SERIAL_TYPE_FILE_MSDOS_FULL;
+        cur_pkt_out.hdr.length = 1;
+        return;
+    }
+
+    mem[0x400+tail] = cur_pkt_in.data[1];
+    mem[0x400+tail+1] = cur_pkt_in.data[2];
+
+    tail += 2;
+    if (tail == 0x3E)
+        tail = 0x1E;
+
+    mem[0x41C] = (unsigned char)(tail >> 0U);
+    mem[0x41D] = (unsigned char)(tail >> 8U);
+}
+
+void do_stream_nak_command(void) {
+    unsigned char i;
+
+    if (stream_mode == 0 || cur_pkt_in.hdr.length < 5 || stream_nak_count >= STREAM_NAK_MAX)
+        return;
+
+    stream_nak[stream_nak_count] = get32(cur_pkt_in.data+1);
+    for (i=0;i < stream_nak_count;i++) {
+        if (stream_nak[i] == stream_nak[stream_nak_count])
+            return;
+    }
+
+    stream_nak_count++;
+}
+
+void do_stream_command(void) {
+    memcpy(cur_pkt_out.data,cur_pkt_in.data,9);
+    cur_pkt_out.hdr.length = 9;
+
+    switch (cur_pkt_in.data[0]) {
+        case REMCTL_SERIAL_TYPE_STREAM_MEMORY:
+        case REMCTL_SERIAL_TYPE_STREAM_FILE:
+            if (cur_pkt_in.hdr.length < 9 ||
+                (cur_pkt_in.data[0] == REMCTL_SERIAL_TYPE_STREAM_FILE && open_file_fd < 0)) {
+                file_error();
+                break;
+            }
+
+            stream_mode = cur_pkt_in.data[0];
+            stream_done_sent = 0;
+            stream_base = get32(cur_pkt_in.data+1);
+            stream_length = get32(cur_pkt_in.data+5);
+            stream_next = 0;
+            stream_nak_count = 0;
+            break;
+        case REMCTL_SERIAL_TYPE_STREAM_END:
+            stream_mode = 0;
+            stream_nak_count = 0;
+            cur_pkt_out.hdr.length = 1;
+            break;
+        default:
+            begin_output_packet(REMCTL_SERIAL_TYPE_ERROR);
+            cur_pkt_out_seq = 0xFF;
+            break;
+    }
+}
+
+void window_reply_clear(void) {
+    unsigned char i;
+
+    for (i=0;i < WINDOW_MAX;i++)
+        window_reply[i].hdr.mark = 0;
+}
+
+/* windowed mode: a retransmit of something already done gets the same answer, it is not
+ * done twice. "MS-DOS is busy" is not kept, the retransmit of that is done for real */
+void window_reply_keep(void) {
+    struct remctl_serial_packet *r = &window_reply[cur_pkt_in.hdr.sequence % WINDOW_MAX];
+
+    r->hdr.mark = 0;
+    if (cur_pkt_out.hdr.mark != REMCTL_SERIAL_MARK)
+        return;
+    if (cur_pkt_out.hdr.type == REMCTL_SERIAL_TYPE_FILE && cur_pkt_out.hdr.length >= 1 &&
+        cur_pkt_out.data[0] == REMCTL_SERIAL_TYPE_FILE_MSDOS_IS_BUSY)
+        return;
+
+    memcpy(r,&cur_pkt_out,sizeof(cur_pkt_out.hdr)+cur_pkt_out.hdr.length);
+}
+
+int window_reply_again(void) {
+    const struct remctl_serial_packet *r = &window_reply[cur_pkt_in.hdr.sequence % WINDOW_MAX];
+
+    if (r->hdr.mark != REMCTL_SERIAL_MARK || r->hdr.sequence != cur_pkt_in.hdr.sequence)
+        return 0;
+
+    memcpy(&cur_pkt_out,r,sizeof(r->hdr)+r->hdr.length);
+    cur_pkt_out_write = 0;
+    out_ready = now_us() + ((uint64_t)latency_ms * 1000ULL);
+    return 1;
+}
+
+/* the client went away or started over: back to stop-and-wait, and no stream */
+void session_reset(void) {
+    window_size = 0;
+    window_ack = 0;
+    window_rcvd = 0;
+    window_reply_clear();
+
+    stream_mode = 0;
+    stream_nak_count = 0;
+
+    cur_pkt_in_seq = 0xFF;
+    cur_pkt_out_seq = 0xFF;
+}
+
+void handle_packet(void) {
+    unsigned int port;
+
+    switch (cur_pkt_in.hdr.type) {
+        case REMCTL_SERIAL_TYPE_PING:
+            begin_output_packet(REMCTL_SERIAL_TYPE_PING);
+            memcpy(cur_pkt_out.data,"PING",4);
+            cur_pkt_out.hdr.length = 4;
+            end_output_packet();
+            break;
+        case REMCTL_SERIAL_TYPE_HALT:
+            halt_system = cur_pkt_in.data[0];
+            begin_output_packet(REMCTL_SERIAL_TYPE_HALT);
+            cur_pkt_out.data[0] = halt_system;
+            cur_pkt_out.hdr.length = 1;
+            end_output_packet();
+            break;
+        case REMCTL_SERIAL_TYPE_DOS:
+            begin_output_packet(REMCTL_SERIAL_TYPE_DOS);
+            memcpy(cur_pkt_out.data,cur_pkt_in.data,8/*big enough*/);
+            cur_pkt_out.hdr.length = 1;
+
+            switch (cur_pkt_in.data[0]) {
+                case REMCTL_SERIAL_TYPE_DOS_LOL:
+                    cur_pkt_out.data[1] = (unsigned char)(FAKE_LOL_OFF >> 0U);
+                    cur_pkt_out.data[2] = (unsigned char)(FAKE_LOL_OFF >> 8U);
+                    cur_pkt_out.data[3] = (unsigned char)(FAKE_LOL_SEG >> 0U);
+                    cur_pkt_out.data[4] = (unsigned char)(FAKE_LOL_SEG >> 8U);
+                    cur_pkt_out.hdr.length = 5;
+                    break;
+                case REMCTL_SERIAL_TYPE_DOS_INDOS:
+                    cur_pkt_out.data[1] = (unsigned char)(FAKE_INDOS_OFF >> 0U);
+                    cur_pkt_out.data[2] = (unsigned char)(FAKE_INDOS_OFF >> 8U);
+                    cur_pkt_out.data[3] = (unsigned char)(FAKE_INDOS_SEG >> 0U);
+                    cur_pkt_out.data[4] = (unsigned char)(FAKE_INDOS_SEG >> 8U);
+                    cur_pkt_out.hdr.length = 5;
+                    break;
+                case REMCTL_SERIAL_TYPE_DOS_STUFF_BIOS_KEYBOARD:
+                    do_dos_stuff_bios_keyboard_command();
+                    break;
+            };
+
+            end_output_packet();
+            break;
+        case REMCTL_SERIAL_TYPE_INPORT:
+            /* nothing there, like an empty ISA bus */
+            begin_output_packet(REMCTL_SERIAL_TYPE_INPORT);
+            memcpy(cur_pkt_out.data,cur_pkt_in.data,8/*big enough*/);
+            port = cur_pkt_in.data[2] == 4 ? 4 : (cur_pkt_in.data[2] == 2 ? 2 : 1);
+            memset(cur_pkt_out.data+3,0xFF,port);
+            cur_pkt_out.hdr.length = 3 + port;
+            end_output_packet();
+            break;
+        case REMCTL_SERIAL_TYPE_OUTPORT:
+            begin_output_packet(REMCTL_SERIAL_TYPE_OUTPORT);
+            memcpy(cur_pkt_out.data,cur_pkt_in.data,8/*big enough*/);
+            cur_pkt_out.hdr.length = 3;
+            end_output_packet();
+            break;
+        case REMCTL_SERIAL_TYPE_MEMREAD:
+            begin_output_packet(REMCTL_SERIAL_TYPE_MEMREAD);
+            memcpy(cur_pkt_out.data,cur_pkt_in.data,8/*big enough*/);
+            cur_pkt_out.hdr.length = 5;
+
+            if (cur_pkt_in.data[4] != 0 && cur_pkt_in.data[4] <= 192) {
+                cur_pkt_out.hdr.length = 5 + (unsigned int)cur_pkt_in.data[4];
+                read_memory(cur_pkt_out.data+5,get32(cur_pkt_in.data),(unsigned int)cur_pkt_in.data[4]);
+            }
+
+            end_output_packet();
+            break;
+        case REMCTL_SERIAL_TYPE_MEMWRITE:
+            begin_output_packet(REMCTL_SERIAL_TYPE_MEMWRITE);
+            memcpy(cur_pkt_out.data,cur_pkt_in.data,8/*big enough*/);
+            cur_pkt_out.hdr.length = 5;
+
+            if (cur_pkt_in.data[4] != 0 && cur_pkt_in.data[4] <= 192)
+                write_memory(cur_pkt_in.data+5,get32(cur_pkt_in.data),(unsigned int)cur_pkt_in.data[4]);
+
+            end_output_packet();
+            break;
+        case REMCTL_SERIAL_TYPE_FILE:
+            begin_output_packet(REMCTL_SERIAL_TYPE_FILE);
+            memcpy(cur_pkt_out.data,cur_pkt_in.data,8/*big enough*/);
+            cur_pkt_out.hdr.length = 1;
+            do_file_command();
+            end_output_packet();
+            break;
+        case REMCTL_SERIAL_TYPE_STREAM:
+            if (cur_pkt_in.data[0] == REMCTL_SERIAL_TYPE_STREAM_NAK) {
+                do_stream_nak_command();
+                break;
+            }
+
+            begin_output_packet(REMCTL_SERIAL_TYPE_STREAM);
+            do_stream_command();
+            end_output_packet();
+            break;
+        case REMCTL_SERIAL_TYPE_WINDOW:
+            if (cur_pkt_in.hdr.length < 1) {
+                begin_output_packet(REMCTL_SERIAL_TYPE_ERROR);
+                cur_pkt_out_seq = 0xFF;
+                end_output_packet();
+                break;
+            }
+
+            window_size = cur_pkt_in.data[0];
+            if (window_size > WINDOW_MAX)
+                window_size = WINDOW_MAX;
+
+            window_ack = 0;
+            window_rcvd = 0;
+            window_reply_clear();
+            cur_pkt_in_seq = 0;
+            cur_pkt_out_seq = 0xFF;
+
+            begin_output_packet(REMCTL_SERIAL_TYPE_WINDOW);
+            cur_pkt_out.hdr.sequence = 0xFF;
+            cur_pkt_out.data[0] = window_size;
+            cur_pkt_out.hdr.length = 1;
+            end_output_packet();
+            break;
+        default:
+            begin_output_packet(REMCTL_SERIAL_TYPE_ERROR);
+            cur_pkt_out_seq = 0xFF;
+            end_output_packet();
+            break;
+    }
+}
+
+/* returns 1 if the sequence number is new, 0 for a retransmit */
+int window_track(const unsigned char seq) {
+    unsigned char d = (seq - window_ack) & 0x7F;
+
+    if (d >= 16 || (window_rcvd & (1U << d)))
+        return 0;
+
+    window_rcvd |= 1U << d;
+    while (window_rcvd & 1U) {
+        window_rcvd >>= 1U;
+        window_ack = (window_ack + 1) & 0x7F;
+    }
+
+    return 1;
+}
+
+int inpkt_validate(void) {
+    unsigned char sum = cur_pkt_in.hdr.chksum;
+    unsigned int i;
+
+    for (i=0;i < cur_pkt_in.hdr.length;i++)
+        sum += cur_pkt_in.data[i];
+    if (sum != 0)
+        return 0;
+
+    /* 2 = a retransmit. at 0xFF, anything but WINDOW and the stream requests is a new client in stop-and-wait */
+    if (window_size != 0) {
+        if (cur_pkt_in.hdr.sequence != 0xFF)
+            return window_track(cur_pkt_in.hdr.sequence) ? 1 : 2;
+        if (cur_pkt_in.hdr.type == REMCTL_SERIAL_TYPE_WINDOW || cur_pkt_in.hdr.type == REMCTL_SERIAL_TYPE_STREAM)
+            return 1;
+
+        session_reset();
+    }
+
+    if (cur_pkt_in.hdr.sequence == 0xFF)
+        cur_pkt_in_seq = cur_pkt_in.hdr.sequence;
+    else if (cur_pkt_in.hdr.sequence != cur_pkt_in_seq)
+        return 0;
+
+    cur_pkt_in_seq = (cur_pkt_in.hdr.sequence + 1) & 0x7F;
+    return 1;
+}
+
+int input_packet_complete(void) {
+    return cur_pkt_in_write != 0 && cur_pkt_in_write >= (sizeof(cur_pkt_in.hdr)+cur_pkt_in.hdr.length);
+}
+
+void process_input_packet(void) {
+    const uint64_t now = now_us();
+    int r;
+
+    stat_packets++;
+
+    /* windowed mode, and the client went quiet: it went away */
+    if (window_size != 0 && (now - client_last) >= CLIENT_IDLE_US)
+        session_reset();
+
+    /* streaming, nothing sent and no NAK or END for STREAM_IDLE_FRAMES frame times (at least a second) */
+    if (stream_mode != 0 && (now - client_last) >= stream_idle_us()) {
+        stream_mode = 0;
+        stream_nak_count = 0;
+    }
+
+    client_last = now;
+
+    if ((r=inpkt_validate()) == 2 && window_reply_again()) {
+        if (verbose)
+            fprintf(stderr,"retransmit seq=%u answered again\n",cur_pkt_in.hdr.sequence);
+    }
+    else if (r != 0) {
+        if (verbose)
+            fprintf(stderr,"packet type=0x%02x('%c') seq=%u length=%u\n",
+                cur_pkt_in.hdr.type,cur_pkt_in.hdr.type,cur_pkt_in.hdr.sequence,cur_pkt_in.hdr.length);
+
+        handle_packet();
+        if (window_size != 0 && cur_pkt_in.hdr.sequence != 0xFF)
+            window_reply_keep();
+    }
+    else {
+        stat_bad_packets++;
+        if (verbose)
+            fprintf(stderr,"bad packet type=0x%02x seq=%u length=%u\n",
+                cur_pkt_in.hdr.type,cur_pkt_in.hdr.sequence,cur_pkt_in.hdr.length);
+
+        if (window_size != 0) {
+            begin_output_packet(REMCTL_SERIAL_TYPE_ACK);
+            cur_pkt_out.hdr.sequence = window_ack;
+            cur_pkt_out.data[0] = window_ack;
+            cur_pkt_out.data[1] = (unsigned char)(window_rcvd >> 0U);
+            cur_pkt_out.data[2] = (unsigned char)(window_rcvd >> 8U);
+            cur_pkt_out.hdr.length = 3;
+            end_output_packet();
+        }
+        else {
+            begin_output_packet(REMCTL_SERIAL_TYPE_ERROR);
+            cur_pkt_out_seq = 0xFF;
+            end_output_packet();
+        }
+    }
+
+    cur_pkt_in.hdr.mark = 0;
+    cur_pkt_in_write = 0;
+}
+
+int stream_output_frame(void) {
+    unsigned int len = 0;
+    unsigned long offset;
+    unsigned short crc;
+    unsigned char i;
+
+    if (stream_mode == 0)
+        return 0;
+
+    if (stream_nak_count != 0)
+        offset = stream_nak[0];
+    else if (stream_next < stream_length)
+        offset = stream_next;
+    else if (!stream_done_sent)
+        offset = stream_length;
+    else
+        return 0;
+
+    if (offset < stream_length) {
+        len = REMCTL_SERIAL_STREAM_FRAME;
+        if (len > (stream_length - offset))
+            len = (unsigned int)(stream_length - offset);
+
+        if (stream_mode == REMCTL_SERIAL_TYPE_STREAM_FILE) {
+            ssize_t r = -1;
+
+            if (open_file_fd >= 0)
+                r = pread(open_file_fd,cur_pkt_out.data+5,len,(off_t)(stream_base + offset));
+
+            if (r <= 0) {
+                stream_length = offset;
+                len = 0;
+            }
+            else {
+                if ((unsigned int)r < len)
+                    stream_length = offset + (unsigned long)r;
+
+                len = (unsigned int)r;
+            }
+        }
+        else {
+            read_memory(cur_pkt_out.data+5,stream_base + offset,len);
+        }
+    }
+
+    if (stream_nak_count != 0) {
+        for (i=1;i < stream_nak_count;i++)
+            stream_nak[i-1] = stream_nak[i];
+
+        stream_nak_count--;
+    }
+    else if (stream_next < stream_length) {
+        stream_next += len;
+    }
+
+    cur_pkt_out.hdr.mark = REMCTL_SERIAL_MARK;
+    cur_pkt_out.hdr.sequence = 0xFF;
+    cur_pkt_out.hdr.type = REMCTL_SERIAL_TYPE_STREAM;
+    cur_pkt_out.hdr.chksum = 0;
+    cur_pkt_out_write = 0;
+    out_ready = now_us();
+
+    if (offset >= stream_length) {
+        offset = stream_length;
+        stream_done_sent = 1;
+        cur_pkt_out.data[0] = REMCTL_SERIAL_TYPE_STREAM_DONE;
+        len = 0;
+    }
+    else {
+        cur_pkt_out.data[0] = REMCTL_SERIAL_TYPE_STREAM_DATA;
+    }
+
+    put32(cur_pkt_out.data+1,offset);
+    crc = remctl_crc16_update(REMCTL_CRC16_INIT,cur_pkt_out.data,5 + len);
+    cur_pkt_out.data[5 + len] = (unsigned char)(crc >> 8U);
+    cur_pkt_out.data[6 + len] = (unsigned char)(crc >> 0U);
+    cur_pkt_out.hdr.length = 7 + len;
+    end_output_packet();
+    client_last = now_us();
+    stat_frames++;
+    return 1;
+}
+
+/* what the UART IRQ does in remsrv.c: take what has arrived, answer a packet when
+ * the last answer is out, and keep a stream going */
+static void process_io(const uint64_t now) {
+    do {
+        /* bytes that have arrived go into cur_pkt_in, up to the end of one packet */
+        while (!input_packet_complete() && rx_q_head != rx_q_tail && rx_q[rx_q_head].t <= now) {
+            ((unsigned char*)(&cur_pkt_in))[cur_pkt_in_write] = rx_q[rx_q_head++].c;
+
+            if (cur_pkt_in_write == 0 && cur_pkt_in.hdr.mark != REMCTL_SERIAL_MARK)
+                continue;
+
+            cur_pkt_in_write++;
+        }
+
+        if (has_output())
+            break;
+
+        if (input_packet_complete()) {
+            process_input_packet();
+            continue;
+        }
+
+        if (!stream_output_frame())
+            break;
+    } while (1);
+}
+
+/*----------------------------------------------------------------------------*/
+/* the connection */
+
+/* a new connection is like restarting REMSRV.EXE, except for the open file and current directory */
+static void reset_connection_state(void) {
+    cur_pkt_in_write = 0;
+    cur_pkt_in.hdr.mark = 0;
+    cur_pkt_in_seq = 0xFF;
+    cur_pkt_out.hdr.mark = 0;
+    cur_pkt_out_write = 0;
+    cur_pkt_out_seq = 0xFF;
+    window_size = 0;
+    window_reply_clear();
+    stream_mode = 0;
+    stream_nak_count = 0;
+    rx_q_head = rx_q_tail = 0;
+    rx_last = tx_next = out_ready = 0;
+}
+
+static void print_stats(void) {
+    fprintf(stderr,"remsim: rx %llu bytes (%llu bits flipped), tx %llu bytes (%llu bits flipped), %llu packets (%llu bad), %llu stream frames\n",
+        stat_rx_bytes,stat_rx_flips,stat_tx_bytes,stat_tx_flips,stat_packets,stat_bad_packets,stat_frames);
+}
+
+static int rx_q_push(const unsigned char *p,const size_t n,const uint64_t now) {
+    const uint64_t bt = byte_time_us();
+    size_t i;
+
+    /* compact, then grow if needed */
+    if (rx_q_head != 0) {
+        memmove(rx_q,rx_q+rx_q_head,(rx_q_tail-rx_q_head)*sizeof(*rx_q));
+        rx_q_tail -= rx_q_head;
+        rx_q_head = 0;
+    }
+    if ((rx_q_tail + n) > rx_q_alloc) {
+        size_t na = rx_q_alloc ? rx_q_alloc : 4096;
+        struct rx_byte *np;
+
+        while (na < (rx_q_tail + n)) na *= 2;
+        if ((np=realloc(rx_q,na*sizeof(*rx_q))) == NULL)
+            return -1;
+
+        rx_q = np;
+        rx_q_alloc = na;
+    }
+
+    /* the bytes take byte_time each to come down the line after the ones before them */
+    if (rx_last < now) rx_last = now;
+    for (i=0;i < n;i++) {
+        rx_last += bt;
+        rx_q[rx_q_tail].t = rx_last;
+        rx_q[rx_q_tail].c = p[i];
+        stat_rx_flips += line_noise(&rx_q[rx_q_tail].c);
+        rx_q_tail++;
+    }
+
+    stat_rx_bytes += n;
+    return 0;
+}
+
+/* run one connection until it goes away */
+static void serve(void) {
+    unsigned char buf[4096];
+    struct pollfd pfd;
+    uint64_t now,next;
+    int timeout;
+    ssize_t r;
+
+    reset_connection_state();
+
+    do {
+        now = now_us();
+        process_io(now);
+        if (transmit(now) < 0)
+            break;
+
+        /* that may have finished a packet, which lets the next one (or stream frame) in */
+        process_io(now);
+
+        /* sleep until something is due */
+        next = UINT64_MAX;
+        if (rx_q_head != rx_q_tail && !(input_packet_complete() && has_output()))
+            next = rx_q[rx_q_head].t;
+        if (has_output()) {
+            uint64_t t = tx_next > out_ready ? tx_next : out_ready;
+            if (t < next) next = t;
+        }
+
+        now = now_us();
+        if (next == UINT64_MAX)
+            timeout = -1;
+        else if (next <= now)
+            timeout = 0;
+        else
+            timeout = (int)((next - now + 999ULL) / 1000ULL);
+
+        pfd.fd = conn_fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        if (poll(&pfd,1,timeout) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        if (pfd.revents & (POLLIN|POLLHUP|POLLERR)) {
+            r = read(conn_fd,buf,sizeof(buf));
+            if (r < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK))
+                continue;
+            if (r <= 0) {
+                /* the pty slave closes between client runs. wait for the next one */
+                if (use_pty) {
+                    usleep(20000);
+                    continue;
+                }
+                break;
+            }
+            if (rx_q_push(buf,(size_t)r,now_us()) < 0)
+                break;
+        }
+    } while (1);
+
+    if (verbose)
+        print_stats();
+}
+
+static int open_pty(void) {
+    struct termios tios;
+    const char *slave;
+    int fd;
+
+    if ((fd=posix_openpt(O_RDWR|O_NOCTTY)) < 0)
+        return -1;
+    if (grantpt(fd) < 0 || unlockpt(fd) < 0 || (slave=ptsname(fd)) == NULL) {
+        close(fd);
+        return -1;
+    }
+
+    /* raw, so nothing in the middle eats 0x11/0x13 or CR */
+    if (tcgetattr(fd,&tios) == 0) {
+        cfmakeraw(&tios);
+        tcsetattr(fd,TCSANOW,&tios);
+    }
+
+    if (pty_link != NULL) {
+        unlink(pty_link);
+        if (symlink(slave,pty_link) < 0)
+            fprintf(stderr,"Failed to symlink %s, %s\n",pty_link,strerror(errno));
+    }
+
+    printf("remsim: pty %s\n",pty_link != NULL ? pty_link : slave);
+    fflush(stdout);
+    return fd;
+}
+
+static int open_listen(void) {
+    struct sockaddr_in sin;
+    int one = 1;
+    int fd;
+
+    if ((fd=socket(AF_INET,SOCK_STREAM,0)) < 0)
+        return -1;
+
+    setsockopt(fd,SOL_SOCKET,SO_REUSEADDR,&one,sizeof(one));
+
+    memset(&sin,0,sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_port = htons(listen_port);
+    sin.sin_addr.s_addr = htonl(0x7F000001UL); /* 127.0.0.1 */
+    if (bind(fd,(const struct sockaddr*)(&sin),sizeof(sin)) < 0 || listen(fd,1) < 0) {
+        fprintf(stderr,"Cannot listen on port %d, %s\n",listen_port,strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    printf("remsim: listening on 127.0.0.1:%d\n",listen_port);
+    fflush(stdout);
+    return fd;
+}
+
+static void on_signal(int sig) {
+    (void)sig;
+    print_stats();
+    if (pty_link != NULL) unlink(pty_link);
+    _exit(0);
+}
+
+static int load_memory(void) {
+    unsigned long i;
+
+    if ((mem=malloc(MEM_SIZE)) == NULL)
+        return -1;
+
+    if (mem_file != NULL) {
+        ssize_t r;
+        int fd;
+
+        memset(mem,0,MEM_SIZE);
+        if ((fd=open(mem_file,O_RDONLY|O_BINARY)) < 0) {
+            fprintf(stderr,"Cannot open %s, %s\n",mem_file,strerror(errno));
+            return -1;
+        }
+        r = read(fd,mem,MEM_SIZE);
+        close(fd);
+        if (r < 0)
+            return -1;
+    }
+    else {
+        /* something that isn't the same in every 256 bytes, so misplaced data shows */
+        for (i=0;i < MEM_SIZE;i++)
+            mem[i] = (unsigned char)((i * 7UL) ^ (i >> 8UL) ^ (i >> 16UL));
+
+        /* empty BIOS keyboard buffer, for stuffkey */
+        mem[0x41A] = 0x1E; mem[0x41B] = 0x00;
+        mem[0x41C] = 0x1E; mem[0x41D] = 0x00;
+        /* InDOS is zero */
+        mem[(FAKE_INDOS_SEG << 4) + FAKE_INDOS_OFF] = 0;
+    }
+
+    return 0;
+}
+
+int main(int argc,char **argv) {
+    if (parse_argv(argc,argv))
+        return 1;
+
+    if (realpath(root_dir,root_path) == NULL) {
+        fprintf(stderr,"Bad root %s, %s\n",root_dir,strerror(errno));
+        return 1;
+    }
+
+    if (load_memory() < 0)
+        return 1;
+
+    srand48((long)seed);
+    signal(SIGPIPE,SIG_IGN);
+    signal(SIGINT,on_signal);
+    signal(SIGTERM,on_signal);
+
+    if (use_pty) {
+        if ((conn_fd=open_pty()) < 0) {
+            fprintf(stderr,"Cannot open pty, %s\n",strerror(errno));
+            return 1;
+        }
+
+        serve();
+        return 0;
+    }
+
+    if ((listen_fd=open_listen()) < 0)
+        return 1;
+
+    do {
+        int one = 1;
+
+        conn_fd = accept(listen_fd,NULL,NULL);
+        if (conn_fd < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        setsockopt(conn_fd,IPPROTO_TCP,TCP_NODELAY,&one,sizeof(one));
+        if (verbose) fprintf(stderr,"remsim: connected\n");
+
+        serve();
+
+        /* the open file and current directory stay, like REMSRV.EXE when the cable is pulled */
+        close(conn_fd);
+        conn_fd = -1;
+    } while (1);
+
+    close(listen_fd);
+    return 0;
+}
@@ -28,6 +28,7 @@
 #include <hw/flatreal/flatreal.h>
 
 #include "proto.h"
+#include "crc16.h"
 
 #ifdef TARGET_PC98
 static struct uart_8251 *uart = NULL;
@@ -63,6 +64,37 @@ static struct remctl_serial_packet      cur_pkt_out = {0};
 static unsigned char                    cur_pkt_out_write = 0;      // from 0 to < sizeof(cur_pkt_out)
 static unsigned char                    cur_pkt_out_seq = 0xFF;
 
+/* windowed mode (see REMCTL_SERIAL_TYPE_WINDOW in proto.h) */
+#define WINDOW_MAX                      4                           // RX_RING_SIZE / 256, so a full window of worst case packets fits
+static unsigned char                    window_size = 0;            // 0 = stop-and-wait
+static unsigned char                    window_ack = 0;             // every sequence number before this was received
+static unsigned int                     window_rcvd = 0;            // bit N = sequence (window_ack + N) was received
+static struct remctl_serial_packet      window_reply[WINDOW_MAX];   // answer to sequence N is in [N % WINDOW_MAX], sent again for a retransmit
+
+/* in windowed mode, the client is taken to be gone if nothing arrives for this long */
+#define CLIENT_IDLE_TICKS               91                          // about 5 seconds of timer ticks
+static volatile unsigned int            client_idle_ticks = 0;      // timer ticks since the last packet arrived or stream frame went out
+
+/* received bytes wait here until the packet ahead of them has been answered.
+ * in windowed mode the client sends packets back to back while we are still
+ * sending a response, which would overrun the UART FIFO if we stopped reading. */
+#define RX_RING_SIZE                    1024                        // must be a power of 2
+static unsigned char                    rx_ring[RX_RING_SIZE];
+static unsigned int                     rx_ring_head = 0;           // next byte from the UART goes here
+static unsigned int                     rx_ring_tail = 0;           // next byte for cur_pkt_in comes from here
+
+/* streaming (see REMCTL_SERIAL_TYPE_STREAM in proto.h). frames go out from process_output() whenever the UART has room */
+#define STREAM_NAK_MAX                  8                           // NAKs beyond this are dropped, the client asks again
+static unsigned char                    stream_mode = 0;            // 0 = not streaming, else REMCTL_SERIAL_TYPE_STREAM_MEMORY/FILE
+static unsigned char                    stream_done_sent = 0;       // the DONE frame went out
+static unsigned long                    stream_base = 0;            // memory address or file offset of the range
+static unsigned long                    stream_length = 0;          // bytes in the range (cut short at end of file)
+static unsigned long                    stream_next = 0;            // next frame in order, offset from stream_base
+static unsigned long                    stream_nak[STREAM_NAK_MAX]; // frames to send again before stream_next
+static unsigned char                    stream_nak_count = 0;
+#define STREAM_IDLE_FRAMES              64                          // stream is dropped after this many frame times with nothing to send and no NAK or END
+static unsigned int                     stream_idle_ticks = 18;     // that in timer ticks at the baud rate, at least a second
+
 #ifdef TARGET_PC98
 void pc98_uart_irq_update(void) {
     /* NTS: Unlike the IBM PC UARTs, we can't just leave all interrupt signals
@@ -84,6 +116,8 @@ void pc98_uart_irq_update(void) {
 void process_input(void);
 void process_output(void);
 void do_process_output(void);
+void session_reset(void);
+void window_reply_clear(void);
 
 int uart_waiting_read = 0;
 int uart_waiting_write = 0;
@@ -342,6 +376,20 @@ static void interrupt timer_irq() {
 #endif
     }
 
+    /* windowed mode, and the client has gone quiet: it went away, so don't
+     * leave the next one talking stop-and-wait to a windowed server */
+    if (client_idle_ticks < 0xFFFFu)
+        client_idle_ticks++;
+    if (window_size != 0 && client_idle_ticks >= CLIENT_IDLE_TICKS && !in_packet_handling)
+        session_reset();
+
+    /* streaming, nothing left to send, and no NAK or END: the client is gone. frames
+     * going out count as activity, so this only runs down once the stream is sent */
+    if (stream_mode != 0 && client_idle_ticks >= stream_idle_ticks && !in_packet_handling) {
+        stream_mode = 0;
+        stream_nak_count = 0;
+    }
+
     /* halt here if instructed */
     if (halt_system) halt_system_loop();
 
@@ -381,6 +429,12 @@ void begin_output_packet(const unsigned char type) {
     cur_pkt_out.hdr.type = type;
     cur_pkt_out.hdr.chksum = 0;
 
+    // windowed mode: answer with the sequence number of the request, so the client can match them up
+    if (window_size != 0) {
+        cur_pkt_out.hdr.sequence = cur_pkt_in.hdr.sequence;
+        return;
+    }
+
     if (cur_pkt_out_seq == 0xFF)
         cur_pkt_out_seq = 0;
     else
@@ -834,6 +888,89 @@ l1:     mov     length,ax
     }
 }
 
+/* seek the open file to an absolute offset. returns 0 if OK, else the DOS error code */
+unsigned short seek_open_file(const unsigned long offset) {
+    unsigned short fd = open_file_fd;
+    unsigned long poff = offset;
+    unsigned short retv = 0;
+
+    __asm {
+        push    ax
+        push    bx
+        push    cx
+        push    dx
+        mov     ax,0x4200               ; seek from start of file
+        mov     bx,fd                   ; file handle
+        mov     cx,word ptr poff + 2    ; CX:DX = file pointer
+        mov     dx,word ptr poff
+        int     21h
+        jnc     l1
+        mov     retv,ax
+l1:     pop     dx
+        pop     cx
+        pop     bx
+        pop     ax
+    }
+
+    return retv;
+}
+
+/* read from the open file at its file pointer. returns 0 if OK, else the DOS error code. *length is updated to what was read */
+unsigned short read_open_file(unsigned char far *p,unsigned short * const length) {
+    unsigned short fd = open_file_fd;
+    unsigned short len = *length;
+    unsigned short retv = 0;
+
+    __asm {
+        push    ds
+        push    ax
+        push    bx
+        push    cx
+        push    dx
+        mov     ah,0x3F                 ; read
+        mov     bx,fd                   ; file handle
+        mov     cx,len
+        lds     dx,word ptr [p]
+        int     21h
+        jnc     l1
+        mov     retv,ax
+        xor     ax,ax
+l1:     mov     len,ax
+        pop     dx
+        pop     cx
+        pop     bx
+        pop     ax
+        pop     ds
+    }
+
+    *length = len;
+    return retv;
+}
+
+/* READ_AT: like READ, but at the offset given in the packet.
+ * the client may send it more than once, so the result must not depend on the file pointer. */
+void do_file_read_at_command(void) {
+    unsigned short length = cur_pkt_in.data[1];
+    unsigned long poff =
+        ((unsigned long)cur_pkt_in.data[2] << 0UL) +
+        ((unsigned long)cur_pkt_in.data[3] << 8UL) +
+        ((unsigned long)cur_pkt_in.data[4] << 16UL) +
+        ((unsigned long)cur_pkt_in.data[5] << 24UL);
+
+    if (length > (255 - 6)) length = 255 - 6;
+
+    if (open_file_fd < 0 || seek_open_file(poff) != 0 ||
+        read_open_file((unsigned char far*)cur_pkt_out.data + 6,&length) != 0) {
+        cur_pkt_out.data[0] = REMCTL_SERIAL_TYPE_FILE_MSDOS_ERROR;
+        cur_pkt_out.hdr.length = 1;
+        return;
+    }
+
+    // data[2-5] (offset) were copied from the request
+    cur_pkt_out.data[1] = length;
+    cur_pkt_out.hdr.length = 6 + length;
+}
+
 void do_dos_stuff_bios_keyboard_command(void) {
     unsigned short head = *((unsigned short far*)MK_FP(0x40,0x1A));
     unsigned short tail = *((unsigned short far*)MK_FP(0x40,0x1C));
@@ -924,6 +1061,70 @@ l1:     mov     length,ax
     }
 }
 
+/* WRITE_AT: like WRITE, but at the offset given in the packet.
+ * the client may send it more than once, so the result must not depend on the file pointer. */
+void do_file_write_at_command(void) {
+    unsigned char far *p = (unsigned char far*)cur_pkt_in.data + 6;
+    unsigned short length = cur_pkt_in.data[1];
+    unsigned short fd = open_file_fd;
+    unsigned short retv = 0;
+    unsigned long poff =
+        ((unsigned long)cur_pkt_in.data[2] << 0UL) +
+        ((unsigned long)cur_pkt_in.data[3] << 8UL) +
+        ((unsigned long)cur_pkt_in.data[4] << 16UL) +
+        ((unsigned long)cur_pkt_in.data[5] << 24UL);
+
+    if (open_file_fd < 0 || cur_pkt_in.hdr.length < 6 || length > (cur_pkt_in.hdr.length - 6)) {
+        cur_pkt_out.data[0] = REMCTL_SERIAL_TYPE_FILE_MSDOS_ERROR;
+        cur_pkt_out.hdr.length = 1;
+        return;
+    }
+
+    if (length == 0) {
+        // write with length == 0 truncates the file, see do_file_write_command()
+        cur_pkt_out.data[1] = length;
+        cur_pkt_out.hdr.length = 6;
+        return;
+    }
+
+    if (seek_open_file(poff) != 0) {
+        cur_pkt_out.data[0] = REMCTL_SERIAL_TYPE_FILE_MSDOS_ERROR;
+        cur_pkt_out.hdr.length = 1;
+        return;
+    }
+
+    __asm {
+        push    ds
+        push    ax
+        push    bx
+        push    cx
+        push    dx
+        mov     ah,0x40                 ; write
+        mov     bx,fd                   ; file handle
+        mov     cx,length
+        lds     dx,word ptr [p]
+        int     21h
+        jnc     l1
+        mov     retv,ax
+l1:     mov     length,ax
+        pop     dx
+        pop     cx
+        pop     bx
+        pop     ax
+        pop     ds
+    }
+
+    if (retv != 0) {
+        cur_pkt_out.data[0] = REMCTL_SERIAL_TYPE_FILE_MSDOS_ERROR;
+        cur_pkt_out.hdr.length = 1;
+    }
+    else {
+        // data[2-5] (offset) were copied from the request
+        cur_pkt_out.data[1] = length;
+        cur_pkt_out.hdr.length = 6;
+    }
+}
+
 void do_file_truncate_command(void) {
     unsigned char far *p = (unsigned char far*)cur_pkt_in.data + 2;
     unsigned short fd = open_file_fd;
@@ -961,6 +1162,109 @@ l1:     pop     dx
     }
 }
 
+/* copy len bytes of memory starting at linear address memaddr */
+void read_memory(unsigned char *dst,const unsigned long memaddr,const unsigned int len) {
+#if TARGET_MSDOS == 16
+    unsigned int i;
+
+    /* if any byte in the range extends past FFFF:FFFF (1MB+64KB) then use flat real mode */
+    if ((memaddr+(unsigned long)len-1UL) > 0x10FFEFUL) {
+        if (cpu_basic_level >= 3 && !is_v86_mode()) {
+            if (flatrealmode_test() == 0 || flatrealmode_setup(FLATREALMODE_4GB)) {
+                for (i=0;i < len;i++)
+                    dst[i] = flatrealmode_readb((uint32_t)memaddr + (uint32_t)i);
+            }
+            else {
+                memset(dst,'F',len);
+            }
+        }
+        else {
+            memset(dst,'V',len);
+        }
+    }
+    else {
+        unsigned long segv = (unsigned long)memaddr >> 4UL;
+        unsigned int ofsv = (unsigned int)(memaddr & 0xFUL);
+
+        if (segv > 0xFFFFUL) {
+            ofsv = memaddr - 0xFFFF0UL;
+            segv = 0xFFFFUL;
+        }
+
+        /* use fmemcpy using linear to segmented conversion */
+        _fmemcpy(dst,MK_FP((unsigned int)segv,ofsv),len);
+    }
+#else
+    (void)dst;
+    (void)memaddr;
+    (void)len;
+#endif
+}
+
+/* NAK: queue the frame to go out again. there is no other answer */
+void do_stream_nak_command(void) {
+    unsigned char i;
+
+    if (stream_mode == 0 || cur_pkt_in.hdr.length < 5 || stream_nak_count >= STREAM_NAK_MAX)
+        return;
+
+    stream_nak[stream_nak_count] =
+        ((unsigned long)cur_pkt_in.data[1] << 0UL) +
+        ((unsigned long)cur_pkt_in.data[2] << 8UL) +
+        ((unsigned long)cur_pkt_in.data[3] << 16UL) +
+        ((unsigned long)cur_pkt_in.data[4] << 24UL);
+
+    // already asked for?
+    for (i=0;i < stream_nak_count;i++) {
+        if (stream_nak[i] == stream_nak[stream_nak_count])
+            return;
+    }
+
+    stream_nak_count++;
+}
+
+void do_stream_command(void) {
+    memcpy(cur_pkt_out.data,cur_pkt_in.data,9);
+    cur_pkt_out.hdr.length = 9;
+
+    switch (cur_pkt_in.data[0]) {
+        case REMCTL_SERIAL_TYPE_STREAM_MEMORY:
+        case REMCTL_SERIAL_TYPE_STREAM_FILE:
+            if (cur_pkt_in.hdr.length < 9 ||
+                (cur_pkt_in.data[0] == REMCTL_SERIAL_TYPE_STREAM_FILE && open_file_fd < 0)) {
+                cur_pkt_out.data[0] = REMCTL_SERIAL_TYPE_FILE_MSDOS_ERROR;
+                cur_pkt_out.hdr.length = 1;
+                break;
+            }
+
+            // a second request (the client didn't get our answer) starts over
+            stream_mode = cur_pkt_in.data[0];
+            stream_done_sent = 0;
+            stream_base =
+                ((unsigned long)cur_pkt_in.data[1] << 0UL) +
+                ((unsigned long)cur_pkt_in.data[2] << 8UL) +
+                ((unsigned long)cur_pkt_in.data[3] << 16UL) +
+                ((unsigned long)cur_pkt_in.data[4] << 24UL);
+            stream_length =
+                ((unsigned long)cur_pkt_in.data[5] << 0UL) +
+                ((unsigned long)cur_pkt_in.data[6] << 8UL) +
+                ((unsigned long)cur_pkt_in.data[7] << 16UL) +
+                ((unsigned long)cur_pkt_in.data[8] << 24UL);
+            stream_next = 0;
+            stream_nak_count = 0;
+            break;
+        case REMCTL_SERIAL_TYPE_STREAM_END:
+            stream_mode = 0;
+            stream_nak_count = 0;
+            cur_pkt_out.hdr.length = 1;
+            break;
+        default:
+            begin_output_packet(REMCTL_SERIAL_TYPE_ERROR);
+            cur_pkt_out_seq = 0xFF;
+            break;
+    }
+}
+
 void handle_packet(void) {
     unsigned int port,data;
 
@@ -1074,38 +1378,19 @@ void handle_packet(void) {
                     ((unsigned long)cur_pkt_in.data[2] << 16UL) +
                     ((unsigned long)cur_pkt_in.data[3] << 24UL);
 
-#if TARGET_MSDOS == 16
-                /* if any byte in the range extends past FFFF:FFFF (1MB+64KB) then use flat real mode */
-                if ((memaddr+(unsigned long)cur_pkt_in.data[4]-1UL) > 0x10FFEFUL) {
-                    if (cpu_basic_level >= 3 && !is_v86_mode()) {
-                        if (flatrealmode_test() == 0 || flatrealmode_setup(FLATREALMODE_4GB)) {
-                            for (port=0;port < (unsigned int)cur_pkt_in.data[4];port++)
-                                cur_pkt_out.data[5+port] = flatrealmode_readb((uint32_t)memaddr + (uint32_t)port);
-                        }
-                        else {
-                            memset(cur_pkt_out.data+5,'F',(unsigned int)cur_pkt_in.data[4]);
-                        }
-                    }
-                    else {
-                        memset(cur_pkt_out.data+5,'V',(unsigned int)cur_pkt_in.data[4]);
-                    }
-                }
-                else {
-                    unsigned long segv = (unsigned long)memaddr >> 4UL;
-                    unsigned int ofsv = (unsigned int)(memaddr & 0xFUL);
-
-                    if (segv > 0xFFFFUL) {
-                        ofsv = memaddr - 0xFFFF0UL;
-                        segv = 0xFFFFUL;
-                    }
+                read_memory(cur_pkt_out.data+5,memaddr,(unsigned int)cur_pkt_in.data[4]);
+            }
 
-                    /* use fmemcpy using linear to segmented conversion */
-                    _fmemcpy(cur_pkt_out.data+5,
-                        MK_FP((unsigned int)segv,ofsv),(unsigned int)cur_pkt_in.data[4]);
-                }
-#endif
+            end_output_packet();
+            break;
+        case REMCTL_SERIAL_TYPE_STREAM:
+            if (cur_pkt_in.data[0] == REMCTL_SERIAL_TYPE_STREAM_NAK) {
+                do_stream_nak_command();
+                break;
             }
 
+            begin_output_packet(REMCTL_SERIAL_TYPE_STREAM);
+            do_stream_command();
             end_output_packet();
             break;
         case REMCTL_SERIAL_TYPE_MEMWRITE:
@@ -1203,6 +1488,12 @@ void handle_packet(void) {
                     case REMCTL_SERIAL_TYPE_FILE_TRUNCATE:
                         do_file_truncate_command();
                         break;
+                    case REMCTL_SERIAL_TYPE_FILE_READ_AT:
+                        do_file_read_at_command();
+                        break;
+                    case REMCTL_SERIAL_TYPE_FILE_WRITE_AT:
+                        do_file_write_at_command();
+                        break;
                     default:
                         begin_output_packet(REMCTL_SERIAL_TYPE_ERROR);
                         cur_pkt_out_seq = 0xFF;
@@ -1214,6 +1505,31 @@ void handle_packet(void) {
                 cur_pkt_out.hdr.length = 1;
             }
 
+            end_output_packet();
+            break;
+        case REMCTL_SERIAL_TYPE_WINDOW:
+            if (cur_pkt_in.hdr.length < 1) {
+                begin_output_packet(REMCTL_SERIAL_TYPE_ERROR);
+                cur_pkt_out_seq = 0xFF;
+                end_output_packet();
+                break;
+            }
+
+            window_size = cur_pkt_in.data[0];
+            if (window_size > WINDOW_MAX)
+                window_size = WINDOW_MAX;
+
+            // the switch happens at sequence 0xFF both ways, so both ends start over from 0
+            window_ack = 0;
+            window_rcvd = 0;
+            window_reply_clear();
+            cur_pkt_in_seq = 0;
+            cur_pkt_out_seq = 0xFF;
+
+            begin_output_packet(REMCTL_SERIAL_TYPE_WINDOW);
+            cur_pkt_out.hdr.sequence = 0xFF;
+            cur_pkt_out.data[0] = window_size;
+            cur_pkt_out.hdr.length = 1;
             end_output_packet();
             break;
         default:
@@ -1228,6 +1544,73 @@ void handle_packet(void) {
     restore_dta();
 }
 
+/* windowed mode: note that a sequence number arrived, advance the cumulative ACK.
+ * returns 1 if it is new, 0 if it arrived before (a retransmit) */
+int window_track(const unsigned char seq) {
+    unsigned char d = (seq - window_ack) & 0x7F;
+
+    // anything further than that is a retransmit of something already acknowledged
+    if (d >= 16 || (window_rcvd & (1U << d)))
+        return 0;
+
+    window_rcvd |= 1U << d;
+    while (window_rcvd & 1U) {
+        window_rcvd >>= 1U;
+        window_ack = (window_ack + 1) & 0x7F;
+    }
+
+    return 1;
+}
+
+void window_reply_clear(void) {
+    unsigned char i;
+
+    for (i=0;i < WINDOW_MAX;i++)
+        window_reply[i].hdr.mark = 0;
+}
+
+/* windowed mode: keep the answer just made, in case the client doesn't get it and asks again.
+ * "MS-DOS is busy" is not kept, nothing was done and the retransmit should be done for real */
+void window_reply_keep(void) {
+    struct remctl_serial_packet *r = &window_reply[cur_pkt_in.hdr.sequence % WINDOW_MAX];
+
+    r->hdr.mark = 0;
+    if (cur_pkt_out.hdr.mark != REMCTL_SERIAL_MARK)
+        return;
+    if (cur_pkt_out.hdr.type == REMCTL_SERIAL_TYPE_FILE && cur_pkt_out.hdr.length >= 1 &&
+        cur_pkt_out.data[0] == REMCTL_SERIAL_TYPE_FILE_MSDOS_IS_BUSY)
+        return;
+
+    memcpy(r,&cur_pkt_out,sizeof(cur_pkt_out.hdr)+cur_pkt_out.hdr.length);
+}
+
+/* windowed mode: a retransmit of something already done gets the same answer again,
+ * it is not done twice (a second FILE WRITE would write the data twice). returns 1 if answered */
+int window_reply_again(void) {
+    const struct remctl_serial_packet *r = &window_reply[cur_pkt_in.hdr.sequence % WINDOW_MAX];
+
+    if (r->hdr.mark != REMCTL_SERIAL_MARK || r->hdr.sequence != cur_pkt_in.hdr.sequence)
+        return 0;
+
+    memcpy(&cur_pkt_out,r,sizeof(r->hdr)+r->hdr.length);
+    cur_pkt_out_write = 0;
+    return 1;
+}
+
+/* the client went away or started over: back to stop-and-wait, and no stream */
+void session_reset(void) {
+    window_size = 0;
+    window_ack = 0;
+    window_rcvd = 0;
+    window_reply_clear();
+
+    stream_mode = 0;
+    stream_nak_count = 0;
+
+    cur_pkt_in_seq = 0xFF;
+    cur_pkt_out_seq = 0xFF;
+}
+
 int inpkt_validate(void) {
     unsigned char sum = cur_pkt_in.hdr.chksum;
     unsigned int i;
@@ -1238,6 +1621,20 @@ int inpkt_validate(void) {
     if (sum != 0)
         return 0;
 
+    // windowed mode: anything in any order, the client retransmits and expects us to answer again.
+    // returns 2 for a retransmit.
+    if (window_size != 0) {
+        if (cur_pkt_in.hdr.sequence != 0xFF)
+            return window_track(cur_pkt_in.hdr.sequence) ? 1 : 2;
+
+        // only WINDOW and the stream requests start over at 0xFF in windowed mode. anything
+        // else is a new client in stop-and-wait, the one that asked for windowed mode is gone
+        if (cur_pkt_in.hdr.type == REMCTL_SERIAL_TYPE_WINDOW || cur_pkt_in.hdr.type == REMCTL_SERIAL_TYPE_STREAM)
+            return 1;
+
+        session_reset();
+    }
+
     // and check sequence
     if (cur_pkt_in.hdr.sequence == 0xFF)
         cur_pkt_in_seq = cur_pkt_in.hdr.sequence;
@@ -1249,6 +1646,8 @@ int inpkt_validate(void) {
 }
 
 int process_input_packet(void) {
+    int r;
+
     /* we can't generate a new packet until the current output packet is finished sending */
     if (cur_pkt_out.hdr.mark == REMCTL_SERIAL_MARK)
         return -1;
@@ -1259,8 +1658,24 @@ int process_input_packet(void) {
 
     /* send an error packet if a packet doesn't validate */
     in_packet_handling = 1;
-    if (inpkt_validate()) {
+    client_idle_ticks = 0;
+    if ((r=inpkt_validate()) == 2 && window_reply_again()) {
+        /* a retransmit, answered again */
+    }
+    else if (r != 0) {
         handle_packet();
+        if (window_size != 0 && cur_pkt_in.hdr.sequence != 0xFF)
+            window_reply_keep();
+    }
+    else if (window_size != 0) {
+        // windowed mode: tell the client what did arrive, so it retransmits only what was lost
+        begin_output_packet(REMCTL_SERIAL_TYPE_ACK);
+        cur_pkt_out.hdr.sequence = window_ack;
+        cur_pkt_out.data[0] = window_ack;
+        cur_pkt_out.data[1] = (unsigned char)(window_rcvd >> 0U);
+        cur_pkt_out.data[2] = (unsigned char)(window_rcvd >> 8U);
+        cur_pkt_out.hdr.length = 3;
+        end_output_packet();
     }
     else {
         begin_output_packet(REMCTL_SERIAL_TYPE_ERROR);
@@ -1278,33 +1693,147 @@ int process_input_packet(void) {
     return 0;
 }
 
-void process_input(void) {
-    if (cur_pkt_in_write >= (sizeof(cur_pkt_in.hdr)+cur_pkt_in.hdr.length)) {
-        if (process_input_packet() < 0)
-            return;
-    }
+/* move everything the UART has into the ring, even while a packet waits for output */
+void rx_ring_fill(void) {
+    unsigned int next;
+    unsigned char c;
 
     do {
 #ifdef TARGET_PC98
         if (!uart_8251_rxready(uart))
             break;
 
-        ((unsigned char*)(&cur_pkt_in))[cur_pkt_in_write] = uart_8251_read(uart);
+        c = uart_8251_read(uart);
 #else
         if (!uart_8250_can_read(uart))
             break;
 
-        ((unsigned char*)(&cur_pkt_in))[cur_pkt_in_write] = uart_8250_read(uart);
+        c = uart_8250_read(uart);
 #endif
 
+        // if the ring is full the byte is lost. the checksum will catch it.
+        next = (rx_ring_head + 1U) & (RX_RING_SIZE - 1U);
+        if (next != rx_ring_tail) {
+            rx_ring[rx_ring_head] = c;
+            rx_ring_head = next;
+        }
+    } while(1);
+}
+
+void process_input(void) {
+    rx_ring_fill();
+
+    if (cur_pkt_in_write >= (sizeof(cur_pkt_in.hdr)+cur_pkt_in.hdr.length)) {
+        if (process_input_packet() < 0)
+            return;
+    }
+
+    while (rx_ring_tail != rx_ring_head) {
+        ((unsigned char*)(&cur_pkt_in))[cur_pkt_in_write] = rx_ring[rx_ring_tail];
+        rx_ring_tail = (rx_ring_tail + 1U) & (RX_RING_SIZE - 1U);
+
         if (cur_pkt_in_write == 0 && cur_pkt_in.hdr.mark != REMCTL_SERIAL_MARK)
             continue;
 
         if ((++cur_pkt_in_write) >= (sizeof(cur_pkt_in.hdr)+cur_pkt_in.hdr.length)) {
             if (process_input_packet() < 0)
                 break;
+
+            // handling the packet may have taken a while
+            rx_ring_fill();
         }
-    } while(1);
+    }
+}
+
+/* put the next stream frame in cur_pkt_out. returns 1 if there is one, 0 if not (or not yet) */
+int stream_output_frame(void) {
+    unsigned short len = 0;
+    unsigned long offset;
+    unsigned short crc;
+    unsigned char i;
+
+    if (stream_mode == 0)
+        return 0;
+
+    if (stream_nak_count != 0)
+        offset = stream_nak[0];
+    else if (stream_next < stream_length)
+        offset = stream_next;
+    else if (!stream_done_sent)
+        offset = stream_length;
+    else
+        return 0;
+
+    if (offset < stream_length) {
+        len = REMCTL_SERIAL_STREAM_FRAME;
+        if (len > (stream_length - offset))
+            len = (unsigned short)(stream_length - offset);
+
+        if (stream_mode == REMCTL_SERIAL_TYPE_STREAM_FILE) {
+            unsigned short err;
+
+            // try again on the next call, it's going to be the timer or INT 28h that finds MS-DOS idle
+            if (!safe_to_use_msdos_fs_io())
+                return 0;
+
+            save_and_switch_psp();
+            err = 1;
+            if (open_file_fd >= 0 && seek_open_file(stream_base + offset) == 0)
+                err = read_open_file((unsigned char far*)cur_pkt_out.data + 5,&len);
+            restore_psp();
+
+            // the file ended (or failed) here. the DONE frame says so
+            if (err != 0 || len == 0) {
+                stream_length = offset;
+                len = 0;
+            }
+            else if (len < REMCTL_SERIAL_STREAM_FRAME) {
+                stream_length = offset + len;
+            }
+        }
+        else {
+            read_memory(cur_pkt_out.data + 5,stream_base + offset,len);
+        }
+    }
+
+    if (stream_nak_count != 0) {
+        for (i=1;i < stream_nak_count;i++)
+            stream_nak[i-1] = stream_nak[i];
+
+        stream_nak_count--;
+    }
+    else if (stream_next < stream_length) {
+        stream_next += len;
+    }
+
+    // frames don't go through begin_output_packet(), they must not take a sequence number
+    cur_pkt_out.hdr.mark = REMCTL_SERIAL_MARK;
+    cur_pkt_out.hdr.sequence = 0xFF;
+    cur_pkt_out.hdr.type = REMCTL_SERIAL_TYPE_STREAM;
+    cur_pkt_out.hdr.chksum = 0;
+
+    if (offset >= stream_length) {
+        offset = stream_length;
+        stream_done_sent = 1;
+        cur_pkt_out.data[0] = REMCTL_SERIAL_TYPE_STREAM_DONE;
+        len = 0;
+    }
+    else {
+        cur_pkt_out.data[0] = REMCTL_SERIAL_TYPE_STREAM_DATA;
+    }
+
+    cur_pkt_out.data[1] = (unsigned char)(offset >> 0UL);
+    cur_pkt_out.data[2] = (unsigned char)(offset >> 8UL);
+    cur_pkt_out.data[3] = (unsigned char)(offset >> 16UL);
+    cur_pkt_out.data[4] = (unsigned char)(offset >> 24UL);
+
+    crc = remctl_crc16_update(REMCTL_CRC16_INIT,cur_pkt_out.data,5 + len);
+    cur_pkt_out.data[5 + len] = (unsigned char)(crc >> 8U);
+    cur_pkt_out.data[6 + len] = (unsigned char)(crc >> 0U);
+    cur_pkt_out.hdr.length = 7 + len;
+    end_output_packet();
+    client_idle_ticks = 0;
+    return 1;
 }
 
 void process_output(void) {
@@ -1313,6 +1842,20 @@ void process_output(void) {
         return;
 
     do_process_output();
+
+    /* streaming: keep the UART busy with the next frame, but let a waiting
+     * request (NAK, END) from the client in first */
+    while (stream_mode != 0 && !has_output()) {
+        if (cur_pkt_in_write != 0 && cur_pkt_in_write >= (sizeof(cur_pkt_in.hdr)+cur_pkt_in.hdr.length)) {
+            process_input_packet(); /* calls us again */
+            break;
+        }
+
+        if (!stream_output_frame())
+            break;
+
+        do_process_output();
+    }
 }
 
 void do_process_output(void) {
@@ -1584,6 +2127,14 @@ int main(int argc,char **argv) {
     if (parse_argv(argc,argv))
         return 1;
 
+    /* 18.2 timer ticks a second, 10 bits a byte */
+    if (baud_rate != 0) {
+        unsigned long t = ((unsigned long)STREAM_IDLE_FRAMES * sizeof(struct remctl_serial_packet) * 182UL) / baud_rate;
+
+        if (t > 0xFFF0UL) t = 0xFFF0UL;
+        if (t > (unsigned long)stream_idle_ticks) stream_idle_ticks = (unsigned int)t;
+    }
+
 	cpu_probe();
 	probe_dos();
     detect_windows();
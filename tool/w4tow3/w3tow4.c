@@ -0,0 +1,264 @@
+/* Compress a W3 VMM32.VXD (such as the output of w4tow3) back into the W4 format.
+ *
+ * W4 layout: the MZ stub up to the W3 header is copied as-is, then the 16-byte W4 header
+ * where the W3 header was, then the chunk table (file offset of each chunk), then the chunks.
+ * Each chunk holds 8KB of the W3 image from the W3 header onward. A chunk that does not
+ * compress is stored as exactly 8KB, which is how the decompressor tells them apart. */
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+
+#include "w4codec.h"
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+char*               src_file = NULL;
+char*               dst_file = NULL;
+
+int                 src_fd = -1;
+int                 dst_fd = -1;
+
+unsigned long       synthetic_size = 0;
+
+int parse_argv(int argc,char **argv) {
+    char *a;
+    int i;
+
+    for (i=1;i < argc;) {
+        a = argv[i++];
+
+        if (*a == '-') {
+            do { a++; } while (*a == '-');
+
+            if (!strcmp(a,"i")) {
+                src_file = argv[i++];
+                if (src_file == NULL) return 1;
+            }
+            else if (!strcmp(a,"o")) {
+                dst_file = argv[i++];
+                if (dst_file == NULL) return 1;
+            }
+            else if (!strcmp(a,"synthetic")) {
+                a = argv[i++];
+                if (a == NULL) return 1;
+                synthetic_size = strtoul(a,NULL,0);
+            }
+            else {
+                fprintf(stderr,"Unknown switch '%s'\n",a);
+                return 1;
+            }
+        }
+        else {
+            fprintf(stderr,"Unexpected arg '%s'\n",a);
+            return 1;
+        }
+    }
+
+    if (src_file == NULL && synthetic_size == 0) {
+        fprintf(stderr,"Need source file, -i switch, or -synthetic <size>\n");
+        return 1;
+    }
+    if (dst_file == NULL) {
+        fprintf(stderr,"Need output file, -o switch\n");
+        return 1;
+    }
+
+    return 0;
+}
+
+/* Make up a W3 image of roughly the given size for testing and benchmarking. The content
+ * is a repeating vocabulary of short random "instruction sequences" with some noise mixed
+ * in, which compresses about as well as real 32-bit code does. */
+unsigned char *MakeSynthetic(unsigned long size,uint32_t *plen) {
+    const uint32_t le_offset = 0x80;
+    unsigned char words[256][24];
+    unsigned char wordlen[256];
+    uint32_t seed = 0x12345678UL;
+    unsigned char *buf;
+    uint32_t len,i,j;
+
+#define RND() (seed = (seed * 1103515245UL) + 12345UL, (unsigned int)(seed >> 16UL))
+
+    len = le_offset + (uint32_t)size;
+    buf = (unsigned char*)malloc(len);
+    if (buf == NULL) return NULL;
+
+    memset(buf,0,le_offset);
+    buf[0] = 'M';
+    buf[1] = 'Z';
+    *((uint32_t*)(buf+0x3C)) = le_offset;
+
+    for (i=0;i < 256;i++) {
+        wordlen[i] = (unsigned char)(2 + (RND() % 22));
+        for (j=0;j < wordlen[i];j++) words[i][j] = (unsigned char)RND();
+    }
+
+    for (i=le_offset;i < len;) {
+        if ((RND() % 8) == 0) {
+            buf[i++] = (unsigned char)RND();
+        }
+        else {
+            const unsigned int w = RND() % 256;
+
+            for (j=0;j < wordlen[w] && i < len;j++) buf[i++] = words[w][j];
+        }
+    }
+
+    buf[le_offset+0] = 'W';
+    buf[le_offset+1] = '3';
+
+#undef RND
+
+    *plen = len;
+    return buf;
+}
+
+int main(int argc,char **argv) {
+    unsigned char *filebuf,*out,*chk;
+    uint32_t *chunkTable;
+    uint32_t le_offset;
+    uint32_t file_size;
+    uint32_t num_chunks;
+    uint32_t chunk,outpos;
+    size_t out_alloc;
+
+    if (parse_argv(argc,argv))
+        return 1;
+
+    W4CodecInit();
+
+    if (synthetic_size != 0) {
+        filebuf = MakeSynthetic(synthetic_size,&file_size);
+        if (filebuf == NULL) {
+            fprintf(stderr,"Cannot alloc\n");
+            return 1;
+        }
+    }
+    else {
+        size_t rd;
+
+        if ((src_fd=open(src_file,O_RDONLY|O_BINARY)) < 0) {
+            fprintf(stderr,"Cannot open source file %s, %s\n",src_file,strerror(errno));
+            return 1;
+        }
+
+        file_size = (uint32_t)lseek(src_fd,0,SEEK_END);
+        if (lseek(src_fd,0,SEEK_SET) != 0) {
+            fprintf(stderr,"Cannot read\n");
+            return 1;
+        }
+        filebuf = (unsigned char*)malloc((size_t)file_size);
+        if (filebuf == NULL) {
+            fprintf(stderr,"Cannot alloc file buffer\n");
+            return 1;
+        }
+        for (rd=0;rd < (size_t)file_size;) {
+            ssize_t r = read(src_fd,filebuf+rd,(size_t)file_size-rd);
+            if (r <= 0) break;
+            rd += (size_t)r;
+        }
+        if (rd != (size_t)file_size) {
+            fprintf(stderr,"Cannot read\n");
+            return 1;
+        }
+        close(src_fd);
+    }
+
+    if (file_size < 0x40) {
+        fprintf(stderr,"Cannot read\n");
+        return 1;
+    }
+    le_offset = *((uint32_t*)(filebuf+0x3C));
+    fprintf(stderr,"W3 offset: %lu\n",(unsigned long)le_offset);
+    if (le_offset > file_size || (file_size - le_offset) < 16 || memcmp(filebuf+le_offset,"W3",2) != 0) {
+        fprintf(stderr,"Not a W3 file\n");
+        return 1;
+    }
+
+    num_chunks = ((file_size - le_offset) + W4_CHUNK_SIZE - 1u) / W4_CHUNK_SIZE;
+    if (num_chunks == 0 || num_chunks > 1024) {
+        fprintf(stderr,"Not the right number of chunks\n");
+        return 1;
+    }
+    fprintf(stderr,"Num chunks: %lu\n",(unsigned long)num_chunks);
+
+    /* worst case, every chunk grows by 1/8 (9-bit literals) */
+    out_alloc = (size_t)le_offset + 16u + (sizeof(uint32_t) * num_chunks) + ((size_t)num_chunks * (W4_CHUNK_SIZE * 2u));
+    out = (unsigned char*)malloc(out_alloc);
+    chk = (unsigned char*)malloc(W4_CHUNK_SIZE);
+    if (out == NULL || chk == NULL) {
+        fprintf(stderr,"Cannot alloc output\n");
+        return 1;
+    }
+
+    memcpy(out,filebuf,le_offset);
+    memset(out+le_offset,0,16);
+    memcpy(out+le_offset+0,"W4",2);
+    *((uint16_t*)(out+le_offset+2)) = 0x0400;
+    *((uint16_t*)(out+le_offset+4)) = W4_CHUNK_SIZE;
+    *((uint16_t*)(out+le_offset+6)) = (uint16_t)num_chunks;
+    memcpy(out+le_offset+8,"DS",2);
+    chunkTable = (uint32_t*)(out+le_offset+16);
+    outpos = le_offset + 16u + (uint32_t)(sizeof(uint32_t) * num_chunks);
+
+    for (chunk=0;chunk < num_chunks;chunk++) {
+        const unsigned char *src = filebuf + le_offset + (chunk * W4_CHUNK_SIZE);
+        uint32_t srclen = file_size - le_offset - (chunk * W4_CHUNK_SIZE);
+        uint32_t complen;
+
+        if (srclen > W4_CHUNK_SIZE) srclen = W4_CHUNK_SIZE;
+
+        chunkTable[chunk] = outpos;
+
+        /* a full chunk stored as-is is exactly 8KB, so compressed data must be smaller than that */
+        complen = W4Compress(out+outpos,(srclen == W4_CHUNK_SIZE) ? (W4_CHUNK_SIZE - 1u) : (W4_CHUNK_SIZE * 2u),src,srclen);
+        if (complen == 0) {
+            if (srclen != W4_CHUNK_SIZE) {
+                fprintf(stderr,"Chunk %lu did not compress\n",(unsigned long)chunk);
+                return 1;
+            }
+
+            memcpy(out+outpos,src,srclen);
+            complen = srclen;
+        }
+        else {
+            /* a chunk exactly 8KB long is taken as stored, so pad with a zero byte (read as more zero bits) */
+            if (complen == W4_CHUNK_SIZE)
+                out[outpos+(complen++)] = 0;
+
+            /* make sure it comes back the same */
+            if (W4Decompress(chk,W4_CHUNK_SIZE,out+outpos,complen) != srclen || memcmp(chk,src,srclen) != 0) {
+                fprintf(stderr,"Chunk %lu did not decompress back to the same data\n",(unsigned long)chunk);
+                return 1;
+            }
+        }
+
+        outpos += complen;
+    }
+
+    fprintf(stderr,"W3 size %lu, W4 size %lu\n",(unsigned long)file_size,(unsigned long)outpos);
+
+    if ((dst_fd=open(dst_file,O_WRONLY|O_BINARY|O_CREAT|O_TRUNC,0644)) < 0) {
+        fprintf(stderr,"Cannot open dest file %s, %s\n",dst_file,strerror(errno));
+        return 1;
+    }
+    if ((uint32_t)write(dst_fd,out,outpos) != outpos) {
+        fprintf(stderr,"Cannot write output, %s\n",strerror(errno));
+        return 1;
+    }
+    close(dst_fd);
+
+    free(filebuf);
+    free(out);
+    free(chk);
+    return 0;
+}
+
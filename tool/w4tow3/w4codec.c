@@ -0,0 +1,509 @@
+/* NTS: Based on "W4DECOMP.C" from the book "Windows Undocumented File Formats",
+ *      with some changes to range-check pointers and make sure we're reading
+ *      correctly. So far, this seems to read VMM32.VXD in my Windows 95 VM
+ *      perfectly fine. */
+
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <stdio.h>
+
+#include "w4codec.h"
+
+/* decode table, indexed by the low 9 bits of the bitstream.
+ * value = base + ((bits >> shift) & mask), then nbits are consumed. */
+#define W4_CODE_INVALID         0
+#define W4_CODE_LITERAL         1
+#define W4_CODE_DEPTH           2
+
+struct w4_code {
+    uint8_t         kind;
+    uint8_t         nbits;
+    uint8_t         shift;
+    uint16_t        base;
+    uint16_t        mask;
+};
+
+static struct w4_code w4_first_code[512];   /* literal or depth */
+static struct w4_code w4_count_code[512];   /* count */
+static int w4_codec_init_done = 0;
+
+void W4CodecInit(void) {
+    unsigned int i,n;
+
+    if (w4_codec_init_done)
+        return;
+
+    for (i=0;i < 512;i++) {
+        struct w4_code *c = &w4_first_code[i];
+
+        memset(c,0,sizeof(*c));
+        if ((i & 3) == 1 || (i & 3) == 2) {
+            c->kind = W4_CODE_LITERAL;
+            c->nbits = 9;
+            c->base = (uint16_t)(((i & 0x1FCu) >> 2u) + ((i & 1u) << 7u));
+        }
+        else if ((i & 3) == 0) { // 0-63
+            c->kind = W4_CODE_DEPTH;
+            c->nbits = 8;
+            c->base = (uint16_t)((i & 0xFCu) >> 2u);
+        }
+        else if ((i & 7) == 3) { // 64-319
+            c->kind = W4_CODE_DEPTH;
+            c->nbits = 11;
+            c->shift = 3;
+            c->mask = 0xFF;
+            c->base = 0x40;
+        }
+        else { // 320-4415
+            c->kind = W4_CODE_DEPTH;
+            c->nbits = 15;
+            c->shift = 3;
+            c->mask = 0xFFF;
+            c->base = 0x140;
+        }
+
+        /* count: n zero bits, a one bit, then n bits */
+        c = &w4_count_code[i];
+        memset(c,0,sizeof(*c));
+        for (n=0;n <= 8;n++) {
+            if (i & (1u << n)) {
+                c->kind = W4_CODE_DEPTH;
+                c->nbits = (uint8_t)((n * 2u) + 1u);
+                c->shift = (uint8_t)(n + 1u);
+                c->mask = (uint16_t)((1u << n) - 1u);
+                c->base = (uint16_t)((1u << n) + 1u);
+                break;
+            }
+        }
+    }
+
+    w4_codec_init_done = 1;
+}
+
+/* where the original decoder's source pointer would be, given how many bits were consumed.
+ * it loads 4 bytes up front and one more every 8 bits. */
+static unsigned char *W4BytewiseSrcPos(unsigned char *src,unsigned char *srcfence,size_t consumed) {
+    size_t o = 4u + (consumed >> 3u);
+
+    if (o > (size_t)(srcfence - src)) return srcfence;
+    return src + o;
+}
+
+/* 64-bit bit reservoir decoder. The reservoir is refilled a word at a time, and
+ * codes are decoded by table lookup instead of testing bit patterns one by one.
+ * Output is the same as W4DecompressBytewise(), including where it stops. */
+uint32_t W4Decompress(unsigned char *dst,size_t dstmax,unsigned char *src,size_t srclen) {
+    unsigned char *srcbase = src;
+    unsigned char *srcfence = src + srclen;
+    unsigned char *dstfence = dst + dstmax;
+    unsigned char *dstbase = dst;
+    const struct w4_code *c;
+    unsigned int bitcount = 0;
+    uint64_t bits = 0;
+    unsigned int depth,count;
+
+    if (!w4_codec_init_done)
+        W4CodecInit();
+
+    for (;;) {
+        /* refill, so that at least 32 bits (the longest depth + count) are available */
+        if (bitcount < 32u) {
+            if ((size_t)(srcfence - src) >= 8u) {
+                uint64_t w =
+                     (uint64_t)src[0]         | ((uint64_t)src[1] <<  8u) |
+                    ((uint64_t)src[2] << 16u) | ((uint64_t)src[3] << 24u) |
+                    ((uint64_t)src[4] << 32u) | ((uint64_t)src[5] << 40u) |
+                    ((uint64_t)src[6] << 48u) | ((uint64_t)src[7] << 56u);
+
+                bits |= w << (uint64_t)bitcount;
+                src += (63u - bitcount) >> 3u;
+                bitcount |= 56u;
+            }
+            else {
+                while (bitcount <= 56u && src < srcfence) {
+                    bits |= (uint64_t)(*src++) << (uint64_t)bitcount;
+                    bitcount += 8u;
+                }
+            }
+        }
+
+        c = &w4_first_code[bits & 0x1FFu];
+        if (c->kind == W4_CODE_LITERAL) {
+            if (dst >= dstfence) break;
+            *dst++ = (unsigned char)c->base;
+            bits >>= 9u;
+            bitcount -= 9u;
+            continue;
+        }
+
+        depth = (unsigned int)c->base + ((unsigned int)(bits >> c->shift) & c->mask);
+        bits >>= c->nbits;
+        bitcount -= c->nbits;
+
+        if (depth == 0u)
+            break;
+
+        if (depth == W4_CHECK_DEPTH) {
+            size_t consumed = ((size_t)(src - srcbase) * 8u) - bitcount;
+
+            if (W4BytewiseSrcPos(srcbase,srcfence,consumed) == srcfence)
+                break;
+
+            continue;
+        }
+
+        c = &w4_count_code[bits & 0x1FFu];
+        if (c->kind == W4_CODE_INVALID) {
+            fprintf(stderr,"Unexpected compressed code=0x%08lx\n",(unsigned long)(bits & 0xFFFFFFFFUL));
+            break;
+        }
+
+        count = (unsigned int)c->base + ((unsigned int)(bits >> c->shift) & c->mask);
+        bits >>= c->nbits;
+        bitcount -= c->nbits;
+
+        if ((size_t)depth > (size_t)(dst - dstbase)) {
+            fprintf(stderr,"Unexpected nDepth too large, reaches back too far\n");
+            break;
+        }
+        if ((size_t)count > (size_t)(dstfence - dst)) {
+            fprintf(stderr,"Unexpected nCount too large, reaches too far forward into dest\n");
+            break;
+        }
+
+        if (depth >= count) {
+            memcpy(dst,dst - depth,count);
+            dst += count;
+        }
+        else {
+            unsigned char *sp = dst - depth;
+
+            do { *dst++ = *sp++;
+            } while (--count != 0u);
+        }
+    }
+
+    {
+        size_t consumed = ((size_t)(src - srcbase) * 8u) - bitcount;
+        unsigned char *osrc = W4BytewiseSrcPos(srcbase,srcfence,consumed);
+
+        if (osrc < srcfence)
+            fprintf(stderr,"Warning: %u bytes left\n",(unsigned int)(srcfence - osrc));
+    }
+
+    return (uint32_t)(dst - dstbase);
+}
+
+struct w4_bitwriter {
+    unsigned char*  dst;
+    unsigned char*  dstfence;
+    uint64_t        bits;
+    unsigned int    bitcount;
+    int             overflow;
+};
+
+static void W4PutBits(struct w4_bitwriter *w,uint32_t v,unsigned int n) {
+    w->bits |= (uint64_t)v << (uint64_t)w->bitcount;
+    w->bitcount += n;
+
+    while (w->bitcount >= 8u) {
+        if (w->dst < w->dstfence)
+            *(w->dst++) = (unsigned char)w->bits;
+        else
+            w->overflow = 1;
+
+        w->bits >>= 8u;
+        w->bitcount -= 8u;
+    }
+}
+
+static void W4PutLiteral(struct w4_bitwriter *w,unsigned char b) {
+    W4PutBits(w,((b & 0x80u) ? 1u : 2u) | ((uint32_t)(b & 0x7Fu) << 2u),9);
+}
+
+static void W4PutDepth(struct w4_bitwriter *w,unsigned int depth) {
+    if (depth < 0x40u)
+        W4PutBits(w,(uint32_t)depth << 2u,8);
+    else if (depth < 0x140u)
+        W4PutBits(w,3u | ((uint32_t)(depth - 0x40u) << 3u),11);
+    else
+        W4PutBits(w,7u | ((uint32_t)(depth - 0x140u) << 3u),15);
+}
+
+static void W4PutCount(struct w4_bitwriter *w,unsigned int count) {
+    unsigned int n = 0;
+
+    while (count >= ((2u << n) + 1u)) n++;
+    W4PutBits(w,(1u << n) | ((uint32_t)(count - ((1u << n) + 1u)) << (n + 1u)),(n * 2u) + 1u);
+}
+
+/* cost in bits of a depth + count pair, for choosing between matches */
+static unsigned int W4MatchCost(unsigned int depth,unsigned int count) {
+    unsigned int n = 0;
+
+    while (count >= ((2u << n) + 1u)) n++;
+    return ((depth < 0x40u) ? 8u : ((depth < 0x140u) ? 11u : 15u)) + (n * 2u) + 1u;
+}
+
+#define W4_HASH_BITS            12u
+#define W4_HASH_SIZE            (1u << W4_HASH_BITS)
+#define W4_CHAIN_LIMIT          128u
+
+static unsigned int W4Hash(const unsigned char *p) {
+    return (((unsigned int)p[0] << 4u) ^ (unsigned int)p[1] ^ ((unsigned int)p[1] << 8u)) & (W4_HASH_SIZE - 1u);
+}
+
+/* longest match for src[pos] within the window. returns the length, depth in *pdepth */
+static unsigned int W4FindMatch(const unsigned char *src,size_t srclen,size_t pos,const uint16_t *head,const uint16_t *prev,unsigned int *pdepth) {
+    unsigned int best = 0,bestcost = 0,chain = W4_CHAIN_LIMIT;
+    size_t maxlen = srclen - pos;
+    uint16_t cand;
+
+    if (maxlen > W4_MAX_COUNT) maxlen = W4_MAX_COUNT;
+    if (maxlen < 2u) return 0;
+
+    cand = head[W4Hash(src + pos)];
+    while (cand != 0xFFFFu && chain-- != 0u) {
+        const size_t depth = pos - (size_t)cand;
+        unsigned int len = 0;
+
+        if (depth > W4_MAX_DEPTH) break;
+
+        if (src[cand+best] == src[pos+best]) {
+            while (len < maxlen && src[cand+len] == src[pos+len]) len++;
+
+            /* prefer longer, then cheaper to encode */
+            if (len >= 2u && (len > best || (len == best && W4MatchCost((unsigned int)depth,len) < bestcost))) {
+                best = len;
+                bestcost = W4MatchCost((unsigned int)depth,len);
+                *pdepth = (unsigned int)depth;
+                if (len == maxlen) break;
+            }
+        }
+
+        cand = prev[cand];
+    }
+
+    return best;
+}
+
+/* LZ77 with hash chains and one step lazy matching, emitted as one block ending in a
+ * check marker. Returns the compressed size, or 0 if it does not fit in dstmax. */
+uint32_t W4Compress(unsigned char *dst,size_t dstmax,const unsigned char *src,size_t srclen) {
+    uint16_t head[W4_HASH_SIZE];
+    uint16_t prev[W4_CHUNK_SIZE];
+    struct w4_bitwriter w;
+    size_t pos = 0,ins = 0;
+
+    if (srclen > W4_CHUNK_SIZE)
+        return 0;
+
+    memset(head,0xFF,sizeof(head));
+    memset(&w,0,sizeof(w));
+    w.dst = dst;
+    w.dstfence = dst + dstmax;
+
+    while (pos < srclen) {
+        unsigned int len,depth = 0;
+
+        /* add positions up to here to the hash chains */
+        for (;ins < pos && (ins+1u) < srclen;ins++) {
+            const unsigned int h = W4Hash(src + ins);
+            prev[ins] = head[h];
+            head[h] = (uint16_t)ins;
+        }
+
+        len = W4FindMatch(src,srclen,pos,head,prev,&depth);
+        if (len != 0u && len < W4_MAX_COUNT && (pos+1u) < srclen) {
+            unsigned int nlen,ndepth = 0;
+
+            if ((ins+1u) < srclen) {
+                const unsigned int h = W4Hash(src + ins);
+                prev[ins] = head[h];
+                head[h] = (uint16_t)ins;
+                ins++;
+            }
+
+            /* if the next byte starts a longer match, emit a literal instead */
+            nlen = W4FindMatch(src,srclen,pos+1u,head,prev,&ndepth);
+            if (nlen > (len + 1u)) {
+                W4PutLiteral(&w,src[pos]);
+                pos++;
+                len = nlen;
+                depth = ndepth;
+            }
+        }
+
+        if (len != 0u) {
+            W4PutDepth(&w,depth);
+            W4PutCount(&w,len);
+            pos += len;
+        }
+        else {
+            W4PutLiteral(&w,src[pos]);
+            pos++;
+        }
+
+        if (w.overflow)
+            return 0;
+    }
+
+    /* end of data. the decoder stops at a check marker once it has loaded the last byte */
+    W4PutDepth(&w,W4_CHECK_DEPTH);
+    if (w.bitcount != 0u)
+        W4PutBits(&w,0,8u - w.bitcount);
+
+    /* the decoder loads 4 bytes before it starts */
+    while ((size_t)(w.dst - dst) < 4u)
+        W4PutBits(&w,0,8);
+
+    if (w.overflow)
+        return 0;
+
+    return (uint32_t)(w.dst - dst);
+}
+
+/* the original decoder */
+static void LoadMiniBuffer(uint32_t *pMiniBuffer,unsigned char **psrc,unsigned char *srcfence,uint16_t *pBitsUsed,uint16_t *pBitCount) {
+    while ((*pBitsUsed) != 0) {
+        (*pBitsUsed)--;
+        *pMiniBuffer >>= 1;
+        if (--(*pBitCount) == 0) {
+            if (*psrc < srcfence) {
+                if (*pMiniBuffer & 0xFF000000UL)
+                    fprintf(stderr,"minibuffer upper 8 bits != 0\n");
+
+                *pMiniBuffer += (uint32_t)(**psrc) << (uint32_t)24U;
+                (*psrc) += 1U;
+            }
+            *pBitCount += 8U;
+        }
+    }
+}
+
+uint32_t W4DecompressBytewise(unsigned char *dst,size_t dstmax,unsigned char *src,size_t srclen) {
+    unsigned char *srcfence = src + srclen;
+    unsigned char *dstfence = dst + dstmax;
+    unsigned char *dstbase = dst;
+    uint32_t minibuffer = 0;
+    uint16_t nCount, nDepth;
+    uint16_t nBitsUsed = 0;
+    uint16_t nBitCount;
+    size_t nIndex = 0;
+
+    nDepth = 1;
+    nBitCount = 8;
+    for (nIndex=0;nIndex <= 3;nIndex++)
+        minibuffer = (minibuffer >> (uint32_t)8) + (((uint32_t)(*src++)) << (uint32_t)24);
+
+    while (nDepth != 0) {
+        LoadMiniBuffer(&minibuffer,&src,srcfence,&nBitsUsed,&nBitCount);
+
+        if ((minibuffer & 3) == 1 ||
+            (minibuffer & 3) == 2) {
+            if (dst >= dstfence) break;
+            *dst++ = (unsigned char)(((minibuffer & 0x1FCU) >> 2U) + ((minibuffer & 1U) << 7U));
+            nBitsUsed = 9;
+        }
+        else {
+            // 0-63
+            if ((minibuffer & 3U) == 0U) {
+                nDepth = (minibuffer & 0xFCU) >> 2U;
+                nBitsUsed = 8;
+            }
+            // 64-319
+            else if ((minibuffer & 7U) == 3U) {
+                nDepth = ((minibuffer & 0x7F8U) >> 3U) + 0x40U;
+                nBitsUsed = 11;
+            }
+            // 320-4414
+            else if ((minibuffer & 7U) == 7U) {
+                nDepth = ((minibuffer & 0x7FF8U) >> 3U) + 0x140U;
+                nBitsUsed = 15;
+            }
+            else {
+                fprintf(stderr,"Invalid depth data\n");
+                break;
+            }
+
+            // if not zero and not CheckBuffer
+            if (nDepth != 0 && nDepth != 0x113FU) { // 0x113FU == (4415 - 320)
+                LoadMiniBuffer(&minibuffer,&src,srcfence,&nBitsUsed,&nBitCount);
+
+                if ((minibuffer & 1) == 1) { // 2
+                    nCount = 2;
+                    nBitsUsed = 1;
+                }
+                else if ((minibuffer & 3) == 2) { // 3-4
+                    nCount = ((minibuffer & 4U) >> 2U) + 3U;
+                    nBitsUsed = 3;
+                }
+                else if ((minibuffer & 7) == 4) { // 5-8
+                    nCount = ((minibuffer & 0x18U) >> 3U) + 5U;
+                    nBitsUsed = 5;
+                }
+                else if ((minibuffer & 0x0FU) == 8) { // 9-16
+                    nCount = ((minibuffer & 0x70U) >> 4U) + 9U;
+                    nBitsUsed = 7;
+                }
+                else if ((minibuffer & 0x1FU) == 16) { // 17-32
+                    nCount = ((minibuffer & 0x1E0U) >> 5U) + 17U;
+                    nBitsUsed = 9;
+                }
+                else if ((minibuffer & 0x3FU) == 32) { // 33-64
+                    nCount = ((minibuffer & 0x7C0U) >> 6U) + 33U;
+                    nBitsUsed = 11;
+                }
+                else if ((minibuffer & 0x7FU) == 64) { // 65-128
+                    nCount = ((minibuffer & 0x1F80U) >> 7U) + 65U;
+                    nBitsUsed = 13;
+                }
+                else if ((minibuffer & 0xFFU) == 128) { // 129-256
+                    nCount = ((minibuffer & 0x7F00U) >> 8U) + 129U;
+                    nBitsUsed = 15;
+                }
+                else if ((minibuffer & 0x1FFU) == 256) { // 257-512
+                    nCount = ((minibuffer & 0x1FE00U) >> 9U) + 257U;
+                    nBitsUsed = 17;
+                }
+                else {
+                    fprintf(stderr,"Unexpected compressed code=0x%08lx\n",(unsigned long)minibuffer);
+                    break;
+                }
+
+                {
+                    unsigned char *sp = dst - nDepth;
+
+                    if (sp < dstbase) {
+                        fprintf(stderr,"Unexpected nDepth too large, reaches back too far\n");
+                        break;
+                    }
+                    if ((dst+nCount) > dstfence) {
+                        fprintf(stderr,"Unexpected nCount too large, reaches too far forward into dest\n");
+                        break;
+                    }
+
+                    assert(nCount != 0);
+
+                    do {  *dst++ = *sp++;
+                    } while (--nCount != 0);
+
+                    assert(sp >= dstbase);
+                    assert(sp <= dstfence);
+                    assert(dst <= dstfence);
+                }
+            }
+            else if (nDepth == 0x113FU && src == srcfence) {
+                break;
+            }
+        }
+    }
+
+    if (src < srcfence)
+        fprintf(stderr,"Warning: %u bytes left\n",(unsigned int)(srcfence - src));
+
+    return (uint32_t)(dst - dstbase);
+}
+
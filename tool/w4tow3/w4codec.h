@@ -0,0 +1,36 @@
+
+#ifndef __DOSLIB_TOOL_W4TOW3_W4CODEC_H
+#define __DOSLIB_TOOL_W4TOW3_W4CODEC_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* W4 (VMM32.VXD) chunks are compressed with the DoubleSpace bitstream, LSB first:
+ *
+ * literal      9 bits: 01 or 10, then 7 bits. bit 0 becomes bit 7 of the byte.
+ * depth        8 bits: 00 + 6 bits            (0-63, 0 = end of data)
+ *             11 bits: 011 + 8 bits           (64-319)
+ *             15 bits: 111 + 12 bits          (320-4415, 4415 = check marker)
+ * count        N zero bits, a one bit, then N bits, N = 0..8 (2-512)
+ *
+ * A depth (other than 0 or the check marker) is followed by a count. */
+
+#define W4_CHUNK_SIZE               8192u
+#define W4_MAX_DEPTH                4414u
+#define W4_CHECK_DEPTH              4415u
+#define W4_MAX_COUNT                512u
+
+/* decompress one chunk. returns the number of bytes written to dst.
+ * W4Decompress() is the fast decoder, W4DecompressBytewise() is the original
+ * byte-at-a-time decoder kept as a reference for benchmarking. */
+uint32_t W4Decompress(unsigned char *dst,size_t dstmax,unsigned char *src,size_t srclen);
+uint32_t W4DecompressBytewise(unsigned char *dst,size_t dstmax,unsigned char *src,size_t srclen);
+
+/* compress one chunk. returns the compressed size, or 0 if it does not fit in dstmax */
+uint32_t W4Compress(unsigned char *dst,size_t dstmax,const unsigned char *src,size_t srclen);
+
+/* must be called once before any other function, before starting threads */
+void W4CodecInit(void);
+
+#endif /* __DOSLIB_TOOL_W4TOW3_W4CODEC_H */
+
@@ -1,8 +1,3 @@
-/* NTS: Based on "W4DECOMP.C" from the book "Windows Undocumented File Formats",
- *      with some changes to range-check pointers and make sure we're reading
- *      correctly. So far, this seems to read VMM32.VXD in my Windows 95 VM
- *      perfectly fine. */
-
 #include <stdint.h>
 #include <string.h>
 #include <unistd.h>
@@ -11,6 +6,11 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
+#include <time.h>
+
+#include <pthread.h>
+
+#include "w4codec.h"
 
 #ifndef O_BINARY
 #define O_BINARY 0
@@ -22,6 +22,9 @@ char*               dst_file = NULL;
 int                 src_fd = -1;
 int                 dst_fd = -1;
 
+unsigned int        num_threads = 0; /* 0 = one per CPU */
+unsigned int        bench_runs = 0;
+
 int parse_argv(int argc,char **argv) {
     char *a;
     int i;
@@ -40,6 +43,16 @@ int parse_argv(int argc,char **argv) {
                 dst_file = argv[i++];
                 if (dst_file == NULL) return 1;
             }
+            else if (!strcmp(a,"j")) {
+                a = argv[i++];
+                if (a == NULL) return 1;
+                num_threads = (unsigned int)strtoul(a,NULL,0);
+            }
+            else if (!strcmp(a,"bench")) {
+                a = argv[i++];
+                if (a == NULL) return 1;
+                bench_runs = (unsigned int)strtoul(a,NULL,0);
+            }
             else {
                 fprintf(stderr,"Unknown switch '%s'\n",a);
                 return 1;
@@ -66,162 +79,188 @@ int parse_argv(int argc,char **argv) {
 uint32_t*           chunkTable = NULL;
 uint32_t            chunkTableEntries = 0;
 
-uint8_t             file_temp[8192]; // also decompression output
-uint8_t             src_temp[8192]; // decompression input
+/* one chunk of the W4 file. chunks are independent, each one decompresses
+ * into its own chunk_size slot of the output image. */
+struct w4_chunk {
+    const unsigned char*    src;
+    uint32_t                srclen;
+    unsigned char*          dst;
+    uint32_t                dstlen;     /* 0 if decompression failed */
+};
 
-void LoadMiniBuffer(uint32_t *pMiniBuffer,unsigned char **psrc,unsigned char *srcfence,uint16_t *pBitsUsed,uint16_t *pBitCount) {
-    while ((*pBitsUsed) != 0) {
-        (*pBitsUsed)--;
-        *pMiniBuffer >>= 1;
-        if (--(*pBitCount) == 0) {
-            if (*psrc < srcfence) {
-                if (*pMiniBuffer & 0xFF000000UL)
-                    fprintf(stderr,"minibuffer upper 8 bits != 0\n");
+struct w4_chunk*    chunks = NULL;
+uint16_t            chunk_size = 0;
+uint16_t            num_chunks = 0;
 
-                *pMiniBuffer += (uint32_t)(**psrc) << (uint32_t)24U;
-                (*psrc) += 1U;
-            }
-            *pBitCount += 8U;
-        }
+pthread_mutex_t     chunk_lock = PTHREAD_MUTEX_INITIALIZER;
+size_t              chunk_next = 0;
+
+typedef uint32_t (*w4_decompress_func)(unsigned char *dst,size_t dstmax,unsigned char *src,size_t srclen);
+
+w4_decompress_func  chunk_decompress = W4Decompress;
+
+void DecompressChunk(struct w4_chunk *c) {
+    if (c->srclen == (uint32_t)chunk_size) {
+        /* TODO: When does this happen? */
+        memcpy(c->dst,c->src,chunk_size);
+        c->dstlen = chunk_size;
+    }
+    else {
+        c->dstlen = chunk_decompress(c->dst,chunk_size,(unsigned char*)c->src,(size_t)c->srclen);
     }
 }
 
-uint32_t W4Decompress(unsigned char *dst,size_t dstmax,unsigned char *src,size_t srclen) {
-    unsigned char *srcfence = src + srclen;
-    unsigned char *dstfence = dst + dstmax;
-    unsigned char *dstbase = dst;
-    uint32_t minibuffer = 0;
-    uint16_t nCount, nDepth;
-    uint16_t nBitsUsed = 0;
-    uint16_t nBitCount;
-    size_t nIndex = 0;
-
-    nDepth = 1;
-    nBitCount = 8;
-    for (nIndex=0;nIndex <= 3;nIndex++)
-        minibuffer = (minibuffer >> (uint32_t)8) + (((uint32_t)(*src++)) << (uint32_t)24);
-
-    while (nDepth != 0) {
-        LoadMiniBuffer(&minibuffer,&src,srcfence,&nBitsUsed,&nBitCount);
-
-        if ((minibuffer & 3) == 1 ||
-            (minibuffer & 3) == 2) {
-            if (dst >= dstfence) break;
-            *dst++ = (unsigned char)(((minibuffer & 0x1FCU) >> 2U) + ((minibuffer & 1U) << 7U));
-            nBitsUsed = 9;
-        }
-        else {
-            // 0-63
-            if ((minibuffer & 3U) == 0U) {
-                nDepth = (minibuffer & 0xFCU) >> 2U;
-                nBitsUsed = 8;
-            }
-            // 64-319
-            else if ((minibuffer & 7U) == 3U) {
-                nDepth = ((minibuffer & 0x7F8U) >> 3U) + 0x40U;
-                nBitsUsed = 11;
-            }
-            // 320-4414
-            else if ((minibuffer & 7U) == 7U) {
-                nDepth = ((minibuffer & 0x7FF8U) >> 3U) + 0x140U;
-                nBitsUsed = 15;
-            }
-            else {
-                fprintf(stderr,"Invalid depth data\n");
-                break;
-            }
+void *DecompressThread(void *arg) {
+    size_t chunk;
 
-            // if not zero and not CheckBuffer
-            if (nDepth != 0 && nDepth != 0x113FU) { // 0x113FU == (4415 - 320)
-                LoadMiniBuffer(&minibuffer,&src,srcfence,&nBitsUsed,&nBitCount);
-
-                if ((minibuffer & 1) == 1) { // 2
-                    nCount = 2;
-                    nBitsUsed = 1;
-                }
-                else if ((minibuffer & 3) == 2) { // 3-4
-                    nCount = ((minibuffer & 4U) >> 2U) + 3U;
-                    nBitsUsed = 3;
-                }
-                else if ((minibuffer & 7) == 4) { // 5-8
-                    nCount = ((minibuffer & 0x18U) >> 3U) + 5U;
-                    nBitsUsed = 5;
-                }
-                else if ((minibuffer & 0x0FU) == 8) { // 9-16
-                    nCount = ((minibuffer & 0x70U) >> 4U) + 9U;
-                    nBitsUsed = 7;
-                }
-                else if ((minibuffer & 0x1FU) == 16) { // 17-32
-                    nCount = ((minibuffer & 0x1E0U) >> 5U) + 17U;
-                    nBitsUsed = 9;
-                }
-                else if ((minibuffer & 0x3FU) == 32) { // 33-64
-                    nCount = ((minibuffer & 0x7C0U) >> 6U) + 33U;
-                    nBitsUsed = 11;
-                }
-                else if ((minibuffer & 0x7FU) == 64) { // 65-128
-                    nCount = ((minibuffer & 0x1F80U) >> 7U) + 65U;
-                    nBitsUsed = 13;
-                }
-                else if ((minibuffer & 0xFFU) == 128) { // 129-256
-                    nCount = ((minibuffer & 0x7F00U) >> 8U) + 129U;
-                    nBitsUsed = 15;
-                }
-                else if ((minibuffer & 0x1FFU) == 256) { // 257-512
-                    nCount = ((minibuffer & 0x1FE00U) >> 9U) + 257U;
-                    nBitsUsed = 17;
-                }
-                else {
-                    fprintf(stderr,"Unexpected compressed code=0x%08lx\n",(unsigned long)minibuffer);
-                    break;
-                }
-
-                {
-                    unsigned char *sp = dst - nDepth;
-
-                    if (sp < dstbase) {
-                        fprintf(stderr,"Unexpected nDepth too large, reaches back too far\n");
-                        break;
-                    }
-                    if ((dst+nCount) > dstfence) {
-                        fprintf(stderr,"Unexpected nCount too large, reaches too far forward into dest\n");
-                        break;
-                    }
-
-                    assert(nCount != 0);
-
-                    do {  *dst++ = *sp++;
-                    } while (--nCount != 0);
-
-                    assert(sp >= dstbase);
-                    assert(sp <= dstfence);
-                    assert(dst <= dstfence);
-                }
-            }
-            else if (nDepth == 0x113FU && src == srcfence) {
-                break;
-            }
-        }
+    (void)arg;
+
+    for (;;) {
+        pthread_mutex_lock(&chunk_lock);
+        chunk = chunk_next++;
+        pthread_mutex_unlock(&chunk_lock);
+
+        if (chunk >= num_chunks)
+            break;
+
+        DecompressChunk(&chunks[chunk]);
+    }
+
+    return NULL;
+}
+
+/* decompress every chunk, using up to "threads" threads */
+int DecompressAll(unsigned int threads) {
+    pthread_t *tid;
+    unsigned int i,started = 0;
+
+    chunk_next = 0;
+    if (threads > num_chunks) threads = num_chunks;
+    if (threads <= 1) {
+        DecompressThread(NULL);
+        return 0;
     }
 
-    if (src < srcfence)
-        fprintf(stderr,"Warning: %u bytes left\n",(unsigned int)(srcfence - src));
+    tid = (pthread_t*)malloc(sizeof(pthread_t) * threads);
+    if (tid == NULL)
+        return -1;
+
+    /* the calling thread works too, so start one less */
+    for (i=0;i < (threads-1U);i++) {
+        if (pthread_create(&tid[i],NULL,DecompressThread,NULL) != 0)
+            break;
+        started++;
+    }
+
+    DecompressThread(NULL);
+
+    for (i=0;i < started;i++)
+        pthread_join(tid[i],NULL);
+
+    free(tid);
+    return 0;
+}
+
+double MonotonicTime(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (double)ts.tv_sec + ((double)ts.tv_nsec / 1000000000.0);
+}
+
+/* decompress every chunk "runs" times with the given decoder and thread count, return seconds taken */
+double BenchmarkPass(unsigned int runs,unsigned int threads,w4_decompress_func func,unsigned char *image,size_t image_chunks_ofs) {
+    unsigned int r;
+    double t;
+
+    chunk_decompress = func;
+    memset(image+image_chunks_ofs,0xE5,(size_t)num_chunks * (size_t)chunk_size);
 
-    return (uint32_t)(dst - dstbase);
+    t = MonotonicTime();
+    for (r=0;r < runs;r++) DecompressAll(threads);
+    t = MonotonicTime() - t;
+
+    chunk_decompress = W4Decompress;
+    return t;
+}
+
+/* compare the chunks against the reference pass */
+int BenchmarkCompare(const unsigned char *ref,const uint32_t *reflen) {
+    size_t i;
+
+    for (i=0;i < num_chunks;i++) {
+        if (chunks[i].dstlen != reflen[i] || memcmp(ref+(i*chunk_size),chunks[i].dst,reflen[i]) != 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+void BenchmarkReport(const char *what,double t,double tref,unsigned int runs,int match) {
+    const double bytes = (double)num_chunks * (double)chunk_size * (double)runs;
+
+    fprintf(stderr,"  %-28s %9.3fms per run, %8.2f MB/s (%.2fx)%s\n",
+        what,(t * 1000.0) / runs,bytes / (t * 1048576.0),tref / t,match ? "" : " OUTPUT DOES NOT MATCH");
+}
+
+/* decompress the whole file "runs" times with the original byte-at-a-time decoder,
+ * then with the current decoder single threaded and with "threads" threads. Check
+ * that the output is bit for bit the same, and report the timing */
+int Benchmark(unsigned int runs,unsigned int threads,unsigned char *image,size_t image_chunks_ofs) {
+    const size_t image_chunks_size = (size_t)num_chunks * (size_t)chunk_size;
+    int match1,matchn;
+    unsigned char *ref;
+    uint32_t *reflen;
+    double tb,t1,tn;
+    char tmp[64];
+    size_t i;
+
+    ref = (unsigned char*)malloc(image_chunks_size);
+    reflen = (uint32_t*)malloc(sizeof(uint32_t) * num_chunks);
+    if (ref == NULL || reflen == NULL)
+        return -1;
+
+    tb = BenchmarkPass(runs,1,W4DecompressBytewise,image,image_chunks_ofs);
+    memcpy(ref,image+image_chunks_ofs,image_chunks_size);
+    for (i=0;i < num_chunks;i++) reflen[i] = chunks[i].dstlen;
+
+    t1 = BenchmarkPass(runs,1,W4Decompress,image,image_chunks_ofs);
+    match1 = (BenchmarkCompare(ref,reflen) == 0);
+
+    tn = BenchmarkPass(runs,threads,W4Decompress,image,image_chunks_ofs);
+    matchn = (BenchmarkCompare(ref,reflen) == 0);
+
+    fprintf(stderr,"Benchmark: %u runs of %lu chunks (%lu bytes of output)\n",
+        runs,(unsigned long)num_chunks,(unsigned long)image_chunks_size);
+    BenchmarkReport("bytewise decoder, 1 thread:",tb,tb,runs,1);
+    BenchmarkReport("fast decoder, 1 thread:",t1,tb,runs,match1);
+    sprintf(tmp,"fast decoder, %u threads:",threads);
+    BenchmarkReport(tmp,tn,tb,runs,matchn);
+
+    free(reflen);
+    free(ref);
+    return (match1 && matchn) ? 0 : -1;
 }
 
 int main(int argc,char **argv) {
-    unsigned char tmp[16];
-    uint16_t chunk_size;
-    uint16_t num_chunks;
+    unsigned char *filebuf,*image;
     uint32_t le_offset;
     uint32_t file_size;
     uint32_t start,end;
     size_t i,chunk;
+    size_t image_size;
+    size_t rd;
 
     if (parse_argv(argc,argv))
         return 1;
 
+    W4CodecInit();
+
+    if (num_threads == 0) {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        num_threads = (n > 0) ? (unsigned int)n : 1U;
+    }
+
     if ((src_fd=open(src_file,O_RDONLY|O_BINARY)) < 0) {
         fprintf(stderr,"Cannot open source file %s, %s\n",src_file,strerror(errno));
         return 1;
@@ -231,26 +270,54 @@ int main(int argc,char **argv) {
         return 1;
     }
 
-    if (lseek(src_fd,0x3C,SEEK_SET) != 0x3C || read(src_fd,&le_offset,4) != 4) {
+    /* read the whole file in one sequential pass */
+    file_size = (uint32_t)lseek(src_fd,0,SEEK_END);
+    if (lseek(src_fd,0,SEEK_SET) != 0) {
         fprintf(stderr,"Cannot read\n");
         return 1;
     }
-    fprintf(stderr,"W4 offset: %lu\n",(unsigned long)le_offset);
-
-    if (lseek(src_fd,le_offset,SEEK_SET) != le_offset || read(src_fd,tmp,16) != 16) {
+    filebuf = (unsigned char*)malloc((size_t)file_size + 16);
+    if (filebuf == NULL) {
+        fprintf(stderr,"Cannot alloc file buffer\n");
+        return 1;
+    }
+    for (rd=0;rd < (size_t)file_size;) {
+        ssize_t r = read(src_fd,filebuf+rd,(size_t)file_size-rd);
+        if (r <= 0) break;
+        rd += (size_t)r;
+    }
+    if (rd != (size_t)file_size) {
         fprintf(stderr,"Cannot read\n");
         return 1;
     }
-    if (memcmp(tmp,"W4",2) != 0 || !(*((uint16_t*)(tmp+2)) == 0 || tmp[3] == 0x04)) {
-        fprintf(stderr,"Not a W4 file\n");
+    /* W4DecompressBytewise() always loads the first 4 bytes of a chunk */
+    memset(filebuf+file_size,0,16);
+
+    if (file_size < 0x40) {
+        fprintf(stderr,"Cannot read\n");
         return 1;
     }
-    if (memcmp(tmp+8,"DS",2) != 0) {
-        fprintf(stderr,"Not DoubleSpace compressed\n");
+    le_offset = *((uint32_t*)(filebuf+0x3C));
+    fprintf(stderr,"W4 offset: %lu\n",(unsigned long)le_offset);
+
+    if (le_offset > file_size || (file_size - le_offset) < 16) {
+        fprintf(stderr,"Cannot read\n");
         return 1;
     }
-    chunk_size = *((uint16_t*)(tmp+4));
-    num_chunks = *((uint16_t*)(tmp+6));
+    {
+        const unsigned char *tmp = filebuf + le_offset;
+
+        if (memcmp(tmp,"W4",2) != 0 || !(*((uint16_t*)(tmp+2)) == 0 || tmp[3] == 0x04)) {
+            fprintf(stderr,"Not a W4 file\n");
+            return 1;
+        }
+        if (memcmp(tmp+8,"DS",2) != 0) {
+            fprintf(stderr,"Not DoubleSpace compressed\n");
+            return 1;
+        }
+        chunk_size = *((uint16_t*)(tmp+4));
+        num_chunks = *((uint16_t*)(tmp+6));
+    }
     fprintf(stderr,"Chunk size: %u\n",(unsigned int)chunk_size);
     fprintf(stderr,"Num chunks: %u\n",(unsigned int)num_chunks);
 
@@ -270,13 +337,11 @@ int main(int argc,char **argv) {
         fprintf(stderr,"Cannot alloc chunk table\n");
         return 1;
     }
-    if ((size_t)read(src_fd,chunkTable,sizeof(uint32_t) * chunkTableEntries) !=
-        (sizeof(uint32_t) * chunkTableEntries)) {
+    if (((size_t)file_size - (size_t)le_offset - 16) < (sizeof(uint32_t) * chunkTableEntries)) {
         fprintf(stderr,"Unable to read chunk table\n");
         return 1;
     }
-
-    file_size = (uint32_t)lseek(src_fd,0,SEEK_END);
+    memcpy(chunkTable,filebuf+le_offset+16,sizeof(uint32_t) * chunkTableEntries);
 
     fprintf(stderr,"Chunk table[%lu] = {",(unsigned long)chunkTableEntries);
     for (i=0;i < (size_t)chunkTableEntries;i++) {
@@ -289,23 +354,15 @@ int main(int argc,char **argv) {
     fprintf(stderr,"}\n");
     fprintf(stderr,"File size (and end of last chunk): %lu\n",(unsigned long)file_size);
 
-    // okay, copy source to dest up to W4 header
-    lseek(src_fd,0,SEEK_SET);
-    lseek(dst_fd,0,SEEK_SET);
-    end = le_offset;
-    start = 0;
-
-    while (start < end) {
-        size_t cpy = (size_t)end - (size_t)start;
-        if (cpy > sizeof(file_temp)) cpy = sizeof(file_temp);
-
-        if ((size_t)read(src_fd,file_temp,cpy) != cpy)
-            return 1;
-        if ((size_t)write(dst_fd,file_temp,cpy) != cpy)
-            return 1;
-
-        start += cpy;
+    // output image: source up to W4 header, then each chunk in its own chunk_size slot
+    image_size = (size_t)le_offset + ((size_t)num_chunks * (size_t)chunk_size);
+    image = (unsigned char*)malloc(image_size);
+    chunks = (struct w4_chunk*)calloc(num_chunks,sizeof(*chunks));
+    if (image == NULL || chunks == NULL) {
+        fprintf(stderr,"Cannot alloc output image\n");
+        return 1;
     }
+    memcpy(image,filebuf,le_offset);
 
     for (chunk=0;chunk < num_chunks;chunk++) {
         start = chunkTable[chunk];
@@ -314,36 +371,54 @@ int main(int argc,char **argv) {
         else
             end = chunkTable[chunk+1];
 
-        if (start >= end)
+        if (start >= end || end > file_size)
             return 1;
         if ((start+chunk_size) < end)
             return 1;
 
-        fprintf(stderr,"Decompressing chunk %lu/%lu: src sz=%lu\n",
-            (unsigned long)chunk,(unsigned long)num_chunks - 1UL,(unsigned long)(end-start));
+        chunks[chunk].src = filebuf + start;
+        chunks[chunk].srclen = end - start;
+        chunks[chunk].dst = image + le_offset + (chunk * (size_t)chunk_size);
+    }
 
-        if ((uint32_t)lseek(src_fd,start,SEEK_SET) != start)
+    if (bench_runs != 0) {
+        if (Benchmark(bench_runs,num_threads,image,(size_t)le_offset) < 0)
             return 1;
-        if ((size_t)read(src_fd,src_temp,(size_t)(end-start)) != (size_t)(end-start))
+    }
+    else {
+        if (DecompressAll(num_threads) < 0) {
+            fprintf(stderr,"Cannot start threads\n");
             return 1;
+        }
+    }
 
-        if ((start+chunk_size) != end) {
-            uint32_t dstsz;
+    /* pack the chunks together, in case any but the last decompressed to less than chunk_size */
+    image_size = (size_t)le_offset;
+    for (chunk=0;chunk < num_chunks;chunk++) {
+        struct w4_chunk *c = &chunks[chunk];
 
-            memset(file_temp,0xE5,chunk_size);
-            dstsz = W4Decompress(file_temp,chunk_size,src_temp,(size_t)(end-start));
-            fprintf(stderr,"  Output: %lu\n",(unsigned long)dstsz);
-            if (dstsz == 0) return 1;
+        fprintf(stderr,"Decompressed chunk %lu/%lu: src sz=%lu\n",
+            (unsigned long)chunk,(unsigned long)num_chunks - 1UL,(unsigned long)c->srclen);
+        if (c->srclen != (uint32_t)chunk_size)
+            fprintf(stderr,"  Output: %lu\n",(unsigned long)c->dstlen);
+        if (c->dstlen == 0)
+            return 1;
 
-            write(dst_fd,file_temp,dstsz);
-        }
-        else {
-            /* TODO: When does this happen? */
-            write(dst_fd,src_temp,chunk_size);
-        }
+        if (c->dst != (image+image_size))
+            memmove(image+image_size,c->dst,c->dstlen);
+
+        image_size += c->dstlen;
+    }
+
+    if ((size_t)write(dst_fd,image,image_size) != image_size) {
+        fprintf(stderr,"Cannot write output, %s\n",strerror(errno));
+        return 1;
     }
 
     free(chunkTable);
+    free(filebuf);
+    free(chunks);
+    free(image);
     close(dst_fd);
     close(src_fd);
     return 0;
@@ -0,0 +1,128 @@
+/* crcbench: check the zipcrc_update() implementations against each other and
+ * time them, and check zipcrc_combine().
+ *
+ * crcbench [megabytes] */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "zipcrc.h"
+
+static double now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (double)ts.tv_sec + ((double)ts.tv_nsec / 1000000000.0);
+}
+
+static zipcrc_t crc_of(zipcrc_update_func_t f,const unsigned char *buf,size_t len) {
+    return zipcrc_finalize(f(zipcrc_init(),buf,len));
+}
+
+int main(int argc,char **argv) {
+    zipcrc_update_func_t ref = zipcrc_impl(ZIPCRC_IMPL_TABLE);
+    size_t len = (size_t)64 << (size_t)20;
+    unsigned char *buf;
+    unsigned int impl;
+    int errors = 0;
+    uint32_t seed;
+    size_t i;
+
+    if (argc > 1) {
+        long mb = strtol(argv[1],NULL,10);
+        if (mb <= 0) {
+            fprintf(stderr,"crcbench [megabytes]\n");
+            return 1;
+        }
+        len = (size_t)mb << (size_t)20;
+    }
+
+    /* one byte extra, to test from an unaligned start */
+    if ((buf=malloc(len+1)) == NULL) {
+        fprintf(stderr,"out of memory\n");
+        return 1;
+    }
+
+    for (seed=0x12345678UL,i=0;i < (len+1);i++) {
+        seed = (seed * 1103515245UL) + 12345UL;
+        buf[i] = (unsigned char)(seed >> 16UL);
+    }
+
+    /* "123456789" is the standard check value */
+    if (crc_of(ref,(const unsigned char*)"123456789",9) != 0xCBF43926UL) {
+        fprintf(stderr,"table: check value wrong\n");
+        errors++;
+    }
+
+    /* every implementation, every length up to 300 and a few offsets, against the table */
+    for (impl=0;impl < ZIPCRC_IMPL_COUNT;impl++) {
+        zipcrc_update_func_t f = zipcrc_impl(impl);
+        size_t l,o;
+
+        if (f == NULL) continue;
+
+        for (o=0;o < 16;o++) {
+            for (l=0;l <= 300;l++) {
+                if (crc_of(f,buf+o,l) != crc_of(ref,buf+o,l)) {
+                    fprintf(stderr,"%s: wrong crc, offset %zu length %zu\n",zipcrc_impl_name(impl),o,l);
+                    errors++;
+                }
+            }
+        }
+
+        if (crc_of(f,buf+1,len) != crc_of(ref,buf+1,len)) {
+            fprintf(stderr,"%s: wrong crc over the whole buffer\n",zipcrc_impl_name(impl));
+            errors++;
+        }
+    }
+
+    /* combine */
+    {
+        static const size_t splits[] = { 0, 1, 7, 64, 1000, 65536 };
+        zipcrc_t whole = crc_of(ref,buf,1u << 20u);
+
+        for (i=0;i < (sizeof(splits)/sizeof(splits[0]));i++) {
+            size_t s = splits[i];
+            zipcrc_t a = crc_of(ref,buf,s);
+            zipcrc_t b = crc_of(ref,buf+s,(1u << 20u) - s);
+
+            if (zipcrc_combine(a,b,(uint64_t)((1u << 20u) - s)) != whole) {
+                fprintf(stderr,"combine: wrong crc, split at %zu\n",s);
+                errors++;
+            }
+        }
+    }
+
+    printf("%zu MB buffer\n",len >> (size_t)20);
+    for (impl=0;impl < ZIPCRC_IMPL_COUNT;impl++) {
+        zipcrc_update_func_t f = zipcrc_impl(impl);
+        double t,best = 0;
+        int pass;
+
+        if (f == NULL) {
+            printf("%-12s not supported by this CPU\n",zipcrc_impl_name(impl));
+            continue;
+        }
+
+        for (pass=0;pass < 3;pass++) {
+            t = now();
+            f(zipcrc_init(),buf,len);
+            t = now() - t;
+            if (pass == 0 || t < best) best = t;
+        }
+
+        printf("%-12s %8.3f GB/s\n",zipcrc_impl_name(impl),((double)len / best) / 1000000000.0);
+    }
+
+    free(buf);
+
+    if (errors) {
+        fprintf(stderr,"%d errors\n",errors);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,41 @@
+#!/bin/bash
+#
+# Archive a directory tree with zip4dos, extract it again with unzip4dos,
+# and check that the result is what went in.
+#
+#   ./roundtrip.sh [zip4dos options]
+#
+# The tree has nested directories, an empty file and a file too big to fit
+# one 1.44MB floppy, so -s 1440K also exercises spanning. Extraction is done
+# twice, into a relative and into an absolute -d directory.
+
+cd "$(dirname "$0")" || exit 1
+make -s bin || exit 1
+
+bin=$(pwd)/linux-host
+tmp=$(mktemp -d) || exit 1
+trap 'rm -Rf "$tmp"' EXIT
+
+mkdir -p "$tmp/in/SRC/SUB/DEEP" "$tmp/in/DOC"
+: >"$tmp/in/EMPTY.TXT"
+cp zip4dos.c unzip4dos.c zipcrc.c "$tmp/in/SRC/"
+cp zipfmt.h "$tmp/in/SRC/SUB/DEEP/"
+head -c 2000000 /dev/urandom >"$tmp/in/DOC/RANDOM.BIN"
+head -c 100000 /dev/zero >"$tmp/in/SRC/SUB/ZEROS.BIN"
+
+zip="$tmp/TEST.ZIP"
+(cd "$tmp/in" && "$bin/zip4dos" -r "$@" --zip "$zip" EMPTY.TXT SRC DOC) >/dev/null 2>&1 || { echo "FAILED: zip4dos"; exit 1; }
+[ -f "$zip" ] || zip="$tmp/TEST.d01"
+
+fail=0
+for out in rel "$tmp/abs/out"; do
+    [ "$out" == rel ] && mkdir -p "$tmp/abs"
+    if ! (cd "$tmp" && "$bin/unzip4dos" -x -q -d "$out" "$zip") >/dev/null ||
+       ! (cd "$tmp" && diff -r in "$out") >/dev/null; then
+        echo "FAILED: extract to $out"
+        fail=1
+    fi
+done
+
+[ $fail == 0 ] && echo "OK"
+exit $fail
@@ -0,0 +1,878 @@
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <utime.h>
+#include <stdint.h>
+#include <endian.h>
+#include <stdio.h>
+#include <ctype.h>
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "zlib.h"
+#include "iconv.h"
+
+#include "zipcrc.h"
+#include "zipfmt.h"
+
+#ifndef O_BINARY
+#define O_BINARY (0)
+#endif
+
+/* unzip4dos: test, list or extract what zip4dos writes.
+ *
+ * The archive is either a plain .zip, or a set of floppy images (.d01, .d02, ...) each holding one
+ * segment of a spanned archive as a file on a FAT12 file system. The segments are read out of the
+ * images and put end to end in memory, so an offset on disk N is just that disk's start plus the
+ * offset. Members are then inflated and CRC checked by a pool of threads, each taking the next
+ * member from a shared counter. Results are kept per member and printed in archive order. */
+
+static void help(void) {
+    fprintf(stderr,"unzip4dos [options] <archive.zip or first disk .d01>\n");
+    fprintf(stderr,"Test, list or extract ZIP archives and spanned floppy images made by zip4dos.\n");
+    fprintf(stderr,"\n");
+    fprintf(stderr,"  -t                       Test the archive (default)\n");
+    fprintf(stderr,"  -l                       List the archive\n");
+    fprintf(stderr,"  -x                       Extract (and test) the archive\n");
+    fprintf(stderr,"  -d <dir>                 Extract into this directory\n");
+    fprintf(stderr,"  -j <n>                   Use n threads (default: one per CPU)\n");
+    fprintf(stderr,"  -q                       Only show errors and the summary\n");
+    fprintf(stderr,"  -ic <charset>            File names on host use this charset\n");
+    fprintf(stderr,"  -oc <charset>            File names in the archive use this charset\n");
+    fprintf(stderr,"\n");
+    fprintf(stderr,"Charsets mean the same as for zip4dos, so the same -ic/-oc given to zip4dos\n");
+    fprintf(stderr,"gets the original names back. If only -oc is specified, -ic is UTF-8.\n");
+}
+
+enum {
+    MODE_TEST=0,
+    MODE_LIST,
+    MODE_EXTRACT
+};
+
+int                     mode = MODE_TEST;
+int                     quiet = 0;
+int                     num_threads = 0;
+char*                   zip_path = NULL;
+char*                   out_dir = NULL;
+char*                   codepage_in = NULL;
+char*                   codepage_out = NULL;
+
+/* the archive, end to end */
+unsigned char*          arc = NULL;
+size_t                  arc_size = 0;
+int                     arc_mapped = 0;
+
+#define DISK_MAX        99
+
+size_t                  disk_base[DISK_MAX];    /* where each disk starts in arc[] */
+int                     disk_count = 0;
+
+struct member {
+    char*               name;           /* as stored */
+    char*               host_name;      /* -x: converted to the host charset */
+    uint32_t            crc32;
+    unsigned long       compressed_size;
+    unsigned long       uncompressed_size;
+    size_t              local;          /* offset of local header in arc[] */
+    unsigned short      method;
+    unsigned short      flags;
+    unsigned short      msdos_time,msdos_date;
+    unsigned char       attr;           /* MS-DOS attributes */
+
+    const char*         error;          /* NULL if OK */
+};
+
+struct member*          members = NULL;
+size_t                  member_count = 0;
+
+static size_t           member_next = 0;
+static pthread_mutex_t  member_lock = PTHREAD_MUTEX_INITIALIZER;
+
+#define ATTR_DOS_DIR    0x10            /* MS-DOS directory */
+
+static uint16_t get16(const unsigned char *p) {
+    return (uint16_t)p[0] + ((uint16_t)p[1] << 8u);
+}
+
+static uint32_t get32(const unsigned char *p) {
+    return (uint32_t)get16(p) + ((uint32_t)get16(p+2) << 16u);
+}
+
+void clear_string(char **a) {
+    if (*a != NULL) {
+        free(*a);
+        *a = NULL;
+    }
+}
+
+char *set_string(char **a,const char *s) {
+    clear_string(a);
+    if (s != NULL) *a = strdup(s);
+    return *a;
+}
+
+/* read a whole file into memory */
+static unsigned char *load_file(const char *path,size_t *size) {
+    unsigned char *buf;
+    struct stat st;
+    size_t got = 0;
+    ssize_t rd;
+    int fd;
+
+    if ((fd=open(path,O_RDONLY|O_BINARY)) < 0)
+        return NULL;
+
+    if (fstat(fd,&st) || (buf=malloc((size_t)st.st_size + 1u)) == NULL) {
+        close(fd);
+        return NULL;
+    }
+
+    while (got < (size_t)st.st_size && (rd=read(fd,buf+got,(size_t)st.st_size-got)) > 0)
+        got += (size_t)rd;
+
+    close(fd);
+    *size = got;
+    return buf;
+}
+
+/* the ZIP segment inside a FAT12 floppy image: the first file in the root directory named *.ZIP,
+ * or else the first file at all. it is read by following its FAT chain.
+ * appends it to arc[], returns 1 if OK */
+static int disk_image_extract(const unsigned char *img,size_t img_size,const char *path) {
+    unsigned int bps,spc,reserved,fats,root_ents,fat_sectors,total_sectors;
+    unsigned long root_ofs,data_ofs,data_end,cluster_size,fat_size,fsz,got;
+    unsigned char seen[0xFF0 / 8];              /* clusters already in the chain */
+    const unsigned char *ent = NULL,*e;
+    unsigned int cluster,clusters,i;
+    unsigned char *np;
+
+    if (img_size < 512) goto bad;
+
+    bps = get16(img+0x0B);
+    spc = img[0x0D];
+    reserved = get16(img+0x0E);
+    fats = img[0x10];
+    root_ents = get16(img+0x11);
+    total_sectors = get16(img+0x13);
+    fat_sectors = get16(img+0x16);
+
+    if (bps < 128 || (bps & (bps-1)) != 0 || spc == 0 || fats == 0 || fat_sectors == 0 || root_ents == 0)
+        goto bad;
+    if (((unsigned long)total_sectors * bps) > img_size)
+        goto bad;
+
+    root_ofs = ((unsigned long)reserved + ((unsigned long)fats * fat_sectors)) * bps;
+    data_ofs = root_ofs + (((unsigned long)root_ents * 32UL) + bps - 1UL) / bps * bps;
+    data_end = (total_sectors != 0) ? ((unsigned long)total_sectors * bps) : (unsigned long)img_size;
+    cluster_size = (unsigned long)spc * bps;
+    fat_size = (unsigned long)fat_sectors * bps;
+    if (data_ofs > data_end)
+        goto bad;
+
+    /* data clusters on the disk, numbered from 2. FAT12 cannot address more than 0xFF0 */
+    clusters = 2u + (unsigned int)((data_end - data_ofs) / cluster_size);
+    if (clusters > 0xFF0u) clusters = 0xFF0u;
+    if (((((unsigned long)clusters - 1UL) * 3UL) / 2UL + 2UL) > fat_size)
+        goto bad;                               /* FAT too small to hold the last entry */
+
+    for (i=0;i < root_ents;i++) {
+        e = img + root_ofs + (i * 32u);
+        if (e[0] == 0x00) break;                /* end of directory */
+        if (e[0] == 0xE5) continue;             /* deleted */
+        if (e[11] & (0x08|0x10)) continue;      /* volume label, directory */
+
+        if (ent == NULL) ent = e;
+        if (!memcmp(e+8,"ZIP",3)) {
+            ent = e;
+            break;
+        }
+    }
+
+    if (ent == NULL) {
+        fprintf(stderr,"%s: no file on the disk image\n",path);
+        return 0;
+    }
+
+    fsz = get32(ent+0x1C);
+    cluster = get16(ent+0x1A);
+    if (fsz > ((unsigned long)(clusters - 2u) * cluster_size))
+        goto bad;
+
+    if ((np=realloc(arc,arc_size + fsz + 1u)) == NULL) {
+        fprintf(stderr,"out of memory\n");
+        return 0;
+    }
+    arc = np;
+
+    memset(seen,0,sizeof(seen));
+    for (got=0;got < fsz;) {
+        unsigned long o = ((unsigned long)reserved * bps) + ((cluster * 3u) / 2u);
+        unsigned long src,todo;
+        unsigned int next;
+
+        if (cluster < 2 || cluster >= clusters)
+            goto bad;
+        if (seen[cluster >> 3u] & (1u << (cluster & 7u)))
+            goto bad;                           /* the chain loops */
+        seen[cluster >> 3u] |= (unsigned char)(1u << (cluster & 7u));
+
+        src = data_ofs + ((unsigned long)(cluster - 2u) * cluster_size);
+        todo = fsz - got;
+        if (todo > cluster_size) todo = cluster_size;
+        if ((src + todo) > img_size)
+            goto bad;
+
+        memcpy(arc + arc_size + got,img + src,todo);
+        got += todo;
+
+        /* next cluster in the FAT12 chain */
+        next = get16(img + o);
+        next = (cluster & 1u) ? (next >> 4u) : (next & 0xFFFu);
+        cluster = next;
+    }
+
+    arc_size += fsz;
+    return 1;
+
+bad:
+    fprintf(stderr,"%s: not a FAT12 disk image with a ZIP on it\n",path);
+    return 0;
+}
+
+/* load the archive: one .zip, or every disk of a spanned set from .d01 on */
+static int load_archive(const char *path) {
+    unsigned char sig[4];
+    char *x,*dn;
+    int fd,spanned;
+
+    /* name.dNN: a spanned set */
+    x = strrchr(path,'.');
+    spanned = (x != NULL && (x[1] == 'd' || x[1] == 'D') && isdigit(x[2]) && isdigit(x[3]) && x[4] == 0);
+
+    if (!spanned) {
+        struct stat st;
+
+        if ((fd=open(path,O_RDONLY|O_BINARY)) < 0) {
+            fprintf(stderr,"Cannot open %s, %s\n",path,strerror(errno));
+            return 0;
+        }
+
+        if (fstat(fd,&st) || st.st_size < 4 || pread(fd,sig,4,0) != 4) {
+            fprintf(stderr,"%s: too small\n",path);
+            close(fd);
+            return 0;
+        }
+
+        /* a set that fit on one disk is left named .zip but is still a disk image */
+        if (sig[0] != 'P' || sig[1] != 'K') {
+            unsigned char *img;
+            size_t img_size;
+            int ok;
+
+            close(fd);
+            if ((img=load_file(path,&img_size)) == NULL) {
+                fprintf(stderr,"Cannot read %s, %s\n",path,strerror(errno));
+                return 0;
+            }
+
+            disk_base[disk_count++] = 0;
+            ok = disk_image_extract(img,img_size,path);
+            free(img);
+            return ok;
+        }
+
+        arc_size = (size_t)st.st_size;
+        arc = mmap(NULL,arc_size,PROT_READ,MAP_PRIVATE,fd,0);
+        close(fd);
+        if (arc == MAP_FAILED) {
+            arc = NULL;
+            fprintf(stderr,"Cannot map %s, %s\n",path,strerror(errno));
+            return 0;
+        }
+
+        arc_mapped = 1;
+        disk_base[disk_count++] = 0;
+        return 1;
+    }
+
+    if ((dn=strdup(path)) == NULL)
+        return 0;
+
+    x = dn + (x - path);
+    for (disk_count=0;disk_count < DISK_MAX;disk_count++) {
+        unsigned char *img;
+        size_t img_size;
+
+        x[2] = (char)('0' + ((disk_count + 1) / 10));
+        x[3] = (char)('0' + ((disk_count + 1) % 10));
+
+        if ((img=load_file(dn,&img_size)) == NULL) {
+            if (errno == ENOENT && disk_count > 0)
+                break;
+
+            fprintf(stderr,"Cannot read %s, %s\n",dn,strerror(errno));
+            free(dn);
+            return 0;
+        }
+
+        disk_base[disk_count] = arc_size;
+        if (!disk_image_extract(img,img_size,dn)) {
+            free(img);
+            free(dn);
+            return 0;
+        }
+
+        free(img);
+    }
+
+    if (!quiet)
+        fprintf(stderr,"%d disks\n",disk_count);
+
+    free(dn);
+    return 1;
+}
+
+/* read the central directory */
+static int load_directory(void) {
+    const unsigned char *p,*end = NULL;
+    unsigned int i,count,cdisk;
+    size_t cdir,cdir_size;
+    long e;
+
+    if (arc_size < sizeof(struct pkzip_central_directory_header_end))
+        goto bad;
+
+    /* the end record, within the last 64KB + 22 bytes */
+    for (e=(long)(arc_size - sizeof(struct pkzip_central_directory_header_end));e >= 0 && (arc_size - (size_t)e) <= (65535u + 22u);e--) {
+        if (get32(arc+e) == PKZIP_CENTRAL_DIRECTORY_END_SIG) {
+            end = arc + e;
+            break;
+        }
+    }
+    if (end == NULL)
+        goto bad;
+
+    cdisk = get16(end+0x06);
+    count = get16(end+0x0A);
+    cdir_size = get32(end+0x0C);
+    if ((int)cdisk >= disk_count)
+        goto bad;
+
+    cdir = disk_base[cdisk] + get32(end+0x10);
+    if ((cdir + cdir_size) > arc_size)
+        goto bad;
+
+    if ((members=calloc(count + 1u,sizeof(struct member))) == NULL) {
+        fprintf(stderr,"out of memory\n");
+        return 0;
+    }
+
+    for (p=arc+cdir,i=0;i < count;i++) {
+        struct member *m = &members[member_count];
+        unsigned int nlen,elen,clen,disk;
+
+        if ((size_t)((p + sizeof(struct pkzip_central_directory_header_main)) - arc) > arc_size)
+            goto bad;
+        if (get32(p) != PKZIP_CENTRAL_DIRECTORY_HEADER_SIG)
+            goto bad;
+
+        nlen = get16(p+0x1C);
+        elen = get16(p+0x1E);
+        clen = get16(p+0x20);
+        disk = get16(p+0x22);
+        if ((size_t)((p + sizeof(struct pkzip_central_directory_header_main) + nlen + elen + clen) - arc) > arc_size)
+            goto bad;
+        if ((int)disk >= disk_count)
+            goto bad;
+
+        m->flags = get16(p+0x08);
+        m->method = get16(p+0x0A);
+        m->msdos_time = get16(p+0x0C);
+        m->msdos_date = get16(p+0x0E);
+        m->crc32 = get32(p+0x10);
+        m->compressed_size = get32(p+0x14);
+        m->uncompressed_size = get32(p+0x18);
+        m->attr = p[0x26];
+        m->local = disk_base[disk] + get32(p+0x2A);
+
+        if ((m->name=malloc(nlen + 1u)) == NULL) {
+            fprintf(stderr,"out of memory\n");
+            return 0;
+        }
+        memcpy(m->name,p+sizeof(struct pkzip_central_directory_header_main),nlen);
+        m->name[nlen] = 0;
+
+        if (nlen != 0 && m->name[nlen-1] == '/')
+            m->attr |= ATTR_DOS_DIR;
+
+        member_count++;
+        p += sizeof(struct pkzip_central_directory_header_main) + nlen + elen + clen;
+    }
+
+    return 1;
+
+bad:
+    fprintf(stderr,"%s: central directory not found or damaged\n",zip_path);
+    return 0;
+}
+
+/* -x: convert names to the host charset, and refuse anything that would land outside the output directory */
+static int convert_names(void) {
+    iconv_t ic = (iconv_t)-1;
+    char tmp[PATH_MAX];
+    size_t i;
+
+    if (codepage_out != NULL || codepage_in != NULL) {
+        if (codepage_in == NULL && set_string(&codepage_in,"UTF-8") == NULL)
+            return 0;
+        if (codepage_out == NULL && set_string(&codepage_out,"UTF-8") == NULL)
+            return 0;
+
+        /* the reverse of what zip4dos does */
+        ic = iconv_open(codepage_in,codepage_out);
+        if (ic == (iconv_t)-1) {
+            fprintf(stderr,"Unable to open character encoding conversion from '%s' to '%s', '%s'\n",codepage_out,codepage_in,strerror(errno));
+            return 0;
+        }
+    }
+
+    for (i=0;i < member_count;i++) {
+        struct member *m = &members[i];
+        char *c;
+
+        if (ic != (iconv_t)-1) {
+            size_t inleft = strlen(m->name);
+            size_t outleft = sizeof(tmp)-1;
+            char *out = tmp,*in = m->name;
+            size_t ret;
+
+            iconv(ic,NULL,NULL,NULL,NULL);
+            ret = iconv(ic,&in,&inleft,&out,&outleft);
+            if (ret == (size_t)-1 || inleft != 0) {
+                m->error = "file name conversion error";
+                continue;
+            }
+            *out = 0;
+        }
+        else {
+            if (strlen(m->name) >= sizeof(tmp)) {
+                m->error = "file name too long";
+                continue;
+            }
+            strcpy(tmp,m->name);
+        }
+
+        /* no absolute paths, no . or .. */
+        for (c=tmp;*c != 0;c++) {
+            if (*c == '\\') *c = '/';
+        }
+        if (tmp[0] == '/') {
+            m->error = "absolute path";
+            continue;
+        }
+        for (c=tmp;*c != 0;) {
+            size_t chk = strcspn(c,"/");
+
+            if ((chk == 1 && c[0] == '.') || (chk == 2 && c[0] == '.' && c[1] == '.')) {
+                m->error = ". or .. in the path";
+                break;
+            }
+
+            c += chk;
+            if (*c == '/') c++;
+        }
+        if (m->error != NULL)
+            continue;
+
+        if ((m->host_name=strdup(tmp)) == NULL) {
+            m->error = "out of memory";
+            continue;
+        }
+    }
+
+    if (ic != (iconv_t)-1)
+        iconv_close(ic);
+
+    return 1;
+}
+
+/* make every directory leading up to the last / of path, below the first skip characters
+ * (the output directory, which already exists and may be absolute) */
+static int make_parents(char *path,size_t skip) {
+    char *s;
+
+    for (s=path+skip;(s=strchr(s,'/')) != NULL;s++) {
+        *s = 0;
+        if (mkdir(path,0755) && errno != EEXIST) {
+            *s = '/';
+            return 0;
+        }
+        *s = '/';
+    }
+
+    return 1;
+}
+
+static void set_mtime(const char *path,const struct member *m) {
+    struct utimbuf ut;
+    struct tm tm;
+
+    memset(&tm,0,sizeof(tm));
+    tm.tm_year = (int)((m->msdos_date >> 9u) & 0x7Fu) + 1980 - 1900;
+    tm.tm_mon  = (int)((m->msdos_date >> 5u) & 0x0Fu) - 1;
+    tm.tm_mday = (int)( m->msdos_date        & 0x1Fu);
+    tm.tm_hour = (int)((m->msdos_time >> 11u) & 0x1Fu);
+    tm.tm_min  = (int)((m->msdos_time >>  5u) & 0x3Fu);
+    tm.tm_sec  = (int)((m->msdos_time & 0x1Fu) * 2u);
+    tm.tm_isdst = -1;
+
+    ut.actime = ut.modtime = mktime(&tm);
+    utime(path,&ut);
+}
+
+/* test one member, and write it out if extracting */
+static void member_process(struct member *m) {
+    unsigned char outbuf[65536];
+    const unsigned char *lh,*data;
+    unsigned long total = 0;
+    char path[PATH_MAX];
+    unsigned int nlen,elen;
+    zipcrc_t crc32;
+    int out_fd = -1;
+
+    if (m->error != NULL)
+        return;
+
+    /* local header */
+    if ((m->local + sizeof(struct pkzip_local_file_header_main)) > arc_size) {
+        m->error = "local header past the end of the archive";
+        return;
+    }
+
+    lh = arc + m->local;
+    if (get32(lh) != PKZIP_LOCAL_FILE_HEADER_SIG) {
+        m->error = "bad local header";
+        return;
+    }
+
+    nlen = get16(lh+0x1A);
+    elen = get16(lh+0x1C);
+    if (nlen != strlen(m->name) || memcmp(lh+sizeof(struct pkzip_local_file_header_main),m->name,nlen)) {
+        m->error = "local header does not match the central directory";
+        return;
+    }
+
+    /* without a data descriptor, the local header has the sizes and crc too */
+    if (!(m->flags & (1u << 3u)) &&
+        (get32(lh+0x0E) != m->crc32 || get32(lh+0x12) != m->compressed_size || get32(lh+0x16) != m->uncompressed_size)) {
+        m->error = "local header does not match the central directory";
+        return;
+    }
+
+    if ((m->local + sizeof(struct pkzip_local_file_header_main) + nlen + elen + m->compressed_size) > arc_size) {
+        m->error = "data past the end of the archive";
+        return;
+    }
+
+    data = lh + sizeof(struct pkzip_local_file_header_main) + nlen + elen;
+
+    if (m->flags & 1u) {
+        m->error = "encrypted";
+        return;
+    }
+    if (m->method != 0 && m->method != 8) {
+        m->error = "unsupported compression method";
+        return;
+    }
+
+    if (mode == MODE_EXTRACT) {
+        int l = snprintf(path,sizeof(path),"%s%s%s",out_dir ? out_dir : "",out_dir ? "/" : "",m->host_name);
+
+        if (l < 0 || (size_t)l >= sizeof(path)) {
+            m->error = "path too long";
+            return;
+        }
+
+        if (!make_parents(path,out_dir ? (strlen(out_dir) + 1u) : 0u)) {
+            m->error = "cannot create directory";
+            return;
+        }
+
+        if (m->attr & ATTR_DOS_DIR) {
+            if (mkdir(path,0755) && errno != EEXIST)
+                m->error = "cannot create directory";
+            return;
+        }
+
+        out_fd = open(path,O_WRONLY|O_CREAT|O_TRUNC|O_BINARY,0644);
+        if (out_fd < 0) {
+            m->error = "cannot create file";
+            return;
+        }
+    }
+
+    crc32 = zipcrc_init();
+
+    if (m->method == 0) {
+        crc32 = zipcrc_update(crc32,data,m->compressed_size);
+        total = m->compressed_size;
+        if (out_fd >= 0 && total != 0 && write(out_fd,data,total) != (ssize_t)total)
+            m->error = "write error";
+    }
+    else {
+        z_stream z;
+        int x;
+
+        memset(&z,0,sizeof(z));
+        if (inflateInit2(&z,-15/*window, raw*/) != Z_OK) {
+            m->error = "out of memory";
+            goto done;
+        }
+
+        z.next_in = (unsigned char*)data;
+        z.avail_in = m->compressed_size;
+
+        do {
+            size_t wd;
+
+            z.next_out = outbuf;
+            z.avail_out = sizeof(outbuf);
+
+            x = inflate(&z,Z_NO_FLUSH);
+            if (x != Z_OK && x != Z_STREAM_END) {
+                m->error = (x == Z_BUF_ERROR) ? "compressed data ends early" : "bad compressed data";
+                break;
+            }
+
+            wd = (size_t)(z.next_out - outbuf);
+            crc32 = zipcrc_update(crc32,outbuf,wd);
+            total += wd;
+
+            if (out_fd >= 0 && wd != 0 && write(out_fd,outbuf,wd) != (ssize_t)wd) {
+                m->error = "write error";
+                break;
+            }
+        } while (x != Z_STREAM_END);
+
+        if (m->error == NULL && z.avail_in != 0)
+            m->error = "data after the end of the compressed data";
+
+        inflateEnd(&z);
+    }
+
+    if (m->error == NULL) {
+        if (total != m->uncompressed_size)
+            m->error = "wrong size";
+        else if (zipcrc_finalize(crc32) != m->crc32)
+            m->error = "CRC error";
+    }
+
+done:
+    if (out_fd >= 0) {
+        close(out_fd);
+        set_mtime(path,m);
+    }
+}
+
+static void *worker(void *arg) {
+    struct member *m;
+
+    (void)arg;
+
+    do {
+        pthread_mutex_lock(&member_lock);
+        m = (member_next < member_count) ? &members[member_next++] : NULL;
+        pthread_mutex_unlock(&member_lock);
+
+        if (m == NULL)
+            break;
+
+        member_process(m);
+    } while (1);
+
+    return NULL;
+}
+
+static int parse(int argc,char **argv) {
+    char *a;
+    int i;
+
+    if (argc <= 1) {
+        help();
+        return 1;
+    }
+
+    for (i=1;i < argc;) {
+        a = argv[i++];
+
+        if (*a == '-') {
+            do { a++; } while (*a == '-');
+
+            if (!strcmp(a,"h") || !strcmp(a,"help")) {
+                help();
+                return 1;
+            }
+            else if (!strcmp(a,"t")) {
+                mode = MODE_TEST;
+            }
+            else if (!strcmp(a,"l")) {
+                mode = MODE_LIST;
+            }
+            else if (!strcmp(a,"x")) {
+                mode = MODE_EXTRACT;
+            }
+            else if (!strcmp(a,"d")) {
+                a = argv[i++];
+                if (a == NULL) return 1;
+                set_string(&out_dir,a);
+                mode = MODE_EXTRACT;
+            }
+            else if (!strcmp(a,"q")) {
+                quiet = 1;
+            }
+            else if (!strcmp(a,"j")) {
+                a = argv[i++];
+                if (a == NULL) return 1;
+                num_threads = (int)strtol(a,(char**)(&a),10);
+                if (*a != 0 || num_threads < 0) return 1;
+            }
+            else if (!strcmp(a,"ic")) {
+                a = argv[i++];
+                if (a == NULL) return 1;
+                set_string(&codepage_in,a);
+            }
+            else if (!strcmp(a,"oc")) {
+                a = argv[i++];
+                if (a == NULL) return 1;
+                set_string(&codepage_out,a);
+            }
+            else {
+                fprintf(stderr,"Unknown switch %s\n",a);
+                return 1;
+            }
+        }
+        else {
+            if (zip_path != NULL) {
+                fprintf(stderr,"Only one archive at a time\n");
+                return 1;
+            }
+            set_string(&zip_path,a);
+        }
+    }
+
+    if (zip_path == NULL) {
+        fprintf(stderr,"No archive given\n");
+        return 1;
+    }
+
+    if (num_threads == 0) {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        num_threads = (n > 0) ? (int)n : 1;
+    }
+
+    return 0;
+}
+
+int main(int argc,char **argv) {
+    unsigned long errors = 0;
+    pthread_t *threads;
+    int t,started;
+    size_t i;
+
+    if (parse(argc,argv))
+        return 1;
+
+    if (!load_archive(zip_path))
+        return 1;
+    if (!load_directory())
+        return 1;
+
+    if (mode == MODE_LIST) {
+        for (i=0;i < member_count;i++) {
+            const struct member *m = &members[i];
+
+            printf("%10lu %10lu %s %04u-%02u-%02u %02u:%02u %08lx %s\n",
+                m->uncompressed_size,m->compressed_size,
+                m->method == 8 ? "Defl" : (m->method == 0 ? "Stor" : "????"),
+                ((m->msdos_date >> 9u) & 0x7Fu) + 1980u,(m->msdos_date >> 5u) & 0x0Fu,m->msdos_date & 0x1Fu,
+                (m->msdos_time >> 11u) & 0x1Fu,(m->msdos_time >> 5u) & 0x3Fu,
+                (unsigned long)m->crc32,m->name);
+        }
+
+        return 0;
+    }
+
+    if (mode == MODE_EXTRACT) {
+        if (out_dir != NULL && mkdir(out_dir,0755) && errno != EEXIST) {
+            fprintf(stderr,"Cannot create %s, %s\n",out_dir,strerror(errno));
+            return 1;
+        }
+        if (!convert_names())
+            return 1;
+    }
+
+    if ((size_t)num_threads > member_count)
+        num_threads = (member_count != 0) ? (int)member_count : 1;
+
+    if ((threads=calloc((size_t)num_threads,sizeof(pthread_t))) == NULL) {
+        fprintf(stderr,"out of memory\n");
+        return 1;
+    }
+
+    for (started=0;started < num_threads;started++) {
+        if (pthread_create(&threads[started],NULL,worker,NULL) != 0)
+            break;
+    }
+
+    /* if no thread could be started, do it all here */
+    if (started == 0)
+        worker(NULL);
+
+    for (t=0;t < started;t++)
+        pthread_join(threads[t],NULL);
+
+    free(threads);
+
+    for (i=0;i < member_count;i++) {
+        const struct member *m = &members[i];
+
+        const char *name = (m->host_name != NULL) ? m->host_name : m->name;
+
+        if (m->error != NULL) {
+            printf("%s: %s\n",name,m->error);
+            errors++;
+        }
+        else if (!quiet) {
+            printf("%s: OK\n",name);
+        }
+    }
+
+    printf("%lu entries, %lu errors\n",(unsigned long)member_count,errors);
+
+    for (i=0;i < member_count;i++) {
+        clear_string(&members[i].name);
+        clear_string(&members[i].host_name);
+    }
+    free(members);
+
+    if (arc_mapped)
+        munmap(arc,arc_size);
+    else if (arc != NULL)
+        free(arc);
+
+    clear_string(&zip_path);
+    clear_string(&out_dir);
+    clear_string(&codepage_in);
+    clear_string(&codepage_out);
+    return (errors != 0) ? 1 : 0;
+}
+
@@ -23,11 +23,14 @@
 #include <limits.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <math.h>
 
 #include "zlib.h"
 #include "iconv.h"
 
 #include "zipcrc.h"
+#include "zipfmt.h"
 
 #ifndef O_BINARY
 #define O_BINARY (0)
@@ -35,70 +38,6 @@
 
 extern unsigned char msdos_floppy_nonboot[512];
 
-#pragma pack(push,1)
-# define PKZIP_LOCAL_FILE_HEADER_SIG        (0x04034B50UL)
-
-struct pkzip_local_file_header_main { /* PKZIP APPNOTE 2.0: General Format of a ZIP file section A */
-    uint32_t                sig;                            /* 4 bytes  +0x00 0x04034B50 = 'PK\x03\x04' */
-    uint16_t                version_needed_to_extract;      /* 2 bytes  +0x04 version needed to extract */
-    uint16_t                general_purpose_bit_flag;       /* 2 bytes  +0x06 general purpose bit flag */
-    uint16_t                compression_method;             /* 2 bytes  +0x08 compression method */
-    uint16_t                last_mod_file_time;             /* 2 bytes  +0x0A */
-    uint16_t                last_mod_file_date;             /* 2 bytes  +0x0C */
-    uint32_t                crc32;                          /* 4 bytes  +0x0E */
-    uint32_t                compressed_size;                /* 4 bytes  +0x12 */
-    uint32_t                uncompressed_size;              /* 4 bytes  +0x16 */
-    uint16_t                filename_length;                /* 2 bytes  +0x1A */
-    uint16_t                extra_field_length;             /* 2 bytes  +0x1C */
-};                                                          /*          =0x1E */
-/* filename and extra field follow, then file data */
-#pragma pack(pop)
-
-#pragma pack(push,1)
-# define PKZIP_CENTRAL_DIRECTORY_HEADER_SIG (0x02014B50UL)
-
-struct pkzip_central_directory_header_main { /* PKZIP APPNOTE 2.0: General Format of a ZIP file section C */
-    uint32_t                sig;                            /* 4 bytes  +0x00 0x02014B50 = 'PK\x01\x02' */
-    uint16_t                version_made_by;                /* 2 bytes  +0x04 version made by */
-    uint16_t                version_needed_to_extract;      /* 2 bytes  +0x06 version needed to extract */
-    uint16_t                general_purpose_bit_flag;       /* 2 bytes  +0x08 general purpose bit flag */
-    uint16_t                compression_method;             /* 2 bytes  +0x0A compression method */
-    uint16_t                last_mod_file_time;             /* 2 bytes  +0x0C */
-    uint16_t                last_mod_file_date;             /* 2 bytes  +0x0E */
-    uint32_t                crc32;                          /* 4 bytes  +0x10 */
-    uint32_t                compressed_size;                /* 4 bytes  +0x14 */
-    uint32_t                uncompressed_size;              /* 4 bytes  +0x18 */
-    uint16_t                filename_length;                /* 2 bytes  +0x1C */
-    uint16_t                extra_field_length;             /* 2 bytes  +0x1E */
-    uint16_t                file_comment_length;            /* 2 bytes  +0x20 */
-    uint16_t                disk_number_start;              /* 2 bytes  +0x22 */
-    uint16_t                internal_file_attributes;       /* 2 bytes  +0x24 */
-    uint32_t                external_file_attributes;       /* 4 bytes  +0x26 */
-    uint32_t                relative_offset_of_local_header;/* 4 bytes  +0x2A */
-};                                                          /*          =0x2E */
-/* filename and extra field follow, then file data */
-#pragma pack(pop)
-
-#pragma pack(push,1)
-# define PKZIP_CENTRAL_DIRECTORY_END_SIG    (0x06054B50UL)
-
-struct pkzip_central_directory_header_end { /* PKZIP APPNOTE 2.0: General Format of a ZIP file section C */
-    uint32_t                sig;                            /* 4 bytes  +0x00 0x06054B50 = 'PK\x05\x06' */
-    uint16_t                number_of_this_disk;            /* 2 bytes  +0x04 */
-    uint16_t                number_of_disk_with_start_of_central_directory;
-                                                            /* 2 bytes  +0x06 */
-    uint16_t                total_number_of_entries_of_central_dir_on_this_disk;
-                                                            /* 2 bytes  +0x08 */
-    uint16_t                total_number_of_entries_of_central_dir;
-                                                            /* 2 bytes  +0x0A */
-    uint32_t                size_of_central_directory;      /* 4 bytes  +0x0C */
-    uint32_t                offset_of_central_directory_from_start_disk;
-                                                            /* 4 bytes  +0x10 */
-    uint16_t                zipfile_comment_length;         /* 2 bytes  +0x14 */
-};                                                          /*          =0x16 */
-/* filename and extra field follow, then file data */
-#pragma pack(pop)
-
 static char ic_tmp[PATH_MAX];
 
 static void help(void) {
@@ -115,6 +54,9 @@ static void help(void) {
     fprintf(stderr,"  -oc <charset>            File names for target use this charset\n");
     fprintf(stderr,"  -t+                      Add trailing data descriptor\n");
     fprintf(stderr,"  -t-                      Don't write trailing descriptor\n");
+    fprintf(stderr,"  -j <n>                   Deflate with n threads (0 = one per CPU)\n");
+    fprintf(stderr,"  -a                       Store files that do not compress\n");
+    fprintf(stderr,"  --update <zip>           Copy files unchanged since <zip> from it\n");
     fprintf(stderr,"\n");
     fprintf(stderr,"Spanning size can be specified in bytes, or with K, M, G, suffix.\n");
     fprintf(stderr,"With spanning, the zip file must have .zip suffix, which will be changed\n");
@@ -222,6 +164,9 @@ struct in_file {
     unsigned short      msdos_time,msdos_date;
     uint32_t            crc32;
     struct in_file*     next;
+    struct zip_job*     job;            /* -j: deflated by a worker thread */
+    struct zip_old*     old;            /* --update: unchanged, copy from the old archive */
+    unsigned short      method;         /* compression method: 0 (stored) or 8 (deflate) */
 
     _Bool               data_descriptor;/* write data descriptor after file */
 } in_file;
@@ -298,9 +243,19 @@ unsigned int number_of_fats = 1;
 unsigned int fat_sectors = 0;
 unsigned int media_desc = 0;
 
+/* The write position is kept here instead of asking the kernel with lseek().
+ *
+ * When spanning, the floppy image being made (boot sector, FATs, root directory, data) is built in
+ * memory, and written out with one pwrite() when the disk is finished. The rest of the disk is zero,
+ * so it is padded to size with ftruncate() instead of writing the zeros. */
+unsigned long           zip_out_offset = 0;     /* write position */
+unsigned char*          zip_vol = NULL;         /* spanning: the disk image */
+unsigned long           zip_vol_size = 0;       /* spanning: bytes of it written so far */
+unsigned long           zip_vol_alloc = 0;
+
 unsigned long zip_out_pos_abs(void) {
     if (zip_fd >= 0)
-        return (unsigned long)lseek(zip_fd,0,SEEK_CUR);
+        return zip_out_offset;
 
     return 0UL;
 }
@@ -316,42 +271,112 @@ unsigned long zip_out_pos(void) {
     return 0UL;
 }
 
+char *zip_out_get_span_name(int disk_number);
+
+/* make sure the disk image can hold sz bytes. new space is zero */
+int zip_vol_reserve(unsigned long sz) {
+    if (sz > zip_vol_alloc) {
+        unsigned long na = (zip_vol_alloc != 0) ? zip_vol_alloc : spanning_size;
+        unsigned char *np;
+
+        while (na < sz) na *= 2UL;
+        if ((np=realloc(zip_vol,na)) == NULL)
+            return 0;
+
+        memset(np+zip_vol_alloc,0,na-zip_vol_alloc);
+        zip_vol = np;
+        zip_vol_alloc = na;
+    }
+
+    return 1;
+}
+
 int zip_out_open(void) {
-    if (zip_fd < 0)
+    if (zip_fd < 0) {
         zip_fd = open(zip_path,O_RDWR|O_CREAT|O_TRUNC|O_BINARY,0644);
+        zip_out_offset = 0;
+
+        if (spanning_size > 0) {
+            if (zip_vol != NULL) memset(zip_vol,0,zip_vol_alloc);
+            zip_vol_size = 0;
+        }
+    }
 
     return (zip_fd >= 0);
 }
 
+/* write at the current position */
+ssize_t zip_out_write(const void *buf,size_t count) {
+    ssize_t w;
+
+    assert(zip_fd >= 0);
+
+    if (spanning_size > 0) {
+        if (!zip_vol_reserve(zip_out_offset + count))
+            return -1;
+
+        memcpy(zip_vol+zip_out_offset,buf,count);
+        zip_out_offset += count;
+        if (zip_vol_size < zip_out_offset)
+            zip_vol_size = zip_out_offset;
+
+        return (ssize_t)count;
+    }
+
+    w = write(zip_fd,buf,count);
+    if (w > 0) zip_out_offset += (unsigned long)w;
+    return w;
+}
+
+/* rewrite something already written, on the current or an earlier disk */
+int zip_out_rewrite(int disk_number,unsigned long ofs,const void *buf,size_t count) {
+    char *nn;
+    int fd,ok;
+
+    if (disk_number == disk_current_number()) {
+        if (spanning_size > 0) {
+            if ((ofs + count) > zip_vol_size)
+                return 0;
+
+            memcpy(zip_vol+ofs,buf,count);
+            return 1;
+        }
+
+        return (pwrite(zip_fd,buf,count,(off_t)ofs) == (ssize_t)count);
+    }
+
+    /* that disk is finished and renamed already */
+    if ((nn=zip_out_get_span_name(disk_number)) == NULL)
+        return 0;
+
+    fd = open(nn,O_RDWR|O_BINARY);
+    free(nn);
+    if (fd < 0)
+        return 0;
+
+    ok = (pwrite(fd,buf,count,(off_t)ofs) == (ssize_t)count);
+    close(fd);
+    return ok;
+}
+
 void zip_out_header_finish(void) {
     if (data_start != 0) {
         unsigned int i,m,u,it;
         unsigned long fsz;
-        char tmp[512];
 
-        lseek(zip_fd,0,SEEK_END);
-        fsz = zip_out_pos_abs() - data_start;
+        fsz = zip_vol_size - data_start;
         fprintf(stderr,"Finishing up file %lu bytes\n",fsz);
 
         assert(zip_fd >= 0);
+        assert(zip_vol != NULL);
 
         /* go back and write in the size of the "file" in the root dir */
-        lseek(zip_fd,archive_zip_offset,SEEK_SET);
-        read(zip_fd,tmp,32);
-
         // starting cluster already filled in. update file size.
-        *((uint32_t*)(tmp+0x1C)) = fsz;
-
-        lseek(zip_fd,archive_zip_offset,SEEK_SET);
-        write(zip_fd,tmp,32);
+        *((uint32_t*)(zip_vol+archive_zip_offset+0x1C)) = fsz;
 
         // now make a FAT chain
         {
-            unsigned char *FAT = malloc(512 * fat_sectors);
-
-            if (FAT == NULL) return;
-            lseek(zip_fd,fat_start,SEEK_SET);
-            read(zip_fd,FAT,512 * fat_sectors);
+            unsigned char *FAT = zip_vol + fat_start;
 
             // how many clusters?
             u = 512 * sectors_per_cluster;
@@ -371,26 +396,20 @@ void zip_out_header_finish(void) {
                 *((uint16_t*)(FAT+o)) |= ent << os;
             }
 
-            lseek(zip_fd,fat_start,SEEK_SET);
-            for (it=0;it < number_of_fats;it++) {
-                write(zip_fd,FAT,512 * fat_sectors);
-            }
-            free(FAT);
+            for (it=1;it < number_of_fats;it++)
+                memcpy(FAT + (it * 512 * fat_sectors),FAT,512 * fat_sectors);
         }
 
-        // fill to end
-        memset(tmp,0,sizeof(tmp));
-        lseek(zip_fd,0,SEEK_END);
-        while (zip_out_pos_abs() < spanning_size) {
-            unsigned long tor = spanning_size - zip_out_pos_abs();
-            if (tor > 512) tor = 512;
-            write(zip_fd,tmp,tor);
-        }
-        if (zip_out_pos_abs() > spanning_size) {
-            fprintf(stderr,"Spanning ended up going over by %lu bytes!\n",(unsigned long)zip_out_pos_abs() - spanning_size);
+        if (zip_vol_size > spanning_size) {
+            fprintf(stderr,"Spanning ended up going over by %lu bytes!\n",zip_vol_size - spanning_size);
             abort();
         }
 
+        // write the disk, then fill to end
+        if (pwrite(zip_fd,zip_vol,zip_vol_size,0) != (ssize_t)zip_vol_size ||
+            ftruncate(zip_fd,(off_t)spanning_size) != 0)
+            fprintf(stderr,"Failed to write disk image, %s\n",strerror(errno));
+
         fat_start = 0;
         data_start = 0;
     }
@@ -469,7 +488,8 @@ int zip_out_header(void) {
         *((uint32_t*)(tmp+0x020)) = 0;
 
         assert(zip_fd >= 0);
-        write(zip_fd,tmp,512);
+        if (zip_out_write(tmp,512) != 512)
+            return 0;
 
         fat_start = zip_out_pos_abs();
         {
@@ -486,7 +506,10 @@ int zip_out_header(void) {
             // zip_out_close() will write a FAT chain for how much was actually written
 
             for (it=0;it < number_of_fats;it++) {
-                write(zip_fd,FAT,512 * fat_sectors);
+                if (zip_out_write(FAT,512 * fat_sectors) != (ssize_t)(512 * fat_sectors)) {
+                    free(FAT);
+                    return 0;
+                }
             }
 
             free(FAT);
@@ -513,20 +536,19 @@ int zip_out_header(void) {
         }
 
         archive_zip_offset = zip_out_pos_abs();
-        write(zip_fd,tmp,32+32);
-
-        /* fill to data start */
-        memset(tmp,0,sizeof(tmp));
-        while (zip_out_pos_abs() < data_start) {
-            unsigned long tor = data_start - zip_out_pos_abs();
-            if (tor > 512) tor = 512;
-            write(zip_fd,tmp,tor);
-        }
+        if (zip_out_write(tmp,32+32) != 32+32)
+            return 0;
 
         if (zip_out_pos_abs() > data_start) {
             fprintf(stderr,"WARNING: header too large\n");
             abort();
         }
+
+        /* skip to data start. the disk image is zero there already */
+        if (!zip_vol_reserve(data_start))
+            return 0;
+
+        zip_out_offset = zip_vol_size = data_start;
     }
 
     return 1;
@@ -639,8 +661,8 @@ ssize_t zip_write_and_span(int fd,const void *buf,size_t count) {
         }
 
         if (towrite != 0) {
-            assert(fd >= 0);
-            w = write(fd,buf,towrite);
+            assert(fd >= 0 && fd == zip_fd);
+            w = zip_out_write(buf,towrite);
             if (w <= 0) break;
         }
         else {
@@ -726,7 +748,18 @@ int zip_store(struct pkzip_local_file_header_main *lfh,struct in_file *list) {
     return 0;
 }
 
-int zip_deflate(struct pkzip_local_file_header_main *lfh,struct in_file *list) {
+/* where zip_deflate_file() puts the compressed data: returns 0, or -1 if it could not be written */
+typedef int (*zip_sink_t)(void *user,const void *buf,size_t len);
+
+static int zip_sink_out(void *user,const void *buf,size_t len) {
+    (void)user;
+    assert(zip_fd >= 0);
+    return ((size_t)zip_write_and_span(zip_fd,buf,len) == len) ? 0 : -1;
+}
+
+/* deflate one file into a sink. the same input chunking is used no matter where the data goes,
+ * so the compressed stream is the same whether it is written directly or through a job (-j) */
+int zip_deflate_file(struct in_file *list,zip_sink_t sink,void *user,uint32_t *crc_out,unsigned long *total_out) {
     size_t inbuffer_sz = 32768,outbuffer_sz = 32768;
     char *inbuffer,*outbuffer;
     unsigned long total = 0;
@@ -741,8 +774,6 @@ int zip_deflate(struct pkzip_local_file_header_main *lfh,struct in_file *list) {
     memset(&z,0,sizeof(z));
     assert(list->in_path != NULL);
 
-    lfh->uncompressed_size = list->file_size;
-
     src_fd = open(list->in_path,O_RDONLY|O_BINARY);
     if (src_fd < 0) {
         fprintf(stderr,"Cannot open %s, %s\n",list->in_path,strerror(errno));
@@ -783,7 +814,7 @@ int zip_deflate(struct pkzip_local_file_header_main *lfh,struct in_file *list) {
             assert((char*)z.next_out <= (outbuffer+outbuffer_sz));
             wd = (size_t)((char*)z.next_out - (char*)outbuffer);
             if (wd > 0) {
-                if ((size_t)zip_write_and_span(zip_fd,outbuffer,wd) != wd) {
+                if (sink(user,outbuffer,wd)) {
                     fprintf(stderr,"write error\n");
                     break;
                 }
@@ -811,7 +842,7 @@ int zip_deflate(struct pkzip_local_file_header_main *lfh,struct in_file *list) {
         assert((char*)z.next_out <= (outbuffer+outbuffer_sz));
         wd = (size_t)((char*)z.next_out - (char*)outbuffer);
         if (wd > 0) {
-            if ((size_t)zip_write_and_span(zip_fd,outbuffer,wd) != wd) {
+            if (sink(user,outbuffer,wd)) {
                 fprintf(stderr,"write error\n");
                 break;
             }
@@ -830,14 +861,690 @@ int zip_deflate(struct pkzip_local_file_header_main *lfh,struct in_file *list) {
     if (deflateEnd(&z) != Z_OK)
         fprintf(stderr,"deflateEnd() error\n");
 
-    lfh->crc32 = list->crc32 = zipcrc_finalize(crc32);
-    list->compressed_size = lfh->compressed_size = total;
+    *crc_out = zipcrc_finalize(crc32);
+    *total_out = total;
     close(src_fd);
     free(inbuffer);
     free(outbuffer);
     return 0;
 }
 
+/* -j: parallel deflate.
+ *
+ * Worker threads deflate files ahead of the writer, each into a job: memory up to ZIP_JOB_MEM_MAX,
+ * then a temporary file. The main thread still writes the archive in file list order, and when it
+ * gets to a file it copies the job's data out through zip_write_and_span() in place of deflating it.
+ * Headers, data descriptors and spanning are done exactly as without -j, so the archive is the same.
+ * Workers stay at most ZIP_JOBS_AHEAD jobs per thread ahead of the writer.
+ *
+ * -a also goes through jobs (run by the writer itself without -j), because the method has to be
+ * known before the local header is written: a job first probes the file, and stores it if it looks
+ * incompressible. Otherwise it deflates it, and if that came out no smaller, the file is stored. */
+#define ZIP_JOB_MEM_MAX         (4ul << 20ul)
+#define ZIP_JOBS_AHEAD          2u
+
+#define ZIP_PROBE_SIZE          65536u  /* -a: how much of the start of a file to look at */
+#define ZIP_PROBE_MIN           256u    /* -a: smaller files are just deflated */
+
+#define ZIP_AUTO_DEFLATE        0u
+#define ZIP_AUTO_PROBE          1u      /* stored, the probe said it will not compress */
+#define ZIP_AUTO_EXPANDED       2u      /* stored, deflate did not make it smaller */
+
+struct zip_job {
+    struct in_file*     file;
+    unsigned char*      buf;            /* compressed data, in memory */
+    size_t              len,alloc;
+    FILE*               spill;          /* compressed data past ZIP_JOB_MEM_MAX */
+    unsigned long       total;
+    uint32_t            crc32;
+    double              entropy;        /* -a: bits per byte at the start of the file */
+    double              seconds;        /* time spent deflating */
+    unsigned char       auto_store;     /* -a: ZIP_AUTO_* */
+    unsigned char       done;
+    unsigned char       error;
+};
+
+int                     zip_threads = 1;
+int                     zip_auto = 0;
+
+static struct zip_job*  zip_jobs = NULL;
+static size_t           zip_jobs_count = 0;
+static size_t           zip_jobs_next = 0;      /* next job for a worker to take */
+static size_t           zip_jobs_written = 0;   /* jobs the writer is done with */
+static pthread_mutex_t  zip_jobs_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t   zip_jobs_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t*       zip_workers = NULL;
+static int              zip_workers_count = 0;
+
+/* -a: what was decided, for the summary */
+static unsigned long    zip_auto_files[3];
+static unsigned long    zip_auto_bytes[3];
+static double           zip_deflate_seconds = 0;
+static unsigned long    zip_deflate_bytes = 0;
+
+static double zip_now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (double)ts.tv_sec + ((double)ts.tv_nsec / 1000000000.0);
+}
+
+/* -a: look at the start of a file and guess whether deflate can do anything with it.
+ * data that is already compressed has close to 8 bits per byte of entropy and next to no
+ * repeated strings for LZ77 to find. returns 1 if it looks that way */
+static int zip_probe_incompressible(const char *path,double *entropy) {
+    static const unsigned int hash_bits = 12;
+    uint32_t count[256],*last;
+    unsigned long matches = 0;
+    unsigned char *buf;
+    double h = 0;
+    ssize_t rd;
+    size_t i,n;
+    int fd;
+
+    *entropy = 0;
+
+    if ((fd=open(path,O_RDONLY|O_BINARY)) < 0)
+        return 0;
+
+    buf = malloc(ZIP_PROBE_SIZE);
+    last = calloc(1u << hash_bits,sizeof(uint32_t));
+    if (buf == NULL || last == NULL) {
+        if (buf) free(buf);
+        if (last) free(last);
+        close(fd);
+        return 0;
+    }
+
+    rd = pread(fd,buf,ZIP_PROBE_SIZE,0);
+    close(fd);
+    n = (rd > 0) ? (size_t)rd : 0;
+
+    if (n >= ZIP_PROBE_MIN) {
+        /* order-0 entropy */
+        memset(count,0,sizeof(count));
+        for (i=0;i < n;i++) count[buf[i]]++;
+        for (i=0;i < 256;i++) {
+            if (count[i] != 0) {
+                double p = (double)count[i] / (double)n;
+                h -= p * log2(p);
+            }
+        }
+
+        /* 4-byte strings seen before at the last position with the same hash */
+        for (i=0;(i+4) <= n;i++) {
+            uint32_t v,hh;
+
+            memcpy(&v,buf+i,4);
+            hh = (uint32_t)(v * 2654435761u) >> (32u - hash_bits);
+            if (last[hh] != 0 && !memcmp(buf+last[hh]-1,buf+i,4))
+                matches++;
+            last[hh] = (uint32_t)(i + 1);
+        }
+    }
+
+    free(last);
+    free(buf);
+
+    if (n < ZIP_PROBE_MIN)
+        return 0;
+
+    *entropy = h;
+    return (h >= 7.5 && (matches * 32UL) < (unsigned long)(n - 3));
+}
+
+static int zip_sink_job(void *user,const void *buf,size_t len) {
+    struct zip_job *j = (struct zip_job*)user;
+
+    if (j->spill == NULL && (j->len + len) > ZIP_JOB_MEM_MAX) {
+        if ((j->spill=tmpfile()) == NULL)
+            return -1;
+    }
+
+    if (j->spill != NULL)
+        return (fwrite(buf,len,1,j->spill) == 1) ? 0 : -1;
+
+    if ((j->len + len) > j->alloc) {
+        size_t na = (j->alloc != 0) ? j->alloc : 65536;
+        unsigned char *np;
+
+        while (na < (j->len + len)) na *= 2u;
+        if ((np=realloc(j->buf,na)) == NULL)
+            return -1;
+
+        j->buf = np;
+        j->alloc = na;
+    }
+
+    memcpy(j->buf+j->len,buf,len);
+    j->len += len;
+    return 0;
+}
+
+static void zip_job_free(struct zip_job *j) {
+    if (j->spill != NULL) {
+        fclose(j->spill);
+        j->spill = NULL;
+    }
+    if (j->buf != NULL) {
+        free(j->buf);
+        j->buf = NULL;
+    }
+    j->len = j->alloc = 0;
+}
+
+static void zip_job_run(struct zip_job *j) {
+    double t;
+
+    if (zip_auto && zip_probe_incompressible(j->file->in_path,&j->entropy)) {
+        j->auto_store = ZIP_AUTO_PROBE;
+        return;
+    }
+
+    t = zip_now();
+    if (zip_deflate_file(j->file,zip_sink_job,j,&j->crc32,&j->total))
+        j->error = 1;
+    j->seconds = zip_now() - t;
+
+    if (zip_auto && !j->error && j->total >= j->file->file_size) {
+        j->auto_store = ZIP_AUTO_EXPANDED;
+        zip_job_free(j);
+    }
+}
+
+static void *zip_worker(void *arg) {
+    struct zip_job *j;
+
+    (void)arg;
+
+    do {
+        pthread_mutex_lock(&zip_jobs_lock);
+        while (zip_jobs_next < zip_jobs_count && zip_jobs_next >= (zip_jobs_written + ((size_t)zip_threads * ZIP_JOBS_AHEAD)))
+            pthread_cond_wait(&zip_jobs_cond,&zip_jobs_lock);
+
+        if (zip_jobs_next >= zip_jobs_count) {
+            pthread_mutex_unlock(&zip_jobs_lock);
+            break;
+        }
+
+        j = &zip_jobs[zip_jobs_next++];
+        pthread_mutex_unlock(&zip_jobs_lock);
+
+        zip_job_run(j);
+
+        pthread_mutex_lock(&zip_jobs_lock);
+        j->done = 1;
+        pthread_cond_broadcast(&zip_jobs_cond);
+        pthread_mutex_unlock(&zip_jobs_lock);
+    } while (1);
+
+    return NULL;
+}
+
+/* make a job for every file that will be deflated, and start the workers */
+int zip_jobs_start(void) {
+    struct in_file *list;
+    size_t i;
+
+    if (zip_threads <= 1 && !zip_auto)
+        return 0;
+
+    for (list=file_list_head;list;list=list->next) {
+        if (list->method == 8 && list->old == NULL)
+            zip_jobs_count++;
+    }
+
+    if (zip_jobs_count == 0 || (zip_jobs_count < 2 && !zip_auto)) {
+        zip_jobs_count = 0;
+        return 0;
+    }
+
+    zip_jobs = (struct zip_job*)calloc(zip_jobs_count,sizeof(struct zip_job));
+    if (zip_jobs == NULL) {
+        fprintf(stderr,"out of memory\n");
+        return -1;
+    }
+
+    for (i=0,list=file_list_head;list;list=list->next) {
+        if (list->method == 8 && list->old == NULL) {
+            zip_jobs[i].file = list;
+            list->job = &zip_jobs[i];
+            i++;
+        }
+    }
+    assert(i == zip_jobs_count);
+
+    /* without workers (-a without -j, or none could be started) the writer runs each job itself */
+    if (zip_threads <= 1)
+        return 0;
+
+    if ((size_t)zip_threads > zip_jobs_count)
+        zip_threads = (int)zip_jobs_count;
+
+    zip_workers = (pthread_t*)calloc((size_t)zip_threads,sizeof(pthread_t));
+    if (zip_workers == NULL) {
+        fprintf(stderr,"out of memory\n");
+        return -1;
+    }
+
+    for (zip_workers_count=0;zip_workers_count < zip_threads;zip_workers_count++) {
+        if (pthread_create(&zip_workers[zip_workers_count],NULL,zip_worker,NULL) != 0) {
+            fprintf(stderr,"Cannot start worker thread\n");
+            break;
+        }
+    }
+
+    return 0;
+}
+
+/* stop the workers. jobs the writer did not get to (an error) are skipped */
+void zip_jobs_stop(void) {
+    size_t i;
+    int t;
+
+    if (zip_workers_count != 0) {
+        pthread_mutex_lock(&zip_jobs_lock);
+        zip_jobs_next = zip_jobs_count;
+        pthread_cond_broadcast(&zip_jobs_cond);
+        pthread_mutex_unlock(&zip_jobs_lock);
+
+        for (t=0;t < zip_workers_count;t++)
+            pthread_join(zip_workers[t],NULL);
+    }
+
+    for (i=0;i < zip_jobs_count;i++) {
+        if (zip_jobs[i].file != NULL)
+            zip_jobs[i].file->job = NULL;
+        zip_job_free(&zip_jobs[i]);
+    }
+
+    if (zip_workers != NULL) { free(zip_workers); zip_workers = NULL; }
+    if (zip_jobs != NULL) { free(zip_jobs); zip_jobs = NULL; }
+    zip_workers_count = 0;
+    zip_jobs_count = 0;
+}
+
+/* wait for a file's job to be done, or do it now if there are no workers */
+void zip_job_wait(struct zip_job *j) {
+    if (zip_workers_count == 0) {
+        if (!j->done) {
+            zip_job_run(j);
+            j->done = 1;
+        }
+        return;
+    }
+
+    pthread_mutex_lock(&zip_jobs_lock);
+    while (!j->done)
+        pthread_cond_wait(&zip_jobs_cond,&zip_jobs_lock);
+    pthread_mutex_unlock(&zip_jobs_lock);
+}
+
+/* the writer is done with a job: let the workers move on */
+static void zip_job_release(struct zip_job *j) {
+    zip_job_free(j);
+
+    if (!j->error && j->auto_store != ZIP_AUTO_PROBE) {
+        zip_deflate_seconds += j->seconds;
+        zip_deflate_bytes += j->file->file_size;
+    }
+    zip_auto_files[j->auto_store]++;
+    zip_auto_bytes[j->auto_store] += j->file->file_size;
+
+    j->file->job = NULL;
+
+    pthread_mutex_lock(&zip_jobs_lock);
+    zip_jobs_written++;
+    pthread_cond_broadcast(&zip_jobs_cond);
+    pthread_mutex_unlock(&zip_jobs_lock);
+}
+
+/* -a: decide the method of a file, before its local header is written.
+ * returns 1 if it was decided to store it (and says so) */
+int zip_job_decide(struct in_file *list) {
+    struct zip_job *j = list->job;
+
+    if (j == NULL)
+        return 0;
+
+    zip_job_wait(j);
+
+    if (j->auto_store == ZIP_AUTO_PROBE) {
+        printf("Storing: %s (%.2f bits/byte, will not compress)\n",list->in_path,j->entropy);
+        list->method = 0;
+        zip_job_release(j);
+        return 1;
+    }
+    else if (j->auto_store == ZIP_AUTO_EXPANDED) {
+        printf("Storing: %s (deflate %lu >= %lu bytes)\n",list->in_path,j->total,list->file_size);
+        list->method = 0;
+        zip_job_release(j);
+        return 1;
+    }
+
+    return 0;
+}
+
+/* -a: summary of what was decided */
+void zip_auto_report(void) {
+    double saved = 0;
+
+    if (!zip_auto)
+        return;
+
+    /* the time deflate would have taken on what the probe stored, at the rate it ran on the rest */
+    if (zip_deflate_bytes != 0)
+        saved = (zip_deflate_seconds * (double)zip_auto_bytes[ZIP_AUTO_PROBE]) / (double)zip_deflate_bytes;
+
+    fprintf(stderr,"Auto: %lu deflated, %lu stored by probe (%lu bytes), %lu stored after deflate (%lu bytes)\n",
+        zip_auto_files[ZIP_AUTO_DEFLATE],
+        zip_auto_files[ZIP_AUTO_PROBE],zip_auto_bytes[ZIP_AUTO_PROBE],
+        zip_auto_files[ZIP_AUTO_EXPANDED],zip_auto_bytes[ZIP_AUTO_EXPANDED]);
+    fprintf(stderr,"Auto: about %.3fs of deflate saved (%.3fs spent)\n",saved,zip_deflate_seconds);
+}
+
+/* wait for a file's job and write its data out */
+static int zip_deflate_from_job(struct pkzip_local_file_header_main *lfh,struct in_file *list) {
+    struct zip_job *j = list->job;
+    int ret = 0;
+
+    zip_job_wait(j);
+
+    if (j->error) {
+        ret = -1;
+    }
+    else {
+        if (j->len != 0 && zip_sink_out(NULL,j->buf,j->len)) {
+            fprintf(stderr,"write error\n");
+            ret = -1;
+        }
+        else if (j->spill != NULL) {
+            unsigned char tmp[32768];
+            size_t rd;
+
+            rewind(j->spill);
+            while ((rd=fread(tmp,1,sizeof(tmp),j->spill)) > 0) {
+                if (zip_sink_out(NULL,tmp,rd)) {
+                    fprintf(stderr,"write error\n");
+                    ret = -1;
+                    break;
+                }
+            }
+        }
+
+        lfh->crc32 = list->crc32 = j->crc32;
+        list->compressed_size = lfh->compressed_size = j->total;
+    }
+
+    zip_job_release(j);
+    return ret;
+}
+
+int zip_deflate(struct pkzip_local_file_header_main *lfh,struct in_file *list) {
+    unsigned long total;
+    uint32_t crc32;
+
+    lfh->uncompressed_size = list->file_size;
+
+    if (list->job != NULL)
+        return zip_deflate_from_job(lfh,list);
+
+    if (zip_deflate_file(list,zip_sink_out,NULL,&crc32,&total))
+        return -1;
+
+    lfh->crc32 = list->crc32 = crc32;
+    list->compressed_size = lfh->compressed_size = total;
+    return 0;
+}
+
+/* --update: the old archive.
+ *
+ * Its central directory is read and sorted by name. A file to archive is unchanged if the old
+ * archive has it by the same name, size, date and time and compression method, and the file's
+ * CRC still matches. The compressed data of unchanged files is copied from the old archive
+ * instead of compressing the file again. Everything else (headers, spanning) is written as usual,
+ * so with the same options the entry comes out the same as in the old archive. */
+struct zip_old {
+    char*               name;
+    uint32_t            crc32;
+    unsigned long       compressed_size;
+    unsigned long       uncompressed_size;
+    unsigned long       local_offset;   /* of the local file header */
+    unsigned short      method;
+    unsigned short      msdos_time,msdos_date;
+};
+
+char*                   zip_old_path = NULL;
+int                     zip_old_fd = -1;
+unsigned long           zip_old_size = 0;
+struct zip_old*         zip_old = NULL;
+size_t                  zip_old_count = 0;
+
+static int zip_old_cmp(const void *a,const void *b) {
+    return strcmp(((const struct zip_old*)a)->name,((const struct zip_old*)b)->name);
+}
+
+void zip_old_free(void) {
+    size_t i;
+
+    if (zip_old != NULL) {
+        for (i=0;i < zip_old_count;i++) clear_string(&zip_old[i].name);
+        free(zip_old);
+        zip_old = NULL;
+    }
+    zip_old_count = 0;
+
+    if (zip_old_fd >= 0) {
+        close(zip_old_fd);
+        zip_old_fd = -1;
+    }
+}
+
+/* read the central directory of the old archive */
+int zip_old_load(void) {
+    struct pkzip_central_directory_header_end ehdr;
+    unsigned char *tail = NULL,*cdir = NULL,*p;
+    unsigned long tail_sz,ofs;
+    struct stat st;
+    size_t i;
+    long e;
+
+    assert(zip_old_path != NULL);
+
+    zip_old_fd = open(zip_old_path,O_RDONLY|O_BINARY);
+    if (zip_old_fd < 0) {
+        fprintf(stderr,"Cannot open %s, %s\n",zip_old_path,strerror(errno));
+        return 0;
+    }
+
+    if (fstat(zip_old_fd,&st) || st.st_size < (off_t)sizeof(ehdr))
+        goto bad;
+    zip_old_size = (unsigned long)st.st_size;
+
+    /* the end record is in the last 64KB + 22 bytes (there may be a comment after it) */
+    tail_sz = zip_old_size;
+    if (tail_sz > (65535UL + sizeof(ehdr))) tail_sz = 65535UL + sizeof(ehdr);
+    if ((tail=malloc(tail_sz)) == NULL)
+        goto oom;
+    if (pread(zip_old_fd,tail,tail_sz,(off_t)(zip_old_size - tail_sz)) != (ssize_t)tail_sz)
+        goto bad;
+
+    for (e=(long)(tail_sz - sizeof(ehdr));e >= 0;e--) {
+        memcpy(&ehdr,tail+e,sizeof(ehdr));
+        if (ehdr.sig == PKZIP_CENTRAL_DIRECTORY_END_SIG)
+            break;
+    }
+    free(tail);
+    tail = NULL;
+    if (e < 0)
+        goto bad;
+
+    if (ehdr.number_of_this_disk != 0 || ehdr.number_of_disk_with_start_of_central_directory != 0) {
+        fprintf(stderr,"%s: spanned archives cannot be used with --update\n",zip_old_path);
+        goto fail;
+    }
+
+    if (((unsigned long)ehdr.offset_of_central_directory_from_start_disk + ehdr.size_of_central_directory) > zip_old_size)
+        goto bad;
+
+    zip_old = (struct zip_old*)calloc(ehdr.total_number_of_entries_of_central_dir + 1u,sizeof(struct zip_old));
+    if ((cdir=malloc(ehdr.size_of_central_directory + 1u)) == NULL || zip_old == NULL)
+        goto oom;
+    if (pread(zip_old_fd,cdir,ehdr.size_of_central_directory,(off_t)ehdr.offset_of_central_directory_from_start_disk) != (ssize_t)ehdr.size_of_central_directory)
+        goto bad;
+
+    for (ofs=0,i=0;i < ehdr.total_number_of_entries_of_central_dir;i++) {
+        struct pkzip_central_directory_header_main chdr;
+        struct zip_old *o = &zip_old[zip_old_count];
+
+        if ((ofs + sizeof(chdr)) > ehdr.size_of_central_directory)
+            goto bad;
+        memcpy(&chdr,cdir+ofs,sizeof(chdr));
+        if (chdr.sig != PKZIP_CENTRAL_DIRECTORY_HEADER_SIG)
+            goto bad;
+
+        p = cdir + ofs + sizeof(chdr);
+        ofs += sizeof(chdr) + chdr.filename_length + chdr.extra_field_length + chdr.file_comment_length;
+        if (ofs > ehdr.size_of_central_directory)
+            goto bad;
+
+        /* only what zip4dos would write itself: stored or deflated, no encryption */
+        if (chdr.compression_method != 0 && chdr.compression_method != 8)
+            continue;
+        if (chdr.general_purpose_bit_flag & 1u)
+            continue;
+
+        if ((o->name=malloc(chdr.filename_length + 1u)) == NULL)
+            goto oom;
+        memcpy(o->name,p,chdr.filename_length);
+        o->name[chdr.filename_length] = 0;
+
+        o->crc32 = chdr.crc32;
+        o->compressed_size = chdr.compressed_size;
+        o->uncompressed_size = chdr.uncompressed_size;
+        o->local_offset = chdr.relative_offset_of_local_header;
+        o->method = chdr.compression_method;
+        o->msdos_time = chdr.last_mod_file_time;
+        o->msdos_date = chdr.last_mod_file_date;
+        zip_old_count++;
+    }
+
+    free(cdir);
+    qsort(zip_old,zip_old_count,sizeof(struct zip_old),zip_old_cmp);
+    return 1;
+
+oom:
+    fprintf(stderr,"out of memory\n");
+    goto fail;
+bad:
+    fprintf(stderr,"%s: not a ZIP archive zip4dos can update from\n",zip_old_path);
+fail:
+    if (tail) free(tail);
+    if (cdir) free(cdir);
+    zip_old_free();
+    return 0;
+}
+
+/* is the file unchanged since the old archive? returns the old entry, or NULL */
+struct zip_old *zip_old_match(struct in_file *list) {
+    struct pkzip_local_file_header_main lhdr;
+    unsigned long data_ofs,total = 0;
+    struct zip_old key,*o;
+    unsigned char *buffer;
+    zipcrc_t crc32;
+    int src_fd;
+    int rd;
+
+    if (zip_old_count == 0 || (list->attr & ATTR_DOS_DIR))
+        return NULL;
+
+    key.name = list->zip_name;
+    o = (struct zip_old*)bsearch(&key,zip_old,zip_old_count,sizeof(struct zip_old),zip_old_cmp);
+    if (o == NULL)
+        return NULL;
+
+    /* -a would pick either method */
+    if ((o->method != list->method && !(zip_auto && list->method == 8)) || o->uncompressed_size != list->file_size ||
+        o->msdos_time != list->msdos_time || o->msdos_date != list->msdos_date)
+        return NULL;
+
+    /* where the data is. the local header's extra field need not match the central directory's */
+    if (pread(zip_old_fd,&lhdr,sizeof(lhdr),(off_t)o->local_offset) != (ssize_t)sizeof(lhdr))
+        return NULL;
+    if (lhdr.sig != PKZIP_LOCAL_FILE_HEADER_SIG)
+        return NULL;
+
+    data_ofs = o->local_offset + sizeof(lhdr) + lhdr.filename_length + lhdr.extra_field_length;
+    if ((data_ofs + o->compressed_size) > zip_old_size)
+        return NULL;
+
+    /* same contents? */
+    src_fd = open(list->in_path,O_RDONLY|O_BINARY);
+    if (src_fd < 0)
+        return NULL;
+
+    if ((buffer=malloc(65536)) == NULL) {
+        close(src_fd);
+        return NULL;
+    }
+
+    crc32 = zipcrc_init();
+    while ((rd=read(src_fd,buffer,65536)) > 0) {
+        crc32 = zipcrc_update(crc32,buffer,rd);
+        total += (unsigned long)rd;
+    }
+    close(src_fd);
+    free(buffer);
+
+    if (rd < 0 || total != list->file_size || zipcrc_finalize(crc32) != o->crc32)
+        return NULL;
+
+    /* from now on local_offset is the offset of the data */
+    o->local_offset = data_ofs;
+    list->method = o->method;
+    return o;
+}
+
+/* copy the compressed data of an unchanged file from the old archive */
+int zip_copy_old(struct pkzip_local_file_header_main *lfh,struct in_file *list) {
+    struct zip_old *o = list->old;
+    unsigned long ofs,left;
+    char *buffer;
+    ssize_t rd;
+
+    assert(o != NULL);
+
+    if ((buffer=malloc(32768)) == NULL) {
+        fprintf(stderr,"out of memory\n");
+        return -1;
+    }
+
+    for (ofs=o->local_offset,left=o->compressed_size;left > 0;) {
+        size_t todo = (left > 32768UL) ? 32768 : (size_t)left;
+
+        rd = pread(zip_old_fd,buffer,todo,(off_t)ofs);
+        if (rd <= 0) {
+            fprintf(stderr,"Cannot read %s, %s\n",zip_old_path,strerror(errno));
+            free(buffer);
+            return -1;
+        }
+
+        if (zip_write_and_span(zip_fd,buffer,(size_t)rd) != rd) {
+            free(buffer);
+            return -1;
+        }
+
+        ofs += (unsigned long)rd;
+        left -= (unsigned long)rd;
+    }
+
+    lfh->crc32 = list->crc32 = o->crc32;
+    lfh->uncompressed_size = list->file_size;
+    list->compressed_size = lfh->compressed_size = o->compressed_size;
+    free(buffer);
+    return 0;
+}
+
 uint16_t stat2msdostime(struct stat *st) {
     struct tm *tm = localtime(&st->st_mtime);
     assert(tm != NULL);
@@ -930,6 +1637,24 @@ static int parse(int argc,char **argv) {
             else if (!strcmp(a,"t-")) {
                 trailing_data_descriptor = 0;
             }
+            else if (!strcmp(a,"a")) {
+                zip_auto = 1;
+            }
+            else if (!strcmp(a,"update")) {
+                a = argv[i++];
+                if (a == NULL || zip_old_path != NULL) return 1;
+                set_string(&zip_old_path,a);
+            }
+            else if (!strcmp(a,"j")) {
+                a = argv[i++];
+                if (a == NULL) return 1;
+                zip_threads = (int)strtol(a,(char**)(&a),10);
+                if (*a != 0 || zip_threads < 0) return 1;
+                if (zip_threads == 0) {
+                    long n = sysconf(_SC_NPROCESSORS_ONLN);
+                    zip_threads = (n > 0) ? (int)n : 1;
+                }
+            }
             else if (isdigit(*a)) {
                 deflate_mode = (int)strtol(a,(char**)(&a),10);
                 if (deflate_mode < 0 || deflate_mode > 9) return 1;
@@ -1291,6 +2016,40 @@ static int parse(int argc,char **argv) {
         ic = (iconv_t)-1;
     }
 
+    {
+        struct in_file *list;
+
+        for (list=file_list_head;list;list=list->next) {
+            if (deflate_mode > 0 && !(list->attr & ATTR_DOS_DIR))
+                list->method = 8; /* deflate */
+            else
+                list->method = 0; /* stored (no compression) */
+        }
+    }
+
+    /* find what is unchanged since the old archive. before the new one is opened, which truncates it */
+    if (zip_old_path != NULL) {
+        struct stat ost;
+        struct in_file *list;
+        unsigned long copies = 0;
+
+        if (zip_path != NULL && !stat(zip_path,&st) && !stat(zip_old_path,&ost) &&
+            st.st_dev == ost.st_dev && st.st_ino == ost.st_ino) {
+            fprintf(stderr,"--update archive cannot be the archive being written\n");
+            return 1;
+        }
+
+        if (!zip_old_load())
+            return 1;
+
+        for (list=file_list_head;list;list=list->next) {
+            list->old = zip_old_match(list);
+            if (list->old != NULL) copies++;
+        }
+
+        fprintf(stderr,"%lu of %lu entries in %s are unchanged\n",copies,(unsigned long)zip_old_count,zip_old_path);
+    }
+
     {
         struct disk_info *d = disk_new();
         if (d == NULL) return 1;
@@ -1311,10 +2070,14 @@ static int parse(int argc,char **argv) {
             /* the first segment of spanned ZIP archives have a special signature at the start */
             uint32_t x = 0x08074B50UL; /* PK\x07\x08 */
 
-            write(zip_fd,&x,4);
+            if (zip_out_write(&x,4) != 4)
+                return 1;
         }
     }
 
+    if (zip_jobs_start())
+        return 1;
+
     {
         struct pkzip_local_file_header_main lhdr;
         struct in_file *list;
@@ -1322,19 +2085,20 @@ static int parse(int argc,char **argv) {
         for (list=file_list_head;list;list=list->next) {
             assert(list->in_path != NULL);
             assert(list->zip_name != NULL);
-            printf("%s: %s\n",
-                deflate_mode==0?"Storing":"Deflating",list->in_path);
+
+            /* -a may store it after all */
+            if (list->old != NULL)
+                printf("Copying: %s\n",list->in_path);
+            else if (!zip_job_decide(list))
+                printf("%s: %s\n",
+                    list->method==0?"Storing":"Deflating",list->in_path);
 
             memset(&lhdr,0,sizeof(lhdr));
             lhdr.sig = PKZIP_LOCAL_FILE_HEADER_SIG;
             lhdr.version_needed_to_extract = 20;        /* PKZIP 2.0 or higher */
             lhdr.general_purpose_bit_flag = (0 << 1);   /* just lie and say that "normal" deflate was used */
 
-            if (deflate_mode > 0 && !(list->attr & ATTR_DOS_DIR))
-                lhdr.compression_method = 8; /* deflate */
-            else
-                lhdr.compression_method = 0; /* stored (no compression) */
-
+            lhdr.compression_method = list->method;
             lhdr.last_mod_file_time = list->msdos_time;
             lhdr.last_mod_file_date = list->msdos_date;
             /* some fields we'll go back and write later */
@@ -1369,17 +2133,21 @@ static int parse(int argc,char **argv) {
             list->disk_offset = zip_out_pos();
             list->abs_offset = disk_current()->byte_count + list->disk_offset;
             assert(sizeof(lhdr) == 30);
-            if (write(zip_fd,&lhdr,sizeof(lhdr)) != sizeof(lhdr))
+            if (zip_out_write(&lhdr,sizeof(lhdr)) != sizeof(lhdr))
                 return 1;
 
             if (lhdr.filename_length != 0) {
-                if (write(zip_fd,list->zip_name,lhdr.filename_length) != lhdr.filename_length)
+                if (zip_out_write(list->zip_name,lhdr.filename_length) != lhdr.filename_length)
                     return 1;
             }
 
             /* store, if a file */
             if (!(list->attr & ATTR_DOS_DIR)) {
-                if (lhdr.compression_method == 8) {
+                if (list->old != NULL) {
+                    if (zip_copy_old(&lhdr,list))
+                        return 1;
+                }
+                else if (lhdr.compression_method == 8) {
                     if (zip_deflate(&lhdr,list))
                         return 1;
                 }
@@ -1398,47 +2166,30 @@ static int parse(int argc,char **argv) {
                     assert((lhdr.general_purpose_bit_flag & (1 << 3)) != 0);
 
                     x = lhdr.crc32;
-                    if (write(zip_fd,&x,4) != 4)
+                    if (zip_out_write(&x,4) != 4)
                         return 1;
 
                     x = lhdr.compressed_size;
-                    if (write(zip_fd,&x,4) != 4)
+                    if (zip_out_write(&x,4) != 4)
                         return 1;
 
                     x = lhdr.uncompressed_size;
-                    if (write(zip_fd,&x,4) != 4)
+                    if (zip_out_write(&x,4) != 4)
                         return 1;
                 }
                 else {
-                    int write_fd=zip_fd,alt_fd=-1;
-
-                    /* access disk if necessary */
-                    if (list->disk_number != disk_current_number()) {
-                        char *nn = zip_out_get_span_name(list->disk_number);
-                        if (nn == NULL) return 1;
-                        write_fd = alt_fd = open(nn,O_RDWR|O_BINARY);
-                        if (alt_fd < 0) return 1;
-                        free(nn);
-                    }
-
-                    /* go back and write the lhdr again */
+                    /* go back and write the lhdr again, on whichever disk it is on */
                     /* WARNING: If spanning floppies we assume the same MS-DOS fat format and data_start */
-                    if ((unsigned long)lseek(write_fd,list->disk_offset + data_start,SEEK_SET) != (list->disk_offset + data_start))
-                        return 1;
-                    if (write(write_fd,&lhdr,sizeof(lhdr)) != sizeof(lhdr))
+                    if (!zip_out_rewrite(list->disk_number,list->disk_offset + data_start,&lhdr,sizeof(lhdr)))
                         return 1;
-
-                    if (alt_fd >= 0) {
-                        close(alt_fd);
-                        alt_fd = -1;
-                    }
-
-                    lseek(zip_fd,0,SEEK_END);
                 }
             }
         }
     }
 
+    zip_jobs_stop();
+    zip_auto_report();
+
     /* write central directory */
     {
         struct pkzip_central_directory_header_main chdr;
@@ -1482,10 +2233,7 @@ static int parse(int argc,char **argv) {
             if (list->data_descriptor)
                 chdr.general_purpose_bit_flag |= (1 << 3);
 
-            if (deflate_mode > 0 && !(list->attr & ATTR_DOS_DIR))
-                chdr.compression_method = 8; /* deflate */
-            else
-                chdr.compression_method = 0; /* stored (no compression) */
+            chdr.compression_method = list->method;
 
             chdr.last_mod_file_time = list->msdos_time;
             chdr.last_mod_file_date = list->msdos_date;
@@ -1520,12 +2268,12 @@ static int parse(int argc,char **argv) {
  
             assert(sizeof(chdr) == 46);
             zip_cdir_byte_count += sizeof(chdr);
-            if (write(zip_fd,&chdr,sizeof(chdr)) != sizeof(chdr))
+            if (zip_out_write(&chdr,sizeof(chdr)) != sizeof(chdr))
                 return 1;
 
             if (chdr.filename_length != 0) {
                 zip_cdir_byte_count += chdr.filename_length;
-                if (write(zip_fd,list->zip_name,chdr.filename_length) != chdr.filename_length)
+                if (zip_out_write(list->zip_name,chdr.filename_length) != chdr.filename_length)
                     return 1;
             }
 
@@ -1550,7 +2298,7 @@ static int parse(int argc,char **argv) {
         assert(zip_fd >= 0);
 
         assert(sizeof(ehdr) == 22);
-        if (write(zip_fd,&ehdr,sizeof(ehdr)) != sizeof(ehdr))
+        if (zip_out_write(&ehdr,sizeof(ehdr)) != sizeof(ehdr))
             return 1;
     }
 
@@ -1561,6 +2309,13 @@ static int parse(int argc,char **argv) {
     }
 
     zip_out_close();
+    if (zip_vol != NULL) {
+        free(zip_vol);
+        zip_vol = NULL;
+        zip_vol_alloc = 0;
+    }
+    zip_old_free();
+    clear_string(&zip_old_path);
     clear_string(&codepage_out);
     clear_string(&codepage_in);
     clear_string(&zip_path);
@@ -1569,8 +2324,10 @@ static int parse(int argc,char **argv) {
 }
 
 int main(int argc,char **argv) {
-    if (parse(argc,argv))
+    if (parse(argc,argv)) {
+        zip_jobs_stop();
         return 1;
+    }
 
     return 0;
 }
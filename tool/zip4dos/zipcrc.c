@@ -12,10 +12,21 @@
  *    Xor_Out       = 0xffffffff
  *    ReflectOut    = True
  *    Algorithm     = table-driven
+ *
+ * Since extended by hand with slice-by-8 and PCLMULQDQ folding versions of
+ * zipcrc_update(), picked at startup by what the CPU can do, and with
+ * zipcrc_combine().
  *****************************************************************************/
 #include "zipcrc.h"     /* include the header file generated with pycrc */
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
+#include <endian.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+# define ZIPCRC_HAVE_PCLMUL 1
+# include <immintrin.h>
+#endif
 
 /**
  * Static table used for the table_driven implementation.
@@ -56,14 +67,11 @@ static const zipcrc_t crc_table[256] = {
 };
 
 /**
- * Update the crc value with new data.
+ * Update the crc value with new data, a byte at a time.
  *
- * \param crc      The current crc value.
- * \param data     Pointer to a buffer of \a data_len bytes.
- * \param data_len Number of bytes in the \a data buffer.
- * \return         The updated crc value.
+ * This is the original pycrc code.
  *****************************************************************************/
-zipcrc_t zipcrc_update(zipcrc_t crc, const void *data, size_t data_len)
+static zipcrc_t zipcrc_update_table(zipcrc_t crc, const void *data, size_t data_len)
 {
     const unsigned char *d = (const unsigned char *)data;
     unsigned int tbl_idx;
@@ -78,3 +86,278 @@ zipcrc_t zipcrc_update(zipcrc_t crc, const void *data, size_t data_len)
 }
 
 
+/**
+ * Tables for slice-by-8, made from crc_table at startup.
+ *
+ * crc_slice[k][i] is the crc of byte i followed by k zero bytes.
+ *****************************************************************************/
+static uint32_t crc_slice[8][256];
+
+
+/**
+ * Update the crc value with new data, 8 bytes at a time.
+ *****************************************************************************/
+static zipcrc_t zipcrc_update_slice8(zipcrc_t crc, const void *data, size_t data_len)
+{
+    const unsigned char *d = (const unsigned char *)data;
+    uint32_t c = (uint32_t)crc;
+    uint32_t one, two;
+
+    /* byte-wise up to an 8 byte boundary */
+    while (data_len > 0 && ((uintptr_t)d & 7u) != 0) {
+        c = crc_slice[0][(c ^ *d++) & 0xff] ^ (c >> 8);
+        data_len--;
+    }
+
+    while (data_len >= 8) {
+        memcpy(&one,d,4);
+        memcpy(&two,d+4,4);
+        one = le32toh(one) ^ c;
+        two = le32toh(two);
+
+        c = crc_slice[7][ one        & 0xff] ^
+            crc_slice[6][(one >>  8) & 0xff] ^
+            crc_slice[5][(one >> 16) & 0xff] ^
+            crc_slice[4][ one >> 24        ] ^
+            crc_slice[3][ two        & 0xff] ^
+            crc_slice[2][(two >>  8) & 0xff] ^
+            crc_slice[1][(two >> 16) & 0xff] ^
+            crc_slice[0][ two >> 24        ];
+
+        d += 8;
+        data_len -= 8;
+    }
+
+    while (data_len--)
+        c = crc_slice[0][(c ^ *d++) & 0xff] ^ (c >> 8);
+
+    return (zipcrc_t)c;
+}
+
+
+#ifdef ZIPCRC_HAVE_PCLMUL
+/**
+ * Update the crc value with new data, with carry-less multiply.
+ *
+ * Folds 64 bytes at a time in four 128-bit lanes, then folds the lanes together,
+ * then a Barrett reduction to 32 bits (Intel, "Fast CRC Computation for Generic
+ * Polynomials Using PCLMULQDQ Instruction"). The constants are x^n mod P for the
+ * fold distances, bit reflected. What is left over past a multiple of 16 bytes is
+ * done with slice-by-8.
+ *****************************************************************************/
+static const uint64_t crc_k1k2[2] __attribute__((aligned(16))) = { 0x0154442bd4ULL, 0x01c6e41596ULL };
+static const uint64_t crc_k3k4[2] __attribute__((aligned(16))) = { 0x01751997d0ULL, 0x00ccaa009eULL };
+static const uint64_t crc_k5k0[2] __attribute__((aligned(16))) = { 0x0163cd6124ULL, 0x0000000000ULL };
+static const uint64_t crc_poly[2] __attribute__((aligned(16))) = { 0x01db710641ULL, 0x01f7011641ULL };
+
+__attribute__((target("pclmul,sse4.1")))
+static zipcrc_t zipcrc_update_pclmul(zipcrc_t crc, const void *data, size_t data_len)
+{
+    const unsigned char *d = (const unsigned char *)data;
+    __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8;
+
+    if (data_len < 64)
+        return zipcrc_update_slice8(crc, data, data_len);
+
+    x1 = _mm_loadu_si128((const __m128i *)(d + 0x00));
+    x2 = _mm_loadu_si128((const __m128i *)(d + 0x10));
+    x3 = _mm_loadu_si128((const __m128i *)(d + 0x20));
+    x4 = _mm_loadu_si128((const __m128i *)(d + 0x30));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)(uint32_t)crc));
+    x0 = _mm_load_si128((const __m128i *)crc_k1k2);
+    d += 64;
+    data_len -= 64;
+
+    /* four lanes, 64 bytes at a time */
+    while (data_len >= 64) {
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+        x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128((const __m128i *)(d + 0x00)));
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128((const __m128i *)(d + 0x10)));
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128((const __m128i *)(d + 0x20)));
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128((const __m128i *)(d + 0x30)));
+        d += 64;
+        data_len -= 64;
+    }
+
+    /* fold the lanes into one */
+    x0 = _mm_load_si128((const __m128i *)crc_k3k4);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+    /* 16 bytes at a time */
+    while (data_len >= 16) {
+        x2 = _mm_loadu_si128((const __m128i *)d);
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+        d += 16;
+        data_len -= 16;
+    }
+
+    /* 128 bits to 64 */
+    x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+    x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+    x1 = _mm_srli_si128(x1, 8);
+    x1 = _mm_xor_si128(x1, x2);
+    x0 = _mm_loadl_epi64((const __m128i *)crc_k5k0);
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, x3);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    /* Barrett reduction to 32 bits */
+    x0 = _mm_load_si128((const __m128i *)crc_poly);
+    x2 = _mm_and_si128(x1, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+    x2 = _mm_and_si128(x2, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    crc = (zipcrc_t)(uint32_t)_mm_extract_epi32(x1, 1);
+
+    return zipcrc_update_slice8(crc, d, data_len);
+}
+#endif
+
+
+static zipcrc_update_func_t zipcrc_update_best = zipcrc_update_table;
+
+
+/**
+ * Make the slice-by-8 tables and pick the fastest zipcrc_update() this CPU can run.
+ *
+ * Runs before main(), so it is done before any thread can call zipcrc_update().
+ *****************************************************************************/
+__attribute__((constructor))
+static void zipcrc_setup(void)
+{
+    unsigned int i, k;
+
+    for (i = 0; i < 256; i++)
+        crc_slice[0][i] = (uint32_t)crc_table[i];
+
+    for (k = 1; k < 8; k++) {
+        for (i = 0; i < 256; i++)
+            crc_slice[k][i] = (crc_slice[k-1][i] >> 8) ^ crc_slice[0][crc_slice[k-1][i] & 0xff];
+    }
+
+    zipcrc_update_best = zipcrc_update_slice8;
+#ifdef ZIPCRC_HAVE_PCLMUL
+    if (zipcrc_impl(ZIPCRC_IMPL_PCLMUL) != NULL)
+        zipcrc_update_best = zipcrc_update_pclmul;
+#endif
+}
+
+
+zipcrc_update_func_t zipcrc_impl(unsigned int which)
+{
+    switch (which) {
+        case ZIPCRC_IMPL_TABLE:
+            return zipcrc_update_table;
+        case ZIPCRC_IMPL_SLICE8:
+            return zipcrc_update_slice8;
+#ifdef ZIPCRC_HAVE_PCLMUL
+        case ZIPCRC_IMPL_PCLMUL:
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1"))
+                return zipcrc_update_pclmul;
+            break;
+#endif
+        default:
+            break;
+    }
+
+    return NULL;
+}
+
+
+const char *zipcrc_impl_name(unsigned int which)
+{
+    switch (which) {
+        case ZIPCRC_IMPL_TABLE:     return "table";
+        case ZIPCRC_IMPL_SLICE8:    return "slice-by-8";
+        case ZIPCRC_IMPL_PCLMUL:    return "pclmul";
+        default:                    break;
+    }
+
+    return NULL;
+}
+
+
+/**
+ * Update the crc value with new data.
+ *
+ * \param crc      The current crc value.
+ * \param data     Pointer to a buffer of \a data_len bytes.
+ * \param data_len Number of bytes in the \a data buffer.
+ * \return         The updated crc value.
+ *****************************************************************************/
+zipcrc_t zipcrc_update(zipcrc_t crc, const void *data, size_t data_len)
+{
+    return zipcrc_update_best(crc, data, data_len);
+}
+
+
+/**
+ * Multiply a and b modulo the polynomial (bit reflected, so x^0 is bit 31).
+ *****************************************************************************/
+static uint32_t crc_multmodp(uint32_t a, uint32_t b)
+{
+    uint32_t m = (uint32_t)1 << 31, p = 0;
+
+    for (;;) {
+        if (a & m) {
+            p ^= b;
+            if ((a & (m - 1)) == 0)
+                break;
+        }
+        m >>= 1;
+        b = (b & 1) ? ((b >> 1) ^ 0xedb88320) : (b >> 1);
+    }
+
+    return p;
+}
+
+
+/**
+ * x^(n * 2^k) modulo the polynomial.
+ *****************************************************************************/
+static uint32_t crc_x2nmodp(uint64_t n, unsigned int k)
+{
+    uint32_t p = (uint32_t)1 << 31;     /* x^0 */
+    uint32_t x2k = (uint32_t)1 << 30;   /* x^1, squared k times below */
+
+    while (k-- > 0)
+        x2k = crc_multmodp(x2k, x2k);
+
+    while (n != 0) {
+        if (n & 1)
+            p = crc_multmodp(x2k, p);
+        n >>= 1;
+        x2k = crc_multmodp(x2k, x2k);
+    }
+
+    return p;
+}
+
+
+zipcrc_t zipcrc_combine(zipcrc_t crc1, zipcrc_t crc2, uint64_t len2)
+{
+    /* shift crc1 past len2 bytes (8*len2 bits), then add crc2.
+     * the xor_in/xor_out of the two cancel out */
+    return (zipcrc_t)(crc_multmodp(crc_x2nmodp(len2, 3), (uint32_t)crc1) ^ (uint32_t)crc2);
+}
@@ -12,6 +12,8 @@
  *    Xor_Out       = 0xffffffff
  *    ReflectOut    = True
  *    Algorithm     = table-driven
+ *
+ * Since extended by hand, see zipcrc.c.
  *****************************************************************************/
 #ifndef __ZIPCRC_H__
 #define __ZIPCRC_H__
@@ -75,6 +77,46 @@ static inline zipcrc_t zipcrc_finalize(zipcrc_t crc)
 }
 
 
+/**
+ * Combine the crcs of two consecutive pieces of data.
+ *
+ * \param crc1  The final crc value of the first piece.
+ * \param crc2  The final crc value of the second piece.
+ * \param len2  The length of the second piece in bytes.
+ * \return      The final crc value of both pieces, one after the other.
+ *****************************************************************************/
+zipcrc_t zipcrc_combine(zipcrc_t crc1, zipcrc_t crc2, uint64_t len2);
+
+
+/**
+ * The implementations of zipcrc_update().
+ *
+ * zipcrc_update() uses the fastest one the CPU supports. These are for
+ * testing and benchmarking them against each other.
+ *****************************************************************************/
+#define ZIPCRC_IMPL_TABLE   0u  /* pycrc, a byte at a time */
+#define ZIPCRC_IMPL_SLICE8  1u  /* slice-by-8 */
+#define ZIPCRC_IMPL_PCLMUL  2u  /* x86 PCLMULQDQ folding */
+#define ZIPCRC_IMPL_COUNT   3u
+
+typedef zipcrc_t (*zipcrc_update_func_t)(zipcrc_t crc, const void *data, size_t data_len);
+
+
+/**
+ * Get an implementation of zipcrc_update().
+ *
+ * \param which ZIPCRC_IMPL_*
+ * \return      The function, or NULL if not available on this CPU.
+ *****************************************************************************/
+zipcrc_update_func_t zipcrc_impl(unsigned int which);
+
+
+/**
+ * Name of an implementation, or NULL.
+ *****************************************************************************/
+const char *zipcrc_impl_name(unsigned int which);
+
+
 #ifdef __cplusplus
 }           /* closing brace for extern "C" */
 #endif
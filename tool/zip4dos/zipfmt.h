@@ -0,0 +1,74 @@
+
+#ifndef __DOSLIB_TOOL_ZIP4DOS_ZIPFMT_H
+#define __DOSLIB_TOOL_ZIP4DOS_ZIPFMT_H
+
+#include <stdint.h>
+
+/* PKZIP structures, shared by zip4dos and unzip4dos */
+
+#pragma pack(push,1)
+# define PKZIP_LOCAL_FILE_HEADER_SIG        (0x04034B50UL)
+
+struct pkzip_local_file_header_main { /* PKZIP APPNOTE 2.0: General Format of a ZIP file section A */
+    uint32_t                sig;                            /* 4 bytes  +0x00 0x04034B50 = 'PK\x03\x04' */
+    uint16_t                version_needed_to_extract;      /* 2 bytes  +0x04 version needed to extract */
+    uint16_t                general_purpose_bit_flag;       /* 2 bytes  +0x06 general purpose bit flag */
+    uint16_t                compression_method;             /* 2 bytes  +0x08 compression method */
+    uint16_t                last_mod_file_time;             /* 2 bytes  +0x0A */
+    uint16_t                last_mod_file_date;             /* 2 bytes  +0x0C */
+    uint32_t                crc32;                          /* 4 bytes  +0x0E */
+    uint32_t                compressed_size;                /* 4 bytes  +0x12 */
+    uint32_t                uncompressed_size;              /* 4 bytes  +0x16 */
+    uint16_t                filename_length;                /* 2 bytes  +0x1A */
+    uint16_t                extra_field_length;             /* 2 bytes  +0x1C */
+};                                                          /*          =0x1E */
+/* filename and extra field follow, then file data */
+#pragma pack(pop)
+
+#pragma pack(push,1)
+# define PKZIP_CENTRAL_DIRECTORY_HEADER_SIG (0x02014B50UL)
+
+struct pkzip_central_directory_header_main { /* PKZIP APPNOTE 2.0: General Format of a ZIP file section C */
+    uint32_t                sig;                            /* 4 bytes  +0x00 0x02014B50 = 'PK\x01\x02' */
+    uint16_t                version_made_by;                /* 2 bytes  +0x04 version made by */
+    uint16_t                version_needed_to_extract;      /* 2 bytes  +0x06 version needed to extract */
+    uint16_t                general_purpose_bit_flag;       /* 2 bytes  +0x08 general purpose bit flag */
+    uint16_t                compression_method;             /* 2 bytes  +0x0A compression method */
+    uint16_t                last_mod_file_time;             /* 2 bytes  +0x0C */
+    uint16_t                last_mod_file_date;             /* 2 bytes  +0x0E */
+    uint32_t                crc32;                          /* 4 bytes  +0x10 */
+    uint32_t                compressed_size;                /* 4 bytes  +0x14 */
+    uint32_t                uncompressed_size;              /* 4 bytes  +0x18 */
+    uint16_t                filename_length;                /* 2 bytes  +0x1C */
+    uint16_t                extra_field_length;             /* 2 bytes  +0x1E */
+    uint16_t                file_comment_length;            /* 2 bytes  +0x20 */
+    uint16_t                disk_number_start;              /* 2 bytes  +0x22 */
+    uint16_t                internal_file_attributes;       /* 2 bytes  +0x24 */
+    uint32_t                external_file_attributes;       /* 4 bytes  +0x26 */
+    uint32_t                relative_offset_of_local_header;/* 4 bytes  +0x2A */
+};                                                          /*          =0x2E */
+/* filename and extra field follow, then file data */
+#pragma pack(pop)
+
+#pragma pack(push,1)
+# define PKZIP_CENTRAL_DIRECTORY_END_SIG    (0x06054B50UL)
+
+struct pkzip_central_directory_header_end { /* PKZIP APPNOTE 2.0: General Format of a ZIP file section C */
+    uint32_t                sig;                            /* 4 bytes  +0x00 0x06054B50 = 'PK\x05\x06' */
+    uint16_t                number_of_this_disk;            /* 2 bytes  +0x04 */
+    uint16_t                number_of_disk_with_start_of_central_directory;
+                                                            /* 2 bytes  +0x06 */
+    uint16_t                total_number_of_entries_of_central_dir_on_this_disk;
+                                                            /* 2 bytes  +0x08 */
+    uint16_t                total_number_of_entries_of_central_dir;
+                                                            /* 2 bytes  +0x0A */
+    uint32_t                size_of_central_directory;      /* 4 bytes  +0x0C */
+    uint32_t                offset_of_central_directory_from_start_disk;
+                                                            /* 4 bytes  +0x10 */
+    uint16_t                zipfile_comment_length;         /* 2 bytes  +0x14 */
+};                                                          /*          =0x16 */
+/* filename and extra field follow, then file data */
+#pragma pack(pop)
+
+#endif /* __DOSLIB_TOOL_ZIP4DOS_ZIPFMT_H */
+